@@ -37,6 +37,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#if defined(__x86_64__)
+#include <arch/cpu/cpu.h>
+#endif
+
 #define AURIX_STACK_SIZE 8 * 1024
 
 void aurix_load(char *kernel_path);
@@ -310,6 +314,26 @@ bool aurix_get_framebuffer(struct aurix_parameters *params)
 	return true;
 }
 
+static inline uint64_t aurix_read_tsc(void)
+{
+#if defined(__x86_64__)
+	return rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void aurix_stamp(struct aurix_parameters *params, const char *name,
+						uint64_t tsc)
+{
+	if (params->boot_stamp_count >= AURIX_MAX_BOOT_STAMPS)
+		return;
+
+	struct aurix_boot_stamp *s = &params->boot_stamps[params->boot_stamp_count++];
+	strncpy(s->name, name, sizeof(s->name) - 1);
+	s->tsc = tsc;
+}
+
 inline char *trim_str(char *s, char d)
 {
 	char *p = s;
@@ -325,6 +349,8 @@ inline char *trim_str(char *s, char d)
 
 void aurix_load(char *kernel_path)
 {
+	uint64_t entry_tsc = aurix_read_tsc();
+
 	char *kbuf = NULL;
 	vfs_read(kernel_path, &kbuf, NULL);
 
@@ -372,6 +398,9 @@ void aurix_load(char *kernel_path)
 	parameters.kernel_addr = kernel_addr;
 	parameters.hhdm_offset = 0xffff800000000000;
 
+	aurix_stamp(&parameters, "loader entry", entry_tsc);
+	aurix_stamp(&parameters, "kernel loaded", aurix_read_tsc());
+
 	// get boot arguments
 #ifdef AXBOOT_UEFI
 	parameters.cmdline = aurix_get_cmdline();
@@ -429,6 +458,8 @@ void aurix_load(char *kernel_path)
 		}
 	}
 
+	aurix_stamp(&parameters, "modules loaded", aurix_read_tsc());
+
 	for (uint32_t i = 0; i < parameters.module_count; i++) {
 		debug("aurix_load(): Module %i\n", i);
 		debug(" - Filename: '%s'\n", parameters.modules[i].filename);
@@ -453,6 +484,9 @@ void aurix_load(char *kernel_path)
 				  VMM_PRESENT | VMM_WRITABLE);
 	}
 
+	// translated and reachable through the hhdm, what the kernel relies on
+	aurix_stamp(&parameters, "memory map ready", aurix_read_tsc());
+
 	// get RSDP and SMBIOS
 #ifdef ARCH_ACPI_AVAILABLE
 	parameters.rsdp_addr = platform_get_rsdp();
@@ -469,6 +503,7 @@ void aurix_load(char *kernel_path)
 	uefi_exit_bs();
 #endif
 
+	aurix_stamp(&parameters, "handoff", aurix_read_tsc());
 	aurix_arch_handoff(kernel_entry, pm, stack, AURIX_STACK_SIZE, &parameters);
 	__builtin_unreachable();
 }
@@ -34,6 +34,13 @@ static inline void cpu_disable_interrupts(void)
 	__asm__ volatile("cli" ::: "memory");
 }
 
+static inline uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+	__asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
 static inline uint64_t read_cr0()
 {
 	uint64_t val;
@@ -25,8 +25,8 @@
 
 #include <stdint.h>
 
-/* Aurix Boot Protocol (revision 1-dev) */
-#define AURIX_PROTOCOL_REVISION 1
+/* Aurix Boot Protocol (revision 2-dev) */
+#define AURIX_PROTOCOL_REVISION 2
 
 enum aurix_memmap_entry {
 	AURIX_MMAP_RESERVED = 0,
@@ -66,6 +66,14 @@ struct aurix_module {
 	size_t size;
 };
 
+#define AURIX_MAX_BOOT_STAMPS 8
+
+// raw TSC readings taken by the loader, 0 where no TSC is available
+struct aurix_boot_stamp {
+	char name[24];
+	uint64_t tsc;
+};
+
 struct aurix_parameters {
 	// PROTOCOL INFO
 	uint8_t revision;
@@ -91,6 +99,10 @@ struct aurix_parameters {
 
 	// FRAMEBUFFER
 	struct aurix_framebuffer framebuffer;
+
+	// BOOT TIMING
+	struct aurix_boot_stamp boot_stamps[AURIX_MAX_BOOT_STAMPS];
+	uint32_t boot_stamp_count;
 };
 
 /* Kernel related stuff */
@@ -47,6 +47,11 @@ void hpet_msleep(uint64_t ms)
 	hpet_nsleep(ms * 1000000);
 }
 
+void hpet_usleep(uint64_t us)
+{
+	hpet_nsleep(us * 1000);
+}
+
 void hpet_nsleep(uint64_t ns)
 {
 	uint64_t start = hpet_get_ns();
@@ -23,6 +23,7 @@
 #include <acpi/acpi.h>
 #include <acpi/madt.h>
 #include <acpi/hpet.h>
+#include <acpi/srat.h>
 #include <arch/mm/paging.h>
 #include <boot/axprot.h>
 #include <mm/vmm.h>
@@ -74,14 +75,15 @@ bool acpi_init(void *rsdp_addr)
 	// parse the almighty SDTs!
 	acpi_hpet_init();
 	acpi_madt_init();
+	acpi_srat_init();
 
 	return true;
 }
 
 void *find_sdt(char *sig)
 {
-	size_t sdt_len = is_xsdt ? (xsdt->hdr.len - sizeof(struct sdt_header) / 8) :
-							   (rsdt->hdr.len - sizeof(struct sdt_header) / 4);
+	size_t sdt_len = is_xsdt ? (xsdt->hdr.len - sizeof(struct sdt_header)) / 8 :
+							   (rsdt->hdr.len - sizeof(struct sdt_header)) / 4;
 	struct sdt_header *hdr;
 	for (size_t i = 0; i < sdt_len; i++) {
 		if (is_xsdt) {
@@ -40,6 +40,7 @@ struct madt_lapic *lapics[CONFIG_CPU_MAX_COUNT];
 struct madt_ioapic *ioapics[CONFIG_IOAPIC_MAX_COUNT];
 
 size_t lapic_count = 0;
+size_t lapic_skipped = 0;
 size_t ioapic_count = 0;
 
 struct madt_iso *isos[16];
@@ -116,6 +117,7 @@ void acpi_madt_init()
 				warn(
 					"Reached maximum allowed CPUs, processor #%u will be left disabled.\n",
 					lapic->id);
+				lapic_skipped++;
 				break;
 			}
 			lapics[lapic_count++] = lapic;
@@ -162,8 +164,17 @@ void acpi_madt_init()
 			trace("Overridden LAPIC base address: 0x%llx\n", override->addr);
 			break;
 		}
+		case MADT_LX2APIC: {
+			// only reached for APIC IDs above 254, which we can't start yet,
+			// but the SRAT may still describe them
+			struct madt_lx2apic *x2apic =
+				(struct madt_lx2apic *)(madt->structures + i);
+			debug("x2APIC processor #%u with _UID %u (%s), not started\n",
+				  x2apic->id, x2apic->acpi_uid,
+				  (x2apic->flags & 1) ? "enabled" : "disabled");
+			break;
+		}
 		case MADT_NMI_SRC:
-		case MADT_LX2APIC:
 		case MADT_LX2APIC_NMI:
 #elif defined(__aarch64__)
 		case MADT_GICC:
@@ -0,0 +1,159 @@
+/*********************************************************************************/
+/* Module Name:  srat.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <acpi/acpi.h>
+#include <acpi/srat.h>
+#include <aurix.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+struct srat_cpu {
+	uint32_t apic_id;
+	uint32_t node;
+};
+
+struct srat_range {
+	uint64_t base;
+	uint64_t len;
+	uint32_t node;
+};
+
+static uint32_t srat_domains[SRAT_MAX_NODES];
+static uint32_t srat_nodes = 0;
+
+static struct srat_cpu srat_cpus[SRAT_MAX_CPUS];
+static size_t srat_cpu_count = 0;
+
+static struct srat_range srat_ranges[SRAT_MAX_RANGES];
+static size_t srat_range_count = 0;
+
+// firmware domain numbers can be sparse, hand out dense node ids instead
+static uint32_t srat_domain_to_node(uint32_t domain)
+{
+	for (uint32_t i = 0; i < srat_nodes; i++) {
+		if (srat_domains[i] == domain)
+			return i;
+	}
+
+	if (srat_nodes >= SRAT_MAX_NODES) {
+		warn("SRAT: too many proximity domains, folding %u into node 0\n",
+			 domain);
+		return 0;
+	}
+
+	srat_domains[srat_nodes] = domain;
+	return srat_nodes++;
+}
+
+static void srat_add_cpu(uint32_t apic_id, uint32_t domain)
+{
+	if (srat_cpu_count >= SRAT_MAX_CPUS) {
+		warn("SRAT: ignoring affinity of APIC %u\n", apic_id);
+		return;
+	}
+
+	uint32_t node = srat_domain_to_node(domain);
+	srat_cpus[srat_cpu_count].apic_id = apic_id;
+	srat_cpus[srat_cpu_count].node = node;
+	srat_cpu_count++;
+	debug("SRAT: APIC %u is on node %u (domain %u)\n", apic_id, node, domain);
+}
+
+void acpi_srat_init(void)
+{
+	struct srat *srat = (struct srat *)find_sdt("SRAT");
+	if (!srat) {
+		debug("SRAT not found, assuming a single memory node\n");
+		return;
+	}
+
+	for (uint64_t i = 0; i < (srat->hdr.len - sizeof(struct srat));) {
+		struct srat_header *shdr = (struct srat_header *)(srat->structures + i);
+		if (shdr->len == 0)
+			break;
+
+		switch (shdr->type) {
+		case SRAT_LAPIC: {
+			struct srat_lapic *lapic = (struct srat_lapic *)shdr;
+			if (!(lapic->flags & SRAT_ENABLED))
+				break;
+			uint32_t domain = lapic->domain_lo |
+							  ((uint32_t)lapic->domain_hi[0] << 8) |
+							  ((uint32_t)lapic->domain_hi[1] << 16) |
+							  ((uint32_t)lapic->domain_hi[2] << 24);
+			srat_add_cpu(lapic->apic_id, domain);
+			break;
+		}
+		case SRAT_X2APIC: {
+			struct srat_x2apic *x2apic = (struct srat_x2apic *)shdr;
+			if (x2apic->flags & SRAT_ENABLED)
+				srat_add_cpu(x2apic->x2apic_id, x2apic->domain);
+			break;
+		}
+		case SRAT_MEMORY: {
+			struct srat_memory *mem = (struct srat_memory *)shdr;
+			if (!(mem->flags & SRAT_ENABLED) || mem->len == 0)
+				break;
+			if (srat_range_count >= SRAT_MAX_RANGES) {
+				warn("SRAT: ignoring memory range at 0x%llx\n", mem->base);
+				break;
+			}
+			struct srat_range *r = &srat_ranges[srat_range_count++];
+			r->base = mem->base;
+			r->len = mem->len;
+			r->node = srat_domain_to_node(mem->domain);
+			debug("SRAT: memory 0x%llx-0x%llx is on node %u\n", r->base,
+				  r->base + r->len, r->node);
+			break;
+		}
+		default:
+			break;
+		}
+
+		i += shdr->len;
+	}
+
+	trace("SRAT summary: nodes=%u cpus=%zu ranges=%zu\n", srat_nodes,
+		  srat_cpu_count, srat_range_count);
+}
+
+uint32_t srat_node_count(void)
+{
+	return srat_nodes ? srat_nodes : 1;
+}
+
+uint32_t srat_apic_node(uint32_t apic_id)
+{
+	for (size_t i = 0; i < srat_cpu_count; i++) {
+		if (srat_cpus[i].apic_id == apic_id)
+			return srat_cpus[i].node;
+	}
+	return 0;
+}
+
+uint32_t srat_addr_node(uint64_t phys)
+{
+	for (size_t i = 0; i < srat_range_count; i++) {
+		if (phys >= srat_ranges[i].base &&
+			phys - srat_ranges[i].base < srat_ranges[i].len)
+			return srat_ranges[i].node;
+	}
+	return 0;
+}
@@ -21,6 +21,7 @@
 #include <arch/cpu/cpu.h>
 #include <mm/vmm.h>
 #include <acpi/madt.h>
+#include <time/time.h>
 #include <aurix.h>
 #include <stdint.h>
 
@@ -78,20 +79,71 @@ void apic_send_eoi()
 	lapic_write(APIC_EOI, 0);
 }
 
+// LAPIC timer ticks per millisecond with a divider of 16, the bus clock
+// is shared so one calibration on the BSP holds for every CPU
+static uint32_t lapic_timer_ticks_ms = 0;
+
+uint32_t lapic_timer_calibrate(void)
+{
+	if (lapic_timer_ticks_ms)
+		return lapic_timer_ticks_ms;
+
+	lapic_write(APIC_TIMER_DIVIDE, 0x3);
+	lapic_write(APIC_LVT_TIMER, APIC_LVT_MASKED);
+	lapic_write(APIC_TIMER_INITIAL, 0xFFFFFFFF);
+	sleep_ms(10);
+	uint32_t elapsed = 0xFFFFFFFF - lapic_read(APIC_TIMER_CURRENT);
+	lapic_write(APIC_TIMER_INITIAL, 0);
+
+	lapic_timer_ticks_ms = elapsed / 10;
+	debug("LAPIC timer runs at %u ticks/ms (div 16)\n", lapic_timer_ticks_ms);
+	return lapic_timer_ticks_ms;
+}
+
+void lapic_timer_start_periodic(uint8_t vector, uint32_t hz)
+{
+	if (!lapic_timer_ticks_ms || hz == 0)
+		return;
+
+	uint32_t count = (uint32_t)(((uint64_t)lapic_timer_ticks_ms * 1000) / hz);
+	if (count == 0)
+		count = 1;
+
+	lapic_write(APIC_TIMER_DIVIDE, 0x3);
+	lapic_write(APIC_LVT_TIMER, vector | APIC_LVT_TIMER_PERIODIC);
+	lapic_write(APIC_TIMER_INITIAL, count);
+}
+
+void lapic_timer_stop(void)
+{
+	lapic_write(APIC_TIMER_INITIAL, 0);
+	lapic_write(APIC_LVT_TIMER, APIC_LVT_MASKED);
+}
+
+void lapic_ipi_all(uint8_t vector)
+{
+	lapic_write(APIC_ICR_HIGH, 0);
+	lapic_write(APIC_ICR_LOW, vector | APIC_ICR_ALL_INCL_SELF);
+
+	while (lapic_read(APIC_ICR_LOW) & APIC_ICR_PENDING)
+		;
+}
+
 void ioapic_write_red(uint32_t gsi, uint8_t vec, uint8_t delivery_mode,
-					  uint8_t polarity, uint8_t trigger_mode, uint8_t lapic_id)
+					  uint8_t polarity, uint8_t trigger_mode, uint8_t dest_mode,
+					  uint8_t dest)
 {
 	union ioapic_redirect_entry redent = { 0 };
 	redent.vec = vec;
 	redent.delivery_mode = delivery_mode;
-	redent.destination_mode = IOAPIC_LOGICAL_DESTINATION;
+	redent.destination_mode = dest_mode;
 	redent.delivery_status = 0;
 	redent.pin_polarity = polarity;
 	redent.remote_irr = 0;
 	redent.trigger_mode = trigger_mode;
 	redent.mask = 0;
 	redent.reserved = 0;
-	redent.dest = lapic_id;
+	redent.dest = dest;
 
 	size_t i;
 	for (i = 0; i < iso_count; i++) {
@@ -0,0 +1,269 @@
+/*********************************************************************************/
+/* Module Name:  fpu.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <arch/cpu/cpu.h>
+#include <arch/cpu/fpu.h>
+#include <arch/cpu/switch.h>
+#include <arch/sys/irqlock.h>
+#include <mm/pmm.h>
+#include <lib/align.h>
+#include <sys/sched.h>
+#include <config.h>
+#include <aurix.h>
+#include <string.h>
+
+#define CR4_OSXSAVE (1ULL << 18)
+
+#define CPUID_1_ECX_XSAVE (1u << 26)
+#define CPUID_1_ECX_AVX (1u << 28)
+#define CPUID_7_EBX_AVX512F (1u << 16)
+#define CPUID_D1_EAX_XSAVEOPT (1u << 0)
+
+#define XFEATURE_X87 (1ULL << 0)
+#define XFEATURE_SSE (1ULL << 1)
+#define XFEATURE_AVX (1ULL << 2)
+#define XFEATURE_OPMASK (1ULL << 5)
+#define XFEATURE_ZMM_HI256 (1ULL << 6)
+#define XFEATURE_HI16_ZMM (1ULL << 7)
+#define XFEATURE_AVX512 \
+	(XFEATURE_OPMASK | XFEATURE_ZMM_HI256 | XFEATURE_HI16_ZMM)
+
+#define FXSAVE_SIZE 512
+#define FPU_FCW_DEFAULT 0x037f
+#define FPU_MXCSR_OFFSET 24
+#define FPU_MXCSR_DEFAULT 0x1f80
+
+enum fpu_mode {
+	FPU_FXSAVE,
+	FPU_XSAVE,
+	FPU_XSAVEOPT,
+};
+
+static const char *fpu_mode_names[] = { "fxsave", "xsave", "xsaveopt" };
+
+static enum fpu_mode fpu_mode = FPU_FXSAVE;
+static uint64_t fpu_xcr0 = 0;
+static size_t fpu_size = FXSAVE_SIZE;
+static bool fpu_probed = false;
+
+// the area whose contents each CPU's registers currently hold. switching back
+// to it skips the XRSTOR, which is the common case when only a kernel thread
+// or the idle loop ran in between
+static void *fpu_loaded[CONFIG_CPU_MAX_COUNT];
+
+static void fpu_probe(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid(0x01, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & CPUID_1_ECX_XSAVE))
+		return;
+	bool avx = ecx & CPUID_1_ECX_AVX;
+
+	cpuid(0x00, &eax, &ebx, &ecx, &edx);
+	uint32_t max_leaf = eax;
+	if (max_leaf < 0x0d)
+		return;
+
+	cpuid_count(0x07, 0, &eax, &ebx, &ecx, &edx);
+	bool avx512 = ebx & CPUID_7_EBX_AVX512F;
+
+	cpuid_count(0x0d, 0, &eax, &ebx, &ecx, &edx);
+	uint64_t supported = ((uint64_t)edx << 32) | eax;
+
+	uint64_t xcr0 = XFEATURE_X87 | XFEATURE_SSE;
+	if (avx)
+		xcr0 |= XFEATURE_AVX;
+	if (avx && avx512)
+		xcr0 |= XFEATURE_AVX512;
+	xcr0 &= supported;
+
+	// AVX-512 state is all or nothing
+	if ((xcr0 & XFEATURE_AVX512) != XFEATURE_AVX512)
+		xcr0 &= ~XFEATURE_AVX512;
+
+	cpuid_count(0x0d, 1, &eax, &ebx, &ecx, &edx);
+
+	fpu_xcr0 = xcr0;
+	fpu_mode = (eax & CPUID_D1_EAX_XSAVEOPT) ? FPU_XSAVEOPT : FPU_XSAVE;
+}
+
+// runs on every CPU from cpu_early_init(), the BSP decides what gets enabled
+// and the APs follow
+void fpu_init(void)
+{
+	if (!fpu_probed)
+		fpu_probe();
+
+	if (fpu_mode != FPU_FXSAVE) {
+		write_cr4(read_cr4() | CR4_OSXSAVE);
+		xsetbv(0, fpu_xcr0);
+	}
+
+	if (fpu_probed)
+		return;
+
+	if (fpu_mode != FPU_FXSAVE) {
+		// EBX reports the size for the features enabled in XCR0
+		uint32_t eax, ebx, ecx, edx;
+		cpuid_count(0x0d, 0, &eax, &ebx, &ecx, &edx);
+		fpu_size = ebx;
+	}
+
+	debug("fpu: %s, xcr0=%llx, %llu byte state\n", fpu_mode_names[fpu_mode],
+		  fpu_xcr0, (uint64_t)fpu_size);
+	fpu_probed = true;
+}
+
+static size_t fpu_state_pages(void)
+{
+	return DIV_ROUND_UP(fpu_size, PAGE_SIZE);
+}
+
+// nobody's registers match this area anymore
+static void fpu_forget(void *state)
+{
+	for (size_t i = 0; i < CONFIG_CPU_MAX_COUNT; i++) {
+		void *expected = state;
+		__atomic_compare_exchange_n(&fpu_loaded[i], &expected, NULL, false,
+									__ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+	}
+}
+
+void *fpu_state_alloc(void)
+{
+	void *phys = palloc(fpu_state_pages());
+	if (!phys)
+		return NULL;
+
+	// page aligned, which covers the 64 bytes XSAVE wants
+	void *state = (void *)PHYS_TO_VIRT(phys);
+	fpu_state_reset(state);
+	return state;
+}
+
+void fpu_state_free(void *state)
+{
+	if (!state)
+		return;
+
+	fpu_forget(state);
+	pfree((void *)VIRT_TO_PHYS(state), fpu_state_pages());
+}
+
+// an all-zero XSAVE header restores every component to its init state, only
+// MXCSR is always loaded from memory
+void fpu_state_reset(void *state)
+{
+	fpu_forget(state);
+
+	memset(state, 0, fpu_size);
+	*(uint16_t *)state = FPU_FCW_DEFAULT;
+	*(uint32_t *)((uint8_t *)state + FPU_MXCSR_OFFSET) = FPU_MXCSR_DEFAULT;
+}
+
+void fpu_state_copy(void *dst, const void *src)
+{
+	fpu_forget(dst);
+	memcpy(dst, src, fpu_size);
+}
+
+void fpu_save(void *state)
+{
+	uint32_t lo = (uint32_t)fpu_xcr0;
+	uint32_t hi = (uint32_t)(fpu_xcr0 >> 32);
+
+	switch (fpu_mode) {
+	case FPU_XSAVEOPT:
+		__asm__ volatile("xsaveopt64 (%0)" ::"r"(state), "a"(lo), "d"(hi)
+						 : "memory");
+		break;
+	case FPU_XSAVE:
+		__asm__ volatile("xsave64 (%0)" ::"r"(state), "a"(lo), "d"(hi)
+						 : "memory");
+		break;
+	default:
+		__asm__ volatile("fxsave64 (%0)" ::"r"(state) : "memory");
+		break;
+	}
+}
+
+void fpu_restore(void *state)
+{
+	uint32_t lo = (uint32_t)fpu_xcr0;
+	uint32_t hi = (uint32_t)(fpu_xcr0 >> 32);
+
+	if (fpu_mode == FPU_FXSAVE)
+		__asm__ volatile("fxrstor64 (%0)" ::"r"(state) : "memory");
+	else
+		__asm__ volatile("xrstor64 (%0)" ::"r"(state), "a"(lo), "d"(hi)
+						 : "memory");
+}
+
+// called by switch_task() before it touches the stacks. state is saved
+// eagerly on the way out, restoring is skipped when the registers still
+// hold it
+void fpu_switch(struct kthread *prev, struct kthread *next)
+{
+	uint8_t irq_state = save_if();
+	cpu_disable_interrupts();
+
+	uint8_t cpu = cpu_get_current_id();
+
+	if (prev && prev->fpu) {
+		fpu_save(prev->fpu);
+		__atomic_store_n(&fpu_loaded[cpu], prev->fpu, __ATOMIC_RELEASE);
+	}
+
+	if (next && next->fpu &&
+		__atomic_load_n(&fpu_loaded[cpu], __ATOMIC_ACQUIRE) != next->fpu) {
+		// whatever another CPU still holds is about to go stale
+		fpu_forget(next->fpu);
+		fpu_restore(next->fpu);
+		__atomic_store_n(&fpu_loaded[cpu], next->fpu, __ATOMIC_RELEASE);
+	}
+
+	restore_if(irq_state);
+}
+
+uint8_t fpu_kernel_begin(void)
+{
+	uint8_t irq_state = save_if();
+	cpu_disable_interrupts();
+
+	tcb *current = thread_current();
+	if (current && current->kthread.fpu)
+		fpu_save(current->kthread.fpu);
+	__atomic_store_n(&fpu_loaded[cpu_get_current_id()], NULL,
+					 __ATOMIC_RELEASE);
+
+	return irq_state;
+}
+
+void fpu_kernel_end(uint8_t irq_state)
+{
+	tcb *current = thread_current();
+	if (current && current->kthread.fpu) {
+		fpu_restore(current->kthread.fpu);
+		__atomic_store_n(&fpu_loaded[cpu_get_current_id()],
+						 current->kthread.fpu, __ATOMIC_RELEASE);
+	}
+
+	restore_if(irq_state);
+}
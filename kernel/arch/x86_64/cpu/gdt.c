@@ -28,6 +28,8 @@
 
 static struct gdt_descriptor gdt[CONFIG_CPU_MAX_COUNT][7];
 struct tss gdt_tss[CONFIG_CPU_MAX_COUNT];
+static uint8_t gdt_df_stack[CONFIG_CPU_MAX_COUNT][GDT_IST_STACK_SIZE]
+	__attribute__((aligned(16)));
 
 void gdt_init()
 {
@@ -51,6 +53,8 @@ void gdt_init()
 	*(uint64_t *)&gdt[cpu][6] = (uint64_t)&gdt_tss[cpu] >> 32; // TSS high
 
 	gdt_tss[cpu].iopb_offset = sizeof(struct tss);
+	gdt_tss[cpu].ist[GDT_IST_DF - 1] =
+		(uint64_t)&gdt_df_stack[cpu][GDT_IST_STACK_SIZE];
 
 	struct gdtr gdtr = { .base = (uintptr_t)&gdt[cpu][0],
 						 .limit = sizeof(gdt[cpu]) - 1 };
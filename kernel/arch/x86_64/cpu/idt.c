@@ -30,8 +30,11 @@
 #include <lib/string.h>
 #include <mm/pmm.h>
 #include <mm/vmm.h>
+#include <sys/cpuidle.h>
 #include <sys/panic.h>
+#include <sys/prof.h>
 #include <sys/sched.h>
+#include <sys/kstack.h>
 #include <aurix.h>
 #include <stdint.h>
 #include <stddef.h>
@@ -97,6 +100,7 @@ void idt_init()
 	for (int v = 32; v < 256; v++) {
 		idt_set_desc(&idt[v], (uint64_t)isr_stubs[v], IDT_INTERRUPT, 0);
 	}
+	idt[8].ist = GDT_IST_DF;
 
 	// syscall handler
 	idt_set_desc(&idt[0x80], (uint64_t)isr_stubs[0x80], IDT_TRAP,
@@ -119,6 +123,11 @@ void idt_set_desc(struct idt_descriptor *desc, uint64_t offset, uint8_t type,
 
 static void isr_handle_user_exception(const struct interrupt_frame *frame)
 {
+	// overflowing a kernel stack faults on its guard page, and that fault
+	// escalates to a double fault since there's no stack left to push onto
+	if (frame->vector == 8 && kstack_is_guard(frame->cr2))
+		error("kernel stack overflow, cr2=0x%llx\n", frame->cr2);
+
 	tcb *current = thread_current();
 	if (!current || !current->process || current->process->pid == 0) {
 		kpanic(frame, exception_str[frame->vector]);
@@ -224,6 +233,9 @@ static void isr_syscall_handler(struct interrupt_frame *frame)
 
 void isr_common_handler(struct interrupt_frame frame)
 {
+	if (frame.vector >= 0x20 && frame.vector != 0x80)
+		cpuidle_wake(cpu_get_current());
+
 	if (frame.vector < 0x20) {
 		isr_handle_user_exception(&frame);
 	} else if (frame.vector < 0x80) {
@@ -233,9 +245,12 @@ void isr_common_handler(struct interrupt_frame frame)
 		if (irq == 0) {
 			sched_tick();
 		}
+	} else if (frame.vector == PROF_VECTOR) {
+		prof_tick(&frame);
+		apic_send_eoi();
 	} else if (frame.vector == 0xfe) {
 		apic_send_eoi();
-		sched_yield();
+		sched_preempt();
 	} else if (frame.vector == 0xff) {
 		// shutdown
 		cpu_halt();
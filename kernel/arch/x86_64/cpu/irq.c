@@ -24,15 +24,29 @@
 #include <arch/cpu/idt.h>
 #include <arch/cpu/irq.h>
 #include <arch/cpu/cpu.h>
+#include <arch/sys/irqlock.h>
+#include <sys/errno.h>
 #include <aurix.h>
 #include <stddef.h>
 
 // this probably isn't the best way to do it... beats me
 struct irq_handler irq_handlers[224] = { 0 };
 
+static irqlock_t irq_alloc_lock = { 0 };
+
+// physical destination for lines routed to the calling CPU. the IOAPIC only
+// has 8 bits for it, anything past that goes to the BSP
+static uint8_t irq_dest(void)
+{
+	uint32_t lapic_id = cpu_get_current()->lapic_id;
+	if (lapic_id > 0xff)
+		lapic_id = cpuinfo[0].lapic_id;
+	return (uint8_t)lapic_id;
+}
+
 void irq_install(uint8_t irq, irq_callback callback, void *ctx)
 {
-	if (irq > 16) {
+	if (irq >= IRQ_MAX_LINES) {
 		warn("Tried to install an IRQ handler for IRQ#%u.\n", irq);
 		return;
 	}
@@ -47,17 +61,23 @@ void irq_install(uint8_t irq, irq_callback callback, void *ctx)
 	h->ctx = ctx;
 
 	if (irq == 0)
-		ioapic_write_red(irq, 0x20 + irq, 0, 0, 0, 0xFF);
+		ioapic_write_red(irq, 0x20 + irq, 0, 0, 0,
+						 IOAPIC_LOGICAL_DESTINATION, 0xFF);
+	else if (irq >= IRQ_ISA_LINES)
+		// past the ISA range it's PCI INTx, level triggered and active low
+		ioapic_write_red(irq, 0x20 + irq, 0, IOAPIC_ACTIVE_LO,
+						 IOAPIC_TRIGGER_LEVEL, IOAPIC_PHYSICAL_DESTINATION,
+						 irq_dest());
 	else
 		ioapic_write_red(irq, 0x20 + irq, 0, 0, 0,
-						 (uint8_t)(1u << cpu_get_current()->id));
+						 IOAPIC_PHYSICAL_DESTINATION, irq_dest());
 
 	debug("Installed IRQ handler 0x%llx for IRQ%u.\n", callback, irq);
 }
 
 void irq_uninstall(uint8_t irq)
 {
-	if (irq > 16) {
+	if (irq >= IRQ_MAX_VECTORS) {
 		warn("Tried to uninstall an IRQ handler for IRQ#%u.\n", irq);
 		return;
 	}
@@ -70,6 +90,45 @@ void irq_uninstall(uint8_t irq)
 	debug("Uninstalled IRQ handler for IRQ#%u.\n", irq);
 }
 
+int irq_alloc(irq_callback callback, void *ctx)
+{
+	if (!callback)
+		return -EINVAL;
+
+	irqlock_acquire(&irq_alloc_lock);
+	for (int irq = IRQ_MAX_LINES; irq < IRQ_MAX_VECTORS; irq++) {
+		struct irq_handler *h = &irq_handlers[irq];
+		if (h->callback)
+			continue;
+
+		h->ctx = ctx;
+		h->callback = callback;
+		irqlock_release(&irq_alloc_lock);
+
+		debug("Allocated IRQ%u for 0x%llx.\n", irq, callback);
+		return irq;
+	}
+	irqlock_release(&irq_alloc_lock);
+
+	return -ENOSPC;
+}
+
+// MSI/MSI-X address and data that raise irq on the given CPU, fixed delivery,
+// edge triggered, physical destination
+int irq_msi_message(uint8_t irq, uint32_t cpu, uint64_t *addr, uint32_t *data)
+{
+	if (irq < IRQ_MAX_LINES || irq >= IRQ_MAX_VECTORS || cpu >= cpu_count)
+		return -EINVAL;
+
+	uint32_t lapic_id = cpuinfo[cpu].lapic_id;
+	if (lapic_id > 0xff)
+		return -ERANGE;
+
+	*addr = 0xfee00000ull | ((uint64_t)lapic_id << 12);
+	*data = 0x20 + irq;
+	return 0;
+}
+
 void irq_dispatch(uint8_t irq)
 {
 	struct irq_handler *h = &irq_handlers[irq];
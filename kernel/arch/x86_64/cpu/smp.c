@@ -33,42 +33,71 @@
 #include <mm/vmm.h>
 #include <sys/sched.h>
 #include <sys/panic.h>
+#include <sys/spinlock.h>
+#include <time/time.h>
+#include <arch/time/tsc.h>
 #include <aurix.h>
+#include <config.h>
 #include <stdint.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <string.h>
 
-#define CORE_STARTUP_MAX_RETRIES 100 // 1s
+#define CORE_STARTUP_TIMEOUT_MS 1000
 
 bool smp_initialized = false;
-static atomic_bool cpu_ready = ATOMIC_VAR_INIT(false);
+static atomic_size_t cpus_arrived = ATOMIC_VAR_INIT(0);
 
-static void *tramp_stack;
+// APs come up together but take turns touching shared kernel state
+static spinlock_t smp_startup_lock;
 
 extern uintptr_t lapic_base;
 extern struct madt_lapic *lapics[];
 extern size_t lapic_count;
+extern size_t lapic_skipped;
 
 extern pagetable *kernel_pm;
 
-void send_start_ipi(uint8_t cpu_id, uint8_t lapic_id)
+static void smp_send_ipi(uint32_t icr_high, uint32_t icr_low)
 {
-	uint8_t *virt_base = (uint8_t *)TRAMP_BASE_ADDR;
-	*((uint64_t *)&virt_base[TRAMP_CPU]) = (uint64_t)cpu_id;
-	*((uint64_t *)&virt_base[TRAMP_STACK]) = (uint64_t)tramp_stack + PAGE_SIZE;
+	lapic_write(0x310, icr_high);
+	lapic_write(0x300, icr_low);
 
-	atomic_store(&cpu_ready, false);
+	while (lapic_read(0x300) & (1u << 12))
+		cpu_spinwait();
+}
 
-	// INIT
-	lapic_write(0x310, lapic_id << 24);
-	lapic_write(0x300, (5 << 8));
+static void smp_start_aps(bool broadcast, uint32_t bsp_lapic, size_t limit)
+{
+	uint32_t sipi = (6 << 8) | ((uintptr_t)TRAMP_BASE_ADDR / PAGE_SIZE);
+
+	if (broadcast) {
+		// INIT, then SIPI twice to everyone but ourselves
+		smp_send_ipi(0, (3 << 18) | (1 << 14) | (5 << 8));
+		hpet_msleep(10);
+		smp_send_ipi(0, (3 << 18) | sipi);
+		hpet_usleep(200);
+		smp_send_ipi(0, (3 << 18) | sipi);
+		return;
+	}
 
+	// same sequence, but only hitting the first `limit` usable LAPICs
+	for (size_t i = 0, n = 0; i < lapic_count && n < limit; i++) {
+		if (lapics[i]->id != bsp_lapic && (lapics[i]->flags & 1)) {
+			smp_send_ipi((uint32_t)lapics[i]->id << 24, (1 << 14) | (5 << 8));
+			n++;
+		}
+	}
 	hpet_msleep(10);
-
-	// SIPI
-	lapic_write(0x310, lapic_id << 24);
-	lapic_write(0x300, (6 << 8) | ((uintptr_t)TRAMP_BASE_ADDR / PAGE_SIZE));
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t i = 0, n = 0; i < lapic_count && n < limit; i++) {
+			if (lapics[i]->id != bsp_lapic && (lapics[i]->flags & 1)) {
+				smp_send_ipi((uint32_t)lapics[i]->id << 24, sipi);
+				n++;
+			}
+		}
+		hpet_usleep(200);
+	}
 }
 
 void smp_init()
@@ -80,24 +109,47 @@ void smp_init()
 
 	cpu_disable_interrupts();
 
-	uint8_t bsp_id = cpu_get_current()->id;
-	debug("Bootstrap CPU ID: %u\n", bsp_id);
+	uint32_t bsp_lapic = lapic_read(APIC_ID) >> 24;
+	debug("Bootstrap CPU ID: %u (LAPIC %u)\n", cpu_get_current()->id,
+		  bsp_lapic);
 
-	// set up trampoline
-	tramp_stack = palloc(1);
-	if (!tramp_stack) {
-		error("Couldn't allocate memory for SMP trampoline stack.\n");
+	// only a broadcast if it can't wake anything we don't know about
+	bool broadcast = (lapic_skipped == 0);
+	size_t ap_count = 0;
+	for (size_t i = 0; i < lapic_count; i++) {
+		if (lapics[i]->id == bsp_lapic)
+			continue;
+		if (lapics[i]->flags & 1)
+			ap_count++;
+		else
+			broadcast = false;
 	}
 
-	map_page(NULL, TRAMP_BASE_ADDR, TRAMP_BASE_ADDR,
-			 VMM_PRESENT | VMM_WRITABLE);
-	map_page(NULL, (uintptr_t)tramp_stack, (uintptr_t)tramp_stack,
-			 VMM_PRESENT | VMM_WRITABLE | VMM_NX);
+	// per-cpu arrays are sized by CONFIG_CPU_MAX_COUNT, leave the rest asleep
+	size_t ap_max = CONFIG_CPU_MAX_COUNT - cpu_count;
+	if (ap_max > TRAMP_MAX_SLOTS)
+		ap_max = TRAMP_MAX_SLOTS;
+	if (ap_count > ap_max) {
+		warn("smp: %zu APs present, only starting %zu of them\n", ap_count,
+			 ap_max);
+		ap_count = ap_max;
+		broadcast = false;
+	}
+	if (ap_count == 0) {
+		smp_initialized = true;
+		cpu_enable_interrupts();
+		return;
+	}
 
-	if (TRAMP_SIZE > PAGE_SIZE) {
-		error("SMP trampoline is >4096 bytes large.\n");
+	if (TRAMP_SIZE > TRAMP_DATA_OFF) {
+		error("SMP trampoline overlaps its data area.\n");
+		cpu_enable_interrupts();
+		return;
 	}
 
+	map_page(NULL, TRAMP_BASE_ADDR, TRAMP_BASE_ADDR,
+			 VMM_PRESENT | VMM_WRITABLE);
+
 	uint8_t *virt_base = (uint8_t *)TRAMP_BASE_ADDR;
 	memcpy(virt_base, smp_tramp_start, TRAMP_SIZE);
 	memset(&virt_base[TRAMP_DATA_OFF], 0, PAGE_SIZE - TRAMP_DATA_OFF);
@@ -105,69 +157,78 @@ void smp_init()
 	*((uint64_t *)&virt_base[TRAMP_PML4]) = (uint64_t)kernel_pm;
 	*((uint64_t *)&virt_base[TRAMP_ENTRY]) = (uint64_t)smp_cpu_startup;
 
-	atomic_init(&cpu_ready, false);
-
-	debug("SMP trampoline initialized, starting up other cores...\n");
-
-	// wake up! grab a brush and put a little makeup!
-	for (size_t i = 0; i < lapic_count; i++) {
-		if (lapics[i]->id == bsp_id) {
-			continue;
+	// hand every AP its stack up front so nobody allocates during startup
+	uint64_t *stacks = (uint64_t *)&virt_base[TRAMP_STACKS];
+	size_t slots = 0;
+	for (; slots < ap_count; slots++) {
+		void *stack = palloc(SMP_AP_STACK_SIZE / PAGE_SIZE);
+		if (!stack) {
+			error("smp: out of memory for AP stacks, starting %zu cores\n",
+				  slots);
+			break;
 		}
+		stacks[slots] = PHYS_TO_VIRT(stack) + SMP_AP_STACK_SIZE;
+	}
+	*((uint32_t *)&virt_base[TRAMP_SLOTS]) = (uint32_t)slots;
+	if (slots < ap_count)
+		broadcast = false;
 
-		send_start_ipi(i, lapics[i]->id);
-
-		int retries = 0;
-		while (retries++ <= CORE_STARTUP_MAX_RETRIES) {
-			if (atomic_load(&cpu_ready)) {
-				success("CPU %u is up and running\n", i);
-				break;
-			}
-			hpet_msleep(10);
-		}
+	spinlock_init(&smp_startup_lock);
+	atomic_store(&cpus_arrived, 0);
 
-		if (!atomic_load(&cpu_ready)) {
-			error("Core %u didn't start up in time, skipping.\n", i);
-		}
+	debug("SMP trampoline initialized, starting up %zu cores (%s)...\n",
+		  slots, broadcast ? "broadcast" : "targeted");
 
-		atomic_store(&cpu_ready, false);
-	}
+	// wake up! grab a brush and put a little makeup!
+	uint64_t start = get_ms();
+	smp_start_aps(broadcast, bsp_lapic, slots);
+
+	while (atomic_load(&cpus_arrived) < slots &&
+		   get_ms() - start < CORE_STARTUP_TIMEOUT_MS)
+		cpu_spinwait();
+
+	size_t arrived = atomic_load(&cpus_arrived);
+	if (arrived < slots)
+		error("Only %zu of %zu cores started up in time.\n", arrived, slots);
+	else
+		success("%zu cores up and running in %llu ms\n", arrived,
+				get_ms() - start);
+
+	// give back stacks no AP claimed
+	uint32_t taken = *((volatile uint32_t *)&virt_base[TRAMP_NEXT]);
+	for (size_t i = taken; i < slots; i++)
+		pfree((void *)VIRT_TO_PHYS(stacks[i] - SMP_AP_STACK_SIZE),
+			  SMP_AP_STACK_SIZE / PAGE_SIZE);
 
 	// remove trampoline
-	unmap_page(NULL, (uintptr_t)tramp_stack);
 	unmap_page(NULL, TRAMP_BASE_ADDR);
-	pfree(tramp_stack, 1);
-	tramp_stack = NULL;
 
 	cpu_enable_interrupts();
 	smp_initialized = true;
 }
 
-__attribute__((noreturn)) void smp_cpu_startup(uint8_t cpu)
+__attribute__((noreturn)) void smp_cpu_startup(uint8_t slot)
 {
+	spinlock_acquire(&smp_startup_lock);
+
 	cpu_early_init();
 	cpu_init();
+	tsc_sync_cpu();
 
-	// set up own stack
-	void *stack = palloc(4); // 16kib
-	if (!stack) {
-		kpanicf(NULL, "smp: couldn't allocate stack for CPU %u", cpu);
-	}
+	struct cpu *cpu = cpu_get_current();
+	apic_cpu_init(cpu->id);
+
+	debug("cpu%u: slot=%u lapic=%u\n", cpu->id, slot, cpu->lapic_id);
 
-	map_pages(NULL, (uintptr_t)stack, (uintptr_t)stack, 16 * 1024,
-			  VMM_PRESENT | VMM_WRITABLE | VMM_NX);
+	sched_init();
 
-	__asm__ volatile("mov %0, %%rsp" ::"r"(stack + (16 * 1024)));
+	spinlock_release(&smp_startup_lock);
 
-	apic_cpu_init(cpu_get_current()->id);
 	cpu_enable_interrupts();
 
 	// we rollin' in parallel now
-	atomic_store(&cpu_ready, true);
+	atomic_fetch_add(&cpus_arrived, 1);
 
-	debug("cpu%u: s=0x%llx, l=%u\n", cpu, stack, 16 * 1024);
-
-	sched_init();
 	for (;;) {
 		__asm__ volatile("hlt");
 	}
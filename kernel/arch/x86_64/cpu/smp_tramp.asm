@@ -6,11 +6,12 @@
 %define TRAMP_ADDR(addr) (TRAMP_BASE + (addr))
 
 TRAMP_BASE equ 0x8000
-TRAMP_DATA equ 0xF00
+TRAMP_DATA equ 0x800
 TRAMP_PML4 equ (TRAMP_DATA)
 TRAMP_ENTRY equ (TRAMP_DATA + 0x08)
-TRAMP_CPU equ (TRAMP_DATA + 0x10)
-TRAMP_STACK equ (TRAMP_DATA + 0x18)
+TRAMP_NEXT equ (TRAMP_DATA + 0x10)
+TRAMP_SLOTS equ (TRAMP_DATA + 0x18)
+TRAMP_STACKS equ (TRAMP_DATA + 0x20)
 
 global smp_tramp_start:function
 global smp_tramp_end:function
@@ -76,15 +77,27 @@ smp_tramp_long:
 	mov fs, ax
 	mov gs, ax
 
-	mov rsp, [TRAMP_ADDR(TRAMP_STACK)]
+	; all APs run this at once, grab a slot (and its stack) atomically
+	mov eax, 1
+	lock xadd dword [TRAMP_ADDR(TRAMP_NEXT)], eax
+	cmp eax, dword [TRAMP_ADDR(TRAMP_SLOTS)]
+	jae .park
+
+	mov rsp, [TRAMP_ADDR(TRAMP_STACKS) + rax * 8]
 	xor rbp, rbp
 
 	push 0x0
 	popfq
 
-	mov rdi, [TRAMP_ADDR(TRAMP_CPU)]
+	mov edi, eax
 	jmp [TRAMP_ADDR(TRAMP_ENTRY)]
 
+	; woken up but nobody expects us (CPU limit reached)
+.park:
+	cli
+	hlt
+	jmp .park
+
 align 16
 gdtr32:
 	dw gdt32_end - gdt32_start - 1
@@ -2,12 +2,23 @@ section .text
 global switch_task
 global switch_enter_user
 global fork_trampoline
+extern fpu_switch
 
 %define KTHREAD_CR3_OFFSET 0
 %define KTHREAD_RSP_OFFSET 16
 %define KTHREAD_FS_BASE_OFFSET 24
+%define KTHREAD_ON_CPU_OFFSET 40
 
 switch_task:
+    ; extended state first, rdi/rsi are the arguments fpu_switch wants too
+    push rdi
+    push rsi
+    sub rsp, 8
+    call fpu_switch
+    add rsp, 8
+    pop rsi
+    pop rdi
+
     test rdi, rdi
     jz .load_next
 
@@ -30,10 +41,17 @@ switch_task:
     mov [rdi + KTHREAD_FS_BASE_OFFSET], rax
 
 .load_next:
+    mov qword [rsi + KTHREAD_ON_CPU_OFFSET], 1
     mov rax, [rsi + KTHREAD_CR3_OFFSET]
     mov cr3, rax
     mov rsp, [rsi + KTHREAD_RSP_OFFSET]
 
+    ; off prev's stack for good, other CPUs may run it from here on
+    test rdi, rdi
+    jz .restore_next
+    mov qword [rdi + KTHREAD_ON_CPU_OFFSET], 0
+
+.restore_next:
     mov rax, [rsi + KTHREAD_FS_BASE_OFFSET]
     mov ecx, 0xC0000100
     mov r8d, eax
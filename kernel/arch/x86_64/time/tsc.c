@@ -0,0 +1,181 @@
+/*********************************************************************************/
+/* Module Name:  tsc.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <arch/time/tsc.h>
+#include <arch/cpu/cpu.h>
+#include <acpi/hpet.h>
+#include <config.h>
+#include <aurix.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+static bool tsc_ready = false;
+static bool tsc_has_rdtscp = false;
+static uint64_t tsc_hz = 0;
+
+// ns = (ticks * tsc_mult) >> 32, ticks = (ns * tsc_inv) >> 24
+static uint64_t tsc_mult = 0;
+static uint64_t tsc_inv = 0;
+
+// BSP reference point that APs line their counters up against
+static uint64_t tsc_ref = 0;
+static uint64_t tsc_ref_ns = 0;
+
+static uint64_t tsc_measure_hz(void)
+{
+	uint64_t h0 = hpet_get_ns();
+	uint64_t t0 = rdtsc();
+	uint64_t target = h0 + TSC_CALIBRATE_MS * 1000000ull;
+	uint64_t h1;
+
+	while ((h1 = hpet_get_ns()) < target)
+		cpu_spinwait();
+
+	uint64_t t1 = rdtsc();
+	return ((t1 - t0) * 1000000000ull) / (h1 - h0);
+}
+
+int tsc_init(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	struct cpu *cpu = cpu_get_current();
+	if (!cpu || !cpu->cpuid.edx_bits.tsc) {
+		debug("tsc: no time stamp counter\n");
+		return 0;
+	}
+
+	cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+	if (eax < 0x80000007) {
+		debug("tsc: can't query invariant TSC support\n");
+		return 0;
+	}
+
+	cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+	tsc_has_rdtscp = (edx & (1 << 27)) != 0;
+
+	cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+	if (!(edx & (1 << 8))) {
+		warn("tsc: TSC is not invariant, staying on HPET\n");
+		return 0;
+	}
+
+	if (!hpet_is_initialized()) {
+		warn("tsc: no HPET to calibrate against\n");
+		return 0;
+	}
+
+	// take the median of a few rounds to filter out SMIs and VM exits
+	uint64_t hz[TSC_CALIBRATE_ROUNDS];
+	for (int i = 0; i < TSC_CALIBRATE_ROUNDS; i++) {
+		uint64_t v = tsc_measure_hz();
+		int j = i;
+		while (j > 0 && hz[j - 1] > v) {
+			hz[j] = hz[j - 1];
+			j--;
+		}
+		hz[j] = v;
+	}
+
+	tsc_hz = hz[TSC_CALIBRATE_ROUNDS / 2];
+	if (tsc_hz == 0) {
+		error("tsc: calibration failed\n");
+		return 0;
+	}
+
+	tsc_mult = (1000000000ull << 32) / tsc_hz;
+	tsc_inv = (tsc_hz << 24) / 1000000000ull;
+
+	cpu->tsc_offset = 0;
+	tsc_ref_ns = hpet_get_ns();
+	tsc_ref = rdtsc();
+	tsc_ready = true;
+
+	success("tsc: invariant TSC running at %llu.%03llu MHz%s\n",
+			tsc_hz / 1000000, (tsc_hz / 1000) % 1000,
+			tsc_has_rdtscp ? " (rdtscp)" : "");
+	return 1;
+}
+
+void tsc_sync_cpu(void)
+{
+	struct cpu *cpu = cpu_get_current();
+	if (!cpu)
+		return;
+
+	cpu->tsc_offset = 0;
+	if (!tsc_ready)
+		return;
+
+	// bracket the HPET read so we know how much the sample can be off by
+	uint64_t t0 = rdtsc();
+	uint64_t h = hpet_get_ns();
+	uint64_t t1 = rdtsc();
+
+	uint64_t local = t0 + (t1 - t0) / 2;
+	uint64_t expected = tsc_ref + tsc_from_ns(h - tsc_ref_ns);
+	int64_t offset = (int64_t)(expected - local);
+
+	// counters that are already in sync shouldn't inherit HPET jitter
+	int64_t slack = (int64_t)(t1 - t0) + (int64_t)tsc_from_ns(1000);
+	if (offset > -slack && offset < slack)
+		offset = 0;
+
+	cpu->tsc_offset = offset;
+	if (offset)
+		debug("tsc: cpu%u offset %lld ticks\n", cpu->id, (long long)offset);
+}
+
+int tsc_is_available(void)
+{
+	return tsc_ready ? 1 : 0;
+}
+
+uint64_t tsc_get_hz(void)
+{
+	return tsc_hz;
+}
+
+uint64_t tsc_read(void)
+{
+	uint32_t id;
+	uint64_t t;
+
+	// TSC_AUX holds our CPU id, so rdtscp can't race with a migration
+	if (tsc_has_rdtscp) {
+		t = rdtscp(&id);
+	} else {
+		id = cpu_get_current_id();
+		t = rdtsc();
+	}
+
+	if (id < CONFIG_CPU_MAX_COUNT)
+		t += (uint64_t)cpuinfo[id].tsc_offset;
+	return t;
+}
+
+uint64_t tsc_to_ns(uint64_t ticks)
+{
+	return (uint64_t)(((unsigned __int128)ticks * tsc_mult) >> 32);
+}
+
+uint64_t tsc_from_ns(uint64_t ns)
+{
+	return (uint64_t)(((unsigned __int128)ns * tsc_inv) >> 24);
+}
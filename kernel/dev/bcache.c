@@ -0,0 +1,486 @@
+/*********************************************************************************/
+/* Module Name:  bcache.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <dev/bcache.h>
+#include <dev/blkdev.h>
+#include <mm/heap.h>
+#include <mm/pmm.h>
+#include <sys/errno.h>
+#include <sys/sched.h>
+#include <sys/spinlock.h>
+#include <time/time.h>
+#include <lib/string.h>
+#include <aurix.h>
+#include <config.h>
+
+static spinlock_t bcache_lock;
+
+static struct buffer *bcache_hash[BCACHE_HASH_SIZE];
+
+// most recently used at the head
+static struct buffer *lru_head = NULL;
+static struct buffer *lru_tail = NULL;
+static size_t bcache_nr = 0;
+
+static uint64_t bcache_last_wb_ms = 0;
+static bool bcache_wb_running = false;
+
+static inline uint32_t bflags(struct buffer *b)
+{
+	return __atomic_load_n(&b->flags, __ATOMIC_ACQUIRE);
+}
+
+static inline uint32_t bflags_set(struct buffer *b, uint32_t f)
+{
+	return __atomic_fetch_or(&b->flags, f, __ATOMIC_ACQ_REL);
+}
+
+static inline void bflags_clear(struct buffer *b, uint32_t f)
+{
+	__atomic_fetch_and(&b->flags, ~f, __ATOMIC_ACQ_REL);
+}
+
+static size_t bcache_hashfn(struct blkdev *bdev, uint64_t block)
+{
+	return ((uint64_t)bdev->id * 0x9e3779b1u + block) % BCACHE_HASH_SIZE;
+}
+
+static uint64_t bcache_block_sector(struct blkdev *bdev, uint64_t block)
+{
+	return block * (BCACHE_BLOCK_SIZE / bdev->sector_size);
+}
+
+size_t bcache_block_bytes(struct blkdev *bdev, uint64_t block)
+{
+	uint64_t sector = bcache_block_sector(bdev, block);
+	if (sector >= bdev->sector_count)
+		return 0;
+
+	uint64_t left = (bdev->sector_count - sector) * bdev->sector_size;
+	return left < BCACHE_BLOCK_SIZE ? (size_t)left : BCACHE_BLOCK_SIZE;
+}
+
+// the helpers below expect bcache_lock to be held
+
+static struct buffer *bcache_lookup(struct blkdev *bdev, uint64_t block)
+{
+	struct buffer *b = bcache_hash[bcache_hashfn(bdev, block)];
+	while (b && (b->bdev != bdev || b->block != block))
+		b = b->hash_next;
+	return b;
+}
+
+static void bcache_hash_remove(struct buffer *b)
+{
+	struct buffer **pp = &bcache_hash[bcache_hashfn(b->bdev, b->block)];
+	while (*pp && *pp != b)
+		pp = &(*pp)->hash_next;
+	if (*pp)
+		*pp = b->hash_next;
+	b->hash_next = NULL;
+}
+
+static void bcache_hash_insert(struct buffer *b)
+{
+	size_t h = bcache_hashfn(b->bdev, b->block);
+	b->hash_next = bcache_hash[h];
+	bcache_hash[h] = b;
+}
+
+static void lru_unlink(struct buffer *b)
+{
+	if (b->lru_prev)
+		b->lru_prev->lru_next = b->lru_next;
+	else
+		lru_head = b->lru_next;
+	if (b->lru_next)
+		b->lru_next->lru_prev = b->lru_prev;
+	else
+		lru_tail = b->lru_prev;
+	b->lru_prev = b->lru_next = NULL;
+}
+
+static void lru_push_front(struct buffer *b)
+{
+	b->lru_prev = NULL;
+	b->lru_next = lru_head;
+	if (lru_head)
+		lru_head->lru_prev = b;
+	lru_head = b;
+	if (!lru_tail)
+		lru_tail = b;
+}
+
+static void bcache_assign(struct buffer *b, struct blkdev *bdev,
+						  uint64_t block)
+{
+	b->bdev = bdev;
+	b->block = block;
+	b->size = (uint32_t)bcache_block_bytes(bdev, block);
+	// handed out held, see getblk()
+	b->flags = B_BUSY;
+	b->refs = 1;
+	b->dirtied_ms = 0;
+	bcache_hash_insert(b);
+	lru_push_front(b);
+}
+
+static void bcache_wait_unbusy(struct buffer *b)
+{
+	while (bflags(b) & B_BUSY) {
+		sched_yield();
+		__asm__ volatile("pause" ::: "memory");
+	}
+}
+
+static void bcache_lock_busy(struct buffer *b)
+{
+	while (bflags_set(b, B_BUSY) & B_BUSY)
+		bcache_wait_unbusy(b);
+}
+
+static struct buffer *bcache_alloc(void)
+{
+	struct buffer *b = kmalloc(sizeof(struct buffer));
+	if (!b)
+		return NULL;
+	memset(b, 0, sizeof(struct buffer));
+
+	// page backed so drivers can DMA straight into it
+	uintptr_t phys = (uintptr_t)palloc(1);
+	if (!phys) {
+		kfree(b);
+		return NULL;
+	}
+	b->data = (uint8_t *)PHYS_TO_VIRT(phys);
+
+	return b;
+}
+
+static void bcache_free(struct buffer *b)
+{
+	pfree((void *)VIRT_TO_PHYS(b->data), 1);
+	kfree(b);
+}
+
+static struct buffer *getblk(struct blkdev *bdev, uint64_t block)
+{
+	for (;;) {
+		spinlock_acquire(&bcache_lock);
+
+		struct buffer *b = bcache_lookup(bdev, block);
+		if (b) {
+			b->refs++;
+			lru_unlink(b);
+			lru_push_front(b);
+			spinlock_release(&bcache_lock);
+			bcache_lock_busy(b);
+			return b;
+		}
+
+		if (bcache_nr < CONFIG_BCACHE_MAX_BUFFERS) {
+			bcache_nr++;
+			spinlock_release(&bcache_lock);
+
+			struct buffer *nb = bcache_alloc();
+
+			spinlock_acquire(&bcache_lock);
+			if (!nb) {
+				bcache_nr--;
+				spinlock_release(&bcache_lock);
+				return NULL;
+			}
+
+			if (bcache_lookup(bdev, block)) {
+				// somebody else brought it in meanwhile
+				bcache_nr--;
+				spinlock_release(&bcache_lock);
+				bcache_free(nb);
+				continue;
+			}
+
+			bcache_assign(nb, bdev, block);
+			spinlock_release(&bcache_lock);
+			return nb;
+		}
+
+		// recycle the least recently used clean buffer
+		struct buffer *victim = NULL;
+		struct buffer *dirty = NULL;
+		for (struct buffer *v = lru_tail; v; v = v->lru_prev) {
+			if (v->refs || (bflags(v) & B_BUSY))
+				continue;
+			if (!(bflags(v) & B_DIRTY)) {
+				victim = v;
+				break;
+			}
+			if (!dirty)
+				dirty = v;
+		}
+
+		if (victim) {
+			bcache_hash_remove(victim);
+			lru_unlink(victim);
+			bcache_assign(victim, bdev, block);
+			spinlock_release(&bcache_lock);
+			return victim;
+		}
+
+		if (dirty) {
+			dirty->refs++;
+			spinlock_release(&bcache_lock);
+			bcache_lock_busy(dirty);
+			bwrite(dirty);
+			bflags_clear(dirty, B_BUSY);
+			spinlock_acquire(&bcache_lock);
+			dirty->refs--;
+			spinlock_release(&bcache_lock);
+			continue;
+		}
+
+		// everything is pinned, wait for somebody to let go
+		spinlock_release(&bcache_lock);
+		sched_yield();
+	}
+}
+
+struct buffer *bread(struct blkdev *bdev, uint64_t block)
+{
+	if (!bdev || bcache_block_bytes(bdev, block) == 0)
+		return NULL;
+
+	struct buffer *b = getblk(bdev, block);
+	if (!b)
+		return NULL;
+
+	if (!(bflags(b) & B_VALID)) {
+		int r = blk_rw_sync(bdev, BLK_OP_READ, bcache_block_sector(bdev, block),
+							b->size / bdev->sector_size, b->data);
+		if (r != 0) {
+			brelse(b);
+			return NULL;
+		}
+		bflags_set(b, B_VALID);
+	}
+
+	return b;
+}
+
+struct buffer *bget(struct blkdev *bdev, uint64_t block)
+{
+	if (!bdev || bcache_block_bytes(bdev, block) == 0)
+		return NULL;
+
+	struct buffer *b = getblk(bdev, block);
+	if (!b)
+		return NULL;
+
+	// the caller overwrites the whole buffer
+	if (!(bflags(b) & B_VALID)) {
+		memset(b->data, 0, b->size);
+		bflags_set(b, B_VALID);
+	}
+
+	return b;
+}
+
+void bdirty(struct buffer *b)
+{
+	if (!b)
+		return;
+
+	if (!(bflags_set(b, B_DIRTY) & B_DIRTY))
+		b->dirtied_ms = get_ms();
+}
+
+// b is held by the caller
+int bwrite(struct buffer *b)
+{
+	if (!b)
+		return -EINVAL;
+
+	bflags_clear(b, B_DIRTY);
+
+	int r = blk_rw_sync(b->bdev, BLK_OP_WRITE,
+						bcache_block_sector(b->bdev, b->block),
+						b->size / b->bdev->sector_size, b->data);
+	if (r != 0)
+		bflags_set(b, B_DIRTY);
+
+	return r;
+}
+
+static void bcache_wb_end_io(struct blk_bio *bio)
+{
+	struct buffer *b =
+		(struct buffer *)((uint8_t *)bio - offsetof(struct buffer, bio));
+
+	if (bio->status != 0)
+		bflags_set(b, B_DIRTY);
+	bflags_clear(b, B_BUSY);
+
+	__atomic_fetch_sub((uint32_t *)bio->private, 1, __ATOMIC_ACQ_REL);
+}
+
+// writes back dirty buffers of bdev (all devices if NULL) as one plugged
+// batch, so neighbouring buffers go out as merged requests
+static int bcache_flush(struct blkdev *bdev, bool expired_only)
+{
+	uint64_t now = get_ms();
+	struct buffer *list = NULL;
+	uint32_t pending = 0;
+
+	spinlock_acquire(&bcache_lock);
+	for (struct buffer *b = lru_head; b; b = b->lru_next) {
+		if (bdev && b->bdev != bdev)
+			continue;
+		if (!(bflags(b) & B_DIRTY))
+			continue;
+		if (expired_only && now - b->dirtied_ms < BCACHE_WRITEBACK_MS)
+			continue;
+		if (bflags_set(b, B_BUSY) & B_BUSY)
+			continue;
+
+		bflags_clear(b, B_DIRTY);
+		b->refs++;
+		b->wb_next = list;
+		list = b;
+		pending++;
+	}
+	spinlock_release(&bcache_lock);
+
+	if (!list)
+		return 0;
+
+	size_t ndev = blkdev_count();
+	for (size_t i = 0; i < ndev; i++)
+		blk_plug(blkdev_get((int)i));
+
+	for (struct buffer *b = list; b; b = b->wb_next) {
+		memset(&b->bio, 0, sizeof(b->bio));
+		b->bio.op = BLK_OP_WRITE;
+		b->bio.sector = bcache_block_sector(b->bdev, b->block);
+		b->bio.count = b->size / b->bdev->sector_size;
+		b->bio.buf = b->data;
+		b->bio.end_io = bcache_wb_end_io;
+		b->bio.private = &pending;
+		blk_submit_bio(b->bdev, &b->bio);
+	}
+
+	for (size_t i = 0; i < ndev; i++)
+		blk_unplug(blkdev_get((int)i));
+
+	while (__atomic_load_n(&pending, __ATOMIC_ACQUIRE) != 0) {
+		sched_yield();
+		__asm__ volatile("pause" ::: "memory");
+	}
+
+	int r = 0;
+	spinlock_acquire(&bcache_lock);
+	for (struct buffer *b = list; b; b = b->wb_next) {
+		if (b->bio.status != 0 && r == 0)
+			r = b->bio.status;
+		b->refs--;
+	}
+	spinlock_release(&bcache_lock);
+
+	return r;
+}
+
+static void bcache_writeback_expired(void)
+{
+	uint64_t now = get_ms();
+	if (now - __atomic_load_n(&bcache_last_wb_ms, __ATOMIC_RELAXED) <
+		BCACHE_WRITEBACK_MS)
+		return;
+
+	if (__atomic_exchange_n(&bcache_wb_running, true, __ATOMIC_ACQUIRE))
+		return;
+
+	__atomic_store_n(&bcache_last_wb_ms, now, __ATOMIC_RELAXED);
+	bcache_flush(NULL, true);
+	__atomic_store_n(&bcache_wb_running, false, __ATOMIC_RELEASE);
+}
+
+void brelse(struct buffer *b)
+{
+	if (!b)
+		return;
+
+	bflags_clear(b, B_BUSY);
+
+	spinlock_acquire(&bcache_lock);
+	b->refs--;
+	spinlock_release(&bcache_lock);
+
+	bcache_writeback_expired();
+}
+
+// dirty buffers nobody touches again still reach the disk
+static void bcache_flusher(void)
+{
+	for (;;) {
+		sched_sleep_ms(BCACHE_FLUSH_INTERVAL_MS);
+		bcache_writeback_expired();
+	}
+}
+
+void bcache_init(void)
+{
+	pcb *p = proc_create();
+	if (!p) {
+		error("bcache: failed to start the flusher\n");
+		return;
+	}
+
+	p->pm = kernel_pm;
+	p->vctx = kvctx;
+	tcb *t = thread_create(p, bcache_flusher);
+	if (!t) {
+		error("bcache: failed to start the flusher\n");
+		return;
+	}
+	p->name = strdup("bflush");
+}
+
+int bcache_sync(struct blkdev *bdev)
+{
+	int r = bcache_flush(bdev, false);
+
+	if (bdev) {
+		int fr = blk_rw_sync(bdev, BLK_OP_FLUSH, 0, 0, NULL);
+		if (r == 0)
+			r = fr;
+	}
+
+	return r;
+}
+
+void bcache_invalidate(struct blkdev *bdev)
+{
+	spinlock_acquire(&bcache_lock);
+	for (struct buffer *b = lru_head; b; b = b->lru_next) {
+		if (bdev && b->bdev != bdev)
+			continue;
+		if (b->refs || (bflags(b) & (B_BUSY | B_DIRTY)))
+			continue;
+		bflags_clear(b, B_VALID);
+	}
+	spinlock_release(&bcache_lock);
+}
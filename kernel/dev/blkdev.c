@@ -0,0 +1,480 @@
+/*********************************************************************************/
+/* Module Name:  blkdev.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <dev/blkdev.h>
+#include <dev/bcache.h>
+#include <dev/driver.h>
+#include <sys/errno.h>
+#include <sys/sched.h>
+#include <sys/spinlock.h>
+#include <lib/string.h>
+#include <util/kprintf.h>
+#include <debug/log.h>
+
+static spinlock_t blkdev_lock;
+static struct blkdev *blkdevs[BLKDEV_MAX];
+static size_t blkdev_nr = 0;
+
+static int blkdev_dev_read(struct device *dev, void *buf, size_t len,
+						   size_t offset);
+static int blkdev_dev_write(struct device *dev, const void *buf, size_t len,
+							size_t offset);
+static int blkdev_dev_ioctl(struct device *dev, uint64_t cmd, void *arg);
+
+static struct device_ops blkdev_dev_ops = {
+	.open = NULL,
+	.close = NULL,
+	.read = blkdev_dev_read,
+	.write = blkdev_dev_write,
+	.ioctl = blkdev_dev_ioctl,
+	.poll = NULL,
+};
+
+static uint64_t blkdev_size(struct blkdev *bdev)
+{
+	return bdev->sector_count * bdev->sector_size;
+}
+
+int blkdev_register(struct blkdev *bdev)
+{
+	if (!bdev || !bdev->ops || !bdev->ops->submit || !bdev->sector_count)
+		return -EINVAL;
+
+	// buffers are whole pages, sectors must tile them
+	if (bdev->sector_size < 512 || bdev->sector_size > BCACHE_BLOCK_SIZE ||
+		(bdev->sector_size & (bdev->sector_size - 1)) != 0)
+		return -EINVAL;
+
+	spinlock_acquire(&blkdev_lock);
+	if (blkdev_nr >= BLKDEV_MAX) {
+		spinlock_release(&blkdev_lock);
+		return -ENOSPC;
+	}
+	bdev->id = (int)blkdev_nr;
+	blkdevs[blkdev_nr++] = bdev;
+	spinlock_release(&blkdev_lock);
+
+	if (bdev->name[0] == '\0')
+		snprintf(bdev->name, sizeof(bdev->name), "blk%d", bdev->id);
+
+	irqlock_init(&bdev->queue_lock);
+	bdev->queue = NULL;
+	bdev->free_reqs = NULL;
+	bdev->queued = 0;
+	bdev->inflight = 0;
+	bdev->plugged = 0;
+	bdev->dispatching = false;
+	for (size_t i = 0; i < BLKDEV_REQUESTS; i++) {
+		bdev->reqs[i].next = bdev->free_reqs;
+		bdev->free_reqs = &bdev->reqs[i];
+	}
+
+	struct device dev = {
+		.name = bdev->name,
+		.class_name = DEVICE_CLASS_BLOCK,
+		.dev_node_path = bdev->name,
+		.driver_data = bdev,
+		.bound_driver = NULL,
+		.ops = &blkdev_dev_ops,
+		.next = NULL,
+	};
+	if (device_register(&dev) != 0)
+		warn("blkdev: failed to publish /dev/%s\n", bdev->name);
+
+	info("blkdev: %s, %llu sectors of %u bytes\n", bdev->name,
+		 bdev->sector_count, bdev->sector_size);
+
+	return 0;
+}
+
+struct blkdev *blkdev_get(int id)
+{
+	if (id < 0 || (size_t)id >= blkdev_nr)
+		return NULL;
+	return blkdevs[id];
+}
+
+struct blkdev *blkdev_find(const char *name)
+{
+	if (!name)
+		return NULL;
+
+	for (size_t i = 0; i < blkdev_nr; i++) {
+		if (strcmp(blkdevs[i]->name, name) == 0)
+			return blkdevs[i];
+	}
+
+	return NULL;
+}
+
+size_t blkdev_count(void)
+{
+	return blkdev_nr;
+}
+
+static void blk_end_bio(struct blk_bio *bio, int status)
+{
+	bio->status = status;
+	bio->next = NULL;
+	if (bio->end_io)
+		bio->end_io(bio);
+}
+
+// callers hold queue_lock
+static bool blk_try_merge(struct blkdev *bdev, struct blk_bio *bio)
+{
+	if (bio->op == BLK_OP_FLUSH)
+		return false;
+
+	for (struct blk_request *req = bdev->queue; req; req = req->next) {
+		if (req->op != bio->op)
+			continue;
+		if (bdev->max_sectors && req->count + bio->count > bdev->max_sectors)
+			continue;
+		if (bdev->max_segments && req->nr_bios >= bdev->max_segments)
+			continue;
+
+		if (req->sector + req->count == bio->sector) {
+			req->bios_tail->next = bio;
+			req->bios_tail = bio;
+			req->count += bio->count;
+			req->nr_bios++;
+			return true;
+		}
+
+		if (bio->sector + bio->count == req->sector) {
+			bio->next = req->bios;
+			req->bios = bio;
+			req->sector = bio->sector;
+			req->count += bio->count;
+			req->nr_bios++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// callers hold queue_lock, keeps the queue sorted by sector so the driver
+// sees one sweep across the disk
+static void blk_insert(struct blkdev *bdev, struct blk_request *req)
+{
+	struct blk_request **pp = &bdev->queue;
+
+	if (req->op != BLK_OP_FLUSH) {
+		while (*pp && (*pp)->op != BLK_OP_FLUSH && (*pp)->sector <= req->sector)
+			pp = &(*pp)->next;
+	} else {
+		// flushes order everything queued before them
+		while (*pp)
+			pp = &(*pp)->next;
+	}
+
+	req->next = *pp;
+	*pp = req;
+	bdev->queued++;
+}
+
+static void blk_run_queue(struct blkdev *bdev)
+{
+	irqlock_acquire(&bdev->queue_lock);
+	if (bdev->dispatching) {
+		irqlock_release(&bdev->queue_lock);
+		return;
+	}
+	bdev->dispatching = true;
+
+	while (bdev->queue && !bdev->plugged &&
+		   (!bdev->queue_depth || bdev->inflight < bdev->queue_depth)) {
+		struct blk_request *req = bdev->queue;
+		bdev->queue = req->next;
+		bdev->queued--;
+		bdev->inflight++;
+		bdev->stat_requests++;
+		req->next = NULL;
+		uint64_t seen = bdev->completed;
+		irqlock_release(&bdev->queue_lock);
+
+		int r = bdev->ops->submit(bdev, req);
+		if (r == -EBUSY) {
+			irqlock_acquire(&bdev->queue_lock);
+			req->next = bdev->queue;
+			bdev->queue = req;
+			bdev->queued++;
+			bdev->inflight--;
+			bdev->stat_requests--;
+			// a completion since then found us dispatching and left, so
+			// there may be room already. otherwise the next one retries
+			if (bdev->completed == seen)
+				break;
+			continue;
+		}
+		if (r != 0)
+			blk_request_complete(req, r);
+
+		irqlock_acquire(&bdev->queue_lock);
+	}
+
+	bdev->dispatching = false;
+	irqlock_release(&bdev->queue_lock);
+}
+
+void blk_submit_bio(struct blkdev *bdev, struct blk_bio *bio)
+{
+	if (!bdev || !bio)
+		return;
+
+	bio->next = NULL;
+	bio->status = 0;
+
+	if (bio->op != BLK_OP_FLUSH &&
+		(bio->count == 0 || bio->sector >= bdev->sector_count ||
+		 bio->count > bdev->sector_count - bio->sector)) {
+		blk_end_bio(bio, -EIO);
+		return;
+	}
+
+	for (;;) {
+		irqlock_acquire(&bdev->queue_lock);
+		bdev->stat_bios++;
+
+		if (blk_try_merge(bdev, bio)) {
+			bdev->stat_merges++;
+			irqlock_release(&bdev->queue_lock);
+			break;
+		}
+
+		struct blk_request *req = bdev->free_reqs;
+		if (req) {
+			bdev->free_reqs = req->next;
+			memset(req, 0, sizeof(*req));
+			req->bdev = bdev;
+			req->op = bio->op;
+			req->sector = bio->sector;
+			req->count = bio->count;
+			req->bios = bio;
+			req->bios_tail = bio;
+			req->nr_bios = 1;
+			blk_insert(bdev, req);
+			irqlock_release(&bdev->queue_lock);
+			break;
+		}
+
+		// out of requests, get the queue moving and try again
+		bdev->stat_bios--;
+		bool plugged = bdev->plugged != 0;
+		irqlock_release(&bdev->queue_lock);
+
+		if (plugged) {
+			blk_unplug(bdev);
+			blk_plug(bdev);
+		} else {
+			blk_run_queue(bdev);
+		}
+		sched_yield();
+	}
+
+	blk_run_queue(bdev);
+}
+
+void blk_request_complete(struct blk_request *req, int status)
+{
+	if (!req)
+		return;
+
+	struct blkdev *bdev = req->bdev;
+	struct blk_bio *bio = req->bios;
+	while (bio) {
+		struct blk_bio *next = bio->next;
+		blk_end_bio(bio, status);
+		bio = next;
+	}
+
+	irqlock_acquire(&bdev->queue_lock);
+	req->next = bdev->free_reqs;
+	bdev->free_reqs = req;
+	bdev->inflight--;
+	bdev->completed++;
+	irqlock_release(&bdev->queue_lock);
+
+	blk_run_queue(bdev);
+}
+
+void blk_plug(struct blkdev *bdev)
+{
+	if (!bdev)
+		return;
+
+	irqlock_acquire(&bdev->queue_lock);
+	bdev->plugged++;
+	irqlock_release(&bdev->queue_lock);
+}
+
+void blk_unplug(struct blkdev *bdev)
+{
+	if (!bdev)
+		return;
+
+	irqlock_acquire(&bdev->queue_lock);
+	if (bdev->plugged)
+		bdev->plugged--;
+	bool run = bdev->plugged == 0;
+	irqlock_release(&bdev->queue_lock);
+
+	if (run)
+		blk_run_queue(bdev);
+}
+
+void blk_wait(volatile bool *done)
+{
+	while (!__atomic_load_n(done, __ATOMIC_ACQUIRE)) {
+		sched_yield();
+		__asm__ volatile("pause" ::: "memory");
+	}
+}
+
+static void blk_sync_end_io(struct blk_bio *bio)
+{
+	__atomic_store_n((bool *)bio->private, true, __ATOMIC_RELEASE);
+}
+
+int blk_rw_sync(struct blkdev *bdev, int op, uint64_t sector, uint32_t count,
+				void *buf)
+{
+	if (!bdev)
+		return -ENODEV;
+
+	volatile bool done = false;
+	struct blk_bio bio = {
+		.op = op,
+		.sector = sector,
+		.count = count,
+		.buf = buf,
+		.end_io = blk_sync_end_io,
+		.private = (void *)&done,
+	};
+
+	blk_submit_bio(bdev, &bio);
+	blk_wait(&done);
+
+	return bio.status;
+}
+
+static int blkdev_dev_read(struct device *dev, void *buf, size_t len,
+						   size_t offset)
+{
+	struct blkdev *bdev = dev ? dev->driver_data : NULL;
+	if (!bdev || !buf)
+		return -EINVAL;
+
+	uint64_t size = blkdev_size(bdev);
+	if (offset >= size)
+		return 0;
+	if (len > size - offset)
+		len = size - offset;
+
+	size_t done = 0;
+	while (done < len) {
+		uint64_t pos = offset + done;
+		struct buffer *b = bread(bdev, pos / BCACHE_BLOCK_SIZE);
+		if (!b)
+			return done ? (int)done : -EIO;
+
+		size_t off = pos % BCACHE_BLOCK_SIZE;
+		size_t n = b->size - off;
+		if (n > len - done)
+			n = len - done;
+		memcpy((uint8_t *)buf + done, b->data + off, n);
+		brelse(b);
+
+		done += n;
+	}
+
+	return (int)done;
+}
+
+static int blkdev_dev_write(struct device *dev, const void *buf, size_t len,
+							size_t offset)
+{
+	struct blkdev *bdev = dev ? dev->driver_data : NULL;
+	if (!bdev || !buf)
+		return -EINVAL;
+
+	uint64_t size = blkdev_size(bdev);
+	if (offset >= size)
+		return -ENOSPC;
+	if (len > size - offset)
+		len = size - offset;
+
+	size_t done = 0;
+	while (done < len) {
+		uint64_t pos = offset + done;
+		uint64_t block = pos / BCACHE_BLOCK_SIZE;
+		size_t off = pos % BCACHE_BLOCK_SIZE;
+		size_t n = BCACHE_BLOCK_SIZE - off;
+		if (n > len - done)
+			n = len - done;
+
+		// whole buffers are overwritten without reading them first
+		struct buffer *b = NULL;
+		if (off == 0 && n == bcache_block_bytes(bdev, block))
+			b = bget(bdev, block);
+		else
+			b = bread(bdev, block);
+		if (!b)
+			return done ? (int)done : -EIO;
+
+		memcpy(b->data + off, (const uint8_t *)buf + done, n);
+		bdirty(b);
+		brelse(b);
+
+		done += n;
+	}
+
+	return (int)done;
+}
+
+static int blkdev_dev_ioctl(struct device *dev, uint64_t cmd, void *arg)
+{
+	struct blkdev *bdev = dev ? dev->driver_data : NULL;
+	if (!bdev)
+		return -EINVAL;
+
+	// requests come through ioctl() as an int and get sign-extended on
+	// the way here, compare only the low 32 bits
+	switch ((uint32_t)cmd) {
+	case BLKGETSIZE64:
+		if (!arg)
+			return -EFAULT;
+		*(uint64_t *)arg = blkdev_size(bdev);
+		return 0;
+	case BLKSSZGET:
+		if (!arg)
+			return -EFAULT;
+		*(int *)arg = (int)bdev->sector_size;
+		return 0;
+	case BLKFLSBUF: {
+		int r = bcache_sync(bdev);
+		bcache_invalidate(bdev);
+		return r;
+	}
+	default:
+		return -ENOTTY;
+	}
+}
@@ -21,11 +21,15 @@
 #include <dev/builtin/null.h>
 #include <dev/builtin/stdio.h>
 #include <dev/builtin/fb.h>
+#include <dev/builtin/ramblk.h>
+#include <dev/builtin/cpuidle.h>
 
 const struct builtin_dev_entry builtin_dev_list[] = {
 	{ .name = "stdio", .init = stdio_init },
 	{ .name = "null", .init = null_init },
 	{ .name = "fb", .init = fb_init },
+	{ .name = "ramblk", .init = ramblk_init },
+	{ .name = "cpuidle", .init = cpuidle_dev_init },
 };
 
 const size_t builtin_dev_count =
@@ -0,0 +1,101 @@
+/*********************************************************************************/
+/* Module Name:  cpuidle.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <dev/builtin/cpuidle.h>
+#include <dev/driver.h>
+#include <arch/cpu/cpu.h>
+#include <sys/cpuidle.h>
+#include <config.h>
+#include <util/kprintf.h>
+#include <lib/string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// room for one line per CPU
+#define CPUIDLE_LINE_MAX 128
+
+// a text snapshot of per-CPU idle residency, regenerated on every read
+static int cpuidle_read(struct device *dev, void *buf, size_t len,
+						size_t offset)
+{
+	(void)dev;
+
+	char report[CONFIG_CPU_MAX_COUNT * CPUIDLE_LINE_MAX];
+	size_t used = 0;
+
+	for (size_t i = 0; i < cpu_count && used < sizeof(report); i++) {
+		struct cpuidle_stats st;
+		cpuidle_get_stats(&cpuinfo[i], &st);
+
+		int n = snprintf(report + used, sizeof(report) - used,
+						 "cpu%u method=%s residency_ms=%llu entries=%llu "
+						 "kicks=%llu\n",
+						 cpuinfo[i].id, st.mwait ? "mwait" : "hlt",
+						 (unsigned long long)(st.residency_ns / 1000000),
+						 (unsigned long long)st.entries,
+						 (unsigned long long)st.kicks);
+		if (n < 0)
+			break;
+		used += (size_t)n;
+	}
+	if (used > sizeof(report))
+		used = sizeof(report);
+
+	if (offset >= used)
+		return 0;
+	if (len > used - offset)
+		len = used - offset;
+	memcpy(buf, report + offset, len);
+	return (int)len;
+}
+
+static int cpuidle_write(struct device *dev, const void *buf, size_t len,
+						 size_t offset)
+{
+	(void)dev;
+	(void)buf;
+	(void)len;
+	(void)offset;
+
+	return -1;
+}
+
+static struct device_ops cpuidle_ops = {
+	.open = NULL,
+	.close = NULL,
+	.read = cpuidle_read,
+	.write = cpuidle_write,
+	.ioctl = NULL,
+	.poll = NULL,
+};
+
+static struct device cpuidle_dev = {
+	.name = "cpuidle",
+	.class_name = "misc",
+	.dev_node_path = "cpuidle",
+	.driver_data = NULL,
+	.bound_driver = NULL,
+	.ops = &cpuidle_ops,
+	.next = NULL,
+};
+
+void cpuidle_dev_init(void)
+{
+	device_register(&cpuidle_dev);
+}
@@ -0,0 +1,103 @@
+/*********************************************************************************/
+/* Module Name:  ramblk.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <dev/builtin/ramblk.h>
+#include <dev/blkdev.h>
+#include <mm/heap.h>
+#include <mm/pmm.h>
+#include <lib/align.h>
+#include <lib/string.h>
+#include <debug/log.h>
+#include <sys/errno.h>
+#include <aurix.h>
+#include <config.h>
+
+static int ramblk_submit(struct blkdev *bdev, struct blk_request *req)
+{
+	uint8_t *disk = bdev->driver_data;
+
+	if (req->op == BLK_OP_FLUSH) {
+		blk_request_complete(req, 0);
+		return 0;
+	}
+
+	uint64_t sector = req->sector;
+	for (struct blk_bio *bio = req->bios; bio; bio = bio->next) {
+		uint8_t *at = disk + sector * bdev->sector_size;
+		size_t len = (size_t)bio->count * bdev->sector_size;
+
+		if (req->op == BLK_OP_WRITE)
+			memcpy(at, bio->buf, len);
+		else
+			memcpy(bio->buf, at, len);
+
+		sector += bio->count;
+	}
+
+	blk_request_complete(req, 0);
+	return 0;
+}
+
+static const struct blkdev_ops ramblk_ops = {
+	.submit = ramblk_submit,
+};
+
+struct blkdev *ramblk_create(uint64_t sectors, uint32_t sector_size)
+{
+	if (!sectors || !sector_size)
+		return NULL;
+
+	size_t bytes = (size_t)(sectors * sector_size);
+	size_t pages = DIV_ROUND_UP(bytes, PAGE_SIZE);
+
+	struct blkdev *bdev = kmalloc(sizeof(struct blkdev));
+	if (!bdev)
+		return NULL;
+	memset(bdev, 0, sizeof(struct blkdev));
+
+	// palloc hands back zeroed pages
+	uintptr_t phys = (uintptr_t)palloc(pages);
+	if (!phys) {
+		kfree(bdev);
+		return NULL;
+	}
+
+	bdev->sector_size = sector_size;
+	bdev->sector_count = sectors;
+	bdev->ops = &ramblk_ops;
+	bdev->driver_data = (void *)PHYS_TO_VIRT(phys);
+
+	if (blkdev_register(bdev) != 0) {
+		pfree((void *)phys, pages);
+		kfree(bdev);
+		return NULL;
+	}
+
+	return bdev;
+}
+
+void ramblk_init(void)
+{
+	if (CONFIG_RAMBLK_SIZE_KB == 0)
+		return;
+
+	if (!ramblk_create((uint64_t)CONFIG_RAMBLK_SIZE_KB * 1024 / 512, 512))
+		warn("ramblk: failed to create a %u KiB RAM disk\n",
+			 CONFIG_RAMBLK_SIZE_KB);
+}
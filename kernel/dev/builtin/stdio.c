@@ -374,7 +374,7 @@ static bool stdin_fd_nonblocking(void)
 	bool nonblocking = false;
 
 	spinlock_acquire(&proc->fd_lock);
-	struct fileio *f = proc->fds[0];
+	struct fileio *f = fdtable_get(&proc->fdt, 0);
 	if (f && (f->flags & O_NONBLOCK) && (f->flags & SPECIAL_FILE_TYPE_DEVICE)) {
 		struct vnode *vn = (struct vnode *)f->private;
 		struct devfs_node *node =
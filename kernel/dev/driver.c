@@ -98,7 +98,8 @@ static void devfs_publish_device(struct device *dev)
 
 		if (is_last && !ends_with_slash) {
 			// Last token, create device node
-			struct devfs_node *node = devfs_create_fs_node(DEVFS_TYPE_CHAR);
+			struct devfs_node *node = devfs_create_fs_node(
+				device_is_block(dev) ? DEVFS_TYPE_BLOCK : DEVFS_TYPE_CHAR);
 			if (!node) {
 				trace("devfs_publish_device: failed to create node for %s\n",
 					  token);
@@ -278,6 +279,7 @@ int driver_register(struct driver *drv)
 	n->drv.class_name = kstrdup(drv->class_name);
 	n->drv.probe = drv->probe;
 	n->drv.remove = drv->remove;
+	n->drv.bound = drv->bound;
 
 	n->owner_cr3 = read_cr3();
 
@@ -354,6 +356,20 @@ int driver_bind_all(void)
 		}
 		irqlock_release(&dev_lock);
 
+		if (driver_bound && drv->bound) {
+			uint8_t irq_state = save_if();
+			cpu_disable_interrupts();
+
+			uint64_t prev_cr3 = read_cr3();
+			if (d->owner_cr3)
+				write_cr3(d->owner_cr3);
+
+			drv->bound();
+
+			write_cr3(prev_cr3);
+			restore_if(irq_state);
+		}
+
 		if (driver_bound == 0) {
 			warn("driver %s: no devices bound\n", drv->name);
 		}
@@ -370,3 +386,8 @@ int device_get_count(void)
 	irqlock_release(&dev_lock);
 	return count;
 }
+
+bool device_is_block(const struct device *dev)
+{
+	return dev && class_match(dev->class_name, DEVICE_CLASS_BLOCK);
+}
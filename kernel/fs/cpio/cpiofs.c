@@ -0,0 +1,610 @@
+/*********************************************************************************/
+/* Module Name:  cpiofs.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <fs/cpio/cpiofs.h>
+#include <fs/cpio/newc.h>
+#include <mm/heap.h>
+#include <debug/log.h>
+#include <lib/string.h>
+#include <lib/hash.h>
+#include <user/access.h>
+#include <aurix.h>
+#include <stdbool.h>
+
+static struct vnode_ops cpiofs_vnops;
+static struct vfs_ops cpiofs_vfsops;
+
+static struct cpiofs_node *cpiofs_hash_lookup(struct cpiofs *fs, uint64_t hash,
+											  const char *path, size_t len)
+{
+	struct cpiofs_node *node = fs->buckets[hash & (fs->bucket_count - 1)];
+	for (; node != NULL; node = node->hash_next) {
+		if (node->hash == hash && node->path_len == len &&
+			memcmp(node->path, path, len) == 0)
+			return node;
+	}
+	return NULL;
+}
+
+static void cpiofs_rehash(struct cpiofs *fs, size_t bucket_count)
+{
+	struct cpiofs_node **buckets =
+		kmalloc(bucket_count * sizeof(struct cpiofs_node *));
+	if (!buckets)
+		return; // keep the old table, chains just get longer
+
+	memset(buckets, 0, bucket_count * sizeof(struct cpiofs_node *));
+
+	for (size_t i = 0; i < fs->bucket_count; i++) {
+		struct cpiofs_node *node = fs->buckets[i];
+		while (node) {
+			struct cpiofs_node *next = node->hash_next;
+			size_t b = node->hash & (bucket_count - 1);
+			node->hash_next = buckets[b];
+			buckets[b] = node;
+			node = next;
+		}
+	}
+
+	kfree(fs->buckets);
+	fs->buckets = buckets;
+	fs->bucket_count = bucket_count;
+}
+
+static struct cpiofs_node *cpiofs_node_new(struct cpiofs *fs,
+										   struct cpiofs_node *parent,
+										   const char *path, size_t len,
+										   uint64_t hash)
+{
+	struct cpiofs_node *node = kmalloc(sizeof(struct cpiofs_node));
+	if (!node)
+		return NULL;
+
+	memset(node, 0, sizeof(struct cpiofs_node));
+	node->path = path;
+	node->path_len = len;
+	node->hash = hash;
+	node->mode = S_IFDIR | 0755;
+
+	node->name = path;
+	for (size_t i = len; i > 0; i--) {
+		if (path[i - 1] == '/') {
+			node->name = path + i;
+			break;
+		}
+	}
+
+	if (!parent)
+		return node;
+
+	node->parent = parent;
+	node->sibling = parent->child;
+	parent->child = node;
+
+	if (fs->node_count >= fs->bucket_count)
+		cpiofs_rehash(fs, fs->bucket_count * 2);
+
+	size_t b = hash & (fs->bucket_count - 1);
+	node->hash_next = fs->buckets[b];
+	fs->buckets[b] = node;
+	fs->node_count++;
+
+	return node;
+}
+
+static size_t cpiofs_dirname_len(const char *path, size_t len)
+{
+	while (len > 0 && path[len - 1] != '/')
+		len--;
+	return len ? len - 1 : 0;
+}
+
+// directories don't have to precede their contents in an archive
+static struct cpiofs_node *cpiofs_get_dir(struct cpiofs *fs, const char *path,
+										  size_t len)
+{
+	if (len == 0)
+		return fs->root;
+
+	uint64_t hash = hash_fnv1a(path, len);
+	struct cpiofs_node *node = cpiofs_hash_lookup(fs, hash, path, len);
+	if (node)
+		return node;
+
+	struct cpiofs_node *parent =
+		cpiofs_get_dir(fs, path, cpiofs_dirname_len(path, len));
+	if (!parent)
+		return NULL;
+
+	char *copy = kmalloc(len + 1);
+	if (!copy)
+		return NULL;
+	memcpy(copy, path, len);
+	copy[len] = '\0';
+
+	node = cpiofs_node_new(fs, parent, copy, len, hash);
+	if (!node)
+		kfree(copy);
+	return node;
+}
+
+static void cpiofs_node_fill(struct cpiofs_node *node, struct cpio_file *file)
+{
+	node->ino = file->ino;
+	node->mode = (mode_t)file->mode;
+	node->uid = (uid_t)file->uid;
+	node->gid = (gid_t)file->gid;
+	node->mtime = (uint32_t)file->mtime;
+	node->size = file->filesize;
+	node->data = file->data;
+}
+
+static bool cpiofs_owns(struct cpiofs *fs, const void *ptr)
+{
+	return (const uint8_t *)ptr >= (const uint8_t *)fs->archive &&
+		   (const uint8_t *)ptr < (const uint8_t *)fs->archive + fs->archive_size;
+}
+
+static int cpiofs_build_index(struct cpiofs *fs)
+{
+	cpio_reader_t reader = {
+		.start = (uint8_t *)fs->archive,
+		.pos = (uint8_t *)fs->archive,
+		.end = (uint8_t *)fs->archive + fs->archive_size,
+	};
+
+	while (reader.pos < reader.end) {
+		struct cpio_file file;
+		memset(&file, 0, sizeof(struct cpio_file));
+
+		int res = cpio_reader_next(&reader, &file);
+		if (res == 1)
+			break;
+		if (res < 0)
+			return -1;
+
+		const char *path = file.filename;
+		while (path[0] == '.' && path[1] == '/')
+			path += 2;
+		while (path[0] == '/')
+			path++;
+
+		size_t len = strlen(path);
+		if (len == 0 || strcmp(path, ".") == 0) {
+			cpiofs_node_fill(fs->root, &file);
+			fs->root->size = 0;
+			fs->root->data = NULL;
+			continue;
+		}
+
+		uint64_t hash = hash_fnv1a(path, len);
+		struct cpiofs_node *node = cpiofs_hash_lookup(fs, hash, path, len);
+		if (!node) {
+			struct cpiofs_node *parent =
+				cpiofs_get_dir(fs, path, cpiofs_dirname_len(path, len));
+			if (!parent || (parent->mode & S_IFMT) != S_IFDIR) {
+				warn("cpiofs: no directory to put %s in\n", path);
+				continue;
+			}
+
+			node = cpiofs_node_new(fs, parent, path, len, hash);
+			if (!node)
+				return -1;
+		}
+
+		cpiofs_node_fill(node, &file);
+	}
+
+	return 0;
+}
+
+static void cpiofs_free(struct cpiofs *fs)
+{
+	if (!fs)
+		return;
+
+	if (fs->buckets) {
+		for (size_t i = 0; i < fs->bucket_count; i++) {
+			struct cpiofs_node *node = fs->buckets[i];
+			while (node) {
+				struct cpiofs_node *next = node->hash_next;
+				if (!cpiofs_owns(fs, node->path))
+					kfree((void *)node->path);
+				kfree(node);
+				node = next;
+			}
+		}
+		kfree(fs->buckets);
+	}
+
+	if (fs->root)
+		kfree(fs->root);
+	kfree(fs);
+}
+
+struct cpiofs_node *cpiofs_find(struct cpiofs *fs, const char *path)
+{
+	if (!fs || !path)
+		return NULL;
+
+	while (path[0] == '/')
+		path++;
+
+	size_t len = strlen(path);
+	if (len == 0)
+		return fs->root;
+
+	return cpiofs_hash_lookup(fs, hash_fnv1a(path, len), path, len);
+}
+
+static struct cpiofs_node *cpiofs_find_child(struct cpiofs *fs,
+											 struct cpiofs_node *dir,
+											 const char *name)
+{
+	size_t name_len = strlen(name);
+
+	uint64_t hash = dir->hash;
+	if (dir->path_len)
+		hash = hash_fnv1a_continue(hash, "/", 1);
+	hash = hash_fnv1a_continue(hash, name, name_len);
+
+	struct cpiofs_node *node = fs->buckets[hash & (fs->bucket_count - 1)];
+	for (; node != NULL; node = node->hash_next) {
+		if (node->hash == hash && node->parent == dir &&
+			strcmp(node->name, name) == 0)
+			return node;
+	}
+	return NULL;
+}
+
+static enum vnode_type cpiofs_vtype(struct cpiofs_node *node)
+{
+	switch (node->mode & S_IFMT) {
+	case S_IFDIR:
+		return VNODE_DIR;
+	case S_IFLNK:
+		return VNODE_LINK;
+	case S_IFCHR:
+		return VNODE_CHAR;
+	case S_IFBLK:
+		return VNODE_BLOCK;
+	case S_IFIFO:
+		return VNODE_PIPE;
+	case S_IFSOCK:
+		return VNODE_SOCKET;
+	default:
+		return VNODE_REGULAR;
+	}
+}
+
+static struct vnode *cpiofs_make_vnode(struct vfs *vfs,
+									   struct cpiofs_node *node, char *path)
+{
+	struct vnode *vnode = vnode_create(vfs, path, cpiofs_vtype(node), node);
+	if (!vnode)
+		return NULL;
+
+	memcpy(vnode->ops, &cpiofs_vnops, sizeof(struct vnode_ops));
+	vnode->mode = node->mode;
+	vnode->uid = node->uid;
+	vnode->gid = node->gid;
+	return vnode;
+}
+
+static int cpiofs_open(struct vnode **vnode_r, int flags, bool clone,
+					   struct fileio **fio_out)
+{
+	(void)(flags);
+	(void)(clone);
+
+	if (!vnode_r || !*vnode_r || !fio_out || !*fio_out)
+		return -1;
+
+	struct cpiofs_node *node = (*vnode_r)->node_data;
+	if (!node)
+		return -1;
+
+	struct fileio *fio = *fio_out;
+	fio->buf_start = (void *)node->data;
+	fio->size = ((node->mode & S_IFMT) == S_IFDIR) ? 0 : node->size;
+	fio->private = *vnode_r;
+	return 0;
+}
+
+static int cpiofs_close(struct vnode *vnode, int flags, bool clone)
+{
+	(void)(flags);
+	(void)(clone);
+	return vnode ? 0 : -1;
+}
+
+static int cpiofs_read(struct vnode *vn, size_t *bytes, size_t *offset,
+					   void *out)
+{
+	if (!vn || !bytes || !offset)
+		return -1;
+
+	struct cpiofs_node *node = vn->node_data;
+	if (!node || (node->mode & S_IFMT) == S_IFDIR)
+		return -1;
+
+	if (*offset >= node->size) {
+		*bytes = 0;
+		return 0;
+	}
+
+	if (*bytes > node->size - *offset)
+		*bytes = node->size - *offset;
+
+	memcpy(out, (const uint8_t *)node->data + *offset, *bytes);
+	*offset += *bytes;
+	return 0;
+}
+
+static int cpiofs_write(struct vnode *vn, void *buf, size_t *bytes,
+						size_t *offset)
+{
+	(void)(vn);
+	(void)(buf);
+	(void)(bytes);
+	(void)(offset);
+
+	// read-only, writes go to whatever is layered on top of us
+	return -1;
+}
+
+static int cpiofs_ioctl(struct vnode *vnode, int request, void *arg)
+{
+	(void)(vnode);
+	(void)(request);
+	(void)(arg);
+	return -1;
+}
+
+static int cpiofs_lookup(struct vnode *parent, const char *name,
+						 struct vnode **out)
+{
+	if (!parent || !name || !out)
+		return -1;
+
+	struct cpiofs *fs = parent->root_vfs->vfs_data;
+	struct cpiofs_node *dir = parent->node_data;
+	if (!fs || !dir || (dir->mode & S_IFMT) != S_IFDIR)
+		return -1;
+
+	struct cpiofs_node *node = cpiofs_find_child(fs, dir, name);
+	if (!node)
+		return -1;
+
+	size_t parent_len = strlen(parent->path);
+	char *child_path = kmalloc(parent_len + strlen(name) + 2);
+	if (!child_path)
+		return -1;
+	strcpy(child_path, parent->path);
+	if (parent_len == 0 || child_path[parent_len - 1] != '/')
+		strcat(child_path, "/");
+	strcat(child_path, name);
+
+	struct vnode *vnode = cpiofs_make_vnode(parent->root_vfs, node, child_path);
+	kfree(child_path);
+	if (!vnode)
+		return -1;
+
+	*out = vnode;
+	return 0;
+}
+
+static int cpiofs_readdir(struct vnode *vnode, struct dirent *entries,
+						  size_t *count)
+{
+	if (!vnode || !entries || !count)
+		return -1;
+
+	struct cpiofs_node *dir = vnode->node_data;
+	if (!dir || (dir->mode & S_IFMT) != S_IFDIR)
+		return -1;
+
+	size_t idx = 0;
+	for (struct cpiofs_node *child = dir->child; child != NULL && idx < *count;
+		 child = child->sibling) {
+		entries[idx].d_ino = child->ino ? child->ino : (uint64_t)child;
+		entries[idx].d_off = idx + 1;
+		entries[idx].d_reclen = sizeof(struct dirent);
+		entries[idx].d_type = vnode_type_to_dtype(cpiofs_vtype(child));
+
+		strncpy(entries[idx].d_name, child->name,
+				sizeof(entries[idx].d_name) - 1);
+		entries[idx].d_name[sizeof(entries[idx].d_name) - 1] = '\0';
+		idx++;
+	}
+
+	*count = idx;
+	return 0;
+}
+
+static int cpiofs_readlink(struct vnode *vnode, char *buf, size_t size)
+{
+	if (!vnode || !buf || size == 0)
+		return -1;
+
+	struct cpiofs_node *node = vnode->node_data;
+	if (!node || (node->mode & S_IFMT) != S_IFLNK || !node->data)
+		return -1;
+
+	// link targets aren't NUL-terminated in the archive
+	size_t len = node->size < size - 1 ? node->size : size - 1;
+	memcpy(buf, node->data, len);
+	buf[len] = '\0';
+	return 0;
+}
+
+static int cpiofs_getattr(struct vnode *vnode, struct stat *st)
+{
+	if (!vnode || !st)
+		return -1;
+
+	struct cpiofs_node *node = vnode->node_data;
+	if (!node)
+		return -1;
+
+	memset(st, 0, sizeof(struct stat));
+	st->st_dev = vnode->root_vfs ? vnode->root_vfs->fs_type.id : 0;
+	st->st_ino = node->ino ? node->ino : (uint64_t)node;
+	st->st_nlink = 1;
+	st->st_mode = node->mode;
+	st->st_uid = node->uid;
+	st->st_gid = node->gid;
+	st->st_size = node->size;
+	st->st_blksize = 4096;
+	st->st_blocks = (node->size + 4095) / 4096;
+	st->st_atim = st->st_mtim = st->st_ctim = node->mtime;
+	return 0;
+}
+
+static struct vnode_ops cpiofs_vnops = {
+	.open = cpiofs_open,
+	.close = cpiofs_close,
+	.read = cpiofs_read,
+	.write = cpiofs_write,
+	.ioctl = cpiofs_ioctl,
+	.lookup = cpiofs_lookup,
+	.readdir = cpiofs_readdir,
+	.readlink = cpiofs_readlink,
+	.getattr = cpiofs_getattr,
+};
+
+static int cpiofs_vfs_unmount(struct vfs *vfs)
+{
+	if (!vfs)
+		return -1;
+
+	cpiofs_free(vfs->vfs_data);
+	vfs->vfs_data = NULL;
+	return 0;
+}
+
+static int cpiofs_vfs_root(struct vfs *vfs, struct vnode **out)
+{
+	if (!vfs || !out)
+		return -1;
+
+	*out = vfs->root_vnode;
+	vnode_ref(*out);
+	return 0;
+}
+
+static int cpiofs_vfs_statfs(struct vfs *vfs, struct statfs *stat)
+{
+	if (!vfs || !stat)
+		return -1;
+
+	struct cpiofs *fs = vfs->vfs_data;
+	if (!fs)
+		return -1;
+
+	stat->block_size = 1;
+	stat->total_blocks = fs->archive_size;
+	stat->free_blocks = 0;
+	stat->total_nodes = fs->node_count + 1;
+	stat->free_nodes = 0;
+	return 0;
+}
+
+static struct vfs_ops cpiofs_vfsops = {
+	.unmount = cpiofs_vfs_unmount,
+	.root = cpiofs_vfs_root,
+	.statfs = cpiofs_vfs_statfs,
+};
+
+int cpiofs_mount(void *archive, size_t size, char *mount_point,
+				 struct vfs **out)
+{
+	if (!archive || !mount_point || !out)
+		return -1;
+
+	struct cpiofs *fs = kmalloc(sizeof(struct cpiofs));
+	if (!fs)
+		return -1;
+
+	memset(fs, 0, sizeof(struct cpiofs));
+	fs->archive = archive;
+	fs->archive_size = size;
+	fs->bucket_count = CPIOFS_MIN_BUCKETS;
+	fs->buckets = kmalloc(fs->bucket_count * sizeof(struct cpiofs_node *));
+	fs->root = cpiofs_node_new(fs, NULL, "", 0, HASH_FNV1A_INIT);
+	if (!fs->buckets || !fs->root) {
+		cpiofs_free(fs);
+		return -1;
+	}
+	memset(fs->buckets, 0, fs->bucket_count * sizeof(struct cpiofs_node *));
+
+	if (cpiofs_build_index(fs) != 0) {
+		cpiofs_free(fs);
+		return -1;
+	}
+
+	struct vfs_fstype fstype;
+	memset(&fstype, 0, sizeof(struct vfs_fstype));
+	strncpy(fstype.name, "cpiofs", sizeof(fstype.name) - 1);
+
+	struct vfs *vfs = vfs_create_fs(&fstype, fs);
+	if (!vfs) {
+		cpiofs_free(fs);
+		return -1;
+	}
+
+	memcpy(vfs->ops, &cpiofs_vfsops, sizeof(struct vfs_ops));
+
+	vfs->root_vnode = cpiofs_make_vnode(vfs, fs->root, mount_point);
+	if (!vfs->root_vnode) {
+		cpiofs_free(fs);
+		kfree(vfs->ops);
+		kfree(vfs);
+		return -1;
+	}
+
+	debug("cpiofs: indexed %zu entries from a %zu byte archive\n",
+		  fs->node_count, size);
+
+	*out = vfs;
+	return 0;
+}
+
+static int cpiofs_fstype_mount(void *device, char *mount_point,
+							   void *mount_data, struct vfs **out)
+{
+	(void)(mount_data);
+
+	struct cpio_fs *archive = (struct cpio_fs *)device;
+	if (!archive)
+		return -1;
+
+	return cpiofs_mount(archive->archive_data, archive->archive_size,
+						mount_point, out);
+}
+
+static struct vfs_fstype cpiofs_fstype = { .id = 0,
+										   .name = "cpiofs",
+										   .mount = cpiofs_fstype_mount,
+										   .next = NULL };
+
+void cpiofs_init(void)
+{
+	vfs_register_fstype(&cpiofs_fstype);
+}
@@ -30,12 +30,6 @@
 
 #define align4(x) (((x) + 3) & ~3)
 
-typedef struct {
-	uint8_t *start;
-	uint8_t *pos;
-	uint8_t *end;
-} cpio_reader_t;
-
 static uint64_t parse_hex(char *buf, size_t len)
 {
 	char temp[17] = { 0 };
@@ -43,7 +37,7 @@ static uint64_t parse_hex(char *buf, size_t len)
 	return strtoull(temp, NULL, 16);
 }
 
-static int cpio_reader_next(cpio_reader_t *reader, struct cpio_file *file)
+int cpio_reader_next(cpio_reader_t *reader, struct cpio_file *file)
 {
 	if ((size_t)(reader->end - reader->pos) < 110) {
 		warn("cpio: truncated header at 0x%llx (remaining=%zu)\n",
@@ -221,166 +215,6 @@ void cpio_fs_free(struct cpio_fs *fs)
 	fs->file_count = 0;
 }
 
-static const char *normalize_dest(const char *dest)
-{
-	if (strcmp(dest, "/") == 0)
-		return "";
-	return dest;
-}
-
-int cpio_extract(struct cpio_fs *cpio, char *dest_path)
-{
-	if (!cpio || !dest_path) {
-		warn("Missing CPIO archive, or destination path (%p, %p).\n", cpio,
-			 dest_path);
-		return -1;
-	}
-
-	const char *base = normalize_dest(dest_path);
-
-	size_t s = 20;
-	char *path = kmalloc(s);
-	memset(path, 0, s);
-	if ((strlen(dest_path) + 1) > s) {
-		path = krealloc(path, (strlen(dest_path) + 1));
-		s = (strlen(dest_path) + 1);
-	}
-
-	trace("Extracting CPIO to %s\n", dest_path);
-
-	if (strcmp(dest_path, "/") != 0) {
-		vfs_mkdir(dest_path, 0755);
-	}
-
-	for (size_t i = 0; i < cpio->file_count; i++) {
-		memset(path, 0, s);
-		strcat(path, base);
-
-		struct cpio_file *file = &cpio->files[i];
-
-		debug("CPIO path %s\n", file->filename);
-
-		char *fname = file->filename;
-		if (fname[0] == '/')
-			fname++;
-
-		char *name_dup = strdup(fname);
-
-		if (file->namesize + 1 > s) {
-			s = file->namesize + 1;
-			path = krealloc(path, s);
-		}
-
-		char *save;
-		char *dir = strtok_r(name_dup, "/", &save);
-		uint16_t type = file->mode & S_IFMT;
-
-		while (dir) {
-			if (*dir == '\0') {
-				dir = strtok_r(NULL, "/", &save);
-				continue;
-			}
-
-			bool is_last = !(save && *save);
-
-			if (strlen(path) + strlen(dir) + 2 > s) {
-				s = strlen(path) + strlen(dir) + 2;
-				path = krealloc(path, s);
-			}
-
-			strcat(path, "/");
-			strcat(path, dir);
-
-			int flags = V_CREATE;
-			if (!is_last)
-				flags |= V_DIR;
-
-			struct vnode *v;
-			struct fileio *f;
-
-			if (vfs_lookup(path, &v) != 0) {
-				char *dup = strdup(path);
-				if (!is_last || type == S_IFDIR) {
-					if (vfs_mkdir(dup, 0755) != 0)
-						warn("cpio: mkdir failed for %s\n", dup);
-					if (vfs_lookup(dup, &v) != 0) {
-						warn("cpio: lookup failed after mkdir for %s\n", dup);
-						return -1;
-					} else {
-						v->gid = file->gid;
-						v->uid = file->uid;
-						if (v->node_data) {
-							struct ramfs_node *node = v->node_data;
-							node->gid = file->gid;
-							node->uid = file->uid;
-						}
-					}
-				} else if (type == S_IFLNK) {
-					if (!file->data || file->filesize == 0) {
-						warn("cpio: empty symlink target for %s\n", dup);
-						return -1;
-					}
-					char *target = kmalloc(file->filesize + 1);
-					if (!target)
-						return -1;
-					memcpy(target, file->data, file->filesize);
-					target[file->filesize] = '\0';
-					if (vfs_symlink(target, dup) != 0) {
-						kfree(target);
-						warn("cpio: failed to create symlink %s -> %s\n", dup,
-							 target);
-						return -1;
-					}
-					kfree(target);
-					if (vfs_lookup_nofollow(dup, &v) != 0) {
-						warn("cpio: lookup failed after symlink for %s\n", dup);
-						return -1;
-					}
-					v->gid = file->gid;
-					v->uid = file->uid;
-					if (v->node_data) {
-						struct ramfs_node *node = v->node_data;
-						node->gid = file->gid;
-						node->uid = file->uid;
-					}
-				} else if (type == S_IFREG) {
-					if (vfs_create(dup, file->mode) != 0) {
-						warn("cpio: create failed for %s\n", dup);
-					} else {
-						if ((f = open(dup, O_WRONLY, 0)) != NULL) {
-							write(f, file->data, file->filesize);
-							close(f);
-						} else {
-							warn("cpio: open failed for %s\n", dup);
-						}
-						if (vfs_lookup(dup, &v) != 0) {
-							warn("cpio: lookup failed after create for %s\n",
-								 dup);
-							return -1;
-						} else {
-							v->gid = file->gid;
-							v->uid = file->uid;
-							if (v->node_data) {
-								struct ramfs_node *node = v->node_data;
-								node->gid = file->gid;
-								node->uid = file->uid;
-							}
-						}
-					}
-				} else {
-					warn("cpio: unsupported type 0x%x for %s\n", type, dup);
-				}
-			}
-
-			dir = strtok_r(NULL, "/", &save);
-		}
-
-		kfree(name_dup);
-	}
-
-	return 0;
-}
-
 int cpio_ramfs_init(struct cpio_fs *fs, struct ramfs *ramfs)
 {
 	if (!fs || !ramfs) {
@@ -22,6 +22,7 @@
 
 #include <fs/devfs.h>
 #include <dev/device.h>
+#include <dev/blkdev.h>
 #include <mm/heap.h>
 #include <lib/string.h>
 #include <debug/log.h>
@@ -318,9 +319,8 @@ int devfs_refresh(void)
 			}
 
 			if (!found) {
-				// TODO: block dev
-				struct devfs_node *new_node =
-					devfs_create_fs_node(DEVFS_TYPE_CHAR);
+				struct devfs_node *new_node = devfs_create_fs_node(
+					device_is_block(dev) ? DEVFS_TYPE_BLOCK : DEVFS_TYPE_CHAR);
 				if (!new_node) {
 					return -1;
 				}
@@ -563,6 +563,13 @@ static int devfs_getattr(struct vnode *vnode, struct stat *st)
 
 		if (node->type == DEVFS_TYPE_BLOCK) {
 			st->st_mode |= S_IFBLK;
+
+			uint64_t size = 0;
+			if (node->device->ops && node->device->ops->ioctl &&
+				node->device->ops->ioctl(node->device, BLKGETSIZE64, &size) ==
+					0) {
+				st->st_size = (off_t)size;
+			}
 		} else if (node->type == DEVFS_TYPE_CHAR) {
 			st->st_mode |= S_IFCHR;
 		} else {
@@ -749,8 +756,8 @@ static int devfs_fstype_mount(void *device, char *mount_point, void *mount_data,
 			continue;
 		}
 
-		// TODO: add block devices
-		struct devfs_node *devfs_node = devfs_create_fs_node(DEVFS_TYPE_CHAR);
+		struct devfs_node *devfs_node = devfs_create_fs_node(
+			device_is_block(dev) ? DEVFS_TYPE_BLOCK : DEVFS_TYPE_CHAR);
 		devfs_node->name = strdup(dev->dev_node_path);
 		devfs_node->device = dev;
 
@@ -71,10 +71,137 @@ struct ramfs_node *ramfs_create_node(enum ramfs_ftype ftype)
 	case RAMFS_SYMLINK:
 		node->mode = S_IFLNK | 0777;
 		break;
+	case RAMFS_SOCKET:
+		node->mode = S_IFSOCK | 0777;
+		break;
 	}
 
 	return node;
 }
+
+// pull in the lower directory's entries the first time this one is used
+static void ramfs_merge_lower(struct ramfs_node *dir)
+{
+	if (!dir || dir->type != RAMFS_DIRECTORY || !dir->lower ||
+		dir->lower_merged) {
+		return;
+	}
+
+	dir->lower_merged = true;
+
+	struct vnode *lower = dir->lower;
+	if (!lower->ops || !lower->ops->readdir || !lower->ops->lookup) {
+		return;
+	}
+
+	size_t max = 64;
+	size_t count;
+	struct dirent *entries;
+	for (;;) {
+		entries = kmalloc(max * sizeof(struct dirent));
+		if (!entries) {
+			return;
+		}
+
+		count = max;
+		if (lower->ops->readdir(lower, entries, &count) != 0) {
+			kfree(entries);
+			return;
+		}
+
+		if (count < max) {
+			break;
+		}
+
+		kfree(entries);
+		max *= 2;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		const char *name = entries[i].d_name;
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+			continue;
+		}
+
+		bool shadowed = false;
+		for (struct ramfs_node *child = dir->child; child != NULL;
+			 child = child->sibling) {
+			if (strcmp(child->name, name) == 0) {
+				shadowed = true;
+				break;
+			}
+		}
+
+		if (shadowed) {
+			continue;
+		}
+
+		struct vnode *lv;
+		if (lower->ops->lookup(lower, name, &lv) != 0) {
+			continue;
+		}
+
+		enum ramfs_ftype rt;
+		if (lv->vtype == VNODE_DIR) {
+			rt = RAMFS_DIRECTORY;
+		} else if (lv->vtype == VNODE_LINK) {
+			rt = RAMFS_SYMLINK;
+		} else if (lv->vtype == VNODE_REGULAR) {
+			rt = RAMFS_FILE;
+		} else {
+			vnode_unref(lv);
+			continue;
+		}
+
+		struct ramfs_node *node = ramfs_create_node(rt);
+		node->name = strdup(name);
+		node->mode = lv->mode;
+		node->uid = lv->uid;
+		node->gid = lv->gid;
+
+		struct stat st;
+		if (lv->ops->getattr && lv->ops->getattr(lv, &st) == 0) {
+			node->size = st.st_size;
+		}
+
+		node->lower = lv;
+		ramfs_append_child(dir, node);
+	}
+
+	kfree(entries);
+}
+
+// first write to a file that still lives in the lower layer
+static int ramfs_copy_up(struct ramfs_node *node)
+{
+	struct vnode *lower = node->lower;
+	if (!lower) {
+		return 0;
+	}
+
+	void *data = NULL;
+	if (node->size) {
+		data = kmalloc(node->size);
+		if (!data) {
+			return -1;
+		}
+
+		size_t bytes = node->size;
+		size_t offset = 0;
+		if (lower->ops->read(lower, &bytes, &offset, data) != 0 ||
+			bytes != node->size) {
+			kfree(data);
+			return -1;
+		}
+	}
+
+	node->data = data;
+	node->lower = NULL;
+	vnode_unref(lower);
+
+	return 0;
+}
+
 int ramfs_find_node(struct ramfs *ramfs, char *path, struct ramfs_node **out)
 {
 	if (!ramfs || !path || !out) {
@@ -109,6 +236,8 @@ int ramfs_find_node(struct ramfs *ramfs, char *path, struct ramfs_node **out)
 	struct ramfs_node *cur_node = ramfs->root_node;
 
 	while (dir) {
+		ramfs_merge_lower(cur_node);
+
 		struct ramfs_node *child = cur_node->child;
 		struct ramfs_node *match = NULL;
 		while (child) {
@@ -271,7 +400,12 @@ int ramfs_print(struct ramfs_node *node, int lvl)
 		break;
 
 	case RAMFS_SYMLINK:
-		kprintf("  %-20s -> %s", node->name, (char *)node->data);
+		kprintf("  %-20s -> %s", node->name,
+				node->data ? (char *)node->data : "(lower)");
+		break;
+
+	case RAMFS_SOCKET:
+		kprintf("= %-20s", node->name);
 		break;
 	}
 
@@ -301,13 +435,17 @@ size_t ramfs_get_node_size(struct ramfs_node *node)
 		break;
 
 	case RAMFS_DIRECTORY:
+		ramfs_merge_lower(node);
 		for (struct ramfs_node *n = node->child; n != NULL; n = n->sibling) {
 			s += ramfs_get_node_size(n);
 		}
 		break;
 
 	case RAMFS_SYMLINK:
-		s = strlen((char *)node->data) + 1;
+		s = node->data ? strlen((char *)node->data) + 1 : node->size;
+		break;
+
+	case RAMFS_SOCKET:
 		break;
 	}
 
@@ -393,13 +531,17 @@ int ramfs_read(struct vnode *vn, size_t *bytes, size_t *offset, void *out)
 		return 0;
 	}
 
-	memset(out, 0, (*bytes));
-
 	struct ramfs_node *ramfs_node = (struct ramfs_node *)vn->node_data;
 	if (!ramfs_node) {
 		return -1;
 	}
 
+	// not copied up yet, serve it straight from the lower layer
+	if (ramfs_node->lower && ramfs_node->type == RAMFS_FILE) {
+		return ramfs_node->lower->ops->read(ramfs_node->lower, bytes, offset,
+											out);
+	}
+
 	if ((*bytes) > ramfs_node->size) {
 		(*bytes) = ramfs_node->size;
 	} else if ((*offset) >= ramfs_node->size) {
@@ -429,6 +571,10 @@ int ramfs_write(struct vnode *vn, void *buf, size_t *bytes, size_t *offset)
 		return -1;
 	}
 
+	if (ramfs_node->lower && ramfs_copy_up(ramfs_node) != 0) {
+		return -1;
+	}
+
 	if ((*bytes) + (*offset) > ramfs_node->size) {
 		// we need to do some relocation
 		size_t more = ((*bytes) + (*offset)) - ramfs_node->size;
@@ -463,6 +609,101 @@ int ramfs_write(struct vnode *vn, void *buf, size_t *bytes, size_t *offset)
 	return 0;
 }
 
+int ramfs_readv(struct vnode *vn, const struct iovec *iov, size_t iovcnt,
+				size_t *bytes, size_t *offset)
+{
+	if (!vn || !bytes || !offset) {
+		return -1;
+	}
+
+	struct ramfs_node *ramfs_node = (struct ramfs_node *)vn->node_data;
+	if (!ramfs_node) {
+		return -1;
+	}
+
+	*bytes = 0;
+
+	// klog and files still on the lower layer go segment by segment
+	bool special = (vn->path && strcmp(vn->path, "/sys/klog") == 0) ||
+				   (ramfs_node->lower && ramfs_node->type == RAMFS_FILE);
+
+	for (size_t i = 0; i < iovcnt; i++) {
+		if (*offset >= ramfs_node->size && !special)
+			break;
+		if (iov[i].iov_len == 0)
+			continue;
+
+		size_t n = iov[i].iov_len;
+		if (special) {
+			if (ramfs_read(vn, &n, offset, iov[i].iov_base) != 0)
+				break;
+		} else {
+			if (n > ramfs_node->size - *offset)
+				n = ramfs_node->size - *offset;
+			memcpy(iov[i].iov_base, ramfs_node->data + *offset, n);
+			*offset += n;
+		}
+
+		*bytes += n;
+		if (n < iov[i].iov_len)
+			break;
+	}
+
+	return 0;
+}
+
+int ramfs_writev(struct vnode *vn, const struct iovec *iov, size_t iovcnt,
+				 size_t *bytes, size_t *offset)
+{
+	if (!vn || !bytes || !offset) {
+		return -1;
+	}
+
+	struct ramfs_node *ramfs_node = vn->node_data;
+	if (!ramfs_node) {
+		return -1;
+	}
+
+	*bytes = 0;
+
+	// klog keeps its original node in sync, let ramfs_write deal with it
+	if (vn->path && strcmp(vn->path, "/sys/klog") == 0) {
+		for (size_t i = 0; i < iovcnt; i++) {
+			size_t n = iov[i].iov_len;
+			if (n && ramfs_write(vn, iov[i].iov_base, &n, offset) != 0)
+				return *bytes ? 0 : -1;
+			*bytes += n;
+		}
+		return 0;
+	}
+
+	if (ramfs_node->lower && ramfs_copy_up(ramfs_node) != 0) {
+		return -1;
+	}
+
+	size_t total = 0;
+	for (size_t i = 0; i < iovcnt; i++)
+		total += iov[i].iov_len;
+
+	// grow once for the whole vector
+	if (total + (*offset) > ramfs_node->size) {
+		void *new_data = krealloc(ramfs_node->data, total + (*offset));
+		if (!new_data) {
+			return -1;
+		}
+		ramfs_node->data = new_data;
+		ramfs_node->size = total + (*offset);
+	}
+
+	for (size_t i = 0; i < iovcnt; i++) {
+		memcpy(ramfs_node->data + (*offset), iov[i].iov_base, iov[i].iov_len);
+		*offset += iov[i].iov_len;
+	}
+
+	*bytes = total;
+	return 0;
+}
+
 int ramfs_close(struct vnode *vnode, int flags, bool clone)
 {
 	(void)(clone);
@@ -562,6 +803,8 @@ int ramfs_lookup(struct vnode *parent, const char *name, struct vnode **out)
 		return -1;
 	}
 
+	ramfs_merge_lower(parent_node);
+
 	for (struct ramfs_node *child = parent_node->child; child != NULL;
 		 child = child->sibling) {
 		if (strcmp(child->name, name) == 0) {
@@ -579,6 +822,8 @@ int ramfs_lookup(struct vnode *parent, const char *name, struct vnode **out)
 				vtype = VNODE_DIR;
 			else if (child->type == RAMFS_SYMLINK)
 				vtype = VNODE_LINK;
+			else if (child->type == RAMFS_SOCKET)
+				vtype = VNODE_SOCKET;
 
 			struct vnode *child_vnode =
 				vnode_create(parent->root_vfs, child_path, vtype, child);
@@ -622,6 +867,8 @@ int ramfs_readdir(struct vnode *vnode, struct dirent *entries, size_t *count)
 		return -1;
 	}
 
+	ramfs_merge_lower(dir_node);
+
 	size_t idx = 0;
 	size_t max = *count;
 
@@ -635,6 +882,8 @@ int ramfs_readdir(struct vnode *vnode, struct dirent *entries, size_t *count)
 			entries[idx].d_type = DT_DIR;
 		} else if (child->type == RAMFS_SYMLINK) {
 			entries[idx].d_type = DT_LNK;
+		} else if (child->type == RAMFS_SOCKET) {
+			entries[idx].d_type = DT_SOCK;
 		} else {
 			entries[idx].d_type = DT_REG;
 		}
@@ -666,6 +915,10 @@ int ramfs_readlink(struct vnode *vnode, char *buf, size_t size)
 	}
 
 	if (!link_node->data) {
+		if (link_node->lower && link_node->lower->ops->readlink) {
+			return link_node->lower->ops->readlink(link_node->lower, buf,
+												   size);
+		}
 		return -1;
 	}
 
@@ -704,6 +957,8 @@ int ramfs_mkdir(struct vnode *parent, const char *name, int mode)
 		return -1;
 	}
 
+	ramfs_merge_lower(parent_node);
+
 	for (struct ramfs_node *child = parent_node->child; child != NULL;
 		 child = child->sibling) {
 		if (strcmp(child->name, name) == 0) {
@@ -744,6 +999,8 @@ int ramfs_rmdir(struct vnode *parent, const char *name)
 		return -1;
 	}
 
+	ramfs_merge_lower(parent_node);
+
 	struct ramfs_node **prev = &parent_node->child;
 	for (struct ramfs_node *child = parent_node->child; child != NULL;
 		 prev = &child->sibling, child = child->sibling) {
@@ -752,11 +1009,14 @@ int ramfs_rmdir(struct vnode *parent, const char *name)
 				return -1;
 			}
 
+			ramfs_merge_lower(child);
 			if (child->child != NULL) {
 				return -1;
 			}
 
 			*prev = child->sibling;
+			if (child->lower)
+				vnode_unref(child->lower);
 			kfree(child->name);
 			kfree(child);
 			return 0;
@@ -791,6 +1051,8 @@ int ramfs_create(struct vnode *parent, const char *name, mode_t mode,
 		return -1;
 	}
 
+	ramfs_merge_lower(parent_node);
+
 	for (struct ramfs_node *child = parent_node->child; child != NULL;
 		 child = child->sibling) {
 		if (strcmp(child->name, name) == 0) {
@@ -798,13 +1060,19 @@ int ramfs_create(struct vnode *parent, const char *name, mode_t mode,
 		}
 	}
 
+	// sockets only ever get created by bind()
 	enum ramfs_ftype rt = RAMFS_FILE;
+	enum vnode_type vtype = VNODE_REGULAR;
+	if ((mode & S_IFMT) == S_IFSOCK) {
+		rt = RAMFS_SOCKET;
+		vtype = VNODE_SOCKET;
+	}
 
 	struct ramfs_node *new_file = ramfs_create_node(rt);
 	new_file->name = strdup(name);
 	new_file->size = 0;
 	new_file->data = NULL;
-	new_file->mode = S_IFREG | mode;
+	new_file->mode = (rt == RAMFS_SOCKET ? S_IFSOCK : S_IFREG) | (mode & 07777);
 	ramfs_current_creds(&new_file->uid, &new_file->gid);
 
 	ramfs_append_child(parent_node, new_file);
@@ -819,7 +1087,7 @@ int ramfs_create(struct vnode *parent, const char *name, mode_t mode,
 	strcat(file_path, name);
 
 	struct vnode *file_vnode =
-		vnode_create(parent->root_vfs, file_path, VNODE_REGULAR, new_file);
+		vnode_create(parent->root_vfs, file_path, vtype, new_file);
 	memcpy(file_vnode->ops, parent->ops, sizeof(struct vnode_ops));
 	file_vnode->mode = new_file->mode;
 	file_vnode->uid = new_file->uid;
@@ -853,6 +1121,8 @@ int ramfs_remove(struct vnode *parent, const char *name)
 		return -1;
 	}
 
+	ramfs_merge_lower(parent_node);
+
 	struct ramfs_node **prev = &parent_node->child;
 	for (struct ramfs_node *child = parent_node->child; child != NULL;
 		 prev = &child->sibling, child = child->sibling) {
@@ -865,6 +1135,8 @@ int ramfs_remove(struct vnode *parent, const char *name)
 			kfree(child->name);
 			if (child->data)
 				kfree(child->data);
+			if (child->lower)
+				vnode_unref(child->lower);
 			kfree(child);
 			return 0;
 		}
@@ -897,6 +1169,8 @@ int ramfs_symlink(struct vnode *parent, const char *name, const char *target)
 		return -1;
 	}
 
+	ramfs_merge_lower(parent_node);
+
 	for (struct ramfs_node *child = parent_node->child; child != NULL;
 		 child = child->sibling) {
 		if (strcmp(child->name, name) == 0) {
@@ -970,6 +1244,8 @@ struct vnode_ops ramfs_vnops = {
 	.close = ramfs_close,
 	.read = ramfs_read,
 	.write = ramfs_write,
+	.readv = ramfs_readv,
+	.writev = ramfs_writev,
 	.ioctl = ramfs_ioctl,
 	.lookup = ramfs_lookup,
 	.readdir = ramfs_readdir,
@@ -1076,6 +1352,11 @@ static int ramfs_fstype_mount(void *device, char *mount_point, void *mount_data,
 		ramfs->root_node->gid = 0;
 	}
 
+	if (ramfs->lower && !ramfs->root_node->lower) {
+		vnode_ref(ramfs->lower);
+		ramfs->root_node->lower = ramfs->lower;
+	}
+
 	struct vfs_fstype fstype;
 	memset(&fstype, 0, sizeof(struct vfs_fstype));
 	strncpy(fstype.name, "ramfs", sizeof(fstype.name) - 1);
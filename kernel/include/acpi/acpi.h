@@ -73,7 +73,9 @@ struct xsdt {
 	uint64_t sdt_ptr[];
 } __attribute__((packed));
 
+#ifdef __KERNEL__
 bool acpi_init(void *rsdp_addr);
 void *find_sdt(char *sig);
+#endif // __KERNEL__
 
 #endif /* _ACPI_ACPI_H */
\ No newline at end of file
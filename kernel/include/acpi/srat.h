@@ -0,0 +1,87 @@
+/*********************************************************************************/
+/* Module Name:  srat.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _ACPI_SRAT_H
+#define _ACPI_SRAT_H
+
+#include <acpi/acpi.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define SRAT_LAPIC 0x00
+#define SRAT_MEMORY 0x01
+#define SRAT_X2APIC 0x02
+
+#define SRAT_ENABLED 1
+
+// proximity domains get renumbered into 0..SRAT_MAX_NODES-1
+#define SRAT_MAX_NODES 8
+#define SRAT_MAX_CPUS 256
+#define SRAT_MAX_RANGES 32
+
+struct srat {
+	struct sdt_header hdr;
+	uint32_t reserved0;
+	uint64_t reserved1;
+	uint8_t structures[];
+} __attribute__((packed));
+
+struct srat_header {
+	uint8_t type;
+	uint8_t len;
+} __attribute__((packed));
+
+struct srat_lapic {
+	struct srat_header hdr;
+	uint8_t domain_lo;
+	uint8_t apic_id;
+	uint32_t flags;
+	uint8_t sapic_eid;
+	uint8_t domain_hi[3];
+	uint32_t clock_domain;
+} __attribute__((packed));
+
+struct srat_memory {
+	struct srat_header hdr;
+	uint32_t domain;
+	uint16_t reserved0;
+	uint64_t base;
+	uint64_t len;
+	uint32_t reserved1;
+	uint32_t flags;
+	uint64_t reserved2;
+} __attribute__((packed));
+
+struct srat_x2apic {
+	struct srat_header hdr;
+	uint16_t reserved0;
+	uint32_t domain;
+	uint32_t x2apic_id;
+	uint32_t flags;
+	uint32_t clock_domain;
+	uint32_t reserved1;
+} __attribute__((packed));
+
+void acpi_srat_init(void);
+// without an SRAT everything is node 0
+uint32_t srat_node_count(void);
+uint32_t srat_apic_node(uint32_t apic_id);
+uint32_t srat_addr_node(uint64_t phys);
+
+#endif /* _ACPI_SRAT_H */
@@ -39,9 +39,22 @@ enum apic_regs {
 	APIC_DEST_FORMAT = 0xE0,
 	APIC_SPURIOUS_IVR = 0xF0,
 
-	APIC_ERROR_STATUS = 0x280
+	APIC_ERROR_STATUS = 0x280,
+
+	APIC_ICR_LOW = 0x300,
+	APIC_ICR_HIGH = 0x310,
+	APIC_LVT_TIMER = 0x320,
+	APIC_TIMER_INITIAL = 0x380,
+	APIC_TIMER_CURRENT = 0x390,
+	APIC_TIMER_DIVIDE = 0x3E0
 };
 
+#define APIC_LVT_MASKED (1u << 16)
+#define APIC_LVT_TIMER_PERIODIC (1u << 17)
+
+#define APIC_ICR_ALL_INCL_SELF (2u << 18)
+#define APIC_ICR_PENDING (1u << 12)
+
 enum ioapic_regs { IOAPICID = 0, IOAPICVER = 1, IOAPICARB = 2 };
 
 #define IOAPICREDTBLL(n) (0x10 + 2 * (n))
@@ -100,7 +113,14 @@ void lapic_write(uint16_t reg, uint32_t val);
 void apic_init();
 void apic_cpu_init(uint8_t cpu_id);
 
+uint32_t lapic_timer_calibrate(void);
+void lapic_timer_start_periodic(uint8_t vector, uint32_t hz);
+void lapic_timer_stop(void);
+
+void lapic_ipi_all(uint8_t vector);
+
 void ioapic_write_red(uint32_t gsi, uint8_t vec, uint8_t delivery_mode,
-					  uint8_t polarity, uint8_t trigger_mode, uint8_t lapic_id);
+					  uint8_t polarity, uint8_t trigger_mode, uint8_t dest_mode,
+					  uint8_t dest);
 
 #endif /* _ARCH_APIC_APIC_H */
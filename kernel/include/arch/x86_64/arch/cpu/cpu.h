@@ -145,6 +145,14 @@ struct cpuid {
 struct tcb; // forward declare becuz stupid errors with including sched.h
 struct cpu {
 	uint32_t id;
+	uint32_t lapic_id;
+
+	// from CPUID 0xB/0x1F, SMT siblings share package and core
+	uint32_t package;
+	uint32_t core;
+	uint32_t smt;
+	// memory node, from the SRAT
+	uint32_t node;
 
 	struct cpuid cpuid;
 	char vendor_str[13];
@@ -154,6 +162,8 @@ struct cpu {
 	uint64_t thread_count;
 
 	irqlock_t sched_lock;
+
+	int64_t tsc_offset;
 };
 
 extern struct cpu cpuinfo[];
@@ -204,6 +214,29 @@ static inline void cpuid(uint32_t reg, uint32_t *eax, uint32_t *ebx,
 					 : "memory");
 }
 
+static inline void cpuid_count(uint32_t reg, uint32_t sub, uint32_t *eax,
+							   uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+	__asm__ volatile("cpuid"
+					 : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+					 : "0"(reg), "2"(sub)
+					 : "memory");
+}
+
+static inline uint64_t xgetbv(uint32_t reg)
+{
+	uint32_t lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(reg));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void xsetbv(uint32_t reg, uint64_t val)
+{
+	uint32_t lo = val & 0xFFFFFFFF;
+	uint32_t hi = val >> 32;
+	__asm__ volatile("xsetbv" ::"c"(reg), "a"(lo), "d"(hi));
+}
+
 static inline uint64_t read_cr0()
 {
 	uint64_t val;
@@ -324,6 +357,22 @@ static inline uint64_t rdmsr(uint64_t msr)
 	return ((uint64_t)hi << 32) | lo;
 }
 
+static inline uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+	__asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t rdtscp(uint32_t *aux)
+{
+	uint32_t lo, hi, c;
+	__asm__ volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(c));
+	if (aux)
+		*aux = c;
+	return ((uint64_t)hi << 32) | lo;
+}
+
 ////
 // Spinlock util
 ////
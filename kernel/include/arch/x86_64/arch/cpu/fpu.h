@@ -0,0 +1,44 @@
+/*********************************************************************************/
+/* Module Name:  fpu.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _ARCH_CPU_FPU_H
+#define _ARCH_CPU_FPU_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct kthread;
+
+void fpu_init(void);
+
+void *fpu_state_alloc(void);
+void fpu_state_free(void *state);
+void fpu_state_reset(void *state);
+void fpu_state_copy(void *dst, const void *src);
+
+void fpu_save(void *state);
+void fpu_restore(void *state);
+void fpu_switch(struct kthread *prev, struct kthread *next);
+
+// the kernel is built without SIMD, code that wants it anyway has to bracket
+// its use so the current thread's registers survive
+uint8_t fpu_kernel_begin(void);
+void fpu_kernel_end(uint8_t irq_state);
+
+#endif // _ARCH_CPU_FPU_H
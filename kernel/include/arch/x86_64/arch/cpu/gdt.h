@@ -48,6 +48,11 @@ struct tss {
 	uint16_t iopb_offset;
 } __attribute__((packed));
 
+// IST slot for double faults, a kernel stack overflow has no stack left to
+// report itself on
+#define GDT_IST_DF 1
+#define GDT_IST_STACK_SIZE (16 * 1024)
+
 extern struct tss gdt_tss[];
 
 void gdt_init(void);
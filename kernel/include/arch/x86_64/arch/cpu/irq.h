@@ -25,6 +25,12 @@
 
 #include <stdint.h>
 
+#define IRQ_ISA_LINES 16
+#define IRQ_MAX_LINES 24
+// vectors 0x20-0x7f, the ones past the IOAPIC lines are handed out to
+// message-signalled interrupts
+#define IRQ_MAX_VECTORS 96
+
 typedef void (*irq_callback)(void *);
 
 struct irq_handler {
@@ -35,6 +41,9 @@ struct irq_handler {
 void irq_install(uint8_t vec, irq_callback callback, void *ctx);
 void irq_uninstall(uint8_t vec);
 
+int irq_alloc(irq_callback callback, void *ctx);
+int irq_msi_message(uint8_t irq, uint32_t cpu, uint64_t *addr, uint32_t *data);
+
 void irq_dispatch(uint8_t irq);
 
 #endif /* _ARCH_CPU_IRQ_H */
\ No newline at end of file
@@ -27,11 +27,17 @@
 
 #define TRAMP_BASE_ADDR 0x8000
 
-#define TRAMP_DATA_OFF 0x0F00
+#define TRAMP_DATA_OFF 0x0800
 #define TRAMP_PML4 (TRAMP_DATA_OFF + 0x00)
 #define TRAMP_ENTRY (TRAMP_DATA_OFF + 0x08)
-#define TRAMP_CPU (TRAMP_DATA_OFF + 0x10)
-#define TRAMP_STACK (TRAMP_DATA_OFF + 0x18)
+#define TRAMP_NEXT (TRAMP_DATA_OFF + 0x10)
+#define TRAMP_SLOTS (TRAMP_DATA_OFF + 0x18)
+#define TRAMP_STACKS (TRAMP_DATA_OFF + 0x20)
+
+// one stack pointer per AP slot, the rest of the page is ours
+#define TRAMP_MAX_SLOTS ((0x1000 - TRAMP_STACKS) / 8)
+
+#define SMP_AP_STACK_SIZE (16 * 1024)
 
 void smp_init(void);
 
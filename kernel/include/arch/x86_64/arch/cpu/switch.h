@@ -30,6 +30,11 @@ struct kthread {
 	uint64_t rsp0;
 	uint64_t rsp;
 	uint64_t fs_base;
+	// XSAVE/FXSAVE area, NULL for threads that never touch the FPU
+	void *fpu;
+	// set while some CPU runs on this stack, switch_task() clears it once
+	// it has moved off
+	volatile uint64_t on_cpu;
 };
 
 extern void switch_task(struct kthread *prev, struct kthread *next);
@@ -0,0 +1,38 @@
+/*********************************************************************************/
+/* Module Name:  tsc.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _ARCH_TIME_TSC_H
+#define _ARCH_TIME_TSC_H
+
+#include <stdint.h>
+
+#define TSC_CALIBRATE_MS 10
+#define TSC_CALIBRATE_ROUNDS 3
+
+int tsc_init(void);
+void tsc_sync_cpu(void);
+
+int tsc_is_available(void);
+uint64_t tsc_get_hz(void);
+
+uint64_t tsc_read(void);
+uint64_t tsc_to_ns(uint64_t ticks);
+uint64_t tsc_from_ns(uint64_t ns);
+
+#endif /* _ARCH_TIME_TSC_H */
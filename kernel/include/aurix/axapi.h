@@ -23,6 +23,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+struct blkdev;
+struct blk_request;
 struct chrdev_ops;
 struct device;
 struct driver;
@@ -38,6 +40,10 @@ struct axapi_import {
 	uintptr_t *target;
 } __attribute__((packed));
 
+// make_child_ex() flags
+// run at nice 10, for pollers that shouldn't compete with real work
+#define AX_CHILD_BACKGROUND (1ULL << 0)
+
 #ifdef __KERNEL__
 #define AXAPI_SYM(ret, name, args) ret name args;
 #else
@@ -1,6 +1,8 @@
+#define CONFIG_BCACHE_MAX_BUFFERS 1024
 #define CONFIG_CPU_MAX_COUNT 4
 #define CONFIG_IRQ_MAX_CALLBACKS 4
 #define CONFIG_IOAPIC_MAX_COUNT 4
 #define CONFIG_KSH 1
 #define CONFIG_MPANIC_DUMP 1
 #define CONFIG_PCI_MAX_DEVICES 32
+#define CONFIG_RAMBLK_SIZE_KB 4096
@@ -0,0 +1,72 @@
+/*********************************************************************************/
+/* Module Name:  bcache.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _DEV_BCACHE_H
+#define _DEV_BCACHE_H
+
+#include <dev/blkdev.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BCACHE_BLOCK_SIZE 4096
+#define BCACHE_HASH_SIZE 256
+#define BCACHE_WRITEBACK_MS 5000
+// how often the flusher thread looks for expired dirty buffers
+#define BCACHE_FLUSH_INTERVAL_MS 1000
+
+#define B_VALID (1 << 0)
+#define B_DIRTY (1 << 1)
+#define B_BUSY (1 << 2)
+
+// one page worth of a block device, filesystems read through these
+struct buffer {
+	struct blkdev *bdev;
+	uint64_t block;
+	uint32_t size;
+	uint8_t *data;
+
+	uint32_t flags;
+	uint32_t refs;
+	uint64_t dirtied_ms;
+
+	struct blk_bio bio;
+
+	struct buffer *hash_next;
+	struct buffer *wb_next;
+	struct buffer *lru_prev;
+	struct buffer *lru_next;
+};
+
+// bread() and bget() hand the buffer out B_BUSY, nobody else touches its data
+// (writeback included) until brelse()
+struct buffer *bread(struct blkdev *bdev, uint64_t block);
+struct buffer *bget(struct blkdev *bdev, uint64_t block);
+void bdirty(struct buffer *b);
+int bwrite(struct buffer *b);
+void brelse(struct buffer *b);
+
+size_t bcache_block_bytes(struct blkdev *bdev, uint64_t block);
+
+void bcache_init(void);
+int bcache_sync(struct blkdev *bdev);
+void bcache_invalidate(struct blkdev *bdev);
+
+#endif /* _DEV_BCACHE_H */
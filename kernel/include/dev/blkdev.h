@@ -0,0 +1,136 @@
+/*********************************************************************************/
+/* Module Name:  blkdev.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _DEV_BLKDEV_H
+#define _DEV_BLKDEV_H
+
+#include <dev/device.h>
+#include <arch/sys/irqlock.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLKDEV_MAX 16
+#define BLKDEV_NAME_MAX 16
+#define BLKDEV_REQUESTS 64
+
+#define BLK_OP_READ 0
+#define BLK_OP_WRITE 1
+#define BLK_OP_FLUSH 2
+
+// Linux-compatible ioctls on /dev/blkN
+#define BLKFLSBUF 0x1261
+#define BLKSSZGET 0x1268
+#define BLKGETSIZE64 0x80081272
+
+struct blkdev;
+struct blk_bio;
+struct blk_request;
+
+typedef void (*blk_end_io_fn)(struct blk_bio *bio);
+
+// one contiguous transfer as issued by a caller
+struct blk_bio {
+	int op;
+	uint64_t sector;
+	uint32_t count;
+	void *buf;
+
+	int status;
+	blk_end_io_fn end_io;
+	void *private;
+
+	struct blk_bio *next;
+};
+
+// one or more sector-adjacent bios handed to the driver as a unit
+struct blk_request {
+	struct blkdev *bdev;
+	int op;
+	uint64_t sector;
+	uint32_t count;
+
+	struct blk_bio *bios;
+	struct blk_bio *bios_tail;
+	uint32_t nr_bios;
+
+	void *driver_private;
+	struct blk_request *next;
+};
+
+struct blkdev_ops {
+	// start the transfer, blk_request_complete() is called once it's done
+	// (possibly before submit returns, possibly from an interrupt). -EBUSY
+	// means the driver is full, the request is retried after a completion
+	int (*submit)(struct blkdev *bdev, struct blk_request *req);
+};
+
+struct blkdev {
+	char name[BLKDEV_NAME_MAX];
+	int id;
+
+	uint32_t sector_size;
+	uint64_t sector_count;
+
+	// per-request transfer and bio limits and how many requests the driver
+	// takes at once, 0 means unlimited
+	uint32_t max_sectors;
+	uint32_t max_segments;
+	uint32_t queue_depth;
+
+	const struct blkdev_ops *ops;
+	void *driver_data;
+
+	irqlock_t queue_lock;
+	struct blk_request *queue;
+	struct blk_request *free_reqs;
+	uint32_t queued;
+	uint32_t inflight;
+	uint32_t plugged;
+	bool dispatching;
+	uint64_t completed;
+
+	// completions may run in interrupt context, so requests never come from
+	// the heap
+	struct blk_request reqs[BLKDEV_REQUESTS];
+
+	uint64_t stat_bios;
+	uint64_t stat_merges;
+	uint64_t stat_requests;
+};
+
+#ifdef __KERNEL__
+int blkdev_register(struct blkdev *bdev);
+struct blkdev *blkdev_get(int id);
+struct blkdev *blkdev_find(const char *name);
+size_t blkdev_count(void);
+
+void blk_submit_bio(struct blkdev *bdev, struct blk_bio *bio);
+void blk_request_complete(struct blk_request *req, int status);
+
+void blk_plug(struct blkdev *bdev);
+void blk_unplug(struct blkdev *bdev);
+
+int blk_rw_sync(struct blkdev *bdev, int op, uint64_t sector, uint32_t count,
+				void *buf);
+void blk_wait(volatile bool *done);
+#endif // __KERNEL__
+
+#endif /* _DEV_BLKDEV_H */
@@ -20,9 +20,12 @@
 #ifndef _DEV_DEVICE_H
 #define _DEV_DEVICE_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+#define DEVICE_CLASS_BLOCK "block"
+
 struct driver;
 struct device;
 
@@ -51,6 +54,7 @@ struct device {
 };
 
 int device_get_count(void);
+bool device_is_block(const struct device *dev);
 
 #define MAX_DEVICES 128
 extern struct device *device_list[MAX_DEVICES];
@@ -26,12 +26,16 @@
 
 typedef int (*driver_probe_fn)(struct device *dev);
 typedef void (*driver_remove_fn)(struct device *dev);
+typedef void (*driver_bound_fn)(void);
 
 struct driver {
 	const char *name;
 	const char *class_name;
 	driver_probe_fn probe;
 	driver_remove_fn remove;
+	// optional, runs after a bind pass that bound something, once the
+	// device list is unlocked again (probe can't register devices itself)
+	driver_bound_fn bound;
 };
 
 void driver_core_init(struct devfs *fs);
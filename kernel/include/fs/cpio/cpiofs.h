@@ -0,0 +1,70 @@
+/*********************************************************************************/
+/* Module Name:  cpiofs.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _FS_CPIO_CPIOFS_H
+#define _FS_CPIO_CPIOFS_H
+
+#include <vfs/vfs.h>
+#include <sys/types.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CPIOFS_MIN_BUCKETS 64
+
+struct cpiofs_node {
+	const char *path; // relative to the archive root, no leading '/'
+	const char *name; // last component of path
+	size_t path_len;
+	uint64_t hash;
+
+	uint64_t ino;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+	uint32_t mtime;
+
+	size_t size;
+	const void *data; // points straight into the archive
+
+	struct cpiofs_node *parent;
+	struct cpiofs_node *child;
+	struct cpiofs_node *sibling;
+	struct cpiofs_node *hash_next;
+};
+
+struct cpiofs {
+	void *archive;
+	size_t archive_size;
+
+	struct cpiofs_node *root;
+
+	struct cpiofs_node **buckets;
+	size_t bucket_count;
+	size_t node_count;
+};
+
+void cpiofs_init(void);
+
+// mounts an in-memory newc archive without copying any file data
+int cpiofs_mount(void *archive, size_t size, char *mount_point,
+				 struct vfs **out);
+
+struct cpiofs_node *cpiofs_find(struct cpiofs *fs, const char *path);
+
+#endif /* _FS_CPIO_CPIOFS_H */
@@ -46,6 +46,12 @@ struct cpio_file {
 	void *data;
 };
 
+typedef struct {
+	uint8_t *start;
+	uint8_t *pos;
+	uint8_t *end;
+} cpio_reader_t;
+
 struct cpio_fs {
 	struct cpio_file *files;
 	size_t file_count;
@@ -53,13 +59,15 @@ struct cpio_fs {
 	size_t archive_size;
 };
 
+// @returns 0 for an entry, 1 at the trailer and -1 on a malformed archive
+int cpio_reader_next(cpio_reader_t *reader, struct cpio_file *file);
+
 int cpio_fs_parse(struct cpio_fs *fs, void *data, size_t size);
 size_t cpio_fs_read(struct cpio_fs *fs, const char *filename, void *buffer,
 					size_t bufsize);
 void cpio_fs_free(struct cpio_fs *fs);
 struct cpio_file *cpio_fs_get_file(struct cpio_fs *fs, const char *filename);
 
-int cpio_extract(struct cpio_fs *cpio, char *dest_path);
 int cpio_ramfs_init(struct cpio_fs *fs, struct ramfs *ramfs);
 
 #endif // _FS_CPIO_NEWC_H
\ No newline at end of file
@@ -32,6 +32,7 @@ enum ramfs_ftype {
 	RAMFS_FILE,
 	RAMFS_DIRECTORY,
 	RAMFS_SYMLINK,
+	RAMFS_SOCKET,
 };
 
 struct ramfs_node {
@@ -46,11 +47,18 @@ struct ramfs_node {
 
 	struct ramfs_node *sibling;
 	struct ramfs_node *child;
+
+	// read-only node this one shadows, data is only copied up on write
+	struct vnode *lower;
+	bool lower_merged;
 };
 
 struct ramfs {
 	struct ramfs_node *root_node;
 	size_t ramfs_size;
+
+	// optional read-only filesystem layered underneath (e.g. the initrd)
+	struct vnode *lower;
 };
 
 struct ramfs *ramfs_create_fs();
@@ -71,6 +79,10 @@ int ramfs_open(struct vnode **vnode_r, int flags, bool clone,
 int ramfs_close(struct vnode *vnode, int flags, bool clone);
 int ramfs_read(struct vnode *vn, size_t *bytes, size_t *offset, void *out);
 int ramfs_write(struct vnode *vn, void *buf, size_t *bytes, size_t *offset);
+int ramfs_readv(struct vnode *vn, const struct iovec *iov, size_t iovcnt,
+				size_t *bytes, size_t *offset);
+int ramfs_writev(struct vnode *vn, const struct iovec *iov, size_t iovcnt,
+				 size_t *bytes, size_t *offset);
 int ramfs_ioctl(struct vnode *vnode, int request, void *arg);
 int ramfs_lookup(struct vnode *parent, const char *name, struct vnode **out);
 int ramfs_readdir(struct vnode *vnode, struct dirent *entries, size_t *count);
@@ -22,15 +22,31 @@
 
 #include <vfs/fileio.h>
 #include <sys/spinlock.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
-#define PIPE_BUFFER_SIZE 4096
+// default capacity, in pages
+#define PIPE_DEF_PAGES 16
+// largest capacity F_SETPIPE_SZ will accept
+#define PIPE_MAX_SIZE (4 * 1024 * 1024)
+
+// one page worth of queued data, the page may be shared with other pipes
+// after a splice or tee
+struct pipe_buf {
+	uintptr_t page;
+	uint32_t off;
+	uint32_t len;
+};
 
 struct pipe {
-	uint8_t buffer[PIPE_BUFFER_SIZE];
-	size_t read_pos;
-	size_t write_pos;
+	struct pipe_buf *bufs;
+	size_t nbufs;
+	// free-running slot indices, masked with nbufs - 1
+	size_t head;
+	size_t tail;
 	size_t used;
 
 	int readers;
@@ -42,6 +58,20 @@ struct pipe {
 int pipe(struct fileio *fds[2]);
 int pipe_read(struct fileio *fio, void *buf, size_t *size);
 int pipe_write(struct fileio *fio, const void *buf, size_t *size);
+int pipe_readv(struct fileio *fio, const struct iovec *iov, size_t iovcnt,
+			   size_t *size);
+int pipe_writev(struct fileio *fio, const struct iovec *iov, size_t iovcnt,
+				size_t *size);
 int pipe_close(struct fileio *fio);
+short pipe_poll(struct fileio *fio, short events);
+int pipe_resize(struct fileio *fio, size_t size);
+size_t pipe_capacity(struct fileio *fio);
+
+ssize_t pipe_splice(struct fileio *rd, struct fileio *wr, size_t len,
+					bool nonblock, bool peek);
+ssize_t pipe_fill(struct fileio *wr, struct vnode *vn, size_t *offset,
+				  size_t len, bool nonblock);
+ssize_t pipe_drain(struct fileio *rd, struct vnode *vn, size_t *offset,
+				   size_t len, bool nonblock);
 
 #endif /* _IPC_PIPE_H */
\ No newline at end of file
@@ -0,0 +1,39 @@
+/*********************************************************************************/
+/* Module Name:  splice.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _IPC_SPLICE_H
+#define _IPC_SPLICE_H
+
+#include <vfs/fileio.h>
+#include <sys/types.h>
+#include <stddef.h>
+
+#define SPLICE_F_MOVE 0x01
+#define SPLICE_F_NONBLOCK 0x02
+#define SPLICE_F_MORE 0x04
+#define SPLICE_F_GIFT 0x08
+
+ssize_t splice(struct fileio *in, size_t *in_off, struct fileio *out,
+			   size_t *out_off, size_t len, unsigned int flags);
+ssize_t tee(struct fileio *in, struct fileio *out, size_t len,
+			unsigned int flags);
+ssize_t sendfile(struct fileio *out, struct fileio *in, size_t *offset,
+				 size_t count);
+
+#endif /* _IPC_SPLICE_H */
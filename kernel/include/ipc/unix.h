@@ -0,0 +1,171 @@
+/*********************************************************************************/
+/* Module Name:  unix.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _IPC_UNIX_H
+#define _IPC_UNIX_H
+
+#include <vfs/fileio.h>
+#include <sys/spinlock.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AF_UNSPEC 0
+#define AF_UNIX 1
+#define AF_LOCAL AF_UNIX
+
+#define SOCK_STREAM 1
+#define SOCK_DGRAM 2
+#define SOCK_SEQPACKET 5
+#define SOCK_TYPE_MASK 0xf
+#define SOCK_NONBLOCK O_NONBLOCK
+#define SOCK_CLOEXEC O_CLOEXEC
+
+#define SOL_SOCKET 1
+#define SCM_RIGHTS 0x01
+
+#define MSG_PEEK 0x02
+#define MSG_CTRUNC 0x08
+#define MSG_TRUNC 0x20
+#define MSG_DONTWAIT 0x40
+#define MSG_NOSIGNAL 0x4000
+#define MSG_CMSG_CLOEXEC 0x40000000
+
+#define SHUT_RD 0
+#define SHUT_WR 1
+#define SHUT_RDWR 2
+
+#define UNIX_PATH_MAX 108
+
+// bytes a socket may have queued for reading before writers block
+#define UNIX_RCVBUF (16 * 4096)
+// a single message may carry at most this many descriptors
+#define UNIX_MAX_RIGHTS 64
+
+typedef uint32_t socklen_t;
+typedef uint16_t sa_family_t;
+
+struct sockaddr {
+	sa_family_t sa_family;
+	char sa_data[14];
+};
+
+struct sockaddr_un {
+	sa_family_t sun_family;
+	char sun_path[UNIX_PATH_MAX];
+};
+
+struct msghdr {
+	void *msg_name;
+	socklen_t msg_namelen;
+	struct iovec *msg_iov;
+	size_t msg_iovlen;
+	void *msg_control;
+	size_t msg_controllen;
+	int msg_flags;
+};
+
+struct cmsghdr {
+	size_t cmsg_len;
+	int cmsg_level;
+	int cmsg_type;
+};
+
+#define CMSG_ALIGN(len) (((len) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1))
+#define CMSG_SPACE(len) (CMSG_ALIGN(sizeof(struct cmsghdr)) + CMSG_ALIGN(len))
+#define CMSG_LEN(len) (CMSG_ALIGN(sizeof(struct cmsghdr)) + (len))
+#define CMSG_DATA(cmsg) \
+	((unsigned char *)(cmsg) + CMSG_ALIGN(sizeof(struct cmsghdr)))
+
+#define UNIX_FILE (1 << 22)
+
+enum unix_state {
+	UNIX_UNCONNECTED,
+	UNIX_LISTENING,
+	UNIX_CONNECTED,
+	UNIX_CLOSED,
+};
+
+// one queued write; stream data is packed into page-sized chunks, datagrams
+// get one message each
+struct unix_msg {
+	struct unix_msg *next;
+	size_t len;
+	size_t off;
+	size_t cap;
+
+	struct fileio **rights;
+	int nrights;
+
+	uint8_t data[];
+};
+
+struct unix_sock {
+	int type;
+	enum unix_state state;
+	atomic_uint refs;
+
+	// stream: the other end, dgram: the default destination
+	struct unix_sock *peer;
+	// nothing more arrives once the rx queue drains
+	bool rx_eof;
+	bool shut_rd;
+	bool shut_wr;
+
+	bool bound;
+	char path[UNIX_PATH_MAX];
+	struct unix_sock *bind_next;
+
+	// connections waiting for accept(), already paired with their client
+	struct unix_sock *pending;
+	struct unix_sock *pending_tail;
+	struct unix_sock *pending_next;
+	int backlog;
+	int backlog_max;
+
+	spinlock_t lock;
+	struct unix_msg *rx_head;
+	struct unix_msg *rx_tail;
+	size_t rx_bytes;
+};
+
+int unix_socket(int type, struct fileio **out);
+int unix_socketpair(int type, struct fileio *fds[2]);
+
+int unix_bind(struct fileio *fio, const char *path);
+int unix_listen(struct fileio *fio, int backlog);
+int unix_accept(struct fileio *fio, struct fileio **out);
+int unix_connect(struct fileio *fio, const char *path);
+int unix_shutdown(struct fileio *fio, int how);
+int unix_getname(struct fileio *fio, bool peer, char *path);
+
+ssize_t unix_sendmsg(struct fileio *fio, const struct iovec *iov, size_t iovcnt,
+					 struct fileio **rights, int nrights, const char *dest,
+					 int flags);
+ssize_t unix_recvmsg(struct fileio *fio, const struct iovec *iov, size_t iovcnt,
+					 struct fileio **rights, int *nrights, int flags,
+					 int *msg_flags);
+
+short unix_poll(struct fileio *fio, short events);
+int unix_close(struct fileio *fio);
+
+#endif /* _IPC_UNIX_H */
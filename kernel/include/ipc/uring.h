@@ -0,0 +1,177 @@
+/*********************************************************************************/
+/* Module Name:  uring.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _IPC_URING_H
+#define _IPC_URING_H
+
+#include <vfs/fileio.h>
+#include <sys/sched.h>
+#include <sys/spinlock.h>
+#include <sys/types.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define URING_FILE (1 << 23)
+
+#define URING_MAX_ENTRIES 4096
+
+// setup flags, a polling worker picks up SQEs without uring_enter()
+#define URING_SETUP_SQPOLL (1 << 0)
+
+// enter flags
+#define URING_ENTER_GETEVENTS (1 << 0)
+
+// sq_flags, an idle SQPOLL worker went to sleep until the next uring_enter()
+#define URING_SQ_NEED_WAKEUP (1 << 0)
+// how long an SQPOLL worker keeps polling an empty ring before it sleeps
+#define URING_SQPOLL_IDLE_MS 100
+
+// sqe->off value meaning "use and advance the file offset"
+#define URING_OFF_CURRENT ((uint64_t)-1)
+
+enum uring_op {
+	URING_OP_NOP = 0,
+	URING_OP_READ = 1,
+	URING_OP_WRITE = 2,
+	URING_OP_READV = 3,
+	URING_OP_WRITEV = 4,
+	URING_OP_OPENAT = 5,
+	URING_OP_CLOSE = 6,
+	URING_OP_POLL = 7,
+	URING_OP_MAX,
+};
+
+// one request, userspace fills these in the shared SQE array. addr/len are a
+// buffer for READ/WRITE, an iovec array for READV/WRITEV and the path for
+// OPENAT. op_flags carries the open flags or the poll events
+struct uring_sqe {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t resv;
+	int32_t fd;
+	uint64_t off;
+	uint64_t addr;
+	uint32_t len;
+	uint32_t op_flags;
+	uint64_t user_data;
+	uint32_t mode;
+	uint32_t pad[5];
+};
+
+// res is what the equivalent syscall would have returned
+struct uring_cqe {
+	uint64_t user_data;
+	int32_t res;
+	uint32_t flags;
+};
+
+// byte offsets into the mapping, relative to its start
+struct uring_sq_offsets {
+	uint32_t head;
+	uint32_t tail;
+	uint32_t mask;
+	uint32_t entries;
+	uint32_t dropped;
+	uint32_t sqes;
+	uint32_t flags;
+};
+
+struct uring_cq_offsets {
+	uint32_t head;
+	uint32_t tail;
+	uint32_t mask;
+	uint32_t entries;
+	uint32_t overflow;
+	uint32_t cqes;
+};
+
+struct uring_params {
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+	uint32_t flags;
+	// bytes to mmap() at offset 0 of the ring fd
+	uint32_t size;
+	struct uring_sq_offsets sq_off;
+	struct uring_cq_offsets cq_off;
+};
+
+// head of the shared mapping. userspace owns sq_tail and cq_head, the kernel
+// owns the rest
+struct uring_ctl {
+	uint32_t sq_head;
+	uint32_t sq_tail;
+	uint32_t sq_mask;
+	uint32_t sq_entries;
+	uint32_t sq_dropped;
+	uint32_t cq_head;
+	uint32_t cq_tail;
+	uint32_t cq_mask;
+	uint32_t cq_entries;
+	uint32_t cq_overflow;
+	uint32_t sq_flags;
+};
+
+struct pcb;
+struct tcb;
+struct uring_poll;
+
+struct uring {
+	struct pcb *proc;
+	struct tcb *worker;
+	uint32_t worker_tid;
+	atomic_bool worker_live;
+	atomic_bool stop;
+	uint32_t flags;
+
+	uintptr_t phys;
+	size_t pages;
+	struct uring_ctl *ctl;
+	struct uring_sqe *sqes;
+	struct uring_cqe *cqes;
+
+	// private copies, userspace can scribble over the shared ones
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+	uint32_t sq_head;
+	uint32_t cq_tail;
+	// SQEs handed over by uring_enter() and not yet picked up
+	atomic_uint sq_submit;
+
+	// poll requests still waiting for their events
+	struct uring_poll *polls;
+	// the worker sleeps here while there's nothing to do, and
+	// uring_enter() here until enough completions are posted
+	struct waitq worker_wq;
+	struct waitq cq_wq;
+
+	spinlock_t lock;
+	struct uring *next;
+};
+
+int uring_setup(struct pcb *proc, uint32_t entries, struct uring_params *p,
+				struct fileio **out);
+int uring_enter(struct fileio *fio, uint32_t to_submit, uint32_t min_complete,
+				uint32_t flags);
+int uring_mmap(struct fileio *fio, struct pcb *proc, size_t offset,
+			   size_t pages, uint64_t vflags, void **out);
+int uring_close(struct fileio *fio);
+
+#endif /* _IPC_URING_H */
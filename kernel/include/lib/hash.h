@@ -0,0 +1,55 @@
+/*********************************************************************************/
+/* Module Name:  hash.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _LIB_HASH_H
+#define _LIB_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HASH_FNV1A_INIT 0xcbf29ce484222325ULL
+#define HASH_FNV1A_PRIME 0x100000001b3ULL
+
+static inline uint64_t hash_fnv1a_continue(uint64_t hash, const void *data,
+										   size_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= HASH_FNV1A_PRIME;
+	}
+	return hash;
+}
+
+static inline uint64_t hash_fnv1a(const void *data, size_t len)
+{
+	return hash_fnv1a_continue(HASH_FNV1A_INIT, data, len);
+}
+
+static inline uint64_t hash_fnv1a_str(const char *str)
+{
+	uint64_t hash = HASH_FNV1A_INIT;
+	while (*str) {
+		hash ^= (uint8_t)*str++;
+		hash *= HASH_FNV1A_PRIME;
+	}
+	return hash;
+}
+
+#endif /* _LIB_HASH_H */
@@ -0,0 +1,70 @@
+/*********************************************************************************/
+/* Module Name:  idr.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _LIB_IDR_H
+#define _LIB_IDR_H
+
+#include <sys/spinlock.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// integer IDs mapped straight to pointers through a two level table. leaves
+// are allocated on first use and never freed, so idr_find() needs no lock
+#define IDR_LEAF_BITS 8
+#define IDR_LEAF_SIZE (1u << IDR_LEAF_BITS)
+#define IDR_LEAF_MASK (IDR_LEAF_SIZE - 1)
+#define IDR_MAX_ID 65536u
+#define IDR_LEAVES (IDR_MAX_ID / IDR_LEAF_SIZE)
+
+#define IDR_NONE UINT32_MAX
+
+struct idr_leaf {
+	void *slots[IDR_LEAF_SIZE];
+	uint64_t used[IDR_LEAF_SIZE / 64];
+	uint32_t count;
+};
+
+struct idr {
+	struct idr_leaf *leaves[IDR_LEAVES];
+	// one bit per leaf with no free IDs left
+	uint64_t full[IDR_LEAVES / 64];
+	// IDs are handed out cyclically so a freed one isn't reused right away
+	uint32_t next;
+	spinlock_t lock;
+};
+
+uint32_t idr_alloc(struct idr *idr, void *ptr);
+bool idr_reserve(struct idr *idr, uint32_t id);
+void idr_remove(struct idr *idr, uint32_t id);
+void idr_replace(struct idr *idr, uint32_t id, void *ptr);
+
+static inline void *idr_find(struct idr *idr, uint32_t id)
+{
+	if (id >= IDR_MAX_ID)
+		return NULL;
+
+	struct idr_leaf *leaf =
+		__atomic_load_n(&idr->leaves[id >> IDR_LEAF_BITS], __ATOMIC_ACQUIRE);
+	if (!leaf)
+		return NULL;
+	return __atomic_load_n(&leaf->slots[id & IDR_LEAF_MASK], __ATOMIC_ACQUIRE);
+}
+
+#endif /* _LIB_IDR_H */
@@ -187,6 +187,7 @@ typedef struct {
 #define SHT_STRTAB 3
 #define SHT_RELA 4
 #define SHT_DYNSYM 11
+#define SHT_GNU_HASH 0x6ffffff6
 
 ///
 // Symbol Table
@@ -214,7 +215,9 @@ typedef struct {
 #define DT_NULL 0
 #define DT_NEEDED 1
 #define DT_STRTAB 5
+#define DT_SYMTAB 6
 #define DT_STRSZ 10
+#define DT_GNU_HASH 0x6ffffef5
 
 typedef struct {
 	Elf64_Addr r_offset;
@@ -263,6 +266,9 @@ typedef struct {
 } elf_loaded_image_t;
 
 bool elf_get_load_range(char *data, uintptr_t *link_base_out, size_t *size_out);
+bool elf_build_image(char *data, elf_loaded_image_t *out);
+bool elf_map_image_shared(char *data, pagetable *pagemap,
+						  const elf_loaded_image_t *img);
 bool elf_load_image_at(char *data, pagetable *pagemap, uintptr_t load_base,
 					   elf_loaded_image_t *out, bool user_mode,
 					   bool apply_relocs);
@@ -272,6 +278,7 @@ bool elf_load_image_mapped(char *data, pagetable *pagemap, uintptr_t load_base,
 						   bool user_mode, bool apply_relocs);
 
 uintptr_t elf_lookup_symbol(char *elf_data, const char *symbol_name);
+const Elf64_Sym *elf_gnu_lookup(char *elf_data, const char *symbol_name);
 bool elf_lookup_addr(char *elf_data, uintptr_t addr, const char **name_out,
 					 uintptr_t *sym_addr_out);
 
@@ -281,5 +288,10 @@ bool elf_load_user_process(char *data, const char *path, struct pcb *proc,
 						   const char *const *argv, size_t argv_count,
 						   const char *const *envp, size_t envp_count,
 						   uintptr_t *entry_out);
+bool elf_load_user_shared(char *data, const elf_loaded_image_t *img,
+						  const char *path, struct pcb *proc,
+						  const char *const *argv, size_t argv_count,
+						  const char *const *envp, size_t envp_count,
+						  uintptr_t *entry_out);
 
 #endif /* _LOADER_ELF_H */
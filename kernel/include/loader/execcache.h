@@ -0,0 +1,56 @@
+/*********************************************************************************/
+/* Module Name:  execcache.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _LOADER_EXECCACHE_H
+#define _LOADER_EXECCACHE_H
+
+#include <loader/elf.h>
+#include <vfs/vfs.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EXECCACHE_MAX_ENTRIES 16
+#define EXECCACHE_MAX_PAGES 4096
+
+// a file loaded for exec, plus its laid out and relocated ELF image when it
+// has one. the image pages are mapped into every process running the file.
+struct exec_image {
+	uint64_t dev;
+	uint64_t ino;
+	size_t size;
+
+	char *data;
+
+	bool has_image;
+	bool cached;
+	elf_loaded_image_t img;
+
+	uint32_t refs;
+	struct exec_image *next;
+};
+
+int execcache_get(const char *path, struct exec_image **out);
+void execcache_put(struct exec_image *ent);
+
+void execcache_invalidate(struct vnode *vnode);
+void execcache_flush(void);
+
+#endif /* _LOADER_EXECCACHE_H */
@@ -0,0 +1,38 @@
+/*********************************************************************************/
+/* Module Name:  boottime.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _SYS_BOOTTIME_H
+#define _SYS_BOOTTIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BOOTTIME_MAX_PHASES 48
+#define BOOTTIME_NAME_MAX 24
+
+struct aurix_parameters;
+
+void boottime_import(const struct aurix_parameters *params);
+void boottime_mark(const char *phase);
+
+size_t boottime_format(char *buf, size_t size);
+void boottime_print(void);
+void boottime_publish(void);
+
+#endif /* _SYS_BOOTTIME_H */
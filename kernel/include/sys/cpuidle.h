@@ -0,0 +1,43 @@
+/*********************************************************************************/
+/* Module Name:  cpuidle.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _SYS_CPUIDLE_H
+#define _SYS_CPUIDLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct cpu;
+
+struct cpuidle_stats {
+	bool mwait;
+	// time actually spent halted or in MWAIT
+	uint64_t residency_ns;
+	uint64_t entries;
+	// remote wakeups done with a store instead of an IPI
+	uint64_t kicks;
+};
+
+void cpuidle_init(struct cpu *cpu);
+void cpuidle_enter(struct cpu *cpu);
+void cpuidle_wake(struct cpu *cpu);
+bool cpuidle_kick(struct cpu *cpu);
+void cpuidle_get_stats(const struct cpu *cpu, struct cpuidle_stats *out);
+
+#endif /* _SYS_CPUIDLE_H */
@@ -0,0 +1,65 @@
+/*********************************************************************************/
+/* Module Name:  fdtable.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _SYS_FDTABLE_H
+#define _SYS_FDTABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+struct fileio;
+
+// slots a table starts with, it doubles from there up to PROC_MAX_FDS
+#define FDTABLE_MIN_SIZE 64
+
+// a process' open files. the bitmaps mirror which slots are taken and which
+// close on exec, so lookups for a free or a CLOEXEC slot scan 64 at a time.
+// callers serialize through the owner's fd_lock
+struct fdtable {
+	struct fileio **files;
+	uint64_t *open;
+	uint64_t *cloexec;
+	uint32_t size;
+};
+
+int fdtable_init(struct fdtable *t);
+void fdtable_destroy(struct fdtable *t);
+
+int fdtable_alloc(struct fdtable *t, struct fileio *f, int start, bool cloexec);
+int fdtable_install(struct fdtable *t, int fd, struct fileio *f, bool cloexec,
+					struct fileio **old);
+struct fileio *fdtable_remove(struct fdtable *t, int fd);
+
+bool fdtable_cloexec(const struct fdtable *t, int fd);
+void fdtable_set_cloexec(struct fdtable *t, int fd, bool on);
+
+int fdtable_next(const struct fdtable *t, int fd);
+int fdtable_next_cloexec(const struct fdtable *t, int fd);
+
+int fdtable_copy(struct fdtable *dst, const struct fdtable *src);
+
+static inline struct fileio *fdtable_get(const struct fdtable *t, int fd)
+{
+	if (fd < 0 || (uint32_t)fd >= t->size)
+		return NULL;
+	return t->files[fd];
+}
+
+#endif /* _SYS_FDTABLE_H */
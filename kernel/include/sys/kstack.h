@@ -0,0 +1,40 @@
+/*********************************************************************************/
+/* Module Name:  kstack.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _SYS_KSTACK_H
+#define _SYS_KSTACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// unmapped pages below every kernel stack
+#define KSTACK_GUARD_PAGES 1
+// stacks each CPU keeps around for the next thread_create()
+#define KSTACK_CACHE_SIZE 8
+
+// both work on the lowest usable address, stacks come back zeroed
+void *kstack_alloc(void);
+void kstack_free(void *base);
+
+size_t kstack_high_water(const void *base);
+size_t kstack_peak(void);
+bool kstack_is_guard(uintptr_t addr);
+
+#endif /* _SYS_KSTACK_H */
@@ -0,0 +1,45 @@
+/*********************************************************************************/
+/* Module Name:  prof.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _SYS_PROF_H
+#define _SYS_PROF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROF_VECTOR 0xf0
+
+#define PROF_DEFAULT_HZ 997
+#define PROF_MAX_DEPTH 8
+#define PROF_SAMPLES_PER_CPU 4096
+
+struct interrupt_frame;
+
+int prof_start(uint32_t hz);
+void prof_stop(void);
+bool prof_is_running(void);
+
+void prof_tick(const struct interrupt_frame *frame);
+
+size_t prof_sample_count(void);
+int prof_report(size_t top);
+int prof_dump(const char *path);
+
+#endif /* _SYS_PROF_H */
@@ -29,6 +29,8 @@
 #include <mm/vmm.h>
 #include <stdatomic.h>
 #include <sys/spinlock.h>
+#include <sys/fdtable.h>
+#include <arch/sys/irqlock.h>
 
 #define STACK_SIZE 4096 * 8
 #define USER_STACK_SIZE (1024 * 1024)
@@ -39,7 +41,40 @@ struct tcb;
 #define TCB_MAGIC_ALIVE 0x544352414C495645ULL
 #define TCB_MAGIC_DEAD 0x544352444541444ULL
 
-#define PROC_MAX_FDS 256
+#define PROC_MAX_FDS 65536
+
+// scheduling classes. SCHED_OTHER threads share the CPU by nice-weighted
+// runtime, FIFO and RR ones always run ahead of them by rt_priority
+#define SCHED_OTHER 0
+#define SCHED_FIFO 1
+#define SCHED_RR 2
+
+#define SCHED_NICE_MIN -20
+#define SCHED_NICE_MAX 19
+#define SCHED_RT_PRIO_MIN 1
+#define SCHED_RT_PRIO_MAX 99
+
+struct sched_param {
+	int sched_priority;
+};
+
+// setpriority() targets, only whole processes so far
+#define PRIO_PROCESS 0
+
+// bit n set: the thread may run on the CPU with id n
+#define SCHED_CPU_MASK_ALL UINT64_MAX
+
+// per-CPU counters since boot, busy/idle split by what was on the CPU
+struct sched_cpu_stats {
+	uint64_t busy_ns;
+	uint64_t idle_ns;
+	uint64_t migrations_in;
+	uint64_t migrations_out;
+};
+
+// waitpid() options
+#define WNOHANG 1
+#define WUNTRACED 2
 
 struct fileio;
 
@@ -50,6 +85,18 @@ typedef struct tcb {
 
 	uint32_t time_slice;
 
+	int policy;
+	int nice;
+	int rt_priority;
+	uint32_t weight;
+	// runtime scaled by weight, the fair class runs the smallest first
+	uint64_t vruntime;
+	// ticks spent on a CPU
+	uint64_t runtime;
+	// where the balancer may move it, and when it last left a CPU
+	uint64_t cpu_mask;
+	uint64_t last_ran;
+
 	struct pcb *process;
 	struct cpu *cpu;
 
@@ -64,8 +111,21 @@ typedef struct tcb {
 
 	atomic_bool kill_pending;
 	int kill_code;
+
+	// sleeping on a wait queue, see waitq_prepare()
+	struct tcb *wait_next;
+	bool wait_queued;
+	atomic_bool waiting;
+	// off the run queue until sched_wake()
+	bool blocked;
 } tcb;
 
+// threads sleeping until some condition changes, woken all at once
+struct waitq {
+	irqlock_t lock;
+	struct tcb *head;
+};
+
 typedef struct pcb {
 	uint32_t pid;
 	pagetable *pm;
@@ -74,7 +134,7 @@ typedef struct pcb {
 	struct pcb *proc_next;
 	spinlock_t fd_lock;
 	spinlock_t thread_lock;
-	struct fileio *fds[PROC_MAX_FDS];
+	struct fdtable fdt;
 	const char *name;
 	char *cwd;
 	mode_t umask;
@@ -83,6 +143,16 @@ typedef struct pcb {
 	uid_t euid;
 	gid_t egid;
 	uint32_t parent_pid;
+	uint32_t pgid;
+	// live children and exited ones waiting to be reaped, both linked
+	// through sibling_next under the process tree lock
+	struct pcb *parent;
+	struct pcb *children;
+	struct pcb *zombies;
+	struct pcb *sibling_next;
+	struct pcb **sibling_pprev;
+	bool zombie;
+	struct waitq child_waitq;
 	int exit_code;
 	bool exited;
 	char *image_elf;
@@ -112,6 +182,8 @@ void proc_destroy(pcb *proc);
 bool proc_has_threads(uint32_t pid);
 pcb *proc_get_by_pid(uint32_t pid);
 int proc_kill(pcb *proc, int code);
+void proc_adopt(pcb *parent, pcb *child);
+int proc_wait_child(pcb *parent, int pid, int options, int *exit_code);
 
 tcb *thread_create(pcb *proc, void (*entry)(void));
 tcb *thread_create_user(pcb *proc, void (*entry)(void));
@@ -119,8 +191,27 @@ tcb *thread_clone_user(pcb *proc, tcb *parent);
 void thread_enqueue(tcb *thread);
 void thread_destroy(tcb *thread);
 void thread_exit(tcb *thread, int code);
+int thread_kill(pcb *proc, tcb *thread, int code);
 tcb *thread_current(void);
 tcb *thread_get_by_tid(uint32_t tid);
 int thread_wait(tcb *thread);
 
+void waitq_init(struct waitq *wq);
+void waitq_prepare(struct waitq *wq);
+void waitq_finish(struct waitq *wq);
+void waitq_wake_all(struct waitq *wq);
+void sched_block(void);
+void sched_wake(tcb *thread);
+void sched_sleep_ms(uint64_t ms);
+void sched_preempt(void);
+
+int sched_set_nice(tcb *thread, int nice);
+int sched_set_policy(tcb *thread, int policy, int rt_priority);
+uint64_t sched_runtime_ms(const tcb *thread);
+uint64_t sched_min_vruntime(const struct cpu *cpu);
+void sched_get_cpu_stats(const struct cpu *cpu, struct sched_cpu_stats *out);
+uint64_t sched_online_mask(void);
+int sched_set_affinity(tcb *thread, uint64_t mask);
+void sched_leave_if_misplaced(void);
+
 #endif // SYS_SCHED_H
\ No newline at end of file
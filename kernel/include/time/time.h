@@ -57,7 +57,11 @@ uint8_t time_get_month(void);
 uint16_t time_get_year(void);
 uint8_t time_get_weekday(void);
 
+void time_clocksource_init(void);
+
+uint64_t time_ns(void);
 uint64_t get_ms(void);
+void sleep_ns(uint64_t ns);
 void sleep_ms(uint64_t ms);
 
 #endif /* _TIME_TIME_H */
\ No newline at end of file
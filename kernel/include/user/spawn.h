@@ -0,0 +1,50 @@
+/*********************************************************************************/
+/* Module Name:  spawn.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _USER_SPAWN_H
+#define _USER_SPAWN_H
+
+#include <stdint.h>
+
+// file actions run against the child's copy of the fd table, in order,
+// before the image is loaded (posix_spawn_file_actions_*)
+#define SPAWN_MAX_ACTIONS 64
+
+enum spawn_op {
+	SPAWN_OPEN = 1,
+	SPAWN_CLOSE = 2,
+	SPAWN_DUP2 = 3,
+};
+
+struct spawn_action {
+	int32_t op;
+	int32_t fd;
+	// SPAWN_DUP2 source
+	int32_t srcfd;
+	// SPAWN_OPEN arguments
+	int32_t flags;
+	uint32_t mode;
+	uint32_t reserved;
+	const char *path;
+};
+
+// SYS_SPAWN flags
+#define SPAWN_SETPGROUP 0x1
+
+#endif /* _USER_SPAWN_H */
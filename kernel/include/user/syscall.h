@@ -82,6 +82,34 @@ enum {
 	SYS_UTIMENSAT = 53,
 	SYS_GETPGID = 54,
 	SYS_PSELECT = 55,
+	SYS_SOCKET = 56,
+	SYS_SOCKETPAIR = 57,
+	SYS_BIND = 58,
+	SYS_LISTEN = 59,
+	SYS_ACCEPT = 60,
+	SYS_CONNECT = 61,
+	SYS_SENDMSG = 62,
+	SYS_RECVMSG = 63,
+	SYS_SHUTDOWN = 64,
+	SYS_GETSOCKNAME = 65,
+	SYS_GETPEERNAME = 66,
+	SYS_SPLICE = 67,
+	SYS_TEE = 68,
+	SYS_SENDFILE = 69,
+	SYS_READV = 70,
+	SYS_WRITEV = 71,
+	SYS_PREADV = 72,
+	SYS_PWRITEV = 73,
+	SYS_URING_SETUP = 74,
+	SYS_URING_ENTER = 75,
+	SYS_SETPGID = 76,
+	SYS_SPAWN = 77,
+	SYS_SETPRIORITY = 78,
+	SYS_GETPRIORITY = 79,
+	SYS_SCHED_SETSCHEDULER = 80,
+	SYS_SCHED_GETSCHEDULER = 81,
+	SYS_SCHED_SETAFFINITY = 82,
+	SYS_SCHED_GETAFFINITY = 83,
 };
 
 typedef struct {
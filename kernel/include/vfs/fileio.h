@@ -63,6 +63,7 @@ typedef enum fcntl_cmd {
 
 struct vnode;
 struct dirent;
+struct iovec;
 struct dir_handle;
 
 struct fileio {
@@ -89,6 +90,10 @@ void fio_retain(struct fileio *file);
 struct fileio *open(const char *path, int flags, mode_t mode);
 ssize_t read(struct fileio *file, size_t size, void *out);
 int write(struct fileio *file, void *buf, size_t size);
+ssize_t readv(struct fileio *file, const struct iovec *iov, size_t iovcnt,
+			  size_t *offset);
+ssize_t writev(struct fileio *file, const struct iovec *iov, size_t iovcnt,
+			   size_t *offset);
 int close(struct fileio *file);
 
 size_t seek(struct fileio *file, size_t offset, fseek_t whence);
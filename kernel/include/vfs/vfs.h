@@ -32,6 +32,7 @@
 
 #include <sys/types.h>
 #include <sys/spinlock.h>
+#include <sys/uio.h>
 
 #define V_CREATE (1 << 0)
 #define V_READ (1 << 1)
@@ -159,6 +160,11 @@ struct vnode_ops {
 
 	int (*read)(struct vnode *, size_t *, size_t *, void *);
 	int (*write)(struct vnode *, void *, size_t *, size_t *);
+	// optional, vfs_readv/vfs_writev fall back to read/write per segment
+	int (*readv)(struct vnode *, const struct iovec *, size_t, size_t *,
+				 size_t *);
+	int (*writev)(struct vnode *, const struct iovec *, size_t, size_t *,
+				  size_t *);
 	int (*ioctl)(struct vnode *, int, void *);
 	int (*lookup)(struct vnode *, const char *, struct vnode **);
 	int (*readdir)(struct vnode *, struct dirent *, size_t *);
@@ -228,6 +234,10 @@ int vfs_lookup_parent(const char *path, struct vnode **parent, char **filename);
 int vfs_open(const char *path, int flags, struct fileio **out);
 int vfs_read(struct vnode *vnode, size_t size, size_t offset, void *out);
 int vfs_write(struct vnode *vnode, void *buf, size_t size, size_t offset);
+ssize_t vfs_readv(struct vnode *vnode, const struct iovec *iov, size_t iovcnt,
+				  size_t offset);
+ssize_t vfs_writev(struct vnode *vnode, const struct iovec *iov, size_t iovcnt,
+				   size_t offset);
 int vfs_ioctl(struct vnode *vnode, int request, void *arg);
 int vfs_close(struct vnode *vnode, int flags, bool clone);
 
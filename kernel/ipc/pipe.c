@@ -19,26 +19,116 @@
 
 #include <ipc/pipe.h>
 #include <vfs/fileio.h>
+#include <vfs/vfs.h>
 #include <mm/heap.h>
+#include <mm/pmm.h>
 #include <lib/string.h>
+#include <sys/poll.h>
 #include <sys/sched.h>
 #include <sys/errno.h>
+#include <aurix.h>
+
+static inline struct pipe_buf *pipe_slot(struct pipe *p, size_t idx)
+{
+	return &p->bufs[idx & (p->nbufs - 1)];
+}
+
+static inline uint8_t *pipe_buf_data(struct pipe_buf *b)
+{
+	return (uint8_t *)PHYS_TO_VIRT(b->page) + b->off;
+}
+
+static inline size_t pipe_free_slots(struct pipe *p)
+{
+	return p->nbufs - (p->head - p->tail);
+}
+
+// room left in the newest page, unless a splice or tee shares it
+static size_t pipe_tail_room(struct pipe *p)
+{
+	if (p->head == p->tail)
+		return 0;
+
+	struct pipe_buf *b = pipe_slot(p, p->head - 1);
+	if (pmm_refcount(b->page) > 1)
+		return 0;
+	return PAGE_SIZE - (b->off + b->len);
+}
 
 static inline size_t pipe_space(struct pipe *p)
 {
-	return PIPE_BUFFER_SIZE - p->used;
+	return pipe_free_slots(p) * PAGE_SIZE + pipe_tail_room(p);
+}
+
+// find up to *len writable bytes at the end of the ring, the caller fills
+// them and calls pipe_commit()
+static uint8_t *pipe_reserve(struct pipe *p, size_t *len, int *err)
+{
+	size_t room = pipe_tail_room(p);
+	if (room) {
+		struct pipe_buf *b = pipe_slot(p, p->head - 1);
+		if (*len > room)
+			*len = room;
+		return pipe_buf_data(b) + b->len;
+	}
+
+	if (!pipe_free_slots(p)) {
+		*err = -EAGAIN;
+		return NULL;
+	}
+
+	void *page = palloc(1);
+	if (!page) {
+		*err = -ENOMEM;
+		return NULL;
+	}
+
+	struct pipe_buf *b = pipe_slot(p, p->head++);
+	b->page = (uintptr_t)page;
+	b->off = 0;
+	b->len = 0;
+
+	if (*len > PAGE_SIZE)
+		*len = PAGE_SIZE;
+	return pipe_buf_data(b);
+}
+
+static void pipe_commit(struct pipe *p, size_t n)
+{
+	struct pipe_buf *b = pipe_slot(p, p->head - 1);
+
+	// don't leave a freshly reserved page behind empty
+	if (n == 0 && b->len == 0) {
+		pmm_ref_dec(b->page, 1);
+		p->head--;
+		return;
+	}
+
+	b->len += n;
+	p->used += n;
 }
 
-static inline size_t pipe_contig_read(struct pipe *p)
+// drop n bytes from the oldest slot, releasing its page once it's empty
+static void pipe_consume(struct pipe *p, size_t n)
 {
-	size_t end = PIPE_BUFFER_SIZE - p->read_pos;
-	return (p->used < end) ? p->used : end;
+	struct pipe_buf *b = pipe_slot(p, p->tail);
+	b->off += n;
+	b->len -= n;
+	p->used -= n;
+
+	if (b->len == 0) {
+		pmm_ref_dec(b->page, 1);
+		p->tail++;
+	}
 }
 
-static inline size_t pipe_contig_write(struct pipe *p)
+static void pipe_release_bufs(struct pipe *p)
 {
-	size_t end = PIPE_BUFFER_SIZE - p->write_pos;
-	return (pipe_space(p) < end) ? pipe_space(p) : end;
+	while (p->tail != p->head) {
+		pmm_ref_dec(pipe_slot(p, p->tail)->page, 1);
+		p->tail++;
+	}
+	p->used = 0;
 }
 
 int pipe(struct fileio *fds[2])
@@ -47,6 +137,14 @@ int pipe(struct fileio *fds[2])
 	if (!p)
 		return -1;
 	memset(p, 0, sizeof(struct pipe));
+
+	p->nbufs = PIPE_DEF_PAGES;
+	p->bufs = kmalloc(sizeof(struct pipe_buf) * p->nbufs);
+	if (!p->bufs) {
+		kfree(p);
+		return -1;
+	}
+
 	spinlock_acquire(&p->lock);
 	p->readers = 1;
 	p->writers = 1;
@@ -58,6 +156,7 @@ int pipe(struct fileio *fds[2])
 			kfree(rd);
 		if (wr)
 			kfree(wr);
+		kfree(p->bufs);
 		kfree(p);
 		return -1;
 	}
@@ -78,33 +177,49 @@ int pipe(struct fileio *fds[2])
 	return 0;
 }
 
-int pipe_read(struct fileio *fio, void *buf, size_t *size)
+int pipe_readv(struct fileio *fio, const struct iovec *iov, size_t iovcnt,
+			   size_t *size)
 {
 	struct pipe *p = (struct pipe *)fio->private;
-	size_t requested = *size;
 	size_t read_bytes = 0;
+	size_t seg = 0;
+	size_t seg_off = 0;
 
-	spinlock_acquire(&p->lock);
-	while (read_bytes == 0) {
-		if (p->used > 0) {
-			size_t to_read = pipe_contig_read(p);
-			if (to_read > requested)
-				to_read = requested;
-
-			memcpy(buf, &p->buffer[p->read_pos], to_read);
-			p->read_pos = (p->read_pos + to_read) % PIPE_BUFFER_SIZE;
-			p->used -= to_read;
-			read_bytes = to_read;
-		} else {
-			if (p->writers == 0) {
-				spinlock_release(&p->lock);
-				*size = 0;
-				return 0;
-			}
+	while (seg < iovcnt && iov[seg].iov_len == 0)
+		seg++;
+	if (seg == iovcnt) {
+		*size = 0;
+		return 0;
+	}
 
+	spinlock_acquire(&p->lock);
+	while (p->used == 0) {
+		if (p->writers == 0) {
 			spinlock_release(&p->lock);
-			sched_yield();
-			spinlock_acquire(&p->lock);
+			*size = 0;
+			return 0;
+		}
+
+		spinlock_release(&p->lock);
+		sched_yield();
+		spinlock_acquire(&p->lock);
+	}
+
+	// take everything that's there in one go
+	while (seg < iovcnt && p->used > 0) {
+		struct pipe_buf *b = pipe_slot(p, p->tail);
+		size_t n = b->len;
+		if (n > iov[seg].iov_len - seg_off)
+			n = iov[seg].iov_len - seg_off;
+
+		memcpy((uint8_t *)iov[seg].iov_base + seg_off, pipe_buf_data(b), n);
+		pipe_consume(p, n);
+		read_bytes += n;
+
+		seg_off += n;
+		if (seg_off == iov[seg].iov_len) {
+			seg++;
+			seg_off = 0;
 		}
 	}
 	spinlock_release(&p->lock);
@@ -113,33 +228,67 @@ int pipe_read(struct fileio *fio, void *buf, size_t *size)
 	return 0;
 }
 
-int pipe_write(struct fileio *fio, const void *buf, size_t *size)
+int pipe_read(struct fileio *fio, void *buf, size_t *size)
+{
+	struct iovec iov = { .iov_base = buf, .iov_len = *size };
+	return pipe_readv(fio, &iov, 1, size);
+}
+
+int pipe_writev(struct fileio *fio, const struct iovec *iov, size_t iovcnt,
+				size_t *size)
 {
 	struct pipe *p = (struct pipe *)fio->private;
-	size_t requested = *size;
+	size_t requested = 0;
 	size_t written = 0;
+	size_t seg = 0;
+	size_t seg_off = 0;
+
+	for (size_t i = 0; i < iovcnt; i++)
+		requested += iov[i].iov_len;
 
 	spinlock_acquire(&p->lock);
 	while (written < requested) {
-		if (pipe_space(p) > 0) {
-			size_t to_write = pipe_contig_write(p);
-			if (to_write > requested - written)
-				to_write = requested - written;
-
-			memcpy(&p->buffer[p->write_pos], (const uint8_t *)buf + written,
-				   to_write);
-			p->write_pos = (p->write_pos + to_write) % PIPE_BUFFER_SIZE;
-			p->used += to_write;
-			written += to_write;
-		} else {
-			if (p->readers == 0) {
-				spinlock_release(&p->lock);
-				return -EPIPE;
-			}
+		if (p->readers == 0) {
+			spinlock_release(&p->lock);
+			return -EPIPE;
+		}
+
+		while (iov[seg].iov_len == seg_off) {
+			seg++;
+			seg_off = 0;
+		}
+
+		int err = 0;
+		size_t n = iov[seg].iov_len - seg_off;
+		uint8_t *dst = pipe_reserve(p, &n, &err);
+		if (dst) {
+			memcpy(dst, (const uint8_t *)iov[seg].iov_base + seg_off, n);
+			pipe_commit(p, n);
+			written += n;
+			seg_off += n;
+			continue;
+		}
 
+		if (err == -ENOMEM) {
+			if (written)
+				break;
+			spinlock_release(&p->lock);
+			return -ENOMEM;
+		}
+
+		// full, let the reader drain a good batch before coming back instead
+		// of trading single pages with it. F_SETPIPE_SZ may shrink the ring
+		// meanwhile, so the batch is sized against what's there now
+		for (;;) {
 			spinlock_release(&p->lock);
 			sched_yield();
 			spinlock_acquire(&p->lock);
+
+			size_t want = requested - written;
+			if (want > p->nbufs * PAGE_SIZE / 2)
+				want = p->nbufs * PAGE_SIZE / 2;
+			if (p->readers == 0 || pipe_space(p) >= want)
+				break;
 		}
 	}
 	spinlock_release(&p->lock);
@@ -148,6 +297,12 @@ int pipe_write(struct fileio *fio, const void *buf, size_t *size)
 	return 0;
 }
 
+int pipe_write(struct fileio *fio, const void *buf, size_t *size)
+{
+	struct iovec iov = { .iov_base = (void *)buf, .iov_len = *size };
+	return pipe_writev(fio, &iov, 1, size);
+}
+
 int pipe_close(struct fileio *fio)
 {
 	struct pipe *p = (struct pipe *)fio->private;
@@ -162,8 +317,223 @@ int pipe_close(struct fileio *fio)
 	spinlock_release(&p->lock);
 
 	kfree(fio);
-	if (destroy)
+	if (destroy) {
+		pipe_release_bufs(p);
+		kfree(p->bufs);
 		kfree(p);
+	}
 
 	return 0;
 }
+
+short pipe_poll(struct fileio *fio, short events)
+{
+	struct pipe *p = (struct pipe *)fio->private;
+	short revents = 0;
+	if (!p)
+		return revents;
+
+	spinlock_acquire(&p->lock);
+	if (fio->flags & PIPE_READ_END) {
+		if ((events & POLLIN) && p->used > 0)
+			revents |= POLLIN;
+		if (p->writers == 0)
+			revents |= POLLHUP;
+	} else {
+		if ((events & POLLOUT) && pipe_space(p) > 0)
+			revents |= POLLOUT;
+		if (p->readers == 0)
+			revents |= POLLERR;
+	}
+	spinlock_release(&p->lock);
+
+	return revents;
+}
+
+size_t pipe_capacity(struct fileio *fio)
+{
+	struct pipe *p = (struct pipe *)fio->private;
+	return p->nbufs * PAGE_SIZE;
+}
+
+int pipe_resize(struct fileio *fio, size_t size)
+{
+	struct pipe *p = (struct pipe *)fio->private;
+	if (size > PIPE_MAX_SIZE)
+		return -EPERM;
+
+	size_t nbufs = 1;
+	while (nbufs * PAGE_SIZE < size)
+		nbufs <<= 1;
+
+	struct pipe_buf *bufs = kmalloc(sizeof(struct pipe_buf) * nbufs);
+	if (!bufs)
+		return -ENOMEM;
+
+	spinlock_acquire(&p->lock);
+	size_t count = p->head - p->tail;
+	if (count > nbufs) {
+		spinlock_release(&p->lock);
+		kfree(bufs);
+		return -EBUSY;
+	}
+
+	for (size_t i = 0; i < count; i++)
+		bufs[i] = *pipe_slot(p, p->tail + i);
+
+	struct pipe_buf *old = p->bufs;
+	p->bufs = bufs;
+	p->nbufs = nbufs;
+	p->tail = 0;
+	p->head = count;
+	spinlock_release(&p->lock);
+
+	kfree(old);
+	return (int)(nbufs * PAGE_SIZE);
+}
+
+// move data from one pipe to another by handing over page references, with
+// peek the source keeps its data (tee)
+ssize_t pipe_splice(struct fileio *rd, struct fileio *wr, size_t len,
+					bool nonblock, bool peek)
+{
+	struct pipe *src = (struct pipe *)rd->private;
+	struct pipe *dst = (struct pipe *)wr->private;
+	if (src == dst)
+		return -EINVAL;
+
+	// lock both in address order
+	struct pipe *first = src < dst ? src : dst;
+	struct pipe *second = src < dst ? dst : src;
+
+	for (;;) {
+		spinlock_acquire(&first->lock);
+		spinlock_acquire(&second->lock);
+
+		if (dst->readers == 0) {
+			spinlock_release(&second->lock);
+			spinlock_release(&first->lock);
+			return -EPIPE;
+		}
+
+		size_t moved = 0;
+		size_t idx = src->tail;
+		while (moved < len && idx != src->head && pipe_free_slots(dst)) {
+			struct pipe_buf *b = pipe_slot(src, idx);
+			size_t n = b->len;
+			if (n > len - moved)
+				n = len - moved;
+
+			if (n) {
+				pmm_ref_inc(b->page, 1);
+				struct pipe_buf *d = pipe_slot(dst, dst->head++);
+				d->page = b->page;
+				d->off = b->off;
+				d->len = (uint32_t)n;
+				dst->used += n;
+				moved += n;
+			}
+
+			if (peek) {
+				idx++;
+			} else {
+				pipe_consume(src, n);
+				idx = src->tail;
+			}
+		}
+
+		bool eof = src->used == 0 && src->writers == 0;
+		spinlock_release(&second->lock);
+		spinlock_release(&first->lock);
+
+		if (moved > 0 || eof)
+			return (ssize_t)moved;
+		if (nonblock)
+			return -EAGAIN;
+		sched_yield();
+	}
+}
+
+// read a file straight into the ring, the vnode has to be memory backed since
+// its read runs under the pipe lock
+ssize_t pipe_fill(struct fileio *wr, struct vnode *vn, size_t *offset,
+				  size_t len, bool nonblock)
+{
+	struct pipe *p = (struct pipe *)wr->private;
+	size_t moved = 0;
+
+	spinlock_acquire(&p->lock);
+	while (p->readers > 0 && pipe_space(p) == 0) {
+		spinlock_release(&p->lock);
+		if (nonblock)
+			return -EAGAIN;
+		sched_yield();
+		spinlock_acquire(&p->lock);
+	}
+
+	if (p->readers == 0) {
+		spinlock_release(&p->lock);
+		return -EPIPE;
+	}
+
+	int err = 0;
+	while (moved < len) {
+		size_t n = len - moved;
+		uint8_t *dst = pipe_reserve(p, &n, &err);
+		if (!dst)
+			break;
+
+		if (vn->ops->read(vn, &n, offset, dst) != 0)
+			n = 0;
+		pipe_commit(p, n);
+		if (n == 0)
+			break;
+		moved += n;
+	}
+	spinlock_release(&p->lock);
+
+	if (!moved && err == -ENOMEM)
+		return -ENOMEM;
+	return (ssize_t)moved;
+}
+
+// write the ring's contents straight into a memory backed file
+ssize_t pipe_drain(struct fileio *rd, struct vnode *vn, size_t *offset,
+				   size_t len, bool nonblock)
+{
+	struct pipe *p = (struct pipe *)rd->private;
+	size_t moved = 0;
+
+	spinlock_acquire(&p->lock);
+	while (p->used == 0) {
+		if (p->writers == 0) {
+			spinlock_release(&p->lock);
+			return 0;
+		}
+
+		spinlock_release(&p->lock);
+		if (nonblock)
+			return -EAGAIN;
+		sched_yield();
+		spinlock_acquire(&p->lock);
+	}
+
+	while (moved < len && p->used > 0) {
+		struct pipe_buf *b = pipe_slot(p, p->tail);
+		size_t n = b->len;
+		if (n > len - moved)
+			n = len - moved;
+
+		int ret = n ? vfs_write(vn, pipe_buf_data(b), n, *offset) : 0;
+		if (ret < 0 || (n && ret == 0))
+			break;
+
+		n = (size_t)ret;
+		*offset += n;
+		pipe_consume(p, n);
+		moved += n;
+	}
+	spinlock_release(&p->lock);
+
+	return moved ? (ssize_t)moved : -EIO;
+}
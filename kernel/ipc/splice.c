@@ -0,0 +1,228 @@
+/*********************************************************************************/
+/* Module Name:  splice.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <ipc/splice.h>
+#include <ipc/pipe.h>
+#include <ipc/unix.h>
+#include <ipc/uring.h>
+#include <vfs/fileio.h>
+#include <vfs/vfs.h>
+#include <mm/heap.h>
+#include <mm/pmm.h>
+#include <sys/errno.h>
+
+#define SPLICE_PIPE (PIPE_READ_END | PIPE_WRITE_END)
+
+static bool splice_is_pipe(struct fileio *f)
+{
+	return f->flags & SPLICE_PIPE;
+}
+
+// plain files are memory backed and can be read or written under a pipe
+// lock, devices and sockets may block so they go through a bounce page
+static bool splice_is_file(struct fileio *f)
+{
+	if (f->flags &
+		(SPLICE_PIPE | UNIX_FILE | URING_FILE | SPECIAL_FILE_TYPE_DEVICE))
+		return false;
+
+	struct vnode *vn = (struct vnode *)f->private;
+	return vn && vn->vtype == VNODE_REGULAR;
+}
+
+static size_t splice_file_left(struct fileio *f, size_t off, size_t len)
+{
+	if (off >= f->size)
+		return 0;
+	return (f->size - off) < len ? (f->size - off) : len;
+}
+
+static ssize_t splice_read(struct fileio *in, size_t *off, void *buf,
+						   size_t len)
+{
+	if (!splice_is_file(in))
+		return read(in, len, buf);
+
+	len = splice_file_left(in, *off, len);
+	if (len == 0)
+		return 0;
+
+	struct vnode *vn = (struct vnode *)in->private;
+	if (vn->ops->read(vn, &len, off, buf) != 0)
+		return -EIO;
+	return (ssize_t)len;
+}
+
+static ssize_t splice_write(struct fileio *out, size_t *off, void *buf,
+							size_t len)
+{
+	if (!splice_is_file(out))
+		return write(out, buf, len);
+
+	int ret = vfs_write((struct vnode *)out->private, buf, len, *off);
+	if (ret < 0)
+		return -EIO;
+
+	*off += (size_t)ret;
+	if (out->size < *off)
+		out->size = *off;
+	return ret;
+}
+
+// fallback for ends that can't be touched under a pipe lock
+static ssize_t splice_bounce(struct fileio *in, size_t *in_off,
+							 struct fileio *out, size_t *out_off, size_t len,
+							 bool all)
+{
+	void *buf = kmalloc(PAGE_SIZE);
+	if (!buf)
+		return -ENOMEM;
+
+	size_t done = 0;
+	ssize_t err = 0;
+	while (done < len) {
+		size_t chunk = len - done < PAGE_SIZE ? len - done : PAGE_SIZE;
+		ssize_t got = splice_read(in, in_off, buf, chunk);
+		if (got <= 0) {
+			err = got;
+			break;
+		}
+
+		size_t put = 0;
+		while (put < (size_t)got) {
+			ssize_t w = splice_write(out, out_off, (uint8_t *)buf + put,
+									 (size_t)got - put);
+			if (w <= 0) {
+				err = w ? w : -EIO;
+				break;
+			}
+			put += (size_t)w;
+		}
+
+		done += put;
+		if (err || !all)
+			break;
+	}
+
+	kfree(buf);
+	return done ? (ssize_t)done : err;
+}
+
+static size_t *splice_offset(struct fileio *f, size_t *off)
+{
+	if (off)
+		return off;
+	if (f->flags & O_APPEND)
+		f->offset = f->size;
+	return &f->offset;
+}
+
+ssize_t splice(struct fileio *in, size_t *in_off, struct fileio *out,
+			   size_t *out_off, size_t len, unsigned int flags)
+{
+	if (!in || !out)
+		return -EBADF;
+	if (!splice_is_pipe(in) && !splice_is_pipe(out))
+		return -EINVAL;
+	if ((in->flags & PIPE_WRITE_END) || (out->flags & PIPE_READ_END))
+		return -EBADF;
+	if ((in_off && splice_is_pipe(in)) || (out_off && splice_is_pipe(out)))
+		return -ESPIPE;
+	if (len == 0)
+		return 0;
+
+	bool nonblock = flags & SPLICE_F_NONBLOCK;
+
+	if (splice_is_pipe(in) && splice_is_pipe(out))
+		return pipe_splice(in, out, len, nonblock || (in->flags & O_NONBLOCK),
+						   false);
+
+	if (splice_is_pipe(out)) {
+		if (!splice_is_file(in))
+			return splice_bounce(in, NULL, out, NULL, len, false);
+
+		size_t *off = splice_offset(in, in_off);
+		len = splice_file_left(in, *off, len);
+		if (len == 0)
+			return 0;
+		return pipe_fill(out, (struct vnode *)in->private, off, len,
+						 nonblock || (out->flags & O_NONBLOCK));
+	}
+
+	if (!splice_is_file(out))
+		return splice_bounce(in, NULL, out, NULL, len, false);
+
+	size_t *off = splice_offset(out, out_off);
+	ssize_t ret = pipe_drain(in, (struct vnode *)out->private, off, len,
+							 nonblock || (in->flags & O_NONBLOCK));
+	if (ret > 0 && out->size < *off)
+		out->size = *off;
+	return ret;
+}
+
+ssize_t tee(struct fileio *in, struct fileio *out, size_t len,
+			unsigned int flags)
+{
+	if (!in || !out)
+		return -EBADF;
+	if (!(in->flags & PIPE_READ_END) || !(out->flags & PIPE_WRITE_END))
+		return -EINVAL;
+	if (len == 0)
+		return 0;
+
+	return pipe_splice(in, out, len,
+					   (flags & SPLICE_F_NONBLOCK) || (in->flags & O_NONBLOCK),
+					   true);
+}
+
+ssize_t sendfile(struct fileio *out, struct fileio *in, size_t *offset,
+				 size_t count)
+{
+	if (!in || !out)
+		return -EBADF;
+	if (!splice_is_file(in))
+		return -EINVAL;
+	if (out->flags & PIPE_READ_END)
+		return -EBADF;
+
+	// an explicit offset leaves the file position alone
+	size_t pos = offset ? *offset : in->offset;
+	count = splice_file_left(in, pos, count);
+
+	ssize_t ret = 0;
+	size_t done = 0;
+	while (done < count) {
+		if (out->flags & PIPE_WRITE_END)
+			ret = pipe_fill(out, (struct vnode *)in->private, &pos,
+							count - done, out->flags & O_NONBLOCK);
+		else
+			ret = splice_bounce(in, &pos, out, splice_offset(out, NULL),
+								count - done, true);
+		if (ret <= 0)
+			break;
+		done += (size_t)ret;
+	}
+
+	if (offset)
+		*offset = pos;
+	else
+		in->offset = pos;
+
+	return done ? (ssize_t)done : ret;
+}
@@ -0,0 +1,986 @@
+/*********************************************************************************/
+/* Module Name:  unix.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <ipc/unix.h>
+#include <vfs/fileio.h>
+#include <vfs/vfs.h>
+#include <mm/heap.h>
+#include <lib/hash.h>
+#include <lib/string.h>
+#include <user/access.h>
+#include <sys/poll.h>
+#include <sys/sched.h>
+#include <sys/errno.h>
+
+#define UNIX_HASH_SIZE 64
+#define UNIX_CHUNK_BYTES 4096
+#define UNIX_CHUNK_SIZE (UNIX_CHUNK_BYTES - sizeof(struct unix_msg))
+#define UNIX_MAX_BACKLOG 128
+
+// bound sockets by path
+static struct unix_sock *unix_bound[UNIX_HASH_SIZE];
+
+// guards the bind table, peer links and accept queues, socket locks nest
+// inside it
+static spinlock_t unix_lock = { 0 };
+
+struct unix_iter {
+	const struct iovec *iov;
+	size_t cnt;
+	size_t idx;
+	size_t off;
+};
+
+static size_t unix_iter_from(struct unix_iter *it, void *dst, size_t len)
+{
+	size_t done = 0;
+	while (done < len && it->idx < it->cnt) {
+		const struct iovec *v = &it->iov[it->idx];
+		size_t n = v->iov_len - it->off;
+		if (n > len - done)
+			n = len - done;
+
+		memcpy((uint8_t *)dst + done, (uint8_t *)v->iov_base + it->off, n);
+		done += n;
+		it->off += n;
+		if (it->off == v->iov_len) {
+			it->idx++;
+			it->off = 0;
+		}
+	}
+	return done;
+}
+
+static size_t unix_iter_to(struct unix_iter *it, const void *src, size_t len)
+{
+	size_t done = 0;
+	while (done < len && it->idx < it->cnt) {
+		const struct iovec *v = &it->iov[it->idx];
+		size_t n = v->iov_len - it->off;
+		if (n > len - done)
+			n = len - done;
+
+		memcpy((uint8_t *)v->iov_base + it->off, (const uint8_t *)src + done, n);
+		done += n;
+		it->off += n;
+		if (it->off == v->iov_len) {
+			it->idx++;
+			it->off = 0;
+		}
+	}
+	return done;
+}
+
+static size_t iov_total(const struct iovec *iov, size_t cnt)
+{
+	size_t total = 0;
+	for (size_t i = 0; i < cnt; i++) {
+		if (total + iov[i].iov_len < total)
+			return (size_t)-1;
+		total += iov[i].iov_len;
+	}
+	return total;
+}
+
+static struct unix_sock *unix_sock_alloc(int type)
+{
+	struct unix_sock *s = kmalloc(sizeof(struct unix_sock));
+	if (!s)
+		return NULL;
+
+	memset(s, 0, sizeof(struct unix_sock));
+	s->type = type;
+	s->state = UNIX_UNCONNECTED;
+	atomic_init(&s->refs, 1);
+	return s;
+}
+
+static inline void unix_ref(struct unix_sock *s)
+{
+	atomic_fetch_add_explicit(&s->refs, 1, memory_order_relaxed);
+}
+
+static void unix_msg_free(struct unix_msg *m)
+{
+	for (int i = 0; i < m->nrights; i++)
+		close(m->rights[i]);
+	if (m->rights)
+		kfree(m->rights);
+	kfree(m);
+}
+
+static void unix_purge(struct unix_sock *s)
+{
+	spinlock_acquire(&s->lock);
+	struct unix_msg *m = s->rx_head;
+	s->rx_head = NULL;
+	s->rx_tail = NULL;
+	s->rx_bytes = 0;
+	spinlock_release(&s->lock);
+
+	while (m) {
+		struct unix_msg *next = m->next;
+		unix_msg_free(m);
+		m = next;
+	}
+}
+
+static void unix_unref(struct unix_sock *s)
+{
+	if (atomic_fetch_sub_explicit(&s->refs, 1, memory_order_acq_rel) != 1)
+		return;
+
+	unix_purge(s);
+	kfree(s);
+}
+
+static struct unix_sock *unix_from(struct fileio *fio)
+{
+	if (!fio || !(fio->flags & UNIX_FILE))
+		return NULL;
+	return fio->private;
+}
+
+static struct fileio *unix_wrap(struct unix_sock *s, int flags)
+{
+	struct fileio *fio = fio_create();
+	if (!fio)
+		return NULL;
+
+	fio->flags = UNIX_FILE | O_RDWR | (flags & (O_NONBLOCK | O_CLOEXEC));
+	fio->private = s;
+	return fio;
+}
+
+static bool unix_nonblock(struct fileio *fio, int flags)
+{
+	return (fio->flags & O_NONBLOCK) || (flags & MSG_DONTWAIT);
+}
+
+static struct unix_sock **unix_bucket(const char *path)
+{
+	return &unix_bound[hash_fnv1a_str(path) % UNIX_HASH_SIZE];
+}
+
+static struct unix_sock *unix_find_locked(const char *path)
+{
+	for (struct unix_sock *s = *unix_bucket(path); s; s = s->bind_next) {
+		if (strcmp(s->path, path) == 0)
+			return s;
+	}
+	return NULL;
+}
+
+static void unix_unbind_locked(struct unix_sock *s)
+{
+	if (!s->bound)
+		return;
+
+	struct unix_sock **pp = unix_bucket(s->path);
+	while (*pp && *pp != s)
+		pp = &(*pp)->bind_next;
+	if (*pp)
+		*pp = s->bind_next;
+
+	s->bind_next = NULL;
+	s->bound = false;
+}
+
+// the path has to name a socket node, the bind table then says who owns it
+static int unix_check_path(const char *path)
+{
+	struct vnode *vn = NULL;
+	if (vfs_lookup(path, &vn) != 0)
+		return -ENOENT;
+
+	int ret = vn->vtype == VNODE_SOCKET ? 0 : -ECONNREFUSED;
+	vnode_unref(vn);
+	return ret;
+}
+
+int unix_socket(int type, struct fileio **out)
+{
+	int kind = type & SOCK_TYPE_MASK;
+	if (kind != SOCK_STREAM && kind != SOCK_DGRAM)
+		return -ESOCKTNOSUPPORT;
+
+	struct unix_sock *s = unix_sock_alloc(kind);
+	if (!s)
+		return -ENOMEM;
+
+	struct fileio *fio = unix_wrap(s, type);
+	if (!fio) {
+		unix_unref(s);
+		return -ENOMEM;
+	}
+
+	*out = fio;
+	return 0;
+}
+
+int unix_socketpair(int type, struct fileio *fds[2])
+{
+	int kind = type & SOCK_TYPE_MASK;
+	if (kind != SOCK_STREAM && kind != SOCK_DGRAM)
+		return -ESOCKTNOSUPPORT;
+
+	struct unix_sock *a = unix_sock_alloc(kind);
+	struct unix_sock *b = unix_sock_alloc(kind);
+	struct fileio *fa = a ? unix_wrap(a, type) : NULL;
+	struct fileio *fb = b ? unix_wrap(b, type) : NULL;
+	if (!fa || !fb) {
+		if (fa)
+			kfree(fa);
+		if (fb)
+			kfree(fb);
+		if (a)
+			unix_unref(a);
+		if (b)
+			unix_unref(b);
+		return -ENOMEM;
+	}
+
+	unix_ref(a);
+	unix_ref(b);
+	a->peer = b;
+	b->peer = a;
+	a->state = UNIX_CONNECTED;
+	b->state = UNIX_CONNECTED;
+
+	fds[0] = fa;
+	fds[1] = fb;
+	return 0;
+}
+
+int unix_bind(struct fileio *fio, const char *path)
+{
+	struct unix_sock *s = unix_from(fio);
+	if (!s)
+		return -ENOTSOCK;
+	if (!path || !*path)
+		return -EINVAL;
+	if (strlen(path) >= UNIX_PATH_MAX)
+		return -ENAMETOOLONG;
+	if (s->bound || s->state != UNIX_UNCONNECTED)
+		return -EINVAL;
+
+	struct vnode *vn = NULL;
+	if (vfs_lookup(path, &vn) == 0) {
+		vnode_unref(vn);
+		return -EADDRINUSE;
+	}
+
+	mode_t mode = 0777;
+	tcb *current = thread_current();
+	if (current && current->process)
+		mode &= ~current->process->umask;
+
+	if (vfs_create(path, S_IFSOCK | mode) != 0)
+		return -ENOENT;
+
+	spinlock_acquire(&unix_lock);
+	// a socket whose node got unlinked keeps its entry until it's closed
+	struct unix_sock *stale = unix_find_locked(path);
+	if (stale)
+		unix_unbind_locked(stale);
+
+	strncpy(s->path, path, UNIX_PATH_MAX - 1);
+	struct unix_sock **head = unix_bucket(path);
+	s->bind_next = *head;
+	*head = s;
+	s->bound = true;
+	spinlock_release(&unix_lock);
+
+	return 0;
+}
+
+int unix_listen(struct fileio *fio, int backlog)
+{
+	struct unix_sock *s = unix_from(fio);
+	if (!s)
+		return -ENOTSOCK;
+	if (s->type != SOCK_STREAM)
+		return -EOPNOTSUPP;
+
+	if (backlog < 1)
+		backlog = 1;
+	if (backlog > UNIX_MAX_BACKLOG)
+		backlog = UNIX_MAX_BACKLOG;
+
+	spinlock_acquire(&unix_lock);
+	if (!s->bound ||
+		(s->state != UNIX_UNCONNECTED && s->state != UNIX_LISTENING)) {
+		spinlock_release(&unix_lock);
+		return -EINVAL;
+	}
+	s->state = UNIX_LISTENING;
+	s->backlog_max = backlog;
+	spinlock_release(&unix_lock);
+
+	return 0;
+}
+
+int unix_connect(struct fileio *fio, const char *path)
+{
+	struct unix_sock *s = unix_from(fio);
+	if (!s)
+		return -ENOTSOCK;
+	if (!path || strlen(path) >= UNIX_PATH_MAX)
+		return -EINVAL;
+
+	int ret = unix_check_path(path);
+	if (ret != 0)
+		return ret;
+
+	if (s->type == SOCK_DGRAM) {
+		spinlock_acquire(&unix_lock);
+		struct unix_sock *target = unix_find_locked(path);
+		if (!target || target->type != SOCK_DGRAM) {
+			spinlock_release(&unix_lock);
+			return target ? -EPROTOTYPE : -ECONNREFUSED;
+		}
+
+		unix_ref(target);
+		struct unix_sock *old = s->peer;
+		s->peer = target;
+		s->state = UNIX_CONNECTED;
+		spinlock_release(&unix_lock);
+
+		if (old)
+			unix_unref(old);
+		return 0;
+	}
+
+	// the server end is created right away and parked on the listener until
+	// accept() picks it up
+	struct unix_sock *srv = unix_sock_alloc(SOCK_STREAM);
+	if (!srv)
+		return -ENOMEM;
+
+	for (;;) {
+		spinlock_acquire(&unix_lock);
+		if (s->state == UNIX_CONNECTED) {
+			ret = -EISCONN;
+			break;
+		}
+		if (s->state != UNIX_UNCONNECTED) {
+			ret = -EINVAL;
+			break;
+		}
+
+		struct unix_sock *l = unix_find_locked(path);
+		if (!l || l->state != UNIX_LISTENING) {
+			ret = -ECONNREFUSED;
+			break;
+		}
+		if (l->type != SOCK_STREAM) {
+			ret = -EPROTOTYPE;
+			break;
+		}
+
+		if (l->backlog >= l->backlog_max) {
+			spinlock_release(&unix_lock);
+			if (unix_nonblock(fio, 0)) {
+				unix_unref(srv);
+				return -EAGAIN;
+			}
+			sched_yield();
+			continue;
+		}
+
+		unix_ref(s);
+		unix_ref(srv);
+		srv->peer = s;
+		s->peer = srv;
+		srv->state = UNIX_CONNECTED;
+		s->state = UNIX_CONNECTED;
+		strncpy(srv->path, l->path, UNIX_PATH_MAX - 1);
+
+		if (l->pending_tail)
+			l->pending_tail->pending_next = srv;
+		else
+			l->pending = srv;
+		l->pending_tail = srv;
+		l->backlog++;
+
+		spinlock_release(&unix_lock);
+		return 0;
+	}
+
+	spinlock_release(&unix_lock);
+	unix_unref(srv);
+	return ret;
+}
+
+int unix_accept(struct fileio *fio, struct fileio **out)
+{
+	struct unix_sock *s = unix_from(fio);
+	if (!s)
+		return -ENOTSOCK;
+	if (s->type != SOCK_STREAM)
+		return -EOPNOTSUPP;
+
+	for (;;) {
+		spinlock_acquire(&unix_lock);
+		if (s->state != UNIX_LISTENING) {
+			spinlock_release(&unix_lock);
+			return -EINVAL;
+		}
+
+		struct unix_sock *srv = s->pending;
+		if (srv) {
+			s->pending = srv->pending_next;
+			if (!s->pending)
+				s->pending_tail = NULL;
+			srv->pending_next = NULL;
+			s->backlog--;
+		}
+		spinlock_release(&unix_lock);
+
+		if (srv) {
+			struct fileio *nf = unix_wrap(srv, 0);
+			if (!nf) {
+				spinlock_acquire(&unix_lock);
+				srv->pending_next = s->pending;
+				s->pending = srv;
+				if (!s->pending_tail)
+					s->pending_tail = srv;
+				s->backlog++;
+				spinlock_release(&unix_lock);
+				return -ENOMEM;
+			}
+
+			*out = nf;
+			return 0;
+		}
+
+		if (unix_nonblock(fio, 0))
+			return -EAGAIN;
+		sched_yield();
+	}
+}
+
+int unix_shutdown(struct fileio *fio, int how)
+{
+	struct unix_sock *s = unix_from(fio);
+	if (!s)
+		return -ENOTSOCK;
+	if (how != SHUT_RD && how != SHUT_WR && how != SHUT_RDWR)
+		return -EINVAL;
+
+	spinlock_acquire(&unix_lock);
+	if (s->state != UNIX_CONNECTED) {
+		spinlock_release(&unix_lock);
+		return -ENOTCONN;
+	}
+
+	struct unix_sock *peer = s->peer;
+	if (peer)
+		unix_ref(peer);
+	spinlock_release(&unix_lock);
+
+	if (how != SHUT_WR) {
+		spinlock_acquire(&s->lock);
+		s->shut_rd = true;
+		spinlock_release(&s->lock);
+	}
+
+	if (how != SHUT_RD) {
+		s->shut_wr = true;
+		// the other end reads EOF once it has drained what's queued
+		if (peer && s->type == SOCK_STREAM) {
+			spinlock_acquire(&peer->lock);
+			peer->rx_eof = true;
+			spinlock_release(&peer->lock);
+		}
+	}
+
+	if (peer)
+		unix_unref(peer);
+	return 0;
+}
+
+int unix_getname(struct fileio *fio, bool peer, char *path)
+{
+	struct unix_sock *s = unix_from(fio);
+	if (!s)
+		return -ENOTSOCK;
+
+	spinlock_acquire(&unix_lock);
+	struct unix_sock *who = peer ? s->peer : s;
+	if (!who) {
+		spinlock_release(&unix_lock);
+		return -ENOTCONN;
+	}
+	memcpy(path, who->path, UNIX_PATH_MAX);
+	spinlock_release(&unix_lock);
+
+	return 0;
+}
+
+static int unix_send_dgram(struct fileio *fio, struct unix_sock *target,
+						   struct unix_iter *it, size_t total,
+						   struct fileio **rights, int nrights, int flags)
+{
+	if (total > UNIX_RCVBUF)
+		return -EMSGSIZE;
+
+	struct unix_msg *m = kmalloc(sizeof(struct unix_msg) + total);
+	if (!m)
+		return -ENOMEM;
+	memset(m, 0, sizeof(struct unix_msg));
+	m->len = unix_iter_from(it, m->data, total);
+	m->cap = 0;
+
+	for (;;) {
+		spinlock_acquire(&target->lock);
+		if (target->state == UNIX_CLOSED || target->shut_rd) {
+			spinlock_release(&target->lock);
+			kfree(m);
+			return -ECONNREFUSED;
+		}
+
+		if (target->rx_bytes + m->len <= UNIX_RCVBUF || !target->rx_head)
+			break;
+
+		spinlock_release(&target->lock);
+		if (unix_nonblock(fio, flags)) {
+			kfree(m);
+			return -EAGAIN;
+		}
+		sched_yield();
+	}
+
+	// from here on the message owns the caller's references
+	m->rights = rights;
+	m->nrights = nrights;
+
+	if (target->rx_tail)
+		target->rx_tail->next = m;
+	else
+		target->rx_head = m;
+	target->rx_tail = m;
+	target->rx_bytes += m->len;
+	spinlock_release(&target->lock);
+
+	return (int)total;
+}
+
+static ssize_t unix_send_stream(struct fileio *fio, struct unix_sock *target,
+								struct unix_iter *it, size_t total,
+								struct fileio **rights, int nrights, int flags)
+{
+	size_t done = 0;
+	ssize_t err = 0;
+	struct unix_msg *spare = NULL;
+
+	while (done < total || rights) {
+		spinlock_acquire(&target->lock);
+		if (target->state == UNIX_CLOSED || target->shut_rd) {
+			spinlock_release(&target->lock);
+			err = -EPIPE;
+			break;
+		}
+
+		size_t space = UNIX_RCVBUF - target->rx_bytes;
+		if (space == 0) {
+			spinlock_release(&target->lock);
+			if (unix_nonblock(fio, flags)) {
+				err = -EAGAIN;
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+
+		size_t want = total - done;
+		if (want > space)
+			want = space;
+
+		// top up the last chunk, rights always start a fresh one so they
+		// arrive with their first byte
+		struct unix_msg *tail = target->rx_tail;
+		if (!rights && tail && !tail->nrights && tail->len < tail->cap) {
+			size_t n = tail->cap - tail->len;
+			if (n > want)
+				n = want;
+			n = unix_iter_from(it, tail->data + tail->len, n);
+			tail->len += n;
+			target->rx_bytes += n;
+			done += n;
+			spinlock_release(&target->lock);
+			continue;
+		}
+
+		if (!spare) {
+			spinlock_release(&target->lock);
+			spare = kmalloc(UNIX_CHUNK_BYTES);
+			if (!spare) {
+				err = -ENOMEM;
+				break;
+			}
+			continue;
+		}
+
+		struct unix_msg *m = spare;
+		spare = NULL;
+		memset(m, 0, sizeof(struct unix_msg));
+		m->cap = UNIX_CHUNK_SIZE;
+		m->len = unix_iter_from(it, m->data, want < m->cap ? want : m->cap);
+		if (rights) {
+			m->rights = rights;
+			m->nrights = nrights;
+			rights = NULL;
+		}
+
+		if (target->rx_tail)
+			target->rx_tail->next = m;
+		else
+			target->rx_head = m;
+		target->rx_tail = m;
+		target->rx_bytes += m->len;
+		done += m->len;
+		spinlock_release(&target->lock);
+	}
+
+	if (spare)
+		kfree(spare);
+
+	// once anything went out the rights went with it
+	if (done > 0 || (!rights && nrights))
+		return (ssize_t)done;
+	return err;
+}
+
+ssize_t unix_sendmsg(struct fileio *fio, const struct iovec *iov, size_t iovcnt,
+					 struct fileio **rights, int nrights, const char *dest,
+					 int flags)
+{
+	struct unix_sock *s = unix_from(fio);
+	if (!s)
+		return -ENOTSOCK;
+	if (s->shut_wr)
+		return -EPIPE;
+	if (nrights < 0 || nrights > UNIX_MAX_RIGHTS)
+		return -EINVAL;
+
+	size_t total = iov_total(iov, iovcnt);
+	if (total == (size_t)-1 || total > 0x7fffffff)
+		return -EINVAL;
+
+	if (dest && s->type == SOCK_STREAM)
+		return s->state == UNIX_CONNECTED ? -EISCONN : -EOPNOTSUPP;
+	if (dest) {
+		int ret = unix_check_path(dest);
+		if (ret != 0)
+			return ret;
+	}
+
+	spinlock_acquire(&unix_lock);
+	struct unix_sock *target = dest ? unix_find_locked(dest) : s->peer;
+	if (!target) {
+		spinlock_release(&unix_lock);
+		if (dest)
+			return -ECONNREFUSED;
+		if (s->type == SOCK_DGRAM)
+			return -EDESTADDRREQ;
+		return s->state == UNIX_CONNECTED ? -EPIPE : -ENOTCONN;
+	}
+	if (target->type != s->type) {
+		spinlock_release(&unix_lock);
+		return -EPROTOTYPE;
+	}
+	unix_ref(target);
+	spinlock_release(&unix_lock);
+
+	struct fileio **owned = NULL;
+	if (nrights) {
+		owned = kmalloc(sizeof(struct fileio *) * nrights);
+		if (!owned) {
+			unix_unref(target);
+			return -ENOMEM;
+		}
+		memcpy(owned, rights, sizeof(struct fileio *) * nrights);
+	}
+
+	struct unix_iter it = { .iov = iov, .cnt = iovcnt };
+	ssize_t ret;
+	if (s->type == SOCK_DGRAM)
+		ret = unix_send_dgram(fio, target, &it, total, owned, nrights, flags);
+	else
+		ret = unix_send_stream(fio, target, &it, total, owned, nrights, flags);
+
+	// on failure the caller still holds its references
+	if (ret < 0 && owned)
+		kfree(owned);
+
+	unix_unref(target);
+	return ret;
+}
+
+// returns false if some of the rights had nowhere to go; those are left in
+// *drop for the caller to close once s->lock is released
+static bool unix_take_rights(struct unix_msg *m, struct fileio **rights,
+							 int *nrights, struct fileio ***drop, int *ndrop)
+{
+	int left = 0;
+	for (int i = 0; i < m->nrights; i++) {
+		if (rights && *nrights < UNIX_MAX_RIGHTS)
+			rights[(*nrights)++] = m->rights[i];
+		else
+			m->rights[left++] = m->rights[i];
+	}
+
+	if (left) {
+		*drop = m->rights;
+		*ndrop = left;
+	} else if (m->rights) {
+		kfree(m->rights);
+	}
+	m->rights = NULL;
+	m->nrights = 0;
+	return left == 0;
+}
+
+ssize_t unix_recvmsg(struct fileio *fio, const struct iovec *iov, size_t iovcnt,
+					 struct fileio **rights, int *nrights, int flags,
+					 int *msg_flags)
+{
+	struct unix_sock *s = unix_from(fio);
+	if (!s)
+		return -ENOTSOCK;
+
+	size_t cap = iov_total(iov, iovcnt);
+	if (cap == (size_t)-1)
+		return -EINVAL;
+
+	int got = 0;
+	if (!nrights)
+		nrights = &got;
+	*nrights = 0;
+	int mflags = 0;
+	bool peek = flags & MSG_PEEK;
+
+	struct unix_iter it = { .iov = iov, .cnt = iovcnt };
+
+	for (;;) {
+		spinlock_acquire(&s->lock);
+		if (s->rx_head)
+			break;
+
+		bool eof = s->rx_eof || s->shut_rd || s->state == UNIX_CLOSED;
+		bool unconnected = s->type == SOCK_STREAM &&
+						   s->state != UNIX_CONNECTED && !eof;
+		spinlock_release(&s->lock);
+
+		if (unconnected)
+			return -ENOTCONN;
+		if (eof)
+			return 0;
+		if (unix_nonblock(fio, flags))
+			return -EAGAIN;
+		sched_yield();
+	}
+
+	size_t copied = 0;
+	struct unix_msg *done = NULL;
+	struct fileio **drop = NULL;
+	int ndrop = 0;
+
+	if (s->type == SOCK_DGRAM) {
+		struct unix_msg *m = s->rx_head;
+		copied = unix_iter_to(&it, m->data, m->len < cap ? m->len : cap);
+		if (m->len > cap)
+			mflags |= MSG_TRUNC;
+
+		if (!peek) {
+			s->rx_head = m->next;
+			if (!s->rx_head)
+				s->rx_tail = NULL;
+			s->rx_bytes -= m->len;
+			if (!unix_take_rights(m, rights, nrights, &drop, &ndrop))
+				mflags |= MSG_CTRUNC;
+			m->next = NULL;
+			done = m;
+		}
+	} else {
+		bool took_rights = false;
+		struct unix_msg *m = s->rx_head;
+		size_t off = m->off;
+
+		while (m && copied < cap) {
+			// one read never hands out two batches of rights
+			if (m->nrights && (copied > 0 || took_rights))
+				break;
+
+			size_t n = m->len - off;
+			if (n > cap - copied)
+				n = cap - copied;
+			n = unix_iter_to(&it, m->data + off, n);
+			copied += n;
+			off += n;
+
+			if (peek) {
+				if (off < m->len)
+					break;
+				m = m->next;
+				off = m ? m->off : 0;
+				continue;
+			}
+
+			s->rx_bytes -= n;
+			m->off = off;
+			if (m->nrights) {
+				if (!unix_take_rights(m, rights, nrights, &drop, &ndrop))
+					mflags |= MSG_CTRUNC;
+				took_rights = true;
+			}
+
+			if (m->off < m->len)
+				break;
+
+			s->rx_head = m->next;
+			if (!s->rx_head)
+				s->rx_tail = NULL;
+			m->next = done;
+			done = m;
+
+			m = s->rx_head;
+			off = m ? m->off : 0;
+		}
+	}
+	spinlock_release(&s->lock);
+
+	// closing may drop the last ref to a socket, never do it under s->lock
+	for (int i = 0; i < ndrop; i++)
+		close(drop[i]);
+	if (drop)
+		kfree(drop);
+
+	while (done) {
+		struct unix_msg *next = done->next;
+		unix_msg_free(done);
+		done = next;
+	}
+
+	if (msg_flags)
+		*msg_flags = mflags;
+	return (ssize_t)copied;
+}
+
+short unix_poll(struct fileio *fio, short events)
+{
+	struct unix_sock *s = unix_from(fio);
+	if (!s)
+		return POLLNVAL;
+
+	short revents = 0;
+
+	spinlock_acquire(&unix_lock);
+	bool listening = s->state == UNIX_LISTENING;
+	bool pending = s->pending != NULL;
+	struct unix_sock *peer = s->peer;
+	if (peer)
+		unix_ref(peer);
+	spinlock_release(&unix_lock);
+
+	spinlock_acquire(&s->lock);
+	bool readable = s->rx_head != NULL;
+	bool eof = s->rx_eof || s->shut_rd;
+	spinlock_release(&s->lock);
+
+	if (listening) {
+		if ((events & POLLIN) && pending)
+			revents |= POLLIN;
+		return revents;
+	}
+
+	if ((events & POLLIN) && (readable || eof))
+		revents |= POLLIN;
+	if (s->type == SOCK_STREAM && eof)
+		revents |= POLLHUP;
+
+	if (peer) {
+		spinlock_acquire(&peer->lock);
+		bool gone = peer->state == UNIX_CLOSED || peer->shut_rd;
+		bool room = peer->rx_bytes < UNIX_RCVBUF;
+		spinlock_release(&peer->lock);
+
+		if (gone)
+			revents |= POLLERR;
+		else if ((events & POLLOUT) && room && !s->shut_wr)
+			revents |= POLLOUT;
+		unix_unref(peer);
+	} else if (s->type == SOCK_DGRAM && (events & POLLOUT)) {
+		revents |= POLLOUT;
+	}
+
+	return revents;
+}
+
+static void unix_release(struct unix_sock *s)
+{
+	spinlock_acquire(&unix_lock);
+	unix_unbind_locked(s);
+
+	struct unix_sock *pending = s->pending;
+	s->pending = NULL;
+	s->pending_tail = NULL;
+	s->backlog = 0;
+
+	struct unix_sock *peer = s->peer;
+	s->peer = NULL;
+	bool mutual = peer && peer->peer == s;
+	if (mutual)
+		peer->peer = NULL;
+	s->state = UNIX_CLOSED;
+	spinlock_release(&unix_lock);
+
+	if (peer) {
+		if (mutual) {
+			spinlock_acquire(&peer->lock);
+			peer->rx_eof = true;
+			spinlock_release(&peer->lock);
+			unix_unref(s);
+		}
+		unix_unref(peer);
+	}
+
+	// connections nobody accepted get reset
+	while (pending) {
+		struct unix_sock *next = pending->pending_next;
+		pending->pending_next = NULL;
+		unix_release(pending);
+		pending = next;
+	}
+
+	unix_purge(s);
+	unix_unref(s);
+}
+
+int unix_close(struct fileio *fio)
+{
+	struct unix_sock *s = unix_from(fio);
+	if (!s)
+		return -ENOTSOCK;
+
+	unix_release(s);
+	kfree(fio);
+	return 0;
+}
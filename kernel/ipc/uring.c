@@ -0,0 +1,601 @@
+/*********************************************************************************/
+/* Module Name:  uring.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <ipc/uring.h>
+#include <vfs/fileio.h>
+#include <mm/heap.h>
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <lib/align.h>
+#include <lib/string.h>
+#include <user/syscall.h>
+#include <sys/poll.h>
+#include <sys/sched.h>
+#include <sys/uio.h>
+#include <sys/errno.h>
+#include <time/time.h>
+#include <aurix.h>
+
+#define URING_CQES_OFF 64
+
+struct uring_poll {
+	struct uring_poll *next;
+	int fd;
+	short events;
+	uint64_t user_data;
+};
+
+static struct uring *uring_list = NULL;
+static spinlock_t uring_list_lock;
+
+// the worker is a kernel thread inside the ring's process, so the buffers,
+// paths and descriptors in an SQE mean the same thing to it as to the
+// submitter. requests run through the regular syscall handlers
+static int64_t uring_call(uint32_t id, syscall_args_t *args)
+{
+	if (id >= MAX_SYSCALLS || !syscall_table[id].valid)
+		return -ENOSYS;
+	return syscall_table[id].handler(args);
+}
+
+// once every other thread of the process is gone the worker has nobody left
+// to serve and must not hold the process up
+static bool uring_orphaned(struct uring *ring)
+{
+	return atomic_load(&ring->proc->thread_count) <= 1;
+}
+
+static void uring_post(struct uring *ring, uint64_t user_data, int32_t res)
+{
+	struct uring_ctl *ctl = ring->ctl;
+
+	// wait for userspace to reap, nothing gets dropped unless we're going away
+	while (ring->cq_tail - __atomic_load_n(&ctl->cq_head, __ATOMIC_ACQUIRE) >=
+		   ring->cq_entries) {
+		if (atomic_load(&ring->stop) || uring_orphaned(ring)) {
+			__atomic_fetch_add(&ctl->cq_overflow, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		sched_yield();
+	}
+
+	struct uring_cqe *cqe = &ring->cqes[ring->cq_tail & (ring->cq_entries - 1)];
+	cqe->user_data = user_data;
+	cqe->res = res;
+	cqe->flags = 0;
+
+	__atomic_store_n(&ring->cq_tail, ring->cq_tail + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ctl->cq_tail, ring->cq_tail, __ATOMIC_RELEASE);
+	waitq_wake_all(&ring->cq_wq);
+}
+
+static bool uring_owns_fd(struct uring *ring, int fd)
+{
+	struct pcb *proc = ring->proc;
+	spinlock_acquire(&proc->fd_lock);
+	struct fileio *f = fdtable_get(&proc->fdt, fd);
+	bool owns = f && (f->flags & URING_FILE) && f->private == ring;
+	spinlock_release(&proc->fd_lock);
+	return owns;
+}
+
+static int64_t uring_rw(const struct uring_sqe *sqe, bool write)
+{
+	syscall_args_t args;
+	memset(&args, 0, sizeof(args));
+	args.rdi = (uint64_t)(int64_t)sqe->fd;
+
+	if (sqe->off == URING_OFF_CURRENT) {
+		args.rsi = sqe->addr;
+		args.rdx = sqe->len;
+		return uring_call(write ? SYS_WRITE : SYS_READ, &args);
+	}
+
+	struct iovec iov = { .iov_base = (void *)(uintptr_t)sqe->addr,
+						 .iov_len = sqe->len };
+	args.rsi = (uint64_t)(uintptr_t)&iov;
+	args.rdx = 1;
+	args.r10 = sqe->off;
+	return uring_call(write ? SYS_PWRITEV : SYS_PREADV, &args);
+}
+
+static int64_t uring_rwv(const struct uring_sqe *sqe, bool write)
+{
+	syscall_args_t args;
+	memset(&args, 0, sizeof(args));
+	args.rdi = (uint64_t)(int64_t)sqe->fd;
+	args.rsi = sqe->addr;
+	args.rdx = sqe->len;
+
+	if (sqe->off == URING_OFF_CURRENT)
+		return uring_call(write ? SYS_WRITEV : SYS_READV, &args);
+
+	args.r10 = sqe->off;
+	return uring_call(write ? SYS_PWRITEV : SYS_PREADV, &args);
+}
+
+static int64_t uring_poll_check(int fd, short events)
+{
+	struct pollfd pfd = { .fd = fd, .events = events, .revents = 0 };
+	int ready = 0;
+
+	syscall_args_t args;
+	memset(&args, 0, sizeof(args));
+	args.rdi = (uint64_t)(uintptr_t)&pfd;
+	args.rsi = 1;
+	args.rdx = 0;
+	args.r10 = (uint64_t)(uintptr_t)&ready;
+
+	int64_t r = uring_call(SYS_POLL, &args);
+	if (r < 0)
+		return r;
+	return pfd.revents;
+}
+
+// poll requests complete once the fd has something to report, until then they
+// sit on the ring and get rechecked every pass of the worker
+static void uring_poll_add(struct uring *ring, const struct uring_sqe *sqe)
+{
+	if (sqe->fd < 0) {
+		uring_post(ring, sqe->user_data, -EBADF);
+		return;
+	}
+
+	short events = (short)sqe->op_flags;
+	int64_t r = uring_poll_check(sqe->fd, events);
+	if (r != 0) {
+		uring_post(ring, sqe->user_data, (int32_t)r);
+		return;
+	}
+
+	struct uring_poll *p = kmalloc(sizeof(*p));
+	if (!p) {
+		uring_post(ring, sqe->user_data, -ENOMEM);
+		return;
+	}
+
+	p->fd = sqe->fd;
+	p->events = events;
+	p->user_data = sqe->user_data;
+	p->next = ring->polls;
+	ring->polls = p;
+}
+
+static bool uring_run_polls(struct uring *ring)
+{
+	bool progress = false;
+	struct uring_poll **link = &ring->polls;
+
+	while (*link) {
+		struct uring_poll *p = *link;
+		int64_t r = uring_poll_check(p->fd, p->events);
+		if (r == 0) {
+			link = &p->next;
+			continue;
+		}
+
+		*link = p->next;
+		uring_post(ring, p->user_data, (int32_t)r);
+		kfree(p);
+		progress = true;
+	}
+
+	return progress;
+}
+
+static void uring_issue(struct uring *ring, const struct uring_sqe *sqe)
+{
+	syscall_args_t args;
+	int64_t res;
+
+	switch (sqe->opcode) {
+	case URING_OP_NOP:
+		res = 0;
+		break;
+	case URING_OP_READ:
+	case URING_OP_WRITE:
+		res = uring_rw(sqe, sqe->opcode == URING_OP_WRITE);
+		break;
+	case URING_OP_READV:
+	case URING_OP_WRITEV:
+		res = uring_rwv(sqe, sqe->opcode == URING_OP_WRITEV);
+		break;
+	case URING_OP_OPENAT:
+		memset(&args, 0, sizeof(args));
+		args.rdi = (uint64_t)(int64_t)sqe->fd;
+		args.rsi = sqe->addr;
+		args.rdx = sqe->op_flags;
+		args.r10 = sqe->mode;
+		res = uring_call(SYS_OPENAT, &args);
+		break;
+	case URING_OP_CLOSE:
+		// closing our own ring from its worker would wait on ourselves
+		if (uring_owns_fd(ring, sqe->fd)) {
+			res = -EBADF;
+			break;
+		}
+		memset(&args, 0, sizeof(args));
+		args.rdi = (uint64_t)(int64_t)sqe->fd;
+		res = uring_call(SYS_CLOSE, &args);
+		break;
+	case URING_OP_POLL:
+		uring_poll_add(ring, sqe);
+		return;
+	default:
+		res = -EINVAL;
+		break;
+	}
+
+	uring_post(ring, sqe->user_data, (int32_t)res);
+}
+
+static bool uring_drain_sq(struct uring *ring)
+{
+	uint32_t tail;
+	if (ring->flags & URING_SETUP_SQPOLL)
+		tail = __atomic_load_n(&ring->ctl->sq_tail, __ATOMIC_ACQUIRE);
+	else
+		tail = atomic_load(&ring->sq_submit);
+
+	if (tail == ring->sq_head)
+		return false;
+
+	// a tail more than a ring ahead can only be garbage
+	if (tail - ring->sq_head > ring->sq_entries) {
+		uint32_t excess = tail - ring->sq_head - ring->sq_entries;
+		__atomic_fetch_add(&ring->ctl->sq_dropped, excess, __ATOMIC_RELAXED);
+		tail = ring->sq_head + ring->sq_entries;
+	}
+
+	while (ring->sq_head != tail && !atomic_load(&ring->stop)) {
+		// take a copy, userspace may already be refilling the slot
+		struct uring_sqe sqe =
+			ring->sqes[ring->sq_head & (ring->sq_entries - 1)];
+
+		__atomic_store_n(&ring->sq_head, ring->sq_head + 1, __ATOMIC_RELEASE);
+		__atomic_store_n(&ring->ctl->sq_head, ring->sq_head,
+						 __ATOMIC_RELEASE);
+
+		uring_issue(ring, &sqe);
+	}
+
+	return true;
+}
+
+static struct uring *uring_find(struct tcb *worker)
+{
+	spinlock_acquire(&uring_list_lock);
+	struct uring *ring = uring_list;
+	while (ring && ring->worker != worker)
+		ring = ring->next;
+	spinlock_release(&uring_list_lock);
+	return ring;
+}
+
+static bool uring_sq_pending(struct uring *ring)
+{
+	uint32_t tail;
+	if (ring->flags & URING_SETUP_SQPOLL)
+		tail = __atomic_load_n(&ring->ctl->sq_tail, __ATOMIC_ACQUIRE);
+	else
+		tail = atomic_load(&ring->sq_submit);
+	return tail != ring->sq_head;
+}
+
+// an SQPOLL worker only goes to sleep after telling userspace, then looks
+// at the tail once more in case an SQE slipped in before it saw the flag
+static bool uring_sqpoll_sleep(struct uring *ring)
+{
+	__atomic_fetch_or(&ring->ctl->sq_flags, URING_SQ_NEED_WAKEUP,
+					  __ATOMIC_SEQ_CST);
+	uint32_t tail = __atomic_load_n(&ring->ctl->sq_tail, __ATOMIC_SEQ_CST);
+	if (tail == ring->sq_head)
+		return true;
+
+	__atomic_fetch_and(&ring->ctl->sq_flags, ~URING_SQ_NEED_WAKEUP,
+					   __ATOMIC_RELAXED);
+	return false;
+}
+
+static void uring_worker(void)
+{
+	struct tcb *self = thread_current();
+	struct uring *ring;
+
+	// thread_create() runs us before uring_setup() gets to record who we are
+	while (!(ring = uring_find(self)))
+		sched_yield();
+
+	bool sqpoll = ring->flags & URING_SETUP_SQPOLL;
+	uint64_t idle_since = get_ms();
+
+	while (!atomic_load(&ring->stop) && !uring_orphaned(ring)) {
+		bool busy = uring_drain_sq(ring);
+		if (uring_run_polls(ring))
+			busy = true;
+		if (busy)
+			idle_since = get_ms();
+
+		// nothing says when a polled fd becomes ready, those keep us
+		// rechecking, and so does SQPOLL for a while after the last SQE
+		if (busy || ring->polls ||
+			(sqpoll && get_ms() - idle_since < URING_SQPOLL_IDLE_MS)) {
+			if (!busy)
+				sched_yield();
+			continue;
+		}
+
+		// only queued for the last look, requests may block on wait
+		// queues of their own and a thread sits on one at a time
+		waitq_prepare(&ring->worker_wq);
+		if (!uring_sq_pending(ring) && !atomic_load(&ring->stop) &&
+			!uring_orphaned(ring) && (!sqpoll || uring_sqpoll_sleep(ring)))
+			sched_block();
+		waitq_finish(&ring->worker_wq);
+
+		if (sqpoll)
+			__atomic_fetch_and(&ring->ctl->sq_flags, ~URING_SQ_NEED_WAKEUP,
+							   __ATOMIC_RELAXED);
+		idle_since = get_ms();
+	}
+
+	int code = ring->proc->exit_code;
+	atomic_store(&ring->worker_live, false);
+	waitq_wake_all(&ring->cq_wq);
+	thread_exit(self, code);
+}
+
+static bool uring_worker_alive(struct uring *ring)
+{
+	if (!atomic_load(&ring->worker_live))
+		return false;
+
+	// the worker dies without a word if its process gets killed
+	struct tcb *t = thread_get_by_tid(ring->worker_tid);
+	return t && t == ring->worker;
+}
+
+static uint32_t uring_roundup(uint32_t n)
+{
+	uint32_t v = 1;
+	while (v < n)
+		v <<= 1;
+	return v;
+}
+
+static void uring_free(struct uring *ring)
+{
+	spinlock_acquire(&uring_list_lock);
+	struct uring **link = &uring_list;
+	while (*link) {
+		if (*link == ring) {
+			*link = ring->next;
+			break;
+		}
+		link = &(*link)->next;
+	}
+	spinlock_release(&uring_list_lock);
+
+	while (ring->polls) {
+		struct uring_poll *p = ring->polls;
+		ring->polls = p->next;
+		kfree(p);
+	}
+
+	// userspace mappings hold their own page references
+	pmm_ref_dec(ring->phys, ring->pages);
+	kfree(ring);
+}
+
+int uring_setup(struct pcb *proc, uint32_t entries, struct uring_params *p,
+				struct fileio **out)
+{
+	if (entries == 0 || entries > URING_MAX_ENTRIES)
+		return -EINVAL;
+	if (p->flags & ~URING_SETUP_SQPOLL)
+		return -EINVAL;
+
+	uint32_t sq = uring_roundup(entries);
+	uint32_t cq = sq * 2;
+
+	size_t sqes_off =
+		ALIGN_UP(URING_CQES_OFF + cq * sizeof(struct uring_cqe), 64);
+	size_t size = sqes_off + sq * sizeof(struct uring_sqe);
+
+	struct uring *ring = kmalloc(sizeof(*ring));
+	if (!ring)
+		return -ENOMEM;
+	memset(ring, 0, sizeof(*ring));
+	waitq_init(&ring->worker_wq);
+	waitq_init(&ring->cq_wq);
+
+	ring->pages = DIV_ROUND_UP(size, PAGE_SIZE);
+	ring->phys = (uintptr_t)palloc(ring->pages);
+	if (!ring->phys) {
+		kfree(ring);
+		return -ENOMEM;
+	}
+
+	uint8_t *base = (uint8_t *)PHYS_TO_VIRT(ring->phys);
+	memset(base, 0, ring->pages * PAGE_SIZE);
+
+	ring->proc = proc;
+	ring->flags = p->flags;
+	ring->sq_entries = sq;
+	ring->cq_entries = cq;
+	ring->ctl = (struct uring_ctl *)base;
+	ring->cqes = (struct uring_cqe *)(base + URING_CQES_OFF);
+	ring->sqes = (struct uring_sqe *)(base + sqes_off);
+
+	ring->ctl->sq_mask = sq - 1;
+	ring->ctl->sq_entries = sq;
+	ring->ctl->cq_mask = cq - 1;
+	ring->ctl->cq_entries = cq;
+
+	p->sq_entries = sq;
+	p->cq_entries = cq;
+	p->size = (uint32_t)size;
+	p->sq_off.head = offsetof(struct uring_ctl, sq_head);
+	p->sq_off.tail = offsetof(struct uring_ctl, sq_tail);
+	p->sq_off.mask = offsetof(struct uring_ctl, sq_mask);
+	p->sq_off.entries = offsetof(struct uring_ctl, sq_entries);
+	p->sq_off.dropped = offsetof(struct uring_ctl, sq_dropped);
+	p->sq_off.sqes = (uint32_t)sqes_off;
+	p->sq_off.flags = offsetof(struct uring_ctl, sq_flags);
+	p->cq_off.head = offsetof(struct uring_ctl, cq_head);
+	p->cq_off.tail = offsetof(struct uring_ctl, cq_tail);
+	p->cq_off.mask = offsetof(struct uring_ctl, cq_mask);
+	p->cq_off.entries = offsetof(struct uring_ctl, cq_entries);
+	p->cq_off.overflow = offsetof(struct uring_ctl, cq_overflow);
+	p->cq_off.cqes = URING_CQES_OFF;
+
+	struct fileio *fio = fio_create();
+	if (!fio) {
+		pmm_ref_dec(ring->phys, ring->pages);
+		kfree(ring);
+		return -ENOMEM;
+	}
+
+	fio->flags = URING_FILE | O_RDWR | O_CLOEXEC;
+	fio->private = ring;
+
+	spinlock_acquire(&uring_list_lock);
+	ring->next = uring_list;
+	uring_list = ring;
+	spinlock_release(&uring_list_lock);
+
+	atomic_store(&ring->worker_live, true);
+	struct tcb *worker = thread_create(proc, uring_worker);
+	if (!worker) {
+		atomic_store(&ring->worker_live, false);
+		uring_free(ring);
+		kfree(fio);
+		return -EAGAIN;
+	}
+
+	spinlock_acquire(&uring_list_lock);
+	ring->worker = worker;
+	ring->worker_tid = worker->tid;
+	spinlock_release(&uring_list_lock);
+
+	*out = fio;
+	return 0;
+}
+
+static uint32_t uring_cq_ready(struct uring *ring)
+{
+	return __atomic_load_n(&ring->cq_tail, __ATOMIC_ACQUIRE) -
+		   __atomic_load_n(&ring->ctl->cq_head, __ATOMIC_ACQUIRE);
+}
+
+int uring_enter(struct fileio *fio, uint32_t to_submit, uint32_t min_complete,
+				uint32_t flags)
+{
+	struct uring *ring = fio->private;
+
+	if (flags & ~URING_ENTER_GETEVENTS)
+		return -EINVAL;
+	if (!uring_worker_alive(ring))
+		return -EBADF;
+
+	uint32_t submitted = to_submit;
+	if (!(ring->flags & URING_SETUP_SQPOLL)) {
+		spinlock_acquire(&ring->lock);
+
+		uint32_t tail = __atomic_load_n(&ring->ctl->sq_tail, __ATOMIC_ACQUIRE);
+		uint32_t sub = atomic_load(&ring->sq_submit);
+		uint32_t head = __atomic_load_n(&ring->sq_head, __ATOMIC_ACQUIRE);
+		uint32_t queued = tail - sub;
+		uint32_t room = ring->sq_entries - (sub - head);
+
+		if (queued > room)
+			queued = room;
+		if (submitted > queued)
+			submitted = queued;
+		atomic_store(&ring->sq_submit, sub + submitted);
+
+		spinlock_release(&ring->lock);
+	}
+
+	// SQPOLL workers may have gone to sleep too, a plain enter wakes them
+	waitq_wake_all(&ring->worker_wq);
+
+	if (flags & URING_ENTER_GETEVENTS) {
+		if (min_complete > ring->cq_entries)
+			min_complete = ring->cq_entries;
+
+		struct tcb *self = thread_current();
+		while (!atomic_load(&self->kill_pending)) {
+			waitq_prepare(&ring->cq_wq);
+			if (uring_cq_ready(ring) >= min_complete ||
+				!uring_worker_alive(ring)) {
+				waitq_finish(&ring->cq_wq);
+				break;
+			}
+			sched_block();
+			waitq_finish(&ring->cq_wq);
+		}
+	}
+
+	return (int)submitted;
+}
+
+int uring_mmap(struct fileio *fio, struct pcb *proc, size_t offset,
+			   size_t pages, uint64_t vflags, void **out)
+{
+	struct uring *ring = fio->private;
+	size_t first = offset / PAGE_SIZE;
+
+	if (!proc->vctx)
+		return -EINVAL;
+	if (first >= ring->pages || pages > ring->pages - first)
+		return -EINVAL;
+
+	uintptr_t phys = ring->phys + first * PAGE_SIZE;
+	pmm_ref_inc(phys, pages);
+
+	void *mapped = vallocatp(proc->vctx, pages, vflags, phys);
+	if (!mapped) {
+		pmm_ref_dec(phys, pages);
+		return -ENOMEM;
+	}
+
+	*out = mapped;
+	return 0;
+}
+
+int uring_close(struct fileio *fio)
+{
+	struct uring *ring = fio->private;
+
+	atomic_store(&ring->stop, true);
+	waitq_wake_all(&ring->worker_wq);
+
+	// stop is only looked at between requests, one stuck in a read on an
+	// empty pipe would keep us here for good. kill the worker out of it,
+	// nobody is left to reap what it was doing anyway
+	if (uring_worker_alive(ring))
+		thread_kill(ring->proc, ring->worker, ring->proc->exit_code);
+	while (uring_worker_alive(ring))
+		sched_yield();
+
+	uring_free(ring);
+	kfree(fio);
+	return 0;
+}
@@ -36,6 +36,7 @@
 #include <platform/time/pit.h>
 #include <platform/time/time.h>
 #include <dev/driver.h>
+#include <dev/bcache.h>
 #include <vfs/vfs.h>
 #include <flanterm/flanterm.h>
 #include <flanterm/backends/fb.h>
@@ -43,10 +44,11 @@
 #include <aurix.h>
 #include <sys/sched.h>
 #include <sys/panic.h>
+#include <sys/boottime.h>
 #include <fs/devfs.h>
 #include <ksh/ksh.h>
 #include <fs/ramfs.h>
-#include <fs/cpio/newc.h>
+#include <fs/cpio/cpiofs.h>
 #include <loader/elf.h>
 #include <user/syscall.h>
 #include <dev/builtin/builtin.h>
@@ -242,6 +244,9 @@ void _start(struct aurix_parameters *params)
 				AURIX_PROTOCOL_REVISION, params->revision);
 	}
 
+	boottime_import(params);
+	boottime_mark("kernel entry");
+
 	ft_ctx = flanterm_fb_init(
 		NULL, NULL, (uint32_t *)boot_params->framebuffer.addr,
 		boot_params->framebuffer.width, boot_params->framebuffer.height,
@@ -253,34 +258,44 @@ void _start(struct aurix_parameters *params)
 		error("Failed to init flanterm\n");
 
 	kprintf("%s\n", aurix_banner);
+	boottime_mark("console");
 
 	cpu_early_init();
 
 	pmm_init();
+	boottime_mark("pmm");
 
 	paging_init();
+	boottime_mark("paging");
 
 	smbios_init((void *)boot_params->smbios_addr);
 
 	acpi_init((void *)boot_params->rsdp_addr);
+	boottime_mark("acpi");
 	apic_init();
+	boottime_mark("apic");
 
 	cpu_init();
+	time_clocksource_init();
+	boottime_mark("clocksource");
 
 	debug("kernel cmdline: %s\n", boot_params->cmdline);
 	parse_boot_args(boot_params->cmdline);
 
 	kvctx = vinit(kernel_pm, 0xffffffff90000000ULL);
 	heap_init(kvctx);
+	boottime_mark("heap");
 
 	// TODO: Add kernel cmdline parsing
 	if (1) {
 		test_run(10);
+		boottime_mark("self tests");
 	}
 
 #ifdef __x86_64__
 	// TODO: Use HPET instead?
 	pit_init(50);
+	boottime_mark("pit");
 #else
 #warning No clock implemented, the scheduler will not fire!
 #endif
@@ -299,36 +314,39 @@ void _start(struct aurix_parameters *params)
 		kpanic(NULL, "No initrd found, checked \\System\\initrd.cpio");
 	}
 
-	struct cpio_fs *cpio = kmalloc(sizeof(struct cpio_fs));
-	memset(cpio, 0, sizeof(struct cpio_fs));
-	if (cpio_fs_parse(cpio, (void *)PHYS_TO_VIRT((uintptr_t)initrd_mod->addr),
-					  initrd_mod->size) != 0) {
+	// the initrd stays where the bootloader put it, ramfs only holds changes
+	cpiofs_init();
+	struct vfs *initrd_vfs = NULL;
+	if (cpiofs_mount((void *)PHYS_TO_VIRT((uintptr_t)initrd_mod->addr),
+					 initrd_mod->size, "/", &initrd_vfs) != 0) {
 		kpanic(NULL, "Failed to parse initrd file.");
 	}
+	boottime_mark("initrd mount");
 
 	ramfs_init();
 	struct ramfs *ramfs = ramfs_create_fs();
+	ramfs->lower = initrd_vfs->root_vnode;
 
 	if (ramfs_vfs_init(ramfs, "/") != 0) {
 		kpanic(NULL, "Failed to initialize ramfs");
 	}
 
-	if (cpio_extract(cpio, "/") != 0) {
-		kpanic(NULL, "Failed to parse initrd file on second pass.");
-	}
-
 	vfs_mkdir("/dev", 0755);
 
 	devfs_init();
 	struct devfs *devfs = devfs_create_fs();
 	if (devfs_vfs_init(devfs, "/dev") != 0)
 		kpanic(NULL, "Failed to initialize devfs");
+	boottime_mark("filesystems");
 
 	driver_core_init(devfs);
 	builtin_dev_init(builtin_dev_list, builtin_dev_count);
+	boottime_mark("builtin devices");
 	cpu_init_mp();
+	boottime_mark("smp");
 	syscall_builtin_init();
 	sched_init();
+	boottime_mark("scheduler");
 
 	platform_timekeeper_init();
 	struct fileio *klog_file =
@@ -344,6 +362,7 @@ void _start(struct aurix_parameters *params)
 		  time_get_second());
 
 	pmm_reclaim_bootparms();
+	boottime_mark("boot complete");
 	{
 		uint64_t ms = get_ms();
 		success("Kernel boot complete in %u.%03u seconds\n",
@@ -368,6 +387,16 @@ void _start(struct aurix_parameters *params)
 	 * sysvinit refuses to run as any other PID.
 	 */
 	stage_boot_modules_to_ramfs();
+	boottime_mark("modules staged");
+	boottime_publish();
+
+	// idle residency keeps changing, so link to the device that renders it
+	// instead of writing a snapshot like /sys/boottime
+	if (vfs_symlink("/dev/cpuidle", "/sys/cpuidle") != 0)
+		warn("Failed to link /sys/cpuidle\n");
+
+	// a process of its own, spawned after init so that keeps PID 1
+	bcache_init();
 
 	pit_set_freq(1000); // 1kHz should be fast enough
 	sched_enable();
@@ -24,13 +24,18 @@
 #include <lib/string.h>
 #include <mm/pmm.h>
 #include <sys/sched.h>
+#include <sys/cpuidle.h>
+#include <sys/kstack.h>
 #include <time/time.h>
 #include <util/kprintf.h>
 #include <boot/axprot.h>
 #include <cpu/trace.h>
 #include <mm/vmm.h>
+#include <dev/blkdev.h>
 #include <dev/driver.h>
 #include <sys/ksyms.h>
+#include <sys/boottime.h>
+#include <sys/prof.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -61,6 +66,7 @@ static int cmd_cpuinfo(int argc, char **argv);
 static int cmd_threads(int argc, char **argv);
 static int cmd_ps(int argc, char **argv);
 static int cmd_uptime(int argc, char **argv);
+static int cmd_boottime(int argc, char **argv);
 static int cmd_whoami(int argc, char **argv);
 static int cmd_hexdump(int argc, char **argv);
 static int cmd_sched(int argc, char **argv);
@@ -75,6 +81,8 @@ static int cmd_registers(int argc, char **argv);
 static int cmd_devices(int argc, char **argv);
 static int cmd_kconfig(int argc, char **argv);
 static int cmd_kill(int argc, char **argv);
+static int cmd_prof(int argc, char **argv);
+static int cmd_blkbench(int argc, char **argv);
 
 static const ksh_command ksh_commands[] = {
 	{ "help", "help [cmd]", "list commands / show help for cmd", cmd_help },
@@ -89,9 +97,11 @@ static const ksh_command ksh_commands[] = {
 	  cmd_threads },
 	{ "ps", "ps", "list processes (derived from runnable threads)", cmd_ps },
 	{ "uptime", "uptime", "show time since boot in ms", cmd_uptime },
+	{ "boottime", "boottime", "show time spent in each boot phase",
+	  cmd_boottime },
 	{ "whoami", "whoami", "show current thread/process/cpu", cmd_whoami },
 	{ "free", "free", "show physical memory usage", cmd_free },
-	{ "sched", "sched", "show scheduler enabled state", cmd_sched },
+	{ "sched", "sched", "show scheduler state per CPU", cmd_sched },
 	{ "modls", "modls", "shows loaded modules", cmd_modls },
 	{ "hexdump", "hexdump <addr> <len>", "dump memory (unsafe if unmapped)",
 	  cmd_hexdump },
@@ -101,6 +111,11 @@ static const ksh_command ksh_commands[] = {
 	{ "exec", "exec [-u|-k] <path>", "execute userspace/kernel executable",
 	  cmd_exec },
 	{ "kill", "kill <pid>", "kill process by PID", cmd_kill },
+	{ "prof", "prof start [hz]|stop|report [n]",
+	  "sample kernel stacks, dump folded stacks to /sys/profile", cmd_prof },
+	{ "blkbench", "blkbench <dev> [read|write] [kb] [count]",
+	  "measure block device latency and throughput (write is destructive)",
+	  cmd_blkbench },
 };
 
 static bool ksh_is_idle_thread_on_cpu(tcb *t, struct cpu *cpu)
@@ -258,6 +273,16 @@ static int cmd_cpuinfo(int argc, char **argv)
 		kprintf("  features: sse=%u sse2=%u apic=%u tsc=%u\n",
 				c->cpuid.edx_bits.sse, c->cpuid.edx_bits.sse2,
 				c->cpuid.edx_bits.apic, c->cpuid.edx_bits.tsc);
+		kprintf("  topology: lapic=%u package=%u core=%u smt=%u node=%u\n",
+				c->lapic_id, c->package, c->core, c->smt, c->node);
+
+		struct cpuidle_stats idle;
+		cpuidle_get_stats(c, &idle);
+		kprintf("  idle: method=%s residency=%llums entries=%llu kicks=%llu\n",
+				idle.mwait ? "mwait" : "hlt",
+				(unsigned long long)(idle.residency_ns / 1000000),
+				(unsigned long long)idle.entries,
+				(unsigned long long)idle.kicks);
 	}
 	return 0;
 }
@@ -273,6 +298,24 @@ static bool ksh_parse_cpu_id(const char *s, size_t *out)
 	return true;
 }
 
+static const char *ksh_sched_policy_name(int policy)
+{
+	switch (policy) {
+	case SCHED_FIFO:
+		return "fifo";
+	case SCHED_RR:
+		return "rr";
+	default:
+		return "other";
+	}
+}
+
+// nice for the fair class, rt_priority for the others
+static int ksh_sched_prio(const tcb *t)
+{
+	return t->policy == SCHED_OTHER ? t->nice : t->rt_priority;
+}
+
 static int cmd_threads(int argc, char **argv)
 {
 	bool single = false;
@@ -301,11 +344,20 @@ static int cmd_threads(int argc, char **argv)
 			uint32_t pid = p ? p->pid : 0;
 			const char *pname = (p && p->name) ? p->name : "(unnamed)";
 			if (ksh_is_idle_thread_on_cpu(t, c)) {
-				kprintf("  tid=idle pid=%u cpu=%u slice=%u proc=%p name=%s\n",
-						pid, c->id, t->time_slice, p, pname);
+				kprintf("  tid=idle pid=%u cpu=%u slice=%u run=%llums proc=%p "
+						"name=%s\n",
+						pid, c->id, t->time_slice,
+						(unsigned long long)sched_runtime_ms(t), p, pname);
 			} else {
-				kprintf("  tid=%u pid=%u cpu=%u slice=%u proc=%p name=%s\n",
-						t->tid, pid, c->id, t->time_slice, p, pname);
+				size_t stack = kstack_high_water(
+					(void *)(uintptr_t)(t->kthread.rsp0 - STACK_SIZE));
+				kprintf("  tid=%u pid=%u cpu=%u slice=%u class=%s prio=%d "
+						"mask=%llx run=%llums stack=%llu proc=%p name=%s\n",
+						t->tid, pid, c->id, t->time_slice,
+						ksh_sched_policy_name(t->policy), ksh_sched_prio(t),
+						(unsigned long long)(t->cpu_mask & sched_online_mask()),
+						(unsigned long long)sched_runtime_ms(t),
+						(unsigned long long)stack, p, pname);
 			}
 			t = t->cpu_next;
 		}
@@ -314,6 +366,8 @@ static int cmd_threads(int argc, char **argv)
 		irqlock_release(&c->sched_lock);
 	}
 
+	kprintf("kernel stack peak (exited threads): %llu of %llu bytes\n",
+			(unsigned long long)kstack_peak(), (unsigned long long)STACK_SIZE);
 	return 0;
 }
 
@@ -376,6 +430,14 @@ static int cmd_uptime(int argc, char **argv)
 	return 0;
 }
 
+static int cmd_boottime(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	boottime_print();
+	return 0;
+}
+
 static int cmd_whoami(int argc, char **argv)
 {
 	(void)argc;
@@ -418,6 +480,38 @@ static int cmd_sched(int argc, char **argv)
 	(void)argc;
 	(void)argv;
 	kprintf("sched: %s\n", sched_is_enabled() ? "enabled" : "disabled");
+
+	for (size_t i = 0; i < cpu_count; i++) {
+		struct cpu *c = &cpuinfo[i];
+		irqlock_acquire(&c->sched_lock);
+		uint64_t fair = 0, rt = 0;
+		for (tcb *t = c->thread_list; t; t = t->cpu_next) {
+			if (ksh_is_idle_thread_on_cpu(t, c))
+				continue;
+			if (t->policy == SCHED_OTHER)
+				fair++;
+			else
+				rt++;
+		}
+		uint64_t min_vruntime = sched_min_vruntime(c);
+		irqlock_release(&c->sched_lock);
+
+		struct sched_cpu_stats st;
+		sched_get_cpu_stats(c, &st);
+		uint64_t total = st.busy_ns + st.idle_ns;
+
+		kprintf("CPU%u: runnable=%llu fair=%llu rt=%llu min_vruntime=%llu\n",
+				c->id, (unsigned long long)c->thread_count,
+				(unsigned long long)fair, (unsigned long long)rt,
+				(unsigned long long)min_vruntime);
+		kprintf("  util=%llu%% busy=%llums idle=%llums migrated in=%llu "
+				"out=%llu\n",
+				(unsigned long long)(total ? st.busy_ns * 100 / total : 0),
+				(unsigned long long)(st.busy_ns / 1000000),
+				(unsigned long long)(st.idle_ns / 1000000),
+				(unsigned long long)st.migrations_in,
+				(unsigned long long)st.migrations_out);
+	}
 	return 0;
 }
 
@@ -899,3 +993,194 @@ static int cmd_kill(int argc, char **argv)
 
 	return 0;
 }
+
+static int cmd_prof(int argc, char **argv)
+{
+	if (argc < 2) {
+		kprintf("usage: prof start [hz]|stop|report [n]\n");
+		return 1;
+	}
+
+	if (streq(argv[1], "start")) {
+		uint64_t hz = PROF_DEFAULT_HZ;
+		if (argc > 2 && (!ksh_parse_u64(argv[2], &hz) || hz == 0 ||
+						 hz > 100000)) {
+			kprintf("ksh: invalid sampling rate\n");
+			return 1;
+		}
+
+		int err = prof_start((uint32_t)hz);
+		if (err != 0) {
+			kprintf("ksh: failed to start profiler (%d)\n", err);
+			return 1;
+		}
+		kprintf("profiling at %llu Hz\n", (unsigned long long)hz);
+		return 0;
+	}
+
+	if (streq(argv[1], "stop")) {
+		prof_stop();
+		kprintf("profiler stopped, %llu samples\n",
+				(unsigned long long)prof_sample_count());
+		return 0;
+	}
+
+	if (streq(argv[1], "report")) {
+		uint64_t top = 20;
+		if (argc > 2 && !ksh_parse_u64(argv[2], &top)) {
+			kprintf("ksh: invalid count\n");
+			return 1;
+		}
+
+		if (prof_report((size_t)top) != 0)
+			return 1;
+		if (prof_dump("/sys/profile") != 0) {
+			kprintf("ksh: failed to write /sys/profile\n");
+			return 1;
+		}
+		kprintf("folded stacks written to /sys/profile\n");
+		return 0;
+	}
+
+	kprintf("usage: prof start [hz]|stop|report [n]\n");
+	return 1;
+}
+
+#define BLKBENCH_DEPTH 32
+
+static volatile uint32_t blkbench_done;
+static volatile int blkbench_err;
+
+static void blkbench_end_io(struct blk_bio *bio)
+{
+	if (bio->status != 0)
+		blkbench_err = bio->status;
+	__atomic_store_n((bool *)bio->private, false, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&blkbench_done, 1, __ATOMIC_RELEASE);
+}
+
+static void blkbench_report(int depth, uint64_t bytes, uint64_t ns)
+{
+	if (ns == 0)
+		ns = 1;
+	uint64_t kbps = bytes * 1000000000ull / ns / 1024;
+	kprintf("qd%d: %llu KiB in %llu us, %llu KiB/s\n", depth,
+			(unsigned long long)(bytes / 1024),
+			(unsigned long long)(ns / 1000), (unsigned long long)kbps);
+}
+
+static int cmd_blkbench(int argc, char **argv)
+{
+	if (argc < 2) {
+		kprintf("usage: blkbench <dev> [read|write] [kb] [count]\n");
+		return 1;
+	}
+
+	struct blkdev *bdev = blkdev_find(argv[1]);
+	if (!bdev) {
+		kprintf("ksh: no such block device '%s'\n", argv[1]);
+		return 1;
+	}
+
+	int op = BLK_OP_READ;
+	if (argc > 2) {
+		if (streq(argv[2], "write")) {
+			op = BLK_OP_WRITE;
+		} else if (!streq(argv[2], "read")) {
+			kprintf("ksh: unknown operation '%s'\n", argv[2]);
+			return 1;
+		}
+	}
+
+	uint64_t kb = 4;
+	uint64_t count = 256;
+	if ((argc > 3 && (!ksh_parse_u64(argv[3], &kb) || kb == 0 || kb > 1024)) ||
+		(argc > 4 && (!ksh_parse_u64(argv[4], &count) || count == 0))) {
+		kprintf("ksh: invalid size or count\n");
+		return 1;
+	}
+
+	uint32_t sectors = (uint32_t)(kb * 1024 / bdev->sector_size);
+	if (sectors == 0 || (uint64_t)sectors * count > bdev->sector_count) {
+		kprintf("ksh: device too small for this run\n");
+		return 1;
+	}
+
+	size_t len = (size_t)sectors * bdev->sector_size;
+	uint8_t *buf = kmalloc(len * BLKBENCH_DEPTH);
+	struct blk_bio *bios = kmalloc(sizeof(*bios) * BLKBENCH_DEPTH);
+	if (!buf || !bios) {
+		kfree(buf);
+		kfree(bios);
+		kprintf("ksh: out of memory\n");
+		return 1;
+	}
+	memset(buf, 0xa5, len * BLKBENCH_DEPTH);
+
+	// one request at a time, for latency
+	uint64_t lat_min = UINT64_MAX, lat_max = 0, lat_sum = 0;
+	uint64_t start = time_ns();
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t t = time_ns();
+		int err = blk_rw_sync(bdev, op, i * sectors, sectors, buf);
+		t = time_ns() - t;
+		if (err != 0) {
+			kprintf("ksh: I/O error %d at sector %llu\n", err,
+					(unsigned long long)(i * sectors));
+			kfree(buf);
+			kfree(bios);
+			return 1;
+		}
+		lat_sum += t;
+		if (t < lat_min)
+			lat_min = t;
+		if (t > lat_max)
+			lat_max = t;
+	}
+	blkbench_report(1, len * count, time_ns() - start);
+	kprintf("latency: min %llu us, avg %llu us, max %llu us\n",
+			(unsigned long long)(lat_min / 1000),
+			(unsigned long long)(lat_sum / count / 1000),
+			(unsigned long long)(lat_max / 1000));
+
+	// keep BLKBENCH_DEPTH bios in flight, for throughput
+	bool busy[BLKBENCH_DEPTH] = { 0 };
+	blkbench_done = 0;
+	blkbench_err = 0;
+	uint64_t issued = 0;
+	start = time_ns();
+	while (blkbench_done < count) {
+		blk_plug(bdev);
+		for (size_t slot = 0; slot < BLKBENCH_DEPTH && issued < count;
+			 slot++) {
+			if (__atomic_load_n(&busy[slot], __ATOMIC_ACQUIRE))
+				continue;
+
+			busy[slot] = true;
+			bios[slot] = (struct blk_bio){
+				.op = op,
+				.sector = issued * sectors,
+				.count = sectors,
+				.buf = buf + slot * len,
+				.end_io = blkbench_end_io,
+				.private = &busy[slot],
+			};
+			blk_submit_bio(bdev, &bios[slot]);
+			issued++;
+		}
+		blk_unplug(bdev);
+
+		sched_yield();
+		__asm__ volatile("pause" ::: "memory");
+	}
+	blkbench_report(BLKBENCH_DEPTH, len * count, time_ns() - start);
+
+	kfree(buf);
+	kfree(bios);
+
+	if (blkbench_err != 0) {
+		kprintf("ksh: I/O error %d\n", blkbench_err);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,164 @@
+/*********************************************************************************/
+/* Module Name:  idr.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <lib/idr.h>
+#include <mm/heap.h>
+#include <string.h>
+
+static inline bool idr_test(const uint64_t *map, uint32_t bit)
+{
+	return map[bit / 64] & (1ULL << (bit % 64));
+}
+
+static inline void idr_set(uint64_t *map, uint32_t bit)
+{
+	map[bit / 64] |= 1ULL << (bit % 64);
+}
+
+static inline void idr_clear(uint64_t *map, uint32_t bit)
+{
+	map[bit / 64] &= ~(1ULL << (bit % 64));
+}
+
+// first clear bit at or after from, or IDR_NONE
+static uint32_t idr_next_zero(const uint64_t *map, uint32_t bits,
+							  uint32_t from)
+{
+	for (uint32_t w = from / 64; w < bits / 64; w++) {
+		uint64_t free = ~map[w];
+		if (w == from / 64)
+			free &= ~0ULL << (from % 64);
+		if (free)
+			return w * 64 + (uint32_t)__builtin_ctzll(free);
+	}
+	return IDR_NONE;
+}
+
+static struct idr_leaf *idr_leaf_get(struct idr *idr, uint32_t li)
+{
+	struct idr_leaf *leaf = idr->leaves[li];
+	if (leaf)
+		return leaf;
+
+	leaf = kmalloc(sizeof(*leaf));
+	if (!leaf)
+		return NULL;
+	memset(leaf, 0, sizeof(*leaf));
+
+	__atomic_store_n(&idr->leaves[li], leaf, __ATOMIC_RELEASE);
+	return leaf;
+}
+
+static uint32_t idr_take(struct idr *idr, struct idr_leaf *leaf, uint32_t id,
+						 void *ptr)
+{
+	idr_set(leaf->used, id & IDR_LEAF_MASK);
+	if (++leaf->count == IDR_LEAF_SIZE)
+		idr_set(idr->full, id >> IDR_LEAF_BITS);
+	__atomic_store_n(&leaf->slots[id & IDR_LEAF_MASK], ptr, __ATOMIC_RELEASE);
+	return id;
+}
+
+// lowest free ID in [from, IDR_MAX_ID), only the first leaf looked at can
+// come up empty, every later one has a free slot by its full bit
+static uint32_t idr_search(struct idr *idr, uint32_t from, void *ptr)
+{
+	uint32_t li = from >> IDR_LEAF_BITS;
+	uint32_t off = from & IDR_LEAF_MASK;
+
+	while ((li = idr_next_zero(idr->full, IDR_LEAVES, li)) != IDR_NONE) {
+		struct idr_leaf *leaf = idr_leaf_get(idr, li);
+		if (!leaf)
+			return IDR_NONE;
+
+		uint32_t slot = idr_next_zero(leaf->used, IDR_LEAF_SIZE, off);
+		if (slot != IDR_NONE)
+			return idr_take(idr, leaf, (li << IDR_LEAF_BITS) | slot, ptr);
+
+		li++;
+		off = 0;
+		if (li >= IDR_LEAVES)
+			break;
+	}
+
+	return IDR_NONE;
+}
+
+uint32_t idr_alloc(struct idr *idr, void *ptr)
+{
+	spinlock_acquire(&idr->lock);
+
+	uint32_t id = idr_search(idr, idr->next, ptr);
+	if (id == IDR_NONE && idr->next != 0)
+		id = idr_search(idr, 0, ptr);
+	if (id != IDR_NONE)
+		idr->next = (id + 1) % IDR_MAX_ID;
+
+	spinlock_release(&idr->lock);
+	return id;
+}
+
+// mark an ID as taken without a pointer, e.g. to keep 0 out of circulation
+bool idr_reserve(struct idr *idr, uint32_t id)
+{
+	if (id >= IDR_MAX_ID)
+		return false;
+
+	spinlock_acquire(&idr->lock);
+
+	struct idr_leaf *leaf = idr_leaf_get(idr, id >> IDR_LEAF_BITS);
+	bool ok = leaf && !idr_test(leaf->used, id & IDR_LEAF_MASK);
+	if (ok)
+		idr_take(idr, leaf, id, NULL);
+
+	spinlock_release(&idr->lock);
+	return ok;
+}
+
+void idr_remove(struct idr *idr, uint32_t id)
+{
+	if (id >= IDR_MAX_ID)
+		return;
+
+	spinlock_acquire(&idr->lock);
+
+	struct idr_leaf *leaf = idr->leaves[id >> IDR_LEAF_BITS];
+	if (leaf && idr_test(leaf->used, id & IDR_LEAF_MASK)) {
+		__atomic_store_n(&leaf->slots[id & IDR_LEAF_MASK], NULL,
+						 __ATOMIC_RELEASE);
+		idr_clear(leaf->used, id & IDR_LEAF_MASK);
+		leaf->count--;
+		idr_clear(idr->full, id >> IDR_LEAF_BITS);
+	}
+
+	spinlock_release(&idr->lock);
+}
+
+// swap what an allocated ID points to, the ID itself stays taken
+void idr_replace(struct idr *idr, uint32_t id, void *ptr)
+{
+	if (id >= IDR_MAX_ID)
+		return;
+
+	struct idr_leaf *leaf =
+		__atomic_load_n(&idr->leaves[id >> IDR_LEAF_BITS], __ATOMIC_ACQUIRE);
+	if (leaf)
+		__atomic_store_n(&leaf->slots[id & IDR_LEAF_MASK], ptr,
+						 __ATOMIC_RELEASE);
+}
@@ -65,8 +65,7 @@ uintptr_t elf32_load(char *data, uintptr_t *addr, size_t *size,
 	return 0;
 }
 
-uintptr_t elf64_load(char *data, uintptr_t *addr, size_t *size,
-					 pagetable *pagemap)
+static bool elf64_build_image(char *data, elf_loaded_image_t *out)
 {
 	Elf64_Ehdr *header = (Elf64_Ehdr *)data;
 	Elf64_Phdr *ph = (Elf64_Phdr *)((uint8_t *)data + header->e_phoff);
@@ -95,25 +94,21 @@ uintptr_t elf64_load(char *data, uintptr_t *addr, size_t *size,
 	}
 
 	if (base_vaddr == (uintptr_t)-1 || end_vaddr <= base_vaddr) {
-		error("elf64_load(): No loadable segments\n");
-		return 0;
+		error("elf64_build_image(): No loadable segments\n");
+		return false;
 	}
 
 	uintptr_t exec_size = end_vaddr - base_vaddr;
 
-	if (size != NULL)
-		*size = exec_size;
-
 	size_t pages = (exec_size + PAGE_SIZE - 1) / PAGE_SIZE;
 	uintptr_t phys_base = (uintptr_t)palloc(pages);
 	if (!phys_base) {
 		error(
 			"Failed to allocate memory for executable! tried allocating %d pages, 0x%.16llx)\n",
 			pages, phys_base);
-		return 0;
+		return false;
 	}
 
-	*addr = (uintptr_t)phys_base;
 	memset((void *)PHYS_TO_VIRT(phys_base), 0, exec_size);
 
 	for (uint16_t i = 0; i < header->e_phnum; i++) {
@@ -123,16 +118,8 @@ uintptr_t elf64_load(char *data, uintptr_t *addr, size_t *size,
 		uintptr_t aligned_vaddr =
 			ALIGN_DOWN((uintptr_t)ph[i].p_vaddr, PAGE_SIZE);
 		uintptr_t seg_off = (uintptr_t)ph[i].p_vaddr - aligned_vaddr;
-		uintptr_t seg_size = seg_off + (uintptr_t)ph[i].p_memsz;
 		uintptr_t seg_phys = phys_base + (aligned_vaddr - base_vaddr);
 
-		uint64_t flags = VMM_PRESENT | VMM_USER;
-		if (ph[i].p_flags & PF_W)
-			flags |= VMM_WRITABLE;
-		if (!(ph[i].p_flags & PF_X))
-			flags |= VMM_NX;
-
-		map_pages(pagemap, aligned_vaddr, seg_phys, seg_size, flags);
 		memcpy((void *)PHYS_TO_VIRT(seg_phys + seg_off), data + ph[i].p_offset,
 			   ph[i].p_filesz);
 
@@ -150,8 +137,101 @@ uintptr_t elf64_load(char *data, uintptr_t *addr, size_t *size,
 		entry_addr = base_vaddr + (uintptr_t)header->e_entry;
 	}
 
-	debug("ELF loaded successfully, entry point: 0x%llx\n", entry_addr);
-	return entry_addr;
+	out->phys_base = phys_base;
+	out->load_base = base_vaddr;
+	out->link_base = base_vaddr;
+	out->size = exec_size;
+	out->entry = entry_addr;
+	return true;
+}
+
+uintptr_t elf64_load(char *data, uintptr_t *addr, size_t *size,
+					 pagetable *pagemap)
+{
+	Elf64_Ehdr *header = (Elf64_Ehdr *)data;
+	Elf64_Phdr *ph = (Elf64_Phdr *)((uint8_t *)data + header->e_phoff);
+
+	elf_loaded_image_t img;
+	if (!elf64_build_image(data, &img))
+		return 0;
+
+	*addr = img.phys_base;
+	if (size != NULL)
+		*size = img.size;
+
+	for (uint16_t i = 0; i < header->e_phnum; i++) {
+		if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0)
+			continue;
+
+		uintptr_t aligned_vaddr =
+			ALIGN_DOWN((uintptr_t)ph[i].p_vaddr, PAGE_SIZE);
+		uintptr_t seg_off = (uintptr_t)ph[i].p_vaddr - aligned_vaddr;
+		uintptr_t seg_size = seg_off + (uintptr_t)ph[i].p_memsz;
+		uintptr_t seg_phys = img.phys_base + (aligned_vaddr - img.link_base);
+
+		uint64_t flags = VMM_PRESENT | VMM_USER;
+		if (ph[i].p_flags & PF_W)
+			flags |= VMM_WRITABLE;
+		if (!(ph[i].p_flags & PF_X))
+			flags |= VMM_NX;
+
+		map_pages(pagemap, aligned_vaddr, seg_phys, seg_size, flags);
+	}
+
+	debug("ELF loaded successfully, entry point: 0x%llx\n", img.entry);
+	return img.entry;
+}
+
+bool elf_map_image_shared(char *data, pagetable *pagemap,
+						  const elf_loaded_image_t *img)
+{
+	if (!data || !pagemap || !img || !img->phys_base)
+		return false;
+
+	Elf64_Ehdr *header = (Elf64_Ehdr *)data;
+	Elf64_Phdr *ph = (Elf64_Phdr *)((uint8_t *)data + header->e_phoff);
+
+	// pages are mapped once each, with the union of the permissions of every
+	// segment touching them, so each mapping holds exactly one reference
+	size_t pages = img->size / PAGE_SIZE;
+	for (size_t p = 0; p < pages; p++) {
+		uintptr_t vaddr = img->link_base + p * PAGE_SIZE;
+		bool covered = false;
+		bool writable = false;
+		bool exec = false;
+
+		for (uint16_t i = 0; i < header->e_phnum; i++) {
+			if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0)
+				continue;
+
+			uintptr_t seg_start =
+				ALIGN_DOWN((uintptr_t)ph[i].p_vaddr, PAGE_SIZE);
+			uintptr_t seg_end =
+				ALIGN_UP((uintptr_t)ph[i].p_vaddr + (uintptr_t)ph[i].p_memsz,
+						 PAGE_SIZE);
+			if (vaddr < seg_start || vaddr >= seg_end)
+				continue;
+
+			covered = true;
+			writable |= (ph[i].p_flags & PF_W) != 0;
+			exec |= (ph[i].p_flags & PF_X) != 0;
+		}
+
+		if (!covered)
+			continue;
+
+		uint64_t flags = VMM_PRESENT | VMM_USER;
+		if (writable)
+			flags |= VMM_COW;
+		if (!exec)
+			flags |= VMM_NX;
+
+		uintptr_t phys = img->phys_base + p * PAGE_SIZE;
+		pmm_ref_inc(phys, 1);
+		map_page(pagemap, vaddr, phys, flags);
+	}
+
+	return true;
 }
 
 bool elf_get_load_range(char *data, uintptr_t *link_base_out, size_t *size_out)
@@ -350,6 +430,25 @@ uintptr_t elf_load(char *data, uintptr_t *addr, size_t *size,
 	return 0;
 }
 
+bool elf_build_image(char *data, elf_loaded_image_t *out)
+{
+	Elf64_Ehdr *header = (Elf64_Ehdr *)data;
+
+	if (!data || !out)
+		return false;
+
+	if (header->e_ident[EI_MAG0] != ELFMAG0 ||
+		header->e_ident[EI_MAG1] != ELFMAG1 ||
+		header->e_ident[EI_MAG2] != ELFMAG2 ||
+		header->e_ident[EI_MAG3] != ELFMAG3 ||
+		header->e_ident[EI_CLASS] != ELFCLASS64 ||
+		header->e_machine != EM_AMD64) {
+		return false;
+	}
+
+	return elf64_build_image(data, out);
+}
+
 static Elf64_Shdr *elf64_find_section(Elf64_Ehdr *ehdr, const char *name)
 {
 	Elf64_Shdr *shdr = (Elf64_Shdr *)((uint8_t *)ehdr + ehdr->e_shoff);
@@ -511,6 +610,14 @@ uintptr_t elf_lookup_symbol(char *elf_data, const char *symbol_name)
 	size_t nsyms = 0;
 	const char *strtab = NULL;
 
+	const Elf64_Sym *hashed = elf_gnu_lookup(elf_data, symbol_name);
+	if (hashed && ELF64_ST_BIND(hashed->st_info) == STB_GLOBAL &&
+		hashed->st_shndx != SHN_ABS) {
+		debug("Found \"%s\" at %p\n", symbol_name,
+			  (uintptr_t)hashed->st_value);
+		return (uintptr_t)hashed->st_value;
+	}
+
 	if (!elf64_get_symtab(ehdr, &symtab, &nsyms, &strtab)) {
 		debug("No .symtab or .strtab found\n");
 		return 0;
@@ -986,6 +1093,114 @@ static size_t elf_bounded_strlen(const char *s, size_t max)
 	return max;
 }
 
+static uint32_t elf_gnu_hash(const char *name)
+{
+	uint32_t h = 5381;
+	for (; *name; name++)
+		h = (h << 5) + h + (uint8_t)*name;
+	return h;
+}
+
+/*
+ * Looks a defined dynamic symbol up through DT_GNU_HASH, so the cost no
+ * longer scales with the size of .dynsym. Returns NULL when the image has no
+ * GNU hash table or does not define the symbol, callers fall back to a linear
+ * scan of .symtab in that case.
+ */
+const Elf64_Sym *elf_gnu_lookup(char *elf_data, const char *symbol_name)
+{
+	if (!elf_data || !symbol_name)
+		return NULL;
+
+	Elf64_Ehdr *ehdr = (Elf64_Ehdr *)elf_data;
+	if (!ehdr->e_phoff || ehdr->e_phnum == 0)
+		return NULL;
+
+	Elf64_Phdr *phdrs = (Elf64_Phdr *)((uint8_t *)elf_data + ehdr->e_phoff);
+	Elf64_Phdr *dyn_ph = NULL;
+	for (uint16_t i = 0; i < ehdr->e_phnum; i++) {
+		if (phdrs[i].p_type == PT_DYNAMIC) {
+			dyn_ph = &phdrs[i];
+			break;
+		}
+	}
+	if (!dyn_ph || dyn_ph->p_filesz == 0)
+		return NULL;
+
+	Elf64_Dyn *dyn = (Elf64_Dyn *)(elf_data + dyn_ph->p_offset);
+	size_t dyn_count = dyn_ph->p_filesz / sizeof(Elf64_Dyn);
+	uint64_t hash_vaddr = 0, symtab_vaddr = 0, strtab_vaddr = 0;
+	uint64_t strtab_size = 0;
+	for (size_t i = 0; i < dyn_count && dyn[i].d_tag != DT_NULL; i++) {
+		if (dyn[i].d_tag == DT_GNU_HASH)
+			hash_vaddr = dyn[i].d_un.d_ptr;
+		else if (dyn[i].d_tag == DT_SYMTAB)
+			symtab_vaddr = dyn[i].d_un.d_ptr;
+		else if (dyn[i].d_tag == DT_STRTAB)
+			strtab_vaddr = dyn[i].d_un.d_ptr;
+		else if (dyn[i].d_tag == DT_STRSZ)
+			strtab_size = dyn[i].d_un.d_val;
+	}
+	if (!hash_vaddr || !symtab_vaddr || !strtab_vaddr || !strtab_size)
+		return NULL;
+
+	uint64_t hash_off, hash_limit, symtab_off, symtab_limit, strtab_off,
+		strtab_limit;
+	if (!elf_vaddr_to_segment(ehdr, hash_vaddr, &hash_off, &hash_limit) ||
+		!elf_vaddr_to_segment(ehdr, symtab_vaddr, &symtab_off,
+							  &symtab_limit) ||
+		!elf_vaddr_to_segment(ehdr, strtab_vaddr, &strtab_off,
+							  &strtab_limit))
+		return NULL;
+	if (strtab_off + strtab_size > strtab_limit)
+		return NULL;
+	if (hash_off + 4 * sizeof(uint32_t) > hash_limit)
+		return NULL;
+
+	const uint32_t *hdr = (const uint32_t *)(elf_data + hash_off);
+	uint32_t nbuckets = hdr[0];
+	uint32_t symoffset = hdr[1];
+	uint32_t bloom_size = hdr[2];
+	uint32_t bloom_shift = hdr[3];
+	if (nbuckets == 0 || bloom_size == 0)
+		return NULL;
+
+	const uint64_t *bloom = (const uint64_t *)(hdr + 4);
+	const uint32_t *buckets = (const uint32_t *)(bloom + bloom_size);
+	const uint32_t *chain = buckets + nbuckets;
+	if ((uint64_t)((const char *)chain - elf_data) > hash_limit)
+		return NULL;
+
+	uint32_t h = elf_gnu_hash(symbol_name);
+
+	uint64_t word = bloom[(h / 64) % bloom_size];
+	uint64_t mask = (1ull << (h % 64)) | (1ull << ((h >> bloom_shift) % 64));
+	if ((word & mask) != mask)
+		return NULL;
+
+	uint32_t idx = buckets[h % nbuckets];
+	if (idx < symoffset)
+		return NULL;
+
+	const Elf64_Sym *symtab = (const Elf64_Sym *)(elf_data + symtab_off);
+	const char *strtab = elf_data + strtab_off;
+	for (;; idx++) {
+		const uint32_t *link = &chain[idx - symoffset];
+		if ((uint64_t)((const char *)(link + 1) - elf_data) > hash_limit)
+			return NULL;
+		if (symtab_off + (idx + 1) * sizeof(Elf64_Sym) > symtab_limit)
+			return NULL;
+
+		const Elf64_Sym *sym = &symtab[idx];
+		if ((h | 1) == (*link | 1) && sym->st_name < strtab_size &&
+			strcmp(strtab + sym->st_name, symbol_name) == 0)
+			return sym->st_shndx == SHN_UNDEF ? NULL : sym;
+
+		if (*link & 1)
+			return NULL;
+	}
+}
+
 static bool elf_try_open(const char *path)
 {
 	if (!path || !*path)
@@ -1138,33 +1353,14 @@ static bool elf_check_needed_libs(char *data, const char *const *envp,
 	return true;
 }
 
-bool elf_load_user_process(char *data, const char *path, struct pcb *proc,
-						   const char *const *argv, size_t argv_count,
-						   const char *const *envp, size_t envp_count,
-						   uintptr_t *entry_out)
+static bool elf_finish_user_process(char *data, const char *path,
+									struct pcb *proc, uintptr_t exec_entry,
+									const char *const *argv, size_t argv_count,
+									const char *const *envp, size_t envp_count,
+									uintptr_t *entry_out)
 {
-	if (!data || !proc || !entry_out)
-		return false;
-
 	const char *interp_path = NULL;
 	bool has_interp = elf_get_interpreter(data, &interp_path);
-	if (has_interp && interp_path && *interp_path)
-		trace("ELF PT_INTERP: %s\n", interp_path);
-	else
-		trace("ELF PT_INTERP: none\n");
-
-	if (!elf_check_needed_libs(data, envp, envp_count))
-		return false;
-
-	uint64_t addr = 0;
-	size_t size = 0;
-	uintptr_t exec_entry = elf_load(data, &addr, &size, proc->pm);
-	if (!exec_entry)
-		return false;
-
-	proc->image_phys_base = addr;
-	proc->image_exec_size = size;
-	proc->image_size = size;
 
 	uintptr_t link_base = 0;
 	size_t load_size = 0;
@@ -1199,3 +1395,64 @@ bool elf_load_user_process(char *data, const char *path, struct pcb *proc,
 	*entry_out = interp_entry ? interp_entry : exec_entry;
 	return true;
 }
+
+static bool elf_check_user_process(char *data, const char *const *envp,
+								   size_t envp_count)
+{
+	const char *interp_path = NULL;
+	bool has_interp = elf_get_interpreter(data, &interp_path);
+	if (has_interp && interp_path && *interp_path)
+		trace("ELF PT_INTERP: %s\n", interp_path);
+	else
+		trace("ELF PT_INTERP: none\n");
+
+	return elf_check_needed_libs(data, envp, envp_count);
+}
+
+bool elf_load_user_process(char *data, const char *path, struct pcb *proc,
+						   const char *const *argv, size_t argv_count,
+						   const char *const *envp, size_t envp_count,
+						   uintptr_t *entry_out)
+{
+	if (!data || !proc || !entry_out)
+		return false;
+
+	if (!elf_check_user_process(data, envp, envp_count))
+		return false;
+
+	uint64_t addr = 0;
+	size_t size = 0;
+	uintptr_t exec_entry = elf_load(data, &addr, &size, proc->pm);
+	if (!exec_entry)
+		return false;
+
+	proc->image_phys_base = addr;
+	proc->image_exec_size = size;
+	proc->image_size = size;
+
+	return elf_finish_user_process(data, path, proc, exec_entry, argv,
+								   argv_count, envp, envp_count, entry_out);
+}
+
+bool elf_load_user_shared(char *data, const elf_loaded_image_t *img,
+						  const char *path, struct pcb *proc,
+						  const char *const *argv, size_t argv_count,
+						  const char *const *envp, size_t envp_count,
+						  uintptr_t *entry_out)
+{
+	if (!data || !img || !proc || !entry_out)
+		return false;
+
+	if (!elf_check_user_process(data, envp, envp_count))
+		return false;
+
+	if (!elf_map_image_shared(data, proc->pm, img))
+		return false;
+
+	proc->image_phys_base = img->phys_base;
+	proc->image_exec_size = img->size;
+	proc->image_size = img->size;
+
+	return elf_finish_user_process(data, path, proc, img->entry, argv,
+								   argv_count, envp, envp_count, entry_out);
+}
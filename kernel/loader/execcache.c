@@ -0,0 +1,309 @@
+/*********************************************************************************/
+/* Module Name:  execcache.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <loader/execcache.h>
+#include <loader/elf.h>
+#include <vfs/vfs.h>
+#include <vfs/fileio.h>
+#include <mm/heap.h>
+#include <mm/pmm.h>
+#include <lib/string.h>
+#include <lib/align.h>
+#include <sys/errno.h>
+#include <sys/spinlock.h>
+#include <aurix.h>
+
+static spinlock_t execcache_lock;
+
+// most recently used first
+static struct exec_image *execcache_head = NULL;
+static size_t execcache_entries = 0;
+static size_t execcache_pages = 0;
+// bumped by every invalidate, a load that saw it change while reading the
+// file doesn't get cached
+static uint64_t execcache_gen = 0;
+
+static size_t execcache_entry_pages(struct exec_image *ent)
+{
+	return ent->has_image ? ent->img.size / PAGE_SIZE : 0;
+}
+
+static void execcache_free(struct exec_image *ent)
+{
+	// processes hold their own reference on every page they mapped
+	if (ent->has_image)
+		pmm_ref_dec(ent->img.phys_base, ent->img.size / PAGE_SIZE);
+	kfree(ent->data);
+	kfree(ent);
+}
+
+// callers hold execcache_lock, returns true when the last reference is gone
+static bool execcache_unlink(struct exec_image *ent)
+{
+	struct exec_image **pp = &execcache_head;
+	while (*pp && *pp != ent)
+		pp = &(*pp)->next;
+	if (!*pp)
+		return false;
+
+	*pp = ent->next;
+	ent->next = NULL;
+	ent->cached = false;
+	execcache_entries--;
+	execcache_pages -= execcache_entry_pages(ent);
+
+	return --ent->refs == 0;
+}
+
+static struct exec_image *execcache_find(uint64_t dev, uint64_t ino,
+										 size_t size)
+{
+	for (struct exec_image *ent = execcache_head; ent; ent = ent->next) {
+		if (ent->dev == dev && ent->ino == ino && ent->size == size)
+			return ent;
+	}
+
+	return NULL;
+}
+
+static int execcache_stat(const char *path, struct stat *st)
+{
+	struct vnode *vn = NULL;
+	if (vfs_lookup(path, &vn) != 0 || !vn)
+		return -ENOENT;
+
+	int r = -1;
+	if (vn->ops && vn->ops->getattr)
+		r = vn->ops->getattr(vn, st);
+	vnode_unref(vn);
+
+	return r;
+}
+
+static int execcache_read(const char *path, struct exec_image *ent)
+{
+	struct fileio *f = open(path, O_RDONLY, 0);
+	if (!f)
+		return -ENOENT;
+
+	if (f->size == 0) {
+		close(f);
+		return -EINVAL;
+	}
+
+	ent->size = f->size;
+	ent->data = (char *)kmalloc(ent->size);
+	if (!ent->data) {
+		close(f);
+		return -ENOMEM;
+	}
+
+	ssize_t got = read(f, ent->size, ent->data);
+	close(f);
+	if (got < 0 || (size_t)got != ent->size) {
+		kfree(ent->data);
+		ent->data = NULL;
+		return -EIO;
+	}
+
+	return 0;
+}
+
+int execcache_get(const char *path, struct exec_image **out)
+{
+	if (!path || !out)
+		return -EFAULT;
+
+	uint64_t gen = __atomic_load_n(&execcache_gen, __ATOMIC_ACQUIRE);
+
+	struct stat st;
+	memset(&st, 0, sizeof(st));
+	bool stable = execcache_stat(path, &st) == 0;
+
+	if (stable) {
+		spinlock_acquire(&execcache_lock);
+		struct exec_image *ent =
+			execcache_find(st.st_dev, st.st_ino, (size_t)st.st_size);
+		if (ent) {
+			// move to the front
+			struct exec_image **pp = &execcache_head;
+			while (*pp != ent)
+				pp = &(*pp)->next;
+			*pp = ent->next;
+			ent->next = execcache_head;
+			execcache_head = ent;
+
+			ent->refs++;
+			spinlock_release(&execcache_lock);
+			*out = ent;
+			return 0;
+		}
+		spinlock_release(&execcache_lock);
+	}
+
+	struct exec_image *ent = kmalloc(sizeof(struct exec_image));
+	if (!ent)
+		return -ENOMEM;
+	memset(ent, 0, sizeof(struct exec_image));
+	ent->refs = 1;
+
+	int r = execcache_read(path, ent);
+	if (r != 0) {
+		kfree(ent);
+		return r;
+	}
+
+	ent->has_image = elf_build_image(ent->data, &ent->img);
+
+	// the file changed between the stat and the read, don't cache it. nor
+	// scripts, they're cheap to read and the slots are for shared images
+	bool script = ent->size >= 2 && ent->data[0] == '#' && ent->data[1] == '!';
+	if (!stable || (size_t)st.st_size != ent->size || script) {
+		*out = ent;
+		return 0;
+	}
+
+	ent->dev = st.st_dev;
+	ent->ino = st.st_ino;
+
+	struct exec_image *victims = NULL;
+
+	spinlock_acquire(&execcache_lock);
+	if (__atomic_load_n(&execcache_gen, __ATOMIC_ACQUIRE) != gen) {
+		spinlock_release(&execcache_lock);
+		*out = ent;
+		return 0;
+	}
+
+	struct exec_image *raced = execcache_find(ent->dev, ent->ino, ent->size);
+	if (raced) {
+		raced->refs++;
+		spinlock_release(&execcache_lock);
+		execcache_free(ent);
+		*out = raced;
+		return 0;
+	}
+
+	ent->refs++;
+	ent->cached = true;
+	ent->next = execcache_head;
+	execcache_head = ent;
+	execcache_entries++;
+	execcache_pages += execcache_entry_pages(ent);
+
+	// evict from the tail, never the entry we just added
+	while (execcache_entries > EXECCACHE_MAX_ENTRIES ||
+		   (execcache_pages > EXECCACHE_MAX_PAGES && execcache_entries > 1)) {
+		struct exec_image *tail = execcache_head;
+		while (tail->next)
+			tail = tail->next;
+		if (execcache_unlink(tail)) {
+			tail->next = victims;
+			victims = tail;
+		}
+	}
+	spinlock_release(&execcache_lock);
+
+	while (victims) {
+		struct exec_image *next = victims->next;
+		execcache_free(victims);
+		victims = next;
+	}
+
+	*out = ent;
+	return 0;
+}
+
+void execcache_put(struct exec_image *ent)
+{
+	if (!ent)
+		return;
+
+	spinlock_acquire(&execcache_lock);
+	bool last = --ent->refs == 0;
+	spinlock_release(&execcache_lock);
+
+	if (last)
+		execcache_free(ent);
+}
+
+// every write goes through here once it's done, consoles and device nodes
+// included, so anything that can't be an executable is turned away before
+// the getattr
+void execcache_invalidate(struct vnode *vnode)
+{
+	if (!vnode || vnode->vtype != VNODE_REGULAR)
+		return;
+
+	// before the entry check, a load may be reading the file right now
+	__atomic_add_fetch(&execcache_gen, 1, __ATOMIC_ACQ_REL);
+	if (__atomic_load_n(&execcache_entries, __ATOMIC_RELAXED) == 0)
+		return;
+
+	if (!vnode->ops || !vnode->ops->getattr)
+		return;
+
+	struct stat st;
+	memset(&st, 0, sizeof(st));
+	if (vnode->ops->getattr(vnode, &st) != 0)
+		return;
+
+	struct exec_image *victims = NULL;
+
+	// match on the inode alone, the size may already have changed
+	spinlock_acquire(&execcache_lock);
+	struct exec_image *ent = execcache_head;
+	while (ent) {
+		struct exec_image *next = ent->next;
+		if (ent->dev == st.st_dev && ent->ino == st.st_ino &&
+			execcache_unlink(ent)) {
+			ent->next = victims;
+			victims = ent;
+		}
+		ent = next;
+	}
+	spinlock_release(&execcache_lock);
+
+	while (victims) {
+		struct exec_image *next = victims->next;
+		execcache_free(victims);
+		victims = next;
+	}
+}
+
+void execcache_flush(void)
+{
+	struct exec_image *victims = NULL;
+
+	spinlock_acquire(&execcache_lock);
+	while (execcache_head) {
+		struct exec_image *ent = execcache_head;
+		if (execcache_unlink(ent)) {
+			ent->next = victims;
+			victims = ent;
+		}
+	}
+	spinlock_release(&execcache_lock);
+
+	while (victims) {
+		struct exec_image *next = victims->next;
+		execcache_free(victims);
+		victims = next;
+	}
+}
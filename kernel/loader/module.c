@@ -122,6 +122,10 @@ static uintptr_t elf64_lookup_symbol_any(char *elf, const char *name)
 	Elf64_Ehdr *ehdr = (Elf64_Ehdr *)elf;
 	uintptr_t addr;
 
+	const Elf64_Sym *hashed = elf_gnu_lookup(elf, name);
+	if (hashed)
+		return hashed->st_value;
+
 	addr = elf64_lookup_symbol_in_sections(ehdr, ".symtab", ".strtab", name);
 	if (addr)
 		return addr;
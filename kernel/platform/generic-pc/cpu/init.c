@@ -22,9 +22,11 @@
 
 #include <arch/apic/apic.h>
 #include <arch/cpu/cpu.h>
+#include <arch/cpu/fpu.h>
 #include <arch/cpu/gdt.h>
 #include <arch/cpu/idt.h>
 #include <arch/cpu/syscall.h>
+#include <acpi/srat.h>
 #include <config.h>
 #include <aurix.h>
 #include <string.h>
@@ -53,20 +55,84 @@ static void cpu_enable_sse(void)
 
 int cpu_early_init()
 {
+	uint32_t eax, ebx, ecx, edx;
+
 	// save cpuinfo
 	cpuinfo[cpu_count].id = cpu_count;
 	wrmsr(CPU_ID_MSR, cpu_count);
 
+	// logical ids follow startup order, IPIs need the real APIC ID
+	cpuid(0x01, &eax, &ebx, &ecx, &edx);
+	cpuinfo[cpu_count].lapic_id = ebx >> 24;
+
 	gdt_init();
 	idt_init();
 	x86_64_syscall_init();
 	cpu_enable_sse();
+	fpu_init();
+
+	// kernel writes into shared or COW user pages have to fault too
+	write_cr0(read_cr0() | (1ULL << 16)); // WP
 
 	cpu_count++;
 
 	return 1; // all good
 }
 
+// split the x2APIC ID into package/core/SMT fields using the level shifts
+// from leaf 0x1F (or 0xB on older parts). anything between core and package
+// (modules, dies) is folded into the core number
+static void cpu_detect_topology(struct cpu *cpu)
+{
+	uint32_t eax, ebx, ecx, edx;
+	uint32_t max_leaf;
+	cpuid(0x00, &max_leaf, &ebx, &ecx, &edx);
+
+	uint32_t leaf = 0;
+	if (max_leaf >= 0x1f) {
+		cpuid_count(0x1f, 0, &eax, &ebx, &ecx, &edx);
+		if (ebx)
+			leaf = 0x1f;
+	}
+	if (!leaf && max_leaf >= 0x0b) {
+		cpuid_count(0x0b, 0, &eax, &ebx, &ecx, &edx);
+		if (ebx)
+			leaf = 0x0b;
+	}
+
+	uint32_t apic = cpu->lapic_id;
+	uint32_t smt_shift = 0;
+	uint32_t pkg_shift = 0;
+
+	if (leaf) {
+		for (uint32_t sub = 0; sub < 8; sub++) {
+			cpuid_count(leaf, sub, &eax, &ebx, &ecx, &edx);
+			uint32_t type = (ecx >> 8) & 0xff;
+			if (type == 0)
+				break;
+			if (type == 1)
+				smt_shift = eax & 0x1f;
+			pkg_shift = eax & 0x1f;
+			apic = edx;
+		}
+	} else {
+		// leaf 1 only knows how many logical CPUs share a package, so treat
+		// each of them as its own core
+		cpuid(0x01, &eax, &ebx, &ecx, &edx);
+		uint32_t logical = (edx & (1u << 28)) ? (ebx >> 16) & 0xff : 1;
+		while ((1u << pkg_shift) < logical)
+			pkg_shift++;
+	}
+
+	cpu->smt = apic & ((1u << smt_shift) - 1);
+	cpu->core = (apic & ((1u << pkg_shift) - 1)) >> smt_shift;
+	cpu->package = apic >> pkg_shift;
+	cpu->node = srat_apic_node(apic);
+
+	debug("cpu%u: apic=%u package=%u core=%u smt=%u node=%u\n", cpu->id, apic,
+		  cpu->package, cpu->core, cpu->smt, cpu->node);
+}
+
 void cpu_init()
 {
 	uint32_t eax, ebx, ecx, edx;
@@ -88,6 +154,8 @@ void cpu_init()
 	cpu->cpuid.ecx = ecx;
 	cpu->cpuid.edx = edx;
 
+	cpu_detect_topology(cpu);
+
 	// get CPU name
 	cpuid(0x80000000, &func, &ebx, &ecx, &edx);
 	if (func >= 0x80000004) {
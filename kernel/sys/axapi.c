@@ -19,32 +19,40 @@
 
 #include <aurix/axapi.h>
 #include <sys/axapi.h>
+#include <lib/hash.h>
 
 #include <string.h>
 
-extern const struct axapi_export __axapi_exports_start[];
-extern const struct axapi_export __axapi_exports_end[];
+#include <axapi_hash.h>
 
+// one table in axapi_defs.inc order, which is the order the build-time
+// perfect hash in axapi_hash.h indexes into
 #undef AXAPI_SYM
-#define AXAPI_SYM(ret, name, args)                                        \
-	__attribute__((                                                       \
-		section(".axapi.exports"),                                        \
-		used)) static const struct axapi_export __axapi_export_##name = { \
-		#name, (uintptr_t)&name                                           \
-	};
+#define AXAPI_SYM(ret, name, args) { #name, (uintptr_t)&name },
+__attribute__((section(".axapi.exports"),
+			   used)) static const struct axapi_export axapi_exports[] = {
 #include <aurix/axapi_defs.inc>
+};
 #undef AXAPI_SYM
 
+typedef char axapi_hash_out_of_date
+	[(sizeof(axapi_exports) / sizeof(axapi_exports[0]) == AXAPI_EXPORT_COUNT) ?
+		 1 :
+		 -1];
+
 uintptr_t axapi_resolve(const char *name)
 {
 	if (!name)
 		return 0;
 
-	for (const struct axapi_export *e = __axapi_exports_start;
-		 e < __axapi_exports_end; e++) {
-		if (e->name && strcmp(e->name, name) == 0)
-			return e->addr;
-	}
+	uint64_t h = hash_fnv1a_continue(AXAPI_HASH_SEED, name, strlen(name));
+	int16_t idx = axapi_hash_slots[h & (AXAPI_HASH_SIZE - 1)];
+	if (idx < 0)
+		return 0;
+
+	const struct axapi_export *e = &axapi_exports[idx];
+	if (strcmp(e->name, name) != 0)
+		return 0;
 
-	return 0;
+	return e->addr;
 }
@@ -19,12 +19,18 @@
 
 #include <aurix/axapi.h>
 #include <arch/cpu/cpu.h>
+#include <arch/mm/paging.h>
+#include <lib/align.h>
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <aurix.h>
 #include <stdint.h>
 #include <sys/sched.h>
 
+#define AX_CHILD_BACKGROUND_NICE 10
+
 int make_child_ex(void (*entry)(void), uint64_t flags)
 {
-	(void)flags;
 	if (!entry)
 		return -1;
 	tcb *cur = thread_current();
@@ -34,6 +40,8 @@ int make_child_ex(void (*entry)(void), uint64_t flags)
 	tcb *t = thread_create(cur->process, entry);
 	if (!t)
 		return -1;
+	if (flags & AX_CHILD_BACKGROUND)
+		sched_set_nice(t, AX_CHILD_BACKGROUND_NICE);
 	return (int)t->tid;
 }
 
@@ -76,3 +84,38 @@ void ax_io_wait(void)
 {
 	io_wait();
 }
+
+uint32_t ax_cpu_count(void)
+{
+	return (uint32_t)cpu_count;
+}
+
+uintptr_t ax_virt_to_phys(const void *virt)
+{
+	uintptr_t va = (uintptr_t)virt;
+	uintptr_t phys = vget_phys(kernel_pm, ALIGN_DOWN(va, PAGE_SIZE));
+	if (!phys)
+		return 0;
+
+	return ALIGN_DOWN(phys, PAGE_SIZE) + (va & (PAGE_SIZE - 1));
+}
+
+void *ax_phys_to_virt(uintptr_t phys)
+{
+	return (void *)PHYS_TO_VIRT(phys);
+}
+
+// device memory goes into the higher half like the LAPIC and HPET, uncached
+void *ax_map_mmio(uintptr_t phys, size_t size)
+{
+	if (!size)
+		return NULL;
+
+	uintptr_t base = ALIGN_DOWN(phys, PAGE_SIZE);
+	size_t len = ALIGN_UP(phys + size, PAGE_SIZE) - base;
+	map_pages(NULL, PHYS_TO_VIRT(base), base, len,
+			  VMM_PRESENT | VMM_WRITABLE | VMM_WRITETHROUGH |
+				  VMM_CACHE_DISABLE | VMM_NX);
+
+	return (void *)PHYS_TO_VIRT(phys);
+}
@@ -0,0 +1,172 @@
+/*********************************************************************************/
+/* Module Name:  boottime.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <sys/boottime.h>
+#include <boot/axprot.h>
+#include <lib/string.h>
+#include <mm/heap.h>
+#include <time/time.h>
+#include <util/kprintf.h>
+#include <vfs/fileio.h>
+#include <aurix.h>
+
+#if defined(__x86_64__)
+#include <arch/cpu/cpu.h>
+#include <arch/time/tsc.h>
+#endif
+
+// one header line plus one line per phase
+#define BOOTTIME_BUF_SIZE ((BOOTTIME_MAX_PHASES + 1) * 80)
+
+struct boottime_phase {
+	char name[BOOTTIME_NAME_MAX];
+	uint64_t stamp;
+	int loader;
+};
+
+static struct boottime_phase phases[BOOTTIME_MAX_PHASES];
+static size_t phase_count = 0;
+
+static uint64_t boottime_read(void)
+{
+#if defined(__x86_64__)
+	return rdtsc();
+#else
+	return time_ns();
+#endif
+}
+
+// converts a stamp delta to microseconds, or returns it as-is (raw cycles)
+// while there is no calibrated TSC to convert with
+static uint64_t boottime_to_us(uint64_t delta)
+{
+#if defined(__x86_64__)
+	if (!tsc_is_available())
+		return delta;
+	return tsc_to_ns(delta) / 1000ull;
+#else
+	return delta / 1000ull;
+#endif
+}
+
+static const char *boottime_unit(void)
+{
+#if defined(__x86_64__)
+	if (!tsc_is_available())
+		return "cycles";
+#endif
+	return "us";
+}
+
+static void boottime_add(const char *name, uint64_t stamp, int loader)
+{
+	if (phase_count >= BOOTTIME_MAX_PHASES)
+		return;
+
+	struct boottime_phase *p = &phases[phase_count++];
+	strncpy(p->name, name, BOOTTIME_NAME_MAX - 1);
+	p->name[BOOTTIME_NAME_MAX - 1] = '\0';
+	p->stamp = stamp;
+	p->loader = loader;
+}
+
+void boottime_import(const struct aurix_parameters *params)
+{
+	uint32_t count = params->boot_stamp_count;
+	if (count > AURIX_MAX_BOOT_STAMPS)
+		count = AURIX_MAX_BOOT_STAMPS;
+
+	for (uint32_t i = 0; i < count; i++) {
+		// the loader leaves stamps at 0 when it has no cycle counter
+		if (params->boot_stamps[i].tsc == 0)
+			continue;
+		boottime_add(params->boot_stamps[i].name, params->boot_stamps[i].tsc,
+					 1);
+	}
+}
+
+void boottime_mark(const char *phase)
+{
+	boottime_add(phase, boottime_read(), 0);
+}
+
+size_t boottime_format(char *buf, size_t size)
+{
+	size_t off = 0;
+	int n;
+
+	if (!buf || size == 0)
+		return 0;
+	buf[0] = '\0';
+
+	n = snprintf(buf, size, "%-6s  %-24s  %12s  %12s  (%s)\n", "stage",
+				 "phase", "delta", "total", boottime_unit());
+	if (n < 0)
+		return 0;
+	off = ((size_t)n < size) ? (size_t)n : size - 1;
+
+	for (size_t i = 0; i < phase_count && off < size - 1; i++) {
+		uint64_t delta = i ? phases[i].stamp - phases[i - 1].stamp : 0;
+		uint64_t total = phases[i].stamp - phases[0].stamp;
+
+		n = snprintf(buf + off, size - off, "%-6s  %-24s  %12llu  %12llu\n",
+					 phases[i].loader ? "loader" : "kernel", phases[i].name,
+					 (unsigned long long)boottime_to_us(delta),
+					 (unsigned long long)boottime_to_us(total));
+		if (n < 0)
+			break;
+		off += ((size_t)n < size - off) ? (size_t)n : size - off - 1;
+	}
+
+	return off;
+}
+
+void boottime_print(void)
+{
+	char *buf = kmalloc(BOOTTIME_BUF_SIZE);
+	if (!buf)
+		return;
+
+	boottime_format(buf, BOOTTIME_BUF_SIZE);
+	kprintf("%s", buf);
+	kfree(buf);
+}
+
+void boottime_publish(void)
+{
+	char *buf = kmalloc(BOOTTIME_BUF_SIZE);
+	if (!buf)
+		return;
+
+	size_t len = boottime_format(buf, BOOTTIME_BUF_SIZE);
+
+	struct fileio *f = open("/sys/boottime", O_CREATE | O_WRONLY | O_TRUNC,
+							0444);
+	if (!f) {
+		warn("boottime: failed to open /sys/boottime\n");
+		kfree(buf);
+		return;
+	}
+
+	if (write(f, buf, len) != (int)len)
+		warn("boottime: short write to /sys/boottime\n");
+
+	close(f);
+	kfree(buf);
+}
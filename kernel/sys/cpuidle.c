@@ -0,0 +1,190 @@
+/*********************************************************************************/
+/* Module Name:  cpuidle.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <sys/cpuidle.h>
+#include <arch/cpu/cpu.h>
+#ifdef __x86_64__
+#include <arch/time/tsc.h>
+#endif
+#include <config.h>
+#include <aurix.h>
+#include <stdatomic.h>
+#include <string.h>
+
+// set while the CPU sits in MWAIT watching its word, a store is enough then
+#define IDLE_POLLING (1u << 0)
+#define IDLE_NEED_RESCHED (1u << 1)
+
+// C1, the shallowest MWAIT state, wakes about as fast as HLT
+#define IDLE_MWAIT_HINT 0
+
+// one line each, so a kick only disturbs the CPU it's meant for
+struct cpuidle_state {
+	atomic_uint flags;
+	bool mwait;
+	// halted since idle_start, until an interrupt or the wait itself ends it
+	bool halted;
+	uint64_t idle_start;
+	uint64_t residency;
+	uint64_t entries;
+	atomic_ullong kicks;
+} __attribute__((aligned(64)));
+
+static struct cpuidle_state idle_state[CONFIG_CPU_MAX_COUNT];
+
+static inline uint64_t cpuidle_clock(void)
+{
+#ifdef __x86_64__
+	if (tsc_is_available())
+		return tsc_read();
+#endif
+	return 0;
+}
+
+static inline struct cpuidle_state *cpuidle_state_of(const struct cpu *cpu)
+{
+	if (!cpu || cpu->id >= CONFIG_CPU_MAX_COUNT)
+		return NULL;
+	return &idle_state[cpu->id];
+}
+
+#ifdef __x86_64__
+static inline void cpuidle_monitor(const void *addr)
+{
+	__asm__ volatile("monitor" ::"a"(addr), "c"(0), "d"(0) : "memory");
+}
+
+// sti's one instruction shadow keeps an interrupt from landing between the
+// two, so a wakeup can't slip in after the check and before the wait
+static inline void cpuidle_sti_mwait(uint32_t hint)
+{
+	__asm__ volatile("sti; mwait; cli" ::"a"(hint), "c"(0) : "memory");
+}
+#endif
+
+void cpuidle_init(struct cpu *cpu)
+{
+	struct cpuidle_state *st = cpuidle_state_of(cpu);
+	if (!st)
+		return;
+
+	memset(st, 0, sizeof(*st));
+	atomic_init(&st->flags, 0);
+	atomic_init(&st->kicks, 0);
+
+#ifdef __x86_64__
+	if (!cpu->cpuid.ecx_bits.monitor)
+		return;
+
+	uint32_t max_leaf, eax, ebx, ecx, edx;
+	cpuid(0x00, &max_leaf, &ebx, &ecx, &edx);
+	if (max_leaf < 0x05)
+		return;
+
+	// leaf 5 reports how big a monitored line is, it has to cover the word
+	cpuid(0x05, &eax, &ebx, &ecx, &edx);
+	if ((eax & 0xffff) == 0 || (ebx & 0xffff) < sizeof(atomic_uint))
+		return;
+
+	st->mwait = true;
+#endif
+
+	debug("cpu%u: idling with %s\n", cpu->id, st->mwait ? "mwait" : "hlt");
+}
+
+// only the CPU itself gets here, with interrupts off
+static inline void cpuidle_account(struct cpuidle_state *st)
+{
+	if (!st->halted)
+		return;
+	st->residency += cpuidle_clock() - st->idle_start;
+	st->halted = false;
+}
+
+void cpuidle_enter(struct cpu *cpu)
+{
+	struct cpuidle_state *st = cpuidle_state_of(cpu);
+	if (st) {
+		st->entries++;
+		st->idle_start = cpuidle_clock();
+		st->halted = true;
+	}
+
+#ifdef __x86_64__
+	if (st && st->mwait) {
+		atomic_fetch_or(&st->flags, IDLE_POLLING);
+		cpuidle_monitor(&st->flags);
+		// a kick that came in before the monitor was armed is seen here
+		if (!(atomic_load(&st->flags) & IDLE_NEED_RESCHED))
+			cpuidle_sti_mwait(IDLE_MWAIT_HINT);
+		atomic_store(&st->flags, 0);
+	} else {
+		__asm__ volatile("sti; hlt; cli");
+	}
+#elif __aarch64__
+	__asm__ volatile("wfe");
+#endif
+
+	// a store woke us, or an interrupt already took the time
+	if (st)
+		cpuidle_account(st);
+}
+
+// the wakeup interrupt runs before the wait returns and may switch away for
+// a long while, stop the clock before its handler does anything
+void cpuidle_wake(struct cpu *cpu)
+{
+	struct cpuidle_state *st = cpuidle_state_of(cpu);
+	if (st)
+		cpuidle_account(st);
+}
+
+// ask cpu to look at its run queue. true if it was waiting in MWAIT and the
+// store alone wakes it, otherwise it's up to the caller to send an IPI
+bool cpuidle_kick(struct cpu *cpu)
+{
+	struct cpuidle_state *st = cpuidle_state_of(cpu);
+	if (!st || !st->mwait)
+		return false;
+
+	unsigned old = atomic_fetch_or(&st->flags, IDLE_NEED_RESCHED);
+	if (!(old & IDLE_POLLING))
+		return false;
+
+	atomic_fetch_add(&st->kicks, 1);
+	return true;
+}
+
+void cpuidle_get_stats(const struct cpu *cpu, struct cpuidle_stats *out)
+{
+	memset(out, 0, sizeof(*out));
+
+	const struct cpuidle_state *st = cpuidle_state_of(cpu);
+	if (!st)
+		return;
+
+	out->mwait = st->mwait;
+#ifdef __x86_64__
+	out->residency_ns = tsc_to_ns(st->residency);
+#else
+	out->residency_ns = st->residency;
+#endif
+	out->entries = st->entries;
+	out->kicks = atomic_load(&st->kicks);
+}
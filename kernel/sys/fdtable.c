@@ -0,0 +1,215 @@
+/*********************************************************************************/
+/* Module Name:  fdtable.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <sys/fdtable.h>
+#include <sys/sched.h>
+#include <sys/errno.h>
+#include <vfs/fileio.h>
+#include <mm/heap.h>
+#include <string.h>
+
+#define FDT_WORDS(size) ((size) / 64)
+
+// the slot array and both bitmaps share one allocation
+static int fdtable_resize(struct fdtable *t, uint32_t size)
+{
+	size_t files_len = size * sizeof(struct fileio *);
+	size_t map_len = FDT_WORDS(size) * sizeof(uint64_t);
+
+	uint8_t *block = kmalloc(files_len + 2 * map_len);
+	if (!block)
+		return -ENOMEM;
+	memset(block, 0, files_len + 2 * map_len);
+
+	struct fileio **files = (struct fileio **)block;
+	uint64_t *open = (uint64_t *)(block + files_len);
+	uint64_t *cloexec = (uint64_t *)(block + files_len + map_len);
+
+	if (t->files) {
+		memcpy(files, t->files, t->size * sizeof(struct fileio *));
+		memcpy(open, t->open, FDT_WORDS(t->size) * sizeof(uint64_t));
+		memcpy(cloexec, t->cloexec, FDT_WORDS(t->size) * sizeof(uint64_t));
+		kfree(t->files);
+	}
+
+	t->files = files;
+	t->open = open;
+	t->cloexec = cloexec;
+	t->size = size;
+	return 0;
+}
+
+// make room for fd, doubling until it fits
+static int fdtable_expand(struct fdtable *t, int fd)
+{
+	if (fd < 0 || fd >= PROC_MAX_FDS)
+		return -EMFILE;
+	if ((uint32_t)fd < t->size)
+		return 0;
+
+	uint32_t size = t->size ? t->size : FDTABLE_MIN_SIZE;
+	while (size <= (uint32_t)fd)
+		size *= 2;
+	return fdtable_resize(t, size);
+}
+
+static void fdtable_set(struct fdtable *t, int fd, struct fileio *f,
+						bool cloexec)
+{
+	uint64_t bit = 1ULL << (fd % 64);
+
+	t->files[fd] = f;
+	t->open[fd / 64] |= bit;
+	if (cloexec)
+		t->cloexec[fd / 64] |= bit;
+	else
+		t->cloexec[fd / 64] &= ~bit;
+}
+
+static int fdtable_scan(const uint64_t *map, uint32_t size, int from, bool set)
+{
+	if (from < 0)
+		from = 0;
+
+	for (uint32_t w = (uint32_t)from / 64; w < FDT_WORDS(size); w++) {
+		uint64_t bits = set ? map[w] : ~map[w];
+		if (w == (uint32_t)from / 64)
+			bits &= ~0ULL << (from % 64);
+		if (bits)
+			return (int)(w * 64 + (uint32_t)__builtin_ctzll(bits));
+	}
+
+	return -1;
+}
+
+int fdtable_init(struct fdtable *t)
+{
+	memset(t, 0, sizeof(*t));
+	return fdtable_resize(t, FDTABLE_MIN_SIZE);
+}
+
+// the files themselves must already be closed
+void fdtable_destroy(struct fdtable *t)
+{
+	if (t->files)
+		kfree(t->files);
+	memset(t, 0, sizeof(*t));
+}
+
+// lowest free slot at or above start
+int fdtable_alloc(struct fdtable *t, struct fileio *f, int start, bool cloexec)
+{
+	int fd = fdtable_scan(t->open, t->size, start, false);
+	if (fd < 0)
+		fd = start > (int)t->size ? start : (int)t->size;
+
+	int r = fdtable_expand(t, fd);
+	if (r != 0)
+		return r;
+
+	fdtable_set(t, fd, f, cloexec);
+	return fd;
+}
+
+// put f at exactly fd, handing back whatever was there for the caller to close
+int fdtable_install(struct fdtable *t, int fd, struct fileio *f, bool cloexec,
+					struct fileio **old)
+{
+	*old = NULL;
+
+	int r = fdtable_expand(t, fd);
+	if (r != 0)
+		return r == -EMFILE ? -EBADF : r;
+
+	*old = t->files[fd];
+	fdtable_set(t, fd, f, cloexec);
+	return 0;
+}
+
+struct fileio *fdtable_remove(struct fdtable *t, int fd)
+{
+	if (fd < 0 || (uint32_t)fd >= t->size)
+		return NULL;
+
+	uint64_t bit = 1ULL << (fd % 64);
+	struct fileio *f = t->files[fd];
+
+	t->files[fd] = NULL;
+	t->open[fd / 64] &= ~bit;
+	t->cloexec[fd / 64] &= ~bit;
+	return f;
+}
+
+bool fdtable_cloexec(const struct fdtable *t, int fd)
+{
+	if (fd < 0 || (uint32_t)fd >= t->size)
+		return false;
+	return t->cloexec[fd / 64] & (1ULL << (fd % 64));
+}
+
+void fdtable_set_cloexec(struct fdtable *t, int fd, bool on)
+{
+	if (!fdtable_get(t, fd))
+		return;
+
+	if (on)
+		t->cloexec[fd / 64] |= 1ULL << (fd % 64);
+	else
+		t->cloexec[fd / 64] &= ~(1ULL << (fd % 64));
+}
+
+// next open fd at or above fd, -1 once there are none
+int fdtable_next(const struct fdtable *t, int fd)
+{
+	return fdtable_scan(t->open, t->size, fd, true);
+}
+
+int fdtable_next_cloexec(const struct fdtable *t, int fd)
+{
+	return fdtable_scan(t->cloexec, t->size, fd, true);
+}
+
+// fork: dst takes a reference on every file open in src. only words with
+// open slots are visited, dst is expected to be empty
+int fdtable_copy(struct fdtable *dst, const struct fdtable *src)
+{
+	if (dst->size < src->size) {
+		int r = fdtable_resize(dst, src->size);
+		if (r != 0)
+			return r;
+	}
+
+	for (uint32_t w = 0; w < FDT_WORDS(src->size); w++) {
+		uint64_t bits = src->open[w];
+		if (!bits)
+			continue;
+
+		dst->open[w] = bits;
+		dst->cloexec[w] = src->cloexec[w];
+		while (bits) {
+			uint32_t fd = w * 64 + (uint32_t)__builtin_ctzll(bits);
+			bits &= bits - 1;
+
+			fio_retain(src->files[fd]);
+			dst->files[fd] = src->files[fd];
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+/*********************************************************************************/
+/* Module Name:  kstack.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <sys/kstack.h>
+#include <sys/sched.h>
+#include <arch/cpu/cpu.h>
+#include <arch/sys/irqlock.h>
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <lib/align.h>
+#include <debug/log.h>
+#include <config.h>
+#include <aurix.h>
+#include <string.h>
+
+#define KSTACK_PAGES DIV_ROUND_UP(STACK_SIZE, PAGE_SIZE)
+#define KSTACK_SLOT_PAGES (KSTACK_PAGES + KSTACK_GUARD_PAGES)
+#define KSTACK_GUARD_SIZE (KSTACK_GUARD_PAGES * PAGE_SIZE)
+
+struct kstack_cache {
+	void *stacks[KSTACK_CACHE_SIZE];
+	size_t count;
+};
+
+static struct kstack_cache kstack_caches[CONFIG_CPU_MAX_COUNT];
+static size_t kstack_peak_used = 0;
+
+static struct kstack_cache *kstack_cache_get(void)
+{
+	uint8_t cpu = cpu_get_current_id();
+	if (cpu >= CONFIG_CPU_MAX_COUNT)
+		return NULL;
+	return &kstack_caches[cpu];
+}
+
+static void *kstack_map(void)
+{
+	uint8_t *slot = valloc(kvctx, KSTACK_SLOT_PAGES, VALLOC_RW);
+	if (!slot)
+		return NULL;
+
+	// running off the bottom faults instead of trampling whatever is below
+	for (size_t i = 0; i < KSTACK_GUARD_PAGES; i++) {
+		uintptr_t virt = (uintptr_t)slot + i * PAGE_SIZE;
+		uintptr_t phys = vget_phys(kvctx->pagemap, virt);
+		unmap_page(kvctx->pagemap, virt);
+		if (phys)
+			pmm_ref_dec(ALIGN_DOWN(phys, PAGE_SIZE), 1);
+	}
+
+	uint8_t *base = slot + KSTACK_GUARD_SIZE;
+	memset(base, 0, STACK_SIZE);
+	return base;
+}
+
+void *kstack_alloc(void)
+{
+	void *base = NULL;
+
+	uint8_t irq_state = save_if();
+	cpu_disable_interrupts();
+	struct kstack_cache *cache = kstack_cache_get();
+	if (cache && cache->count)
+		base = cache->stacks[--cache->count];
+	restore_if(irq_state);
+
+	if (!base)
+		base = kstack_map();
+	return base;
+}
+
+// the untouched bottom of a stack is still zero, so the first non-zero word
+// marks how deep it ever went
+size_t kstack_high_water(const void *base)
+{
+	if (!base)
+		return 0;
+
+	const uint64_t *p = base;
+	const uint64_t *end = (const uint64_t *)((const uint8_t *)base + STACK_SIZE);
+	while (p < end && *p == 0)
+		p++;
+
+	return (size_t)((const uint8_t *)end - (const uint8_t *)p);
+}
+
+size_t kstack_peak(void)
+{
+	return __atomic_load_n(&kstack_peak_used, __ATOMIC_RELAXED);
+}
+
+// only the part that was used gets zeroed, which keeps the cached stacks
+// clean without paying for the whole 32K on every exit
+void kstack_free(void *base)
+{
+	if (!base)
+		return;
+
+	size_t used = kstack_high_water(base);
+	memset((uint8_t *)base + STACK_SIZE - used, 0, used);
+
+	size_t peak = kstack_peak();
+	while (used > peak) {
+		if (__atomic_compare_exchange_n(&kstack_peak_used, &peak, used, false,
+										__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			debug("kstack: new peak usage %llu of %llu bytes\n",
+				  (uint64_t)used, (uint64_t)STACK_SIZE);
+			break;
+		}
+	}
+
+	uint8_t irq_state = save_if();
+	cpu_disable_interrupts();
+	struct kstack_cache *cache = kstack_cache_get();
+	bool cached = false;
+	if (cache && cache->count < KSTACK_CACHE_SIZE) {
+		cache->stacks[cache->count++] = base;
+		cached = true;
+	}
+	restore_if(irq_state);
+
+	if (!cached)
+		vfree(kvctx, (uint8_t *)base - KSTACK_GUARD_SIZE);
+}
+
+bool kstack_is_guard(uintptr_t addr)
+{
+	vregion_t *region = vget(kvctx, addr);
+	if (!region || region->pages != KSTACK_SLOT_PAGES)
+		return false;
+	return addr < region->start + KSTACK_GUARD_SIZE;
+}
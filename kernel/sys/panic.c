@@ -60,7 +60,7 @@ static void panic_stop_other_cpus(uint8_t this_cpu)
 	for (size_t i = 0; i < cpu_count; i++) {
 		if (i == this_cpu)
 			continue;
-		lapic_write(0x310, cpuinfo[i].id << 24);
+		lapic_write(0x310, cpuinfo[i].lapic_id << 24);
 		lapic_write(0x300, 0xff);
 	}
 }
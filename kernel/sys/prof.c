@@ -0,0 +1,373 @@
+/*********************************************************************************/
+/* Module Name:  prof.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <sys/prof.h>
+#include <sys/errno.h>
+#include <arch/apic/apic.h>
+#include <arch/cpu/cpu.h>
+#include <cpu/trace.h>
+#include <lib/hash.h>
+#include <lib/string.h>
+#include <mm/heap.h>
+#include <mm/vmm.h>
+#include <util/kprintf.h>
+#include <vfs/fileio.h>
+#include <config.h>
+#include <aurix.h>
+#include <stdatomic.h>
+
+#define PROF_KERNEL_MIN 0xffff800000000000ULL
+#define PROF_MAX_FUNCS 64
+
+struct prof_sample {
+	uint8_t depth; // 0 for samples taken in user mode
+	uintptr_t pc[PROF_MAX_DEPTH];
+};
+
+struct prof_cpu {
+	struct prof_sample *samples;
+	size_t count;
+	size_t dropped;
+	bool armed;
+};
+
+struct prof_stack {
+	const struct prof_sample *sample;
+	uint64_t hash;
+	size_t count;
+};
+
+struct prof_func {
+	uintptr_t addr;
+	const char *name;
+	size_t count;
+};
+
+static struct prof_cpu prof_cpus[CONFIG_CPU_MAX_COUNT];
+static atomic_bool prof_running = ATOMIC_VAR_INIT(false);
+static uint32_t prof_hz = PROF_DEFAULT_HZ;
+
+int prof_start(uint32_t hz)
+{
+	if (atomic_load(&prof_running))
+		return -EBUSY;
+
+	if (hz == 0)
+		hz = PROF_DEFAULT_HZ;
+
+	if (!lapic_timer_calibrate())
+		return -ENODEV;
+
+	for (size_t i = 0; i < cpu_count && i < CONFIG_CPU_MAX_COUNT; i++) {
+		struct prof_cpu *pc = &prof_cpus[i];
+		if (!pc->samples) {
+			pc->samples =
+				kmalloc(sizeof(struct prof_sample) * PROF_SAMPLES_PER_CPU);
+			if (!pc->samples)
+				return -ENOMEM;
+		}
+		pc->count = 0;
+		pc->dropped = 0;
+	}
+
+	prof_hz = hz;
+	atomic_store(&prof_running, true);
+
+	// every CPU arms its own LAPIC timer on the first PROF_VECTOR it sees
+	lapic_ipi_all(PROF_VECTOR);
+	return 0;
+}
+
+void prof_stop(void)
+{
+	if (!atomic_load(&prof_running))
+		return;
+
+	atomic_store(&prof_running, false);
+	lapic_ipi_all(PROF_VECTOR);
+}
+
+bool prof_is_running(void)
+{
+	return atomic_load(&prof_running);
+}
+
+static void prof_walk(struct prof_sample *s, uintptr_t rbp)
+{
+	while (s->depth < PROF_MAX_DEPTH) {
+		if (rbp < PROF_KERNEL_MIN || (rbp & 0x7))
+			break;
+		if (vget_phys(NULL, rbp) == 0 ||
+			vget_phys(NULL, rbp + sizeof(void *)) == 0)
+			break;
+
+		struct stack_frame *f = (struct stack_frame *)rbp;
+		if (f->rip < PROF_KERNEL_MIN)
+			break;
+		s->pc[s->depth++] = f->rip;
+
+		// callers always live higher up the same stack
+		if ((uintptr_t)f->rbp <= rbp)
+			break;
+		rbp = (uintptr_t)f->rbp;
+	}
+}
+
+void prof_tick(const struct interrupt_frame *frame)
+{
+	struct cpu *cpu = cpu_get_current();
+	if (!cpu || cpu->id >= CONFIG_CPU_MAX_COUNT)
+		return;
+
+	struct prof_cpu *pc = &prof_cpus[cpu->id];
+
+	if (!atomic_load(&prof_running)) {
+		if (pc->armed) {
+			lapic_timer_stop();
+			pc->armed = false;
+		}
+		return;
+	}
+
+	if (!pc->armed) {
+		lapic_timer_start_periodic(PROF_VECTOR, prof_hz);
+		pc->armed = true;
+		return;
+	}
+
+	if (!pc->samples || pc->count >= PROF_SAMPLES_PER_CPU) {
+		pc->dropped++;
+		return;
+	}
+
+	struct prof_sample *s = &pc->samples[pc->count];
+	s->depth = 0;
+	if ((frame->cs & 0x3) == 0) {
+		s->pc[s->depth++] = frame->rip;
+		prof_walk(s, frame->rbp);
+	}
+	pc->count++;
+}
+
+size_t prof_sample_count(void)
+{
+	size_t total = 0;
+	for (size_t i = 0; i < cpu_count && i < CONFIG_CPU_MAX_COUNT; i++)
+		total += prof_cpus[i].count;
+	return total;
+}
+
+static uint64_t prof_hash_sample(const struct prof_sample *s)
+{
+	uint64_t h = hash_fnv1a(&s->depth, sizeof(s->depth));
+	return hash_fnv1a_continue(h, s->pc, s->depth * sizeof(uintptr_t));
+}
+
+static bool prof_same_stack(const struct prof_sample *a,
+							const struct prof_sample *b)
+{
+	return a->depth == b->depth &&
+		   memcmp(a->pc, b->pc, a->depth * sizeof(uintptr_t)) == 0;
+}
+
+// folds identical stacks together, returns a table of `*slots_out` entries
+static struct prof_stack *prof_collect(size_t *slots_out)
+{
+	size_t slots = 16;
+	while (slots < prof_sample_count() * 2)
+		slots <<= 1;
+
+	struct prof_stack *table = kmalloc(sizeof(struct prof_stack) * slots);
+	if (!table)
+		return NULL;
+	memset(table, 0, sizeof(struct prof_stack) * slots);
+
+	for (size_t c = 0; c < cpu_count && c < CONFIG_CPU_MAX_COUNT; c++) {
+		struct prof_cpu *pc = &prof_cpus[c];
+		for (size_t i = 0; i < pc->count; i++) {
+			const struct prof_sample *s = &pc->samples[i];
+			uint64_t h = prof_hash_sample(s);
+			size_t idx = h & (slots - 1);
+
+			while (table[idx].sample &&
+				   (table[idx].hash != h ||
+					!prof_same_stack(table[idx].sample, s)))
+				idx = (idx + 1) & (slots - 1);
+
+			if (!table[idx].sample) {
+				table[idx].sample = s;
+				table[idx].hash = h;
+			}
+			table[idx].count++;
+		}
+	}
+
+	*slots_out = slots;
+	return table;
+}
+
+static int prof_format_frame(char *buf, size_t size, uintptr_t addr)
+{
+	const char *name = NULL;
+	uintptr_t sym = 0;
+	if (trace_lookup_symbol(addr, &name, &sym) && name)
+		return snprintf(buf, size, "%s", name);
+	return snprintf(buf, size, "0x%llx", (unsigned long long)addr);
+}
+
+int prof_report(size_t top)
+{
+	if (prof_is_running()) {
+		kprintf("prof: stop the profiler before reporting\n");
+		return -EBUSY;
+	}
+
+	size_t total = prof_sample_count();
+	size_t dropped = 0;
+	for (size_t i = 0; i < cpu_count && i < CONFIG_CPU_MAX_COUNT; i++)
+		dropped += prof_cpus[i].dropped;
+
+	kprintf("%llu samples at %u Hz, %llu dropped\n",
+			(unsigned long long)total, prof_hz, (unsigned long long)dropped);
+	if (total == 0)
+		return 0;
+
+	size_t slots = 0;
+	struct prof_stack *stacks = prof_collect(&slots);
+	if (!stacks)
+		return -ENOMEM;
+
+	// self samples per function, user time and overflow get their own rows
+	struct prof_func funcs[PROF_MAX_FUNCS];
+	size_t func_count = 0;
+	size_t user = 0;
+	size_t other = 0;
+
+	for (size_t i = 0; i < slots; i++) {
+		if (!stacks[i].sample)
+			continue;
+		if (stacks[i].sample->depth == 0) {
+			user += stacks[i].count;
+			continue;
+		}
+
+		const char *name = NULL;
+		uintptr_t sym = 0;
+		uintptr_t leaf = stacks[i].sample->pc[0];
+		if (!trace_lookup_symbol(leaf, &name, &sym) || !name)
+			sym = leaf;
+
+		size_t f = 0;
+		while (f < func_count && funcs[f].addr != sym)
+			f++;
+		if (f == func_count) {
+			if (func_count == PROF_MAX_FUNCS) {
+				other += stacks[i].count;
+				continue;
+			}
+			funcs[f].addr = sym;
+			funcs[f].name = name;
+			funcs[f].count = 0;
+			func_count++;
+		}
+		funcs[f].count += stacks[i].count;
+	}
+	kfree(stacks);
+
+	for (size_t i = 1; i < func_count; i++) {
+		struct prof_func tmp = funcs[i];
+		size_t j = i;
+		for (; j > 0 && funcs[j - 1].count < tmp.count; j--)
+			funcs[j] = funcs[j - 1];
+		funcs[j] = tmp;
+	}
+
+	kprintf("%8s  %6s  %s\n", "samples", "self%", "function");
+	for (size_t i = 0; i < func_count && i < top; i++) {
+		uint64_t pm = (funcs[i].count * 1000ull) / total;
+		if (funcs[i].name)
+			kprintf("%8llu  %3llu.%llu%%  %s\n",
+					(unsigned long long)funcs[i].count, pm / 10, pm % 10,
+					funcs[i].name);
+		else
+			kprintf("%8llu  %3llu.%llu%%  0x%llx\n",
+					(unsigned long long)funcs[i].count, pm / 10, pm % 10,
+					(unsigned long long)funcs[i].addr);
+	}
+	if (user)
+		kprintf("%8llu  %6s  [user]\n", (unsigned long long)user, "");
+	if (other)
+		kprintf("%8llu  %6s  [other]\n", (unsigned long long)other, "");
+
+	return 0;
+}
+
+int prof_dump(const char *path)
+{
+	if (prof_is_running())
+		return -EBUSY;
+
+	size_t slots = 0;
+	struct prof_stack *stacks = prof_collect(&slots);
+	if (!stacks)
+		return -ENOMEM;
+
+	struct fileio *f = open(path, O_CREATE | O_WRONLY | O_TRUNC, 0444);
+	if (!f) {
+		kfree(stacks);
+		return -ENOENT;
+	}
+
+	// folded stack format: outermost;...;leaf <count>
+	char line[512];
+	for (size_t i = 0; i < slots; i++) {
+		const struct prof_sample *s = stacks[i].sample;
+		if (!s)
+			continue;
+
+		size_t off = 0;
+		if (s->depth == 0)
+			off = (size_t)snprintf(line, sizeof(line), "[user]");
+		for (size_t d = s->depth; d > 0 && off < sizeof(line) - 1; d--) {
+			if (d != s->depth)
+				line[off++] = ';';
+			int n = prof_format_frame(line + off, sizeof(line) - off,
+									  s->pc[d - 1]);
+			if (n < 0)
+				break;
+			off += ((size_t)n < sizeof(line) - off) ? (size_t)n :
+													   sizeof(line) - off - 1;
+		}
+
+		if (off < sizeof(line) - 1) {
+			int n = snprintf(line + off, sizeof(line) - off, " %llu\n",
+							 (unsigned long long)stacks[i].count);
+			if (n > 0)
+				off += ((size_t)n < sizeof(line) - off) ?
+						   (size_t)n :
+						   sizeof(line) - off - 1;
+		}
+
+		write(f, line, off);
+	}
+
+	close(f);
+	kfree(stacks);
+	return 0;
+}
@@ -18,13 +18,17 @@
 
 #include <boot/axprot.h>
 #include <sys/sched.h>
+#include <sys/kstack.h>
+#include <sys/cpuidle.h>
 #include <mm/heap.h>
 #include <mm/vmm.h>
 #include <debug/log.h>
 #include <string.h>
 #include <arch/sys/irqlock.h>
 #include <lib/align.h>
+#include <lib/idr.h>
 #include <arch/cpu/switch.h>
+#include <arch/cpu/fpu.h>
 #ifdef __x86_64__
 #include <arch/cpu/gdt.h>
 #endif
@@ -32,29 +36,27 @@
 #include <aurix.h>
 #include <stdatomic.h>
 #include <acpi/madt.h>
+#include <acpi/srat.h>
 #include <vfs/fileio.h>
 
 #ifdef __x86_64__
 #include <platform/time/pit.h>
+#include <time/time.h>
+#include <arch/time/tsc.h>
 #endif
 
 #define SCHED_DEFAULT_SLICE 10
+#define SCHED_BALANCE_TICKS 50
+// a thread that left its CPU this recently still has a warm cache there
+#define SCHED_CACHE_HOT_TICKS 2
 #define USER_STACK_SIZE (1024 * 1024)
 
-#define PID_MAX 65536u
-#define TID_MAX 65536u
-
 static atomic_uint live_proc_count = ATOMIC_VAR_INIT(0);
 static atomic_uint live_thread_count = ATOMIC_VAR_INIT(0);
 
-static spinlock_t pid_alloc_lock = { 0 };
-static spinlock_t tid_alloc_lock = { 0 };
-
-static uint8_t pid_used[PID_MAX];
-static uint8_t tid_used[TID_MAX];
-
-static uint32_t pid_next_hint = 1;
-static uint32_t tid_next_hint = 1;
+// PID/TID -> pcb/tcb, an ID is held from creation until the object is freed
+static struct idr pid_idr;
+static struct idr tid_idr;
 static bool id_alloc_inited = false;
 
 static atomic_bool sched_enabled = ATOMIC_VAR_INIT(false);
@@ -65,6 +67,8 @@ static tcb idle_threads[CONFIG_CPU_MAX_COUNT];
 static bool cpu_sched_inited[CONFIG_CPU_MAX_COUNT] = { false };
 static pcb *proc_list = NULL;
 static spinlock_t proc_list_lock = { 0 };
+// parent/child links, zombies and pid_idr removal
+static irqlock_t proc_tree_lock = { 0 };
 
 static tcb *deferred_thread_reap[CONFIG_CPU_MAX_COUNT] = { 0 };
 static pcb *deferred_proc_reap[CONFIG_CPU_MAX_COUNT] = { 0 };
@@ -95,105 +99,65 @@ static void sched_id_allocator_init(void)
 	if (id_alloc_inited)
 		return;
 
-	spinlock_init(&pid_alloc_lock);
-	spinlock_init(&tid_alloc_lock);
+	memset(&pid_idr, 0, sizeof(pid_idr));
+	memset(&tid_idr, 0, sizeof(tid_idr));
+	spinlock_init(&pid_idr.lock);
+	spinlock_init(&tid_idr.lock);
 
-	memset(pid_used, 0, sizeof(pid_used));
-	memset(tid_used, 0, sizeof(tid_used));
+	// 0 is the kernel process and never handed out
+	idr_reserve(&pid_idr, 0);
+	idr_reserve(&tid_idr, 0);
 
-	pid_used[0] = 1;
-	tid_used[0] = 1;
-
-	pid_next_hint = 1;
-	tid_next_hint = 1;
 	id_alloc_inited = true;
 }
 
-static uint32_t sched_alloc_pid(void)
+static void proc_sibling_link(pcb **head, pcb *proc)
 {
-	uint32_t pid = UINT32_MAX;
-
-	spinlock_acquire(&pid_alloc_lock);
-
-	for (uint32_t scanned = 0; scanned < (PID_MAX - 1); scanned++) {
-		uint32_t cand = pid_next_hint;
-		if (cand == 0 || cand >= PID_MAX)
-			cand = 1;
-
-		if (!pid_used[cand]) {
-			pid_used[cand] = 1;
-			pid = cand;
-			pid_next_hint = cand + 1;
-			if (pid_next_hint >= PID_MAX)
-				pid_next_hint = 1;
-			break;
-		}
-
-		pid_next_hint++;
-		if (pid_next_hint >= PID_MAX)
-			pid_next_hint = 1;
-	}
-
-	spinlock_release(&pid_alloc_lock);
-	return pid;
+	proc->sibling_next = *head;
+	if (*head)
+		(*head)->sibling_pprev = &proc->sibling_next;
+	proc->sibling_pprev = head;
+	*head = proc;
 }
 
-static void sched_free_pid(uint32_t pid)
+static void proc_sibling_unlink(pcb *proc)
 {
-	if (pid == 0 || pid >= PID_MAX)
+	if (!proc->sibling_pprev)
 		return;
 
-	spinlock_acquire(&pid_alloc_lock);
-	pid_used[pid] = 0;
-	if (pid < pid_next_hint)
-		pid_next_hint = pid;
-	spinlock_release(&pid_alloc_lock);
+	*proc->sibling_pprev = proc->sibling_next;
+	if (proc->sibling_next)
+		proc->sibling_next->sibling_pprev = proc->sibling_pprev;
+	proc->sibling_next = NULL;
+	proc->sibling_pprev = NULL;
 }
 
-static uint32_t sched_alloc_tid(void)
+static void proc_free(pcb *proc)
 {
-	uint32_t tid = UINT32_MAX;
-
-	spinlock_acquire(&tid_alloc_lock);
-
-	for (uint32_t scanned = 0; scanned < (TID_MAX - 1); scanned++) {
-		uint32_t cand = tid_next_hint;
-		if (cand == 0 || cand >= TID_MAX)
-			cand = 1;
+	uint32_t pid = proc->pid;
 
-		if (!tid_used[cand]) {
-			tid_used[cand] = 1;
-			tid = cand;
-			tid_next_hint = cand + 1;
-			if (tid_next_hint >= TID_MAX)
-				tid_next_hint = 1;
+	spinlock_acquire(&proc_list_lock);
+	pcb **link = &proc_list;
+	while (*link) {
+		if (*link == proc) {
+			*link = proc->proc_next;
 			break;
 		}
-
-		tid_next_hint++;
-		if (tid_next_hint >= TID_MAX)
-			tid_next_hint = 1;
+		link = &(*link)->proc_next;
 	}
+	spinlock_release(&proc_list_lock);
 
-	spinlock_release(&tid_alloc_lock);
-	return tid;
-}
-
-static void sched_free_tid(uint32_t tid)
-{
-	if (tid == 0 || tid >= TID_MAX)
-		return;
+	// waitpid looks children up by PID under the tree lock
+	irqlock_acquire(&proc_tree_lock);
+	idr_remove(&pid_idr, pid);
+	irqlock_release(&proc_tree_lock);
 
-	spinlock_acquire(&tid_alloc_lock);
-	tid_used[tid] = 0;
-	if (tid < tid_next_hint)
-		tid_next_hint = tid;
-	spinlock_release(&tid_alloc_lock);
-}
+	if (proc->name)
+		kfree((void *)proc->name);
+	kfree(proc);
+	atomic_fetch_sub(&live_proc_count, 1);
 
-static inline bool sched_tid_is_managed(uint32_t tid)
-{
-	return tid > 0 && tid < TID_MAX;
+	trace("Destroyed process resources, PID=%u\n", pid);
 }
 
 static void proc_release_resources(pcb *proc)
@@ -207,43 +171,68 @@ static void proc_release_resources(pcb *proc)
 	uint32_t pid = proc->pid;
 
 	spinlock_acquire(&proc->fd_lock);
-	for (size_t fd = 0; fd < PROC_MAX_FDS; fd++) {
-		struct fileio *f = proc->fds[fd];
-		proc->fds[fd] = NULL;
-		if (f) {
-			spinlock_release(&proc->fd_lock);
-			close(f);
-			spinlock_acquire(&proc->fd_lock);
-		}
+	for (int fd = fdtable_next(&proc->fdt, 0); fd >= 0;
+		 fd = fdtable_next(&proc->fdt, fd + 1)) {
+		struct fileio *f = fdtable_remove(&proc->fdt, fd);
+		spinlock_release(&proc->fd_lock);
+		close(f);
+		spinlock_acquire(&proc->fd_lock);
 	}
+	fdtable_destroy(&proc->fdt);
 	spinlock_release(&proc->fd_lock);
 
 	if (proc->vctx)
 		vdestroy(proc->vctx);
 	if (proc->pm)
 		destroy_pagemap(proc->pm);
+	proc->vctx = NULL;
+	proc->pm = NULL;
 
-	if (proc->name)
-		kfree((void *)proc->name);
 	if (proc->cwd)
 		kfree(proc->cwd);
+	proc->cwd = NULL;
 
-	spinlock_acquire(&proc_list_lock);
-	pcb **link = &proc_list;
-	while (*link) {
-		if (*link == proc) {
-			*link = proc->proc_next;
-			break;
-		}
-		link = &(*link)->proc_next;
+	pcb *orphans = NULL;
+
+	irqlock_acquire(&proc_tree_lock);
+
+	// live children carry on without a parent, dead ones have nobody left
+	// to reap them
+	while (proc->children) {
+		pcb *child = proc->children;
+		proc_sibling_unlink(child);
+		child->parent = NULL;
+		child->parent_pid = 0;
+	}
+	while (proc->zombies) {
+		pcb *zombie = proc->zombies;
+		proc_sibling_unlink(zombie);
+		zombie->parent = NULL;
+		zombie->sibling_next = orphans;
+		orphans = zombie;
 	}
-	spinlock_release(&proc_list_lock);
 
-	kfree(proc);
-	sched_free_pid(pid);
-	atomic_fetch_sub(&live_proc_count, 1);
+	pcb *parent = proc->parent;
+	if (parent) {
+		proc_sibling_unlink(proc);
+		proc_sibling_link(&parent->zombies, proc);
+		proc->zombie = true;
+		waitq_wake_all(&parent->child_waitq);
+	}
 
-	trace("Destroyed process resources, PID=%u\n", pid);
+	irqlock_release(&proc_tree_lock);
+
+	while (orphans) {
+		pcb *next = orphans->sibling_next;
+		proc_free(orphans);
+		orphans = next;
+	}
+
+	if (parent)
+		trace("PID=%u exited, waiting for PID=%u to reap it\n", pid,
+			  parent->pid);
+	else
+		proc_free(proc);
 }
 
 static void proc_try_reap(pcb *proc)
@@ -259,40 +248,349 @@ static void proc_try_reap(pcb *proc)
 	proc_release_resources(proc);
 }
 
-static void sched_ipi_cpu(struct cpu *target)
+// get target to look at its queue. an idle CPU waiting in MWAIT wakes up
+// from the store to its idle word, anything else needs the IPI
+static void sched_kick_cpu(struct cpu *target)
 {
 	if (!target || target->id == cpu_get_current()->id)
 		return;
+	if (cpuidle_kick(target))
+		return;
 
-	lapic_write(0x310, (uint32_t)target->id << 24);
+	lapic_write(0x310, target->lapic_id << 24);
 	lapic_write(0x300, (uint32_t)0xfe | (1u << 14));
 
 	while (lapic_read(0x300) & (1u << 12))
 		;
 }
 
-static struct cpu *sched_pick_best_cpu(void)
+// nice -20..19 to weight, each step is roughly 10% of CPU time
+static const uint32_t sched_nice_weights[40] = {
+	88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+	9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
+	1024,  820,   655,   526,   423,   335,   272,   215,   172,   137,
+	110,   87,    70,    56,    45,    36,    29,    23,    18,    15,
+};
+
+#define SCHED_NICE0_WEIGHT 1024
+// vruntime a nice 0 thread gains per tick
+#define SCHED_VRUNTIME_TICK (1ULL << 20)
+// how far behind the pack a thread waking from sleep may start
+#define SCHED_WAKE_CREDIT (SCHED_VRUNTIME_TICK * SCHED_DEFAULT_SLICE / 2)
+
+static uint64_t cpu_min_vruntime[CONFIG_CPU_MAX_COUNT] = { 0 };
+
+enum { SCHED_RANK_IDLE, SCHED_RANK_FAIR, SCHED_RANK_RT };
+
+static inline bool sched_is_idle(const struct cpu *cpu, const tcb *t)
+{
+	return cpu->id < CONFIG_CPU_MAX_COUNT && t == &idle_threads[cpu->id];
+}
+
+static inline int sched_rank(const struct cpu *cpu, const tcb *t)
+{
+	if (sched_is_idle(cpu, t))
+		return SCHED_RANK_IDLE;
+	return t->policy == SCHED_OTHER ? SCHED_RANK_FAIR : SCHED_RANK_RT;
+}
+
+// clock readings, only turned into ns when someone asks for them
+struct sched_cpu_acct {
+	uint64_t since;
+	uint64_t busy;
+	uint64_t idle;
+	uint64_t migrations_in;
+	uint64_t migrations_out;
+};
+
+static struct sched_cpu_acct cpu_acct[CONFIG_CPU_MAX_COUNT] = { 0 };
+
+static uint64_t sched_next_balance = 0;
+static atomic_bool sched_balancing = ATOMIC_VAR_INIT(false);
+static atomic_bool sched_affinity_dirty = ATOMIC_VAR_INIT(false);
+
+// threads in sched_sleep_ms(), all woken by the first tick past the earliest
+// deadline, the rest just go back to sleep
+static struct waitq sched_sleepers = { 0 };
+static _Atomic uint64_t sched_next_wakeup = ATOMIC_VAR_INIT(UINT64_MAX);
+
+static inline uint64_t sched_clock(void)
+{
+#ifdef __x86_64__
+	if (tsc_is_available())
+		return tsc_read();
+#endif
+	return 0;
+}
+
+static inline uint64_t sched_clock_to_ns(uint64_t t)
+{
+#ifdef __x86_64__
+	return tsc_to_ns(t);
+#else
+	return t;
+#endif
+}
+
+static inline uint64_t sched_ticks_now(void)
+{
+#ifdef __x86_64__
+	return pit_get_ticks();
+#else
+	return 0;
+#endif
+}
+
+// prev is about to be switched away from
+static void sched_switch_locked(struct cpu *cpu, tcb *prev)
+{
+	prev->last_ran = sched_ticks_now();
+	if (cpu->id >= CONFIG_CPU_MAX_COUNT)
+		return;
+
+	struct sched_cpu_acct *acct = &cpu_acct[cpu->id];
+	uint64_t now = sched_clock();
+	uint64_t delta = acct->since ? now - acct->since : 0;
+	if (sched_is_idle(cpu, prev))
+		acct->idle += delta;
+	else
+		acct->busy += delta;
+	acct->since = now;
+}
+
+// should a run before b. ties keep queue order, which is what makes RR
+// round robin and FIFO first come first served
+static bool sched_before(const struct cpu *cpu, const tcb *a, const tcb *b)
+{
+	int ra = sched_rank(cpu, a);
+	int rb = sched_rank(cpu, b);
+	if (ra != rb)
+		return ra > rb;
+	if (ra == SCHED_RANK_RT)
+		return a->rt_priority > b->rt_priority;
+	if (ra == SCHED_RANK_FAIR)
+		return (int64_t)(a->vruntime - b->vruntime) < 0;
+	return false;
+}
+
+static inline bool sched_cpu_allowed(const tcb *thread, const struct cpu *cpu)
+{
+	return cpu->id < 64 && (thread->cpu_mask & (1ULL << cpu->id));
+}
+
+// best thread on the queue other than current, the idle thread at worst.
+// threads whose affinity no longer covers this CPU wait for the balancer
+static tcb *sched_pick_locked(struct cpu *cpu, tcb *current)
+{
+	tcb *best = NULL;
+	for (tcb *t = cpu->thread_list; t; t = t->cpu_next) {
+		if (t == current || !sched_cpu_allowed(t, cpu))
+			continue;
+		if (!best || sched_before(cpu, t, best))
+			best = t;
+	}
+	return best;
+}
+
+static void sched_unlink_locked(struct cpu *cpu, tcb *thread)
+{
+	tcb **link = &cpu->thread_list;
+	while (*link && *link != thread)
+		link = &(*link)->cpu_next;
+	if (*link)
+		*link = thread->cpu_next;
+	thread->cpu_next = NULL;
+}
+
+// the head of the queue is what's running, see thread_current()
+static void sched_push_front_locked(struct cpu *cpu, tcb *thread)
+{
+	sched_unlink_locked(cpu, thread);
+	thread->cpu_next = cpu->thread_list;
+	cpu->thread_list = thread;
+}
+
+static void sched_push_back_locked(struct cpu *cpu, tcb *thread)
+{
+	sched_unlink_locked(cpu, thread);
+	tcb **link = &cpu->thread_list;
+	while (*link)
+		link = &(*link)->cpu_next;
+	*link = thread;
+}
+
+// a thread joining a queue starts level with it, so it can't bank the time
+// it spent away and then hog the CPU
+static void sched_place_locked(struct cpu *cpu, tcb *thread, uint64_t credit)
+{
+	if (thread->policy != SCHED_OTHER || cpu->id >= CONFIG_CPU_MAX_COUNT)
+		return;
+
+	uint64_t min = cpu_min_vruntime[cpu->id];
+	uint64_t floor = min > credit ? min - credit : 0;
+	if ((int64_t)(thread->vruntime - floor) < 0)
+		thread->vruntime = floor;
+}
+
+static void sched_account_locked(struct cpu *cpu, tcb *current)
+{
+	current->runtime++;
+	if (sched_rank(cpu, current) != SCHED_RANK_FAIR)
+		return;
+
+	current->vruntime +=
+		SCHED_VRUNTIME_TICK * SCHED_NICE0_WEIGHT / current->weight;
+
+	// the queue's floor only ever moves forward
+	uint64_t min = current->vruntime;
+	for (tcb *t = cpu->thread_list; t; t = t->cpu_next) {
+		if (sched_rank(cpu, t) == SCHED_RANK_FAIR &&
+			(int64_t)(t->vruntime - min) < 0)
+			min = t->vruntime;
+	}
+	if ((int64_t)(min - cpu_min_vruntime[cpu->id]) > 0)
+		cpu_min_vruntime[cpu->id] = min;
+}
+
+static bool sched_should_preempt(const struct cpu *cpu, const tcb *current,
+								 const tcb *best, bool expired)
+{
+	if (!best || sched_is_idle(cpu, best))
+		return false;
+	if (sched_is_idle(cpu, current))
+		return true;
+
+	int rc = sched_rank(cpu, current);
+	int rb = sched_rank(cpu, best);
+	if (rb != rc)
+		return rb > rc;
+
+	if (rc == SCHED_RANK_RT) {
+		if (best->rt_priority != current->rt_priority)
+			return best->rt_priority > current->rt_priority;
+		return expired && current->policy == SCHED_RR;
+	}
+
+	// a fair thread keeps its slice even when someone else is behind
+	return expired && (int64_t)(best->vruntime - current->vruntime) < 0;
+}
+
+static void sched_init_thread(tcb *thread)
+{
+	thread->policy = SCHED_OTHER;
+	thread->nice = 0;
+	thread->rt_priority = 0;
+	thread->weight = SCHED_NICE0_WEIGHT;
+	thread->vruntime = 0;
+	thread->runtime = 0;
+	thread->cpu_mask = SCHED_CPU_MASK_ALL;
+	thread->last_ran = 0;
+	thread->kthread.on_cpu = 0;
+}
+
+static uint64_t sched_cpu_load(struct cpu *cpu)
+{
+	irqlock_acquire(&cpu->sched_lock);
+	uint64_t count = cpu->thread_count;
+	irqlock_release(&cpu->sched_lock);
+	return count;
+}
+
+// a thread's CPU can change until that CPU's lock is held
+static struct cpu *sched_lock_thread(tcb *thread)
+{
+	for (;;) {
+		struct cpu *cpu = thread->cpu;
+		if (!cpu)
+			return NULL;
+		irqlock_acquire(&cpu->sched_lock);
+		if (thread->cpu == cpu)
+			return cpu;
+		irqlock_release(&cpu->sched_lock);
+	}
+}
+
+// lowest id first so two balancers can't deadlock, released in reverse
+static void sched_lock_pair(struct cpu *a, struct cpu *b)
+{
+	if (a->id > b->id) {
+		struct cpu *tmp = a;
+		a = b;
+		b = tmp;
+	}
+	irqlock_acquire(&a->sched_lock);
+	irqlock_acquire(&b->sched_lock);
+}
+
+static void sched_unlock_pair(struct cpu *a, struct cpu *b)
+{
+	if (a->id > b->id) {
+		struct cpu *tmp = a;
+		a = b;
+		b = tmp;
+	}
+	irqlock_release(&b->sched_lock);
+	irqlock_release(&a->sched_lock);
+}
+
+static inline bool sched_cpu_usable(const struct cpu *cpu)
+{
+	return cpu->id < CONFIG_CPU_MAX_COUNT && cpu_sched_inited[cpu->id];
+}
+
+// the node holding the thread's page tables, as good a guess as any for
+// where the rest of its memory is
+static inline uint32_t sched_thread_node(const tcb *thread)
+{
+	return srat_addr_node(thread->kthread.cr3);
+}
+
+// everything queued on the physical core cpu belongs to
+static uint64_t sched_core_load(struct cpu *cpu)
+{
+	uint64_t load = 0;
+	for (size_t i = 0; i < cpu_count; i++) {
+		struct cpu *c = &cpuinfo[i];
+		if (sched_cpu_usable(c) && c->package == cpu->package &&
+			c->core == cpu->core)
+			load += sched_cpu_load(c);
+	}
+	return load;
+}
+
+// lower is better: fewest threads on the CPU, then on its physical core so
+// SMT siblings fill up last, then staying on the given memory node
+static uint64_t sched_cpu_score(struct cpu *cpu, uint32_t node)
+{
+	uint64_t load = sched_cpu_load(cpu);
+	uint64_t core = sched_core_load(cpu);
+	if (load > UINT32_MAX)
+		load = UINT32_MAX;
+	if (core > UINT32_MAX >> 1)
+		core = UINT32_MAX >> 1;
+	return (load << 32) | (core << 1) | (cpu->node != node);
+}
+
+static struct cpu *sched_pick_best_cpu(const tcb *thread)
 {
 	if (cpu_count == 1)
 		return cpu_get_current();
 
+	uint32_t node = sched_thread_node(thread);
 	struct cpu *best = NULL;
-	uint64_t best_count = UINT64_MAX;
+	uint64_t best_score = UINT64_MAX;
 
 	for (size_t i = 0; i < cpu_count; i++) {
 		struct cpu *c = &cpuinfo[i];
 
-		if (c->id < CONFIG_CPU_MAX_COUNT && !cpu_sched_inited[c->id])
+		if (!sched_cpu_usable(c) || !sched_cpu_allowed(thread, c))
 			continue;
 
-		irqlock_acquire(&c->sched_lock);
-		uint64_t count = c->thread_count;
-		irqlock_release(&c->sched_lock);
-
-		if (count < best_count ||
-			(count == best_count && c == cpu_get_current())) {
+		uint64_t score = sched_cpu_score(c, node);
+		if (score < best_score ||
+			(score == best_score && c == cpu_get_current())) {
 			best = c;
-			best_count = count;
+			best_score = score;
 		}
 	}
 
@@ -309,6 +607,7 @@ static void cpu_add_thread(struct cpu *cpu, tcb *thread)
 	irqlock_acquire(&cpu->sched_lock);
 
 	thread->cpu_next = NULL;
+	sched_place_locked(cpu, thread, 0);
 
 	if (!cpu->thread_list) {
 		cpu->thread_list = thread;
@@ -328,7 +627,7 @@ static void cpu_add_thread(struct cpu *cpu, tcb *thread)
 	irqlock_release(&cpu->sched_lock);
 
 	if (atomic_load(&sched_enabled) && cpu->id != cpu_get_current()->id)
-		sched_ipi_cpu(cpu);
+		sched_kick_cpu(cpu);
 }
 
 static void cpu_remove_thread(struct cpu *cpu, tcb *thread)
@@ -352,6 +651,225 @@ static void cpu_remove_thread(struct cpu *cpu, tcb *thread)
 	irqlock_release(&cpu->sched_lock);
 }
 
+// the running thread stays put, as does one src hasn't finished switching
+// away from yet, or that left its CPU within the last couple of ticks
+static bool sched_can_migrate(const struct cpu *src, const struct cpu *dst,
+							  const tcb *thread, uint64_t now)
+{
+	if (thread == src->thread_list || sched_is_idle(src, thread))
+		return false;
+	if (!sched_cpu_allowed(thread, dst) || thread->kthread.on_cpu)
+		return false;
+	return now - thread->last_ran >= SCHED_CACHE_HOT_TICKS;
+}
+
+static void sched_move_locked(struct cpu *src, struct cpu *dst, tcb *thread)
+{
+	sched_unlink_locked(src, thread);
+	src->thread_count--;
+
+	// keep its lead or lag relative to the queue it's leaving
+	if (thread->policy == SCHED_OTHER)
+		thread->vruntime = thread->vruntime - cpu_min_vruntime[src->id] +
+						   cpu_min_vruntime[dst->id];
+
+	sched_push_back_locked(dst, thread);
+	dst->thread_count++;
+	thread->cpu = dst;
+
+	cpu_acct[src->id].migrations_out++;
+	cpu_acct[dst->id].migrations_in++;
+
+	trace("Migrated TID=%u CPU%u -> CPU%u\n", thread->tid, src->id, dst->id);
+}
+
+static bool sched_pair_ok(const struct cpu *src, const struct cpu *dst)
+{
+	return src != dst && src->id < CONFIG_CPU_MAX_COUNT &&
+		   dst->id < CONFIG_CPU_MAX_COUNT;
+}
+
+// move the coldest movable thread from src to dst while src is at least
+// two threads ahead, preferring one whose memory lives near dst
+static bool sched_migrate_one(struct cpu *src, struct cpu *dst)
+{
+	if (!sched_pair_ok(src, dst))
+		return false;
+
+	uint64_t now = sched_ticks_now();
+	tcb *pick = NULL;
+	bool pick_local = false;
+
+	sched_lock_pair(src, dst);
+
+	if (src->thread_count >= dst->thread_count + 2) {
+		for (tcb *t = src->thread_list; t; t = t->cpu_next) {
+			if (!sched_can_migrate(src, dst, t, now))
+				continue;
+			bool local = sched_thread_node(t) == dst->node;
+			if (!pick || (local && !pick_local) ||
+				(local == pick_local && t->last_ran < pick->last_ran)) {
+				pick = t;
+				pick_local = local;
+			}
+		}
+	}
+
+	if (pick)
+		sched_move_locked(src, dst, pick);
+
+	sched_unlock_pair(src, dst);
+
+	if (pick && dst->id != cpu_get_current()->id)
+		sched_kick_cpu(dst);
+	return pick != NULL;
+}
+
+// move one particular thread, if it's still queued on src and movable
+static bool sched_migrate_thread(struct cpu *src, struct cpu *dst, tcb *thread)
+{
+	if (!sched_pair_ok(src, dst))
+		return false;
+
+	uint64_t now = sched_ticks_now();
+	bool moved = false;
+
+	sched_lock_pair(src, dst);
+
+	for (tcb *t = src->thread_list; t; t = t->cpu_next) {
+		if (t == thread) {
+			if (sched_can_migrate(src, dst, t, now)) {
+				sched_move_locked(src, dst, t);
+				moved = true;
+			}
+			break;
+		}
+	}
+
+	sched_unlock_pair(src, dst);
+
+	if (moved && dst->id != cpu_get_current()->id)
+		sched_kick_cpu(dst);
+	return moved;
+}
+
+// pull one thread onto dst from the busiest other CPU
+static bool sched_balance_cpu(struct cpu *dst)
+{
+	struct cpu *busiest = NULL;
+	uint64_t busiest_load = 0;
+
+	for (size_t i = 0; i < cpu_count; i++) {
+		struct cpu *c = &cpuinfo[i];
+		if (c == dst || !sched_cpu_usable(c))
+			continue;
+
+		uint64_t load = sched_cpu_load(c);
+		if (!busiest || load > busiest_load) {
+			busiest = c;
+			busiest_load = load;
+		}
+	}
+
+	return busiest && sched_migrate_one(busiest, dst);
+}
+
+// evict threads queued on a CPU their affinity no longer covers. they're
+// never picked to run there, so they go cold and can move. returns true
+// while some are still waiting for that
+static bool sched_fix_affinity(void)
+{
+	bool left = false;
+
+	for (size_t i = 0; i < cpu_count; i++) {
+		struct cpu *src = &cpuinfo[i];
+		if (!sched_cpu_usable(src))
+			continue;
+
+		for (;;) {
+			uint64_t now = sched_ticks_now();
+			tcb *victim = NULL;
+
+			irqlock_acquire(&src->sched_lock);
+			for (tcb *t = src->thread_list; t; t = t->cpu_next) {
+				if (sched_is_idle(src, t) || sched_cpu_allowed(t, src))
+					continue;
+				if (t != src->thread_list &&
+					now - t->last_ran >= SCHED_CACHE_HOT_TICKS) {
+					victim = t;
+					break;
+				}
+				left = true;
+			}
+			irqlock_release(&src->sched_lock);
+
+			if (!victim)
+				break;
+
+			struct cpu *dst = sched_pick_best_cpu(victim);
+			if (!sched_migrate_thread(src, dst, victim)) {
+				left = true;
+				break;
+			}
+		}
+	}
+
+	return left;
+}
+
+// every SCHED_BALANCE_TICKS whichever CPU gets there first feeds the least
+// loaded one. affinity changes are chased on every tick until settled
+static void sched_balance_tick(void)
+{
+	if (cpu_count < 2)
+		return;
+
+	uint64_t now = sched_ticks_now();
+	bool dirty = atomic_load(&sched_affinity_dirty);
+	bool due = (int64_t)(now - sched_next_balance) >= 0;
+	if ((!dirty && !due) || atomic_exchange(&sched_balancing, true))
+		return;
+
+	if (dirty) {
+		atomic_store(&sched_affinity_dirty, false);
+		if (sched_fix_affinity())
+			atomic_store(&sched_affinity_dirty, true);
+	}
+
+	if (due) {
+		sched_next_balance = now + SCHED_BALANCE_TICKS;
+
+		struct cpu *idlest = NULL;
+		uint64_t idlest_score = UINT64_MAX;
+		for (size_t i = 0; i < cpu_count; i++) {
+			struct cpu *c = &cpuinfo[i];
+			if (!sched_cpu_usable(c))
+				continue;
+
+			uint64_t score = sched_cpu_score(c, UINT32_MAX);
+			if (score < idlest_score) {
+				idlest = c;
+				idlest_score = score;
+			}
+		}
+
+		if (idlest)
+			sched_balance_cpu(idlest);
+	}
+
+	atomic_store(&sched_balancing, false);
+}
+
+// a CPU with nothing but its idle thread goes looking for work
+static void sched_balance_idle(void)
+{
+	struct cpu *cpu = cpu_get_current();
+	if (!cpu || cpu_count < 2 || sched_cpu_load(cpu) > 1)
+		return;
+
+	sched_balance_cpu(cpu);
+}
+
 static void proc_unlink_thread_locked(pcb *proc, tcb *thread)
 {
 	if (!proc || !thread)
@@ -386,13 +904,12 @@ static void thread_release_final(tcb *thread)
 	thread->cpu = NULL;
 
 	if (stack_base)
-		vfree(kvctx, (void *)stack_base);
+		kstack_free((void *)stack_base);
+	fpu_state_free(thread->kthread.fpu);
 
+	idr_remove(&tid_idr, tid);
 	kfree(thread);
 
-	if (sched_tid_is_managed(tid))
-		sched_free_tid(tid);
-
 	atomic_fetch_sub(&live_thread_count, 1);
 }
 
@@ -416,7 +933,18 @@ static void sched_reap_deferred(struct cpu *cpu)
 		proc_try_reap(dead_proc);
 }
 
-void sched_tick(void)
+static void sched_wake_sleepers(void)
+{
+	if (get_ms() < atomic_load(&sched_next_wakeup))
+		return;
+
+	atomic_store(&sched_next_wakeup, UINT64_MAX);
+	waitq_wake_all(&sched_sleepers);
+}
+
+// tick: charge the running thread and hand over once something else has a
+// better claim. an IPI asks the same question without charging anyone
+static void sched_resched(bool tick)
 {
 	if (!atomic_load(&sched_enabled))
 		return;
@@ -426,6 +954,10 @@ void sched_tick(void)
 		return;
 
 	sched_reap_deferred(cpu);
+	if (tick) {
+		sched_balance_tick();
+		sched_wake_sleepers();
+	}
 
 	irqlock_acquire(&cpu->sched_lock);
 
@@ -435,23 +967,56 @@ void sched_tick(void)
 		return;
 	}
 
-	if (atomic_load(&current->kill_pending)) {
-		int code = current->kill_code;
+	if (atomic_load(&current->kill_pending)) {
+		int code = current->kill_code;
+		irqlock_release(&cpu->sched_lock);
+		thread_exit(current, code);
+		__builtin_unreachable();
+	}
+
+	bool expired = false;
+	if (tick) {
+		sched_account_locked(cpu, current);
+
+		if (current->policy != SCHED_FIFO && current->time_slice > 0)
+			current->time_slice--;
+		if (current->policy != SCHED_FIFO && current->time_slice == 0) {
+			current->time_slice = SCHED_DEFAULT_SLICE;
+			expired = true;
+		}
+	}
+
+	// a thread whose affinity just dropped this CPU makes way for anyone,
+	// idle included, so it can cool down and be moved
+	tcb *next = sched_pick_locked(cpu, current);
+	bool evict = next && !sched_cpu_allowed(current, cpu);
+	if (!evict && !sched_should_preempt(cpu, current, next, expired)) {
 		irqlock_release(&cpu->sched_lock);
-		thread_exit(current, code);
-		__builtin_unreachable();
+		return;
 	}
 
-	if (current->time_slice > 0)
-		current->time_slice--;
+	sched_push_back_locked(cpu, current);
+	sched_push_front_locked(cpu, next);
+	sched_switch_locked(cpu, current);
 
-	bool should_yield = (current->time_slice == 0);
 	irqlock_release(&cpu->sched_lock);
 
-	if (should_yield)
-		sched_yield();
+	sched_prepare_cpu_stack(next);
+	switch_task(&current->kthread, &next->kthread);
+}
+
+void sched_tick(void)
+{
+	sched_resched(true);
+}
+
+void sched_preempt(void)
+{
+	sched_resched(false);
 }
 
+// give the CPU to whoever is next in line, whatever their class. the kernel
+// still waits by yielding in a loop, so a yielder must never pick itself
 void sched_yield(void)
 {
 	if (!atomic_load(&sched_enabled))
@@ -480,19 +1045,16 @@ void sched_yield(void)
 
 	current->time_slice = SCHED_DEFAULT_SLICE;
 
-	if (!current->cpu_next) {
+	tcb *next = sched_pick_locked(cpu, current);
+	if (!next ||
+		(sched_is_idle(cpu, next) && sched_cpu_allowed(current, cpu))) {
 		irqlock_release(&cpu->sched_lock);
 		return;
 	}
 
-	tcb *next = current->cpu_next;
-	cpu->thread_list = next;
-
-	tcb *tail = next;
-	while (tail->cpu_next)
-		tail = tail->cpu_next;
-	tail->cpu_next = current;
-	current->cpu_next = NULL;
+	sched_push_back_locked(cpu, current);
+	sched_push_front_locked(cpu, next);
+	sched_switch_locked(cpu, current);
 
 	irqlock_release(&cpu->sched_lock);
 
@@ -507,7 +1069,7 @@ void sched_enable(void)
 	for (size_t i = 0; i < cpu_count; i++) {
 		struct cpu *c = &cpuinfo[i];
 		if (c->id != cpu_get_current()->id)
-			sched_ipi_cpu(c);
+			sched_kick_cpu(c);
 	}
 }
 
@@ -524,13 +1086,11 @@ bool sched_is_enabled(void)
 static void idle(void)
 {
 	for (;;) {
-#ifdef __x86_64__
-		__asm__ volatile("sti; hlt; cli");
-#elif __aarch64__
-		__asm__ volatile("wfe");
-#endif
-		if (atomic_load(&sched_enabled))
+		cpuidle_enter(cpu_get_current());
+		if (atomic_load(&sched_enabled)) {
+			sched_balance_idle();
 			sched_yield();
+		}
 	}
 }
 
@@ -560,7 +1120,6 @@ void sched_init(void)
 		kernel_proc.threads = NULL;
 		spinlock_init(&kernel_proc.fd_lock);
 		spinlock_init(&kernel_proc.thread_lock);
-		memset(kernel_proc.fds, 0, sizeof(kernel_proc.fds));
 		kernel_proc.umask = 0022;
 		kernel_proc.uid = 0;
 		kernel_proc.gid = 0;
@@ -579,17 +1138,16 @@ void sched_init(void)
 		idle_tcb->magic = TCB_MAGIC_ALIVE;
 		idle_tcb->tid = UINT32_MAX - cpu->id;
 		idle_tcb->time_slice = SCHED_DEFAULT_SLICE;
+		sched_init_thread(idle_tcb);
 		idle_tcb->process = &kernel_proc;
 		idle_tcb->cpu = cpu;
 		atomic_store(&idle_tcb->finished, false);
 		atomic_store(&idle_tcb->kill_pending, false);
 		idle_tcb->kill_code = 0;
 
-		uint64_t *stack_base =
-			valloc(kvctx, DIV_ROUND_UP(STACK_SIZE, PAGE_SIZE), VALLOC_RW);
+		uint64_t *stack_base = kstack_alloc();
 		uint64_t *rsp = (uint64_t *)((uint8_t *)stack_base + STACK_SIZE);
 		rsp = (uint64_t *)((uintptr_t)rsp - 8);
-		memset(stack_base, 0, STACK_SIZE);
 
 		*--rsp = (uint64_t)idle;
 		*--rsp = 0;
@@ -608,12 +1166,25 @@ void sched_init(void)
 		cpu->thread_list = idle_tcb;
 		cpu->thread_count = 1;
 
+		cpuidle_init(cpu);
 		cpu_sched_inited[cpu->id] = true;
 	}
 
 	trace("Scheduler initialized on CPU=%u\n", cpu->id);
 }
 
+static void proc_open_stdio(pcb *proc, int fd, const char *path, int flags)
+{
+	struct fileio *f = open(path, flags, 0);
+	struct fileio *old = NULL;
+
+	if (!f || fdtable_install(&proc->fdt, fd, f, false, &old) != 0) {
+		if (f)
+			close(f);
+		warn("proc_create: PID=%u failed to open %s\n", proc->pid, path);
+	}
+}
+
 pcb *proc_create(void)
 {
 	pcb *proc = kmalloc(sizeof(pcb));
@@ -624,8 +1195,9 @@ pcb *proc_create(void)
 
 	memset(proc, 0, sizeof(pcb));
 
-	proc->pid = sched_alloc_pid();
-	if (proc->pid == UINT32_MAX) {
+	// reserved now, published once the process is fully set up
+	proc->pid = idr_alloc(&pid_idr, NULL);
+	if (proc->pid == IDR_NONE) {
 		kfree(proc);
 		error("proc_create: out of PIDs\n");
 		return NULL;
@@ -635,7 +1207,7 @@ pcb *proc_create(void)
 
 	proc->pm = create_pagemap();
 	if (!proc->pm) {
-		sched_free_pid(proc->pid);
+		idr_remove(&pid_idr, proc->pid);
 		atomic_fetch_sub(&live_proc_count, 1);
 		kfree(proc);
 		error("proc_create: create_pagemap failed\n");
@@ -643,12 +1215,14 @@ pcb *proc_create(void)
 	}
 
 	proc->vctx = vinit(proc->pm, 0x1000);
-	if (!proc->vctx) {
+	if (!proc->vctx || fdtable_init(&proc->fdt) != 0) {
+		if (proc->vctx)
+			vdestroy(proc->vctx);
 		destroy_pagemap(proc->pm);
-		sched_free_pid(proc->pid);
+		idr_remove(&pid_idr, proc->pid);
 		atomic_fetch_sub(&live_proc_count, 1);
 		kfree(proc);
-		error("proc_create: vinit failed\n");
+		error("proc_create: vinit or fd table allocation failed\n");
 		return NULL;
 	}
 
@@ -656,7 +1230,7 @@ pcb *proc_create(void)
 	proc->proc_next = NULL;
 	spinlock_init(&proc->fd_lock);
 	spinlock_init(&proc->thread_lock);
-	memset(proc->fds, 0, sizeof(proc->fds));
+	waitq_init(&proc->child_waitq);
 	proc->cwd = strdup("/");
 	proc->umask = 0022;
 	proc->uid = 0;
@@ -664,6 +1238,7 @@ pcb *proc_create(void)
 	proc->euid = 0;
 	proc->egid = 0;
 	proc->parent_pid = 0;
+	proc->pgid = proc->pid;
 	proc->exit_code = 0;
 	proc->exited = false;
 	atomic_init(&proc->kill_pending, false);
@@ -671,17 +1246,9 @@ pcb *proc_create(void)
 	atomic_init(&proc->thread_count, 0);
 	atomic_init(&proc->reaped, false);
 
-	proc->fds[0] = open("/dev/stdin", O_RDONLY, 0);
-	if (!proc->fds[0])
-		warn("proc_create: PID=%u failed to open /dev/stdin\n", proc->pid);
-
-	proc->fds[1] = open("/dev/stdout", O_WRONLY, 0);
-	if (!proc->fds[1])
-		warn("proc_create: PID=%u failed to open /dev/stdout\n", proc->pid);
-
-	proc->fds[2] = open("/dev/stderr", O_WRONLY, 0);
-	if (!proc->fds[2])
-		warn("proc_create: PID=%u failed to open /dev/stderr\n", proc->pid);
+	proc_open_stdio(proc, 0, "/dev/stdin", O_RDONLY);
+	proc_open_stdio(proc, 1, "/dev/stdout", O_WRONLY);
+	proc_open_stdio(proc, 2, "/dev/stderr", O_WRONLY);
 
 	uintptr_t kvirt = 0xffffffff80000000ULL;
 	uintptr_t kphys = boot_params->kernel_addr;
@@ -708,6 +1275,8 @@ pcb *proc_create(void)
 	proc_list = proc;
 	spinlock_release(&proc_list_lock);
 
+	idr_replace(&pid_idr, proc->pid, proc);
+
 	return proc;
 }
 
@@ -744,8 +1313,8 @@ static tcb *thread_create_internal(pcb *proc, void (*entry)(void),
 	memset(thread, 0, sizeof(tcb));
 
 	thread->magic = TCB_MAGIC_ALIVE;
-	thread->tid = sched_alloc_tid();
-	if (thread->tid == UINT32_MAX) {
+	thread->tid = idr_alloc(&tid_idr, thread);
+	if (thread->tid == IDR_NONE) {
 		kfree(thread);
 		error("Failed to allocate TID for new thread\n");
 		return NULL;
@@ -755,23 +1324,34 @@ static tcb *thread_create_internal(pcb *proc, void (*entry)(void),
 	thread->user = user_mode;
 	thread->process = proc;
 	thread->time_slice = SCHED_DEFAULT_SLICE;
+	sched_init_thread(thread);
 	thread->joinable = false;
 	atomic_store(&thread->finished, false);
 	atomic_store(&thread->kill_pending, false);
 	thread->kill_code = 0;
 
-	uint64_t *stack_base =
-		valloc(kvctx, DIV_ROUND_UP(STACK_SIZE, PAGE_SIZE), VALLOC_RW);
+	uint64_t *stack_base = kstack_alloc();
 	if (!stack_base) {
-		sched_free_tid(thread->tid);
+		idr_remove(&tid_idr, thread->tid);
 		atomic_fetch_sub(&live_thread_count, 1);
 		kfree(thread);
 		return NULL;
 	}
 
+	// kernel threads are built without SIMD and need no FPU area
+	if (user_mode) {
+		thread->kthread.fpu = fpu_state_alloc();
+		if (!thread->kthread.fpu) {
+			kstack_free(stack_base);
+			idr_remove(&tid_idr, thread->tid);
+			atomic_fetch_sub(&live_thread_count, 1);
+			kfree(thread);
+			return NULL;
+		}
+	}
+
 	uint64_t *rsp = (uint64_t *)((uint8_t *)stack_base + STACK_SIZE);
 	rsp = (uint64_t *)((uintptr_t)rsp - 8);
-	memset(stack_base, 0, STACK_SIZE);
 	thread->kthread.rsp0 = (uint64_t)stack_base + STACK_SIZE;
 
 	if (!user_mode) {
@@ -787,8 +1367,9 @@ static tcb *thread_create_internal(pcb *proc, void (*entry)(void),
 		if (!proc->user_rsp || !proc->user_stack_base ||
 			proc->user_stack_size == 0) {
 			error("user stack not initialized for PID=%u\n", proc->pid);
-			vfree(kvctx, stack_base);
-			sched_free_tid(thread->tid);
+			fpu_state_free(thread->kthread.fpu);
+			kstack_free(stack_base);
+			idr_remove(&tid_idr, thread->tid);
 			atomic_fetch_sub(&live_thread_count, 1);
 			kfree(thread);
 			return NULL;
@@ -801,8 +1382,9 @@ static tcb *thread_create_internal(pcb *proc, void (*entry)(void),
 		if (user_rsp < proc->user_stack_base || user_rsp > user_stack_end) {
 			error("user rsp out of range for PID=%u (rsp=%p)\n", proc->pid,
 				  (void *)user_rsp);
-			vfree(kvctx, stack_base);
-			sched_free_tid(thread->tid);
+			fpu_state_free(thread->kthread.fpu);
+			kstack_free(stack_base);
+			idr_remove(&tid_idr, thread->tid);
 			atomic_fetch_sub(&live_thread_count, 1);
 			kfree(thread);
 			return NULL;
@@ -839,7 +1421,7 @@ static tcb *thread_create_internal(pcb *proc, void (*entry)(void),
 	atomic_fetch_add(&proc->thread_count, 1);
 	spinlock_release(&proc->thread_lock);
 
-	struct cpu *cpu = sched_pick_best_cpu();
+	struct cpu *cpu = sched_pick_best_cpu(thread);
 	cpu_add_thread(cpu, thread);
 
 	return thread;
@@ -860,7 +1442,7 @@ void thread_enqueue(tcb *thread)
 	if (!thread)
 		return;
 
-	struct cpu *cpu = sched_pick_best_cpu();
+	struct cpu *cpu = sched_pick_best_cpu(thread);
 	cpu_add_thread(cpu, thread);
 }
 
@@ -880,8 +1462,8 @@ tcb *thread_clone_user(pcb *proc, tcb *parent)
 	memset(thread, 0, sizeof(tcb));
 
 	thread->magic = TCB_MAGIC_ALIVE;
-	thread->tid = sched_alloc_tid();
-	if (thread->tid == UINT32_MAX) {
+	thread->tid = idr_alloc(&tid_idr, thread);
+	if (thread->tid == IDR_NONE) {
 		kfree(thread);
 		error("Failed to allocate TID for cloned thread\n");
 		return NULL;
@@ -891,21 +1473,43 @@ tcb *thread_clone_user(pcb *proc, tcb *parent)
 	thread->user = true;
 	thread->process = proc;
 	thread->time_slice = SCHED_DEFAULT_SLICE;
+	thread->policy = parent->policy;
+	thread->nice = parent->nice;
+	thread->rt_priority = parent->rt_priority;
+	thread->weight = parent->weight;
+	thread->vruntime = parent->vruntime;
+	thread->cpu_mask = parent->cpu_mask;
 	thread->joinable = parent->joinable;
 	thread->kthread.fs_base = parent->kthread.fs_base;
 	atomic_store(&thread->finished, false);
 	atomic_store(&thread->kill_pending, false);
 	thread->kill_code = 0;
 
-	uint64_t *stack_base =
-		valloc(kvctx, DIV_ROUND_UP(STACK_SIZE, PAGE_SIZE), VALLOC_RW);
+	uint64_t *stack_base = kstack_alloc();
 	if (!stack_base) {
-		sched_free_tid(thread->tid);
+		idr_remove(&tid_idr, thread->tid);
+		atomic_fetch_sub(&live_thread_count, 1);
+		kfree(thread);
+		return NULL;
+	}
+
+	thread->kthread.fpu = fpu_state_alloc();
+	if (!thread->kthread.fpu) {
+		kstack_free(stack_base);
+		idr_remove(&tid_idr, thread->tid);
 		atomic_fetch_sub(&live_thread_count, 1);
 		kfree(thread);
 		return NULL;
 	}
 
+	// the child starts with the parent's registers, the parent's live ones
+	// haven't been written back yet if it's the one forking
+	if (parent->kthread.fpu) {
+		if (parent == thread_current())
+			fpu_save(parent->kthread.fpu);
+		fpu_state_copy(thread->kthread.fpu, parent->kthread.fpu);
+	}
+
 	thread->kthread.rsp0 = (uint64_t)stack_base + STACK_SIZE;
 	thread->kthread.cr3 = (uint64_t)proc->pm;
 
@@ -979,10 +1583,6 @@ void thread_exit(tcb *thread, int code)
 	if (cpu) {
 		irqlock_acquire(&cpu->sched_lock);
 
-		next = thread->cpu_next;
-		if (!next || next == thread)
-			next = (cpu->thread_list != thread) ? cpu->thread_list : NULL;
-
 		tcb **link = &cpu->thread_list;
 		while (*link) {
 			if (*link == thread) {
@@ -996,9 +1596,12 @@ void thread_exit(tcb *thread, int code)
 		thread->cpu = NULL;
 		thread->cpu_next = NULL;
 
-		if (!next)
-			next = cpu->thread_list;
-		if (!next && cpu->id < CONFIG_CPU_MAX_COUNT)
+		sched_switch_locked(cpu, thread);
+
+		next = sched_pick_locked(cpu, thread);
+		if (next)
+			sched_push_front_locked(cpu, next);
+		else if (cpu->id < CONFIG_CPU_MAX_COUNT)
 			next = &idle_threads[cpu->id];
 
 		irqlock_release(&cpu->sched_lock);
@@ -1008,11 +1611,19 @@ void thread_exit(tcb *thread, int code)
 		spinlock_acquire(&proc->thread_lock);
 		proc_unlink_thread_locked(proc, thread);
 		unsigned remaining = atomic_fetch_sub(&proc->thread_count, 1) - 1;
+		// a ring worker may outlive the user threads, it exits with the
+		// code the last of them left behind
+		if (thread->user)
+			proc->exit_code = code;
 		if (remaining == 0) {
 			proc->exit_code = code;
 			proc->exited = true;
 			last_proc_thread = true;
 		}
+		// the last one left may be a ring worker asleep until its siblings
+		// are gone, a spurious wakeup costs anyone else nothing
+		if (remaining == 1 && proc->threads)
+			sched_wake(proc->threads);
 		spinlock_release(&proc->thread_lock);
 
 		thread->process = NULL;
@@ -1022,6 +1633,9 @@ void thread_exit(tcb *thread, int code)
 	thread->magic = TCB_MAGIC_DEAD;
 	atomic_store(&thread->finished, true);
 
+	// keep the TID until the tcb is freed, but stop handing it out
+	idr_replace(&tid_idr, thread->tid, NULL);
+
 	if (!next && cpu && cpu->id < CONFIG_CPU_MAX_COUNT)
 		next = &idle_threads[cpu->id];
 
@@ -1039,8 +1653,9 @@ void thread_exit(tcb *thread, int code)
 
 	sched_prepare_cpu_stack(next);
 
-	struct kthread dead_ctx = thread->kthread;
-	switch_task(&dead_ctx, &next->kthread);
+	// nothing left worth saving, and a joiner may free this stack as soon
+	// as we're off it, so don't leave switch_task() anything to write
+	switch_task(NULL, &next->kthread);
 	__builtin_unreachable();
 }
 
@@ -1058,26 +1673,13 @@ tcb *thread_get_by_tid(uint32_t tid)
 	if (tid == UINT32_MAX)
 		return NULL;
 
-	for (size_t cpu_idx = 0; cpu_idx < cpu_count; cpu_idx++) {
-		struct cpu *cpu = &cpuinfo[cpu_idx];
-		if (!cpu)
-			continue;
-
-		irqlock_acquire(&cpu->sched_lock);
-
-		tcb *t = cpu->thread_list;
-		while (t) {
-			if (t->tid == tid) {
-				irqlock_release(&cpu->sched_lock);
-				return t;
-			}
-			t = t->cpu_next;
-		}
-
-		irqlock_release(&cpu->sched_lock);
+	// idle threads count down from UINT32_MAX, outside the table
+	if (tid > UINT32_MAX - CONFIG_CPU_MAX_COUNT) {
+		tcb *idle_tcb = &idle_threads[UINT32_MAX - tid];
+		return idle_tcb->magic == TCB_MAGIC_ALIVE ? idle_tcb : NULL;
 	}
 
-	return NULL;
+	return idr_find(&tid_idr, tid);
 }
 
 bool proc_has_threads(uint32_t pid)
@@ -1085,60 +1687,370 @@ bool proc_has_threads(uint32_t pid)
 	if (pid == 0 || pid == UINT32_MAX)
 		return false;
 
-	for (size_t cpu_idx = 0; cpu_idx < cpu_count; cpu_idx++) {
-		struct cpu *cpu = &cpuinfo[cpu_idx];
-		if (!cpu)
-			continue;
+	pcb *proc = idr_find(&pid_idr, pid);
+	return proc && atomic_load(&proc->thread_count) != 0;
+}
 
-		irqlock_acquire(&cpu->sched_lock);
+pcb *proc_get_by_pid(uint32_t pid)
+{
+	return idr_find(&pid_idr, pid);
+}
 
-		tcb *t = cpu->thread_list;
-		while (t) {
-			if (t->process && t->process->pid == pid) {
-				irqlock_release(&cpu->sched_lock);
-				return true;
-			}
-			t = t->cpu_next;
-		}
+int thread_wait(tcb *thread)
+{
+	if (!thread) {
+		error("thread_wait: NULL thread\n");
+		return -1;
+	}
+
+	thread->joinable = true;
+
+	while (!atomic_load(&thread->finished))
+		sched_yield();
+
+	int code = thread->exit_code;
+	thread_release_final(thread);
+	return code;
+}
+
+void waitq_init(struct waitq *wq)
+{
+	irqlock_init(&wq->lock);
+	wq->head = NULL;
+}
+
+// queue the current thread before checking the condition it waits for, a
+// wakeup that lands before sched_block() then makes it return right away
+void waitq_prepare(struct waitq *wq)
+{
+	tcb *self = thread_current();
+	if (!self)
+		return;
+
+	irqlock_acquire(&wq->lock);
+	if (!self->wait_queued) {
+		self->wait_next = wq->head;
+		wq->head = self;
+		self->wait_queued = true;
+	}
+	atomic_store(&self->waiting, true);
+	irqlock_release(&wq->lock);
+}
+
+void waitq_finish(struct waitq *wq)
+{
+	tcb *self = thread_current();
+	if (!self)
+		return;
+
+	irqlock_acquire(&wq->lock);
+	atomic_store(&self->waiting, false);
+	if (self->wait_queued) {
+		tcb **link = &wq->head;
+		while (*link && *link != self)
+			link = &(*link)->wait_next;
+		if (*link)
+			*link = self->wait_next;
+		self->wait_next = NULL;
+		self->wait_queued = false;
+	}
+	irqlock_release(&wq->lock);
+}
 
+void waitq_wake_all(struct waitq *wq)
+{
+	irqlock_acquire(&wq->lock);
+
+	// a queued thread can't leave before waitq_finish() takes the lock, so
+	// waking under it never touches a freed tcb
+	tcb *t = wq->head;
+	wq->head = NULL;
+	while (t) {
+		tcb *next = t->wait_next;
+		t->wait_next = NULL;
+		t->wait_queued = false;
+		sched_wake(t);
+		t = next;
+	}
+
+	irqlock_release(&wq->lock);
+}
+
+// take the current thread off its run queue until sched_wake(), unless it
+// was woken (or killed) since waitq_prepare()
+void sched_block(void)
+{
+	struct cpu *cpu = cpu_get_current();
+	if (!cpu)
+		return;
+
+	irqlock_acquire(&cpu->sched_lock);
+
+	tcb *current = cpu->thread_list;
+	if (!current || !current->cpu_next || !atomic_load(&current->waiting) ||
+		atomic_load(&current->kill_pending)) {
 		irqlock_release(&cpu->sched_lock);
+		return;
 	}
 
-	return false;
+	tcb *next = sched_pick_locked(cpu, current);
+	sched_push_front_locked(cpu, next);
+	sched_unlink_locked(cpu, current);
+	cpu->thread_count--;
+	current->blocked = true;
+	sched_switch_locked(cpu, current);
+	current->time_slice = SCHED_DEFAULT_SLICE;
+
+	irqlock_release(&cpu->sched_lock);
+
+	sched_prepare_cpu_stack(next);
+	switch_task(&current->kthread, &next->kthread);
 }
 
-pcb *proc_get_by_pid(uint32_t pid)
+// block for at least ms, give or take a tick. queued before the deadline is
+// published, so a tick that takes it always finds us
+void sched_sleep_ms(uint64_t ms)
 {
-	spinlock_acquire(&proc_list_lock);
+	uint64_t deadline = get_ms() + ms;
+
+	while (get_ms() < deadline) {
+		waitq_prepare(&sched_sleepers);
+
+		uint64_t next = atomic_load(&sched_next_wakeup);
+		while (deadline < next &&
+			   !atomic_compare_exchange_weak(&sched_next_wakeup, &next,
+											 deadline))
+			;
+
+		if (get_ms() < deadline)
+			sched_block();
+		waitq_finish(&sched_sleepers);
+
+		tcb *self = thread_current();
+		if (self && atomic_load(&self->kill_pending))
+			break;
+	}
+}
+
+// threads stay on their CPU while blocked. if their affinity dropped it in
+// the meantime they're woken on an allowed one instead, unless the old CPU
+// is still switching away, then the balancer chases them from there
+void sched_wake(tcb *thread)
+{
+	struct cpu *cpu = thread ? thread->cpu : NULL;
+	if (!cpu)
+		return;
+
+	struct cpu *dst = cpu;
+	if (!sched_cpu_allowed(thread, cpu))
+		dst = sched_pick_best_cpu(thread);
+	if (dst != cpu &&
+		(!sched_pair_ok(cpu, dst) || !sched_cpu_allowed(thread, dst)))
+		dst = cpu;
+
+	if (dst != cpu)
+		sched_lock_pair(cpu, dst);
+	else
+		irqlock_acquire(&cpu->sched_lock);
+
+	atomic_store(&thread->waiting, false);
+
+	bool requeued = thread->blocked;
+	struct cpu *target = cpu;
+	if (requeued) {
+		thread->blocked = false;
+		thread->cpu_next = NULL;
 
-	pcb *p = proc_list;
-	while (p) {
-		if (p->pid == pid) {
-			spinlock_release(&proc_list_lock);
-			return p;
+		if (dst != cpu && !thread->kthread.on_cpu) {
+			if (thread->policy == SCHED_OTHER)
+				thread->vruntime = thread->vruntime -
+								   cpu_min_vruntime[cpu->id] +
+								   cpu_min_vruntime[dst->id];
+			thread->cpu = dst;
+			cpu_acct[cpu->id].migrations_out++;
+			cpu_acct[dst->id].migrations_in++;
+			target = dst;
+		} else if (!sched_cpu_allowed(thread, cpu)) {
+			atomic_store(&sched_affinity_dirty, true);
 		}
-		p = p->proc_next;
+
+		sched_place_locked(target, thread, SCHED_WAKE_CREDIT);
+
+		tcb **link = &target->thread_list;
+		while (*link)
+			link = &(*link)->cpu_next;
+		*link = thread;
+		target->thread_count++;
 	}
 
-	spinlock_release(&proc_list_lock);
-	return NULL;
+	if (dst != cpu)
+		sched_unlock_pair(cpu, dst);
+	else
+		irqlock_release(&cpu->sched_lock);
+
+	if (requeued && atomic_load(&sched_enabled) &&
+		target->id != cpu_get_current()->id)
+		sched_kick_cpu(target);
 }
 
-int thread_wait(tcb *thread)
+int sched_set_nice(tcb *thread, int nice)
 {
-	if (!thread) {
-		error("thread_wait: NULL thread\n");
+	if (!thread || nice < SCHED_NICE_MIN || nice > SCHED_NICE_MAX)
+		return -1;
+
+	struct cpu *cpu = sched_lock_thread(thread);
+
+	thread->nice = nice;
+	thread->weight = sched_nice_weights[nice - SCHED_NICE_MIN];
+
+	if (cpu)
+		irqlock_release(&cpu->sched_lock);
+	return 0;
+}
+
+int sched_set_policy(tcb *thread, int policy, int rt_priority)
+{
+	if (!thread)
+		return -1;
+
+	if (policy == SCHED_OTHER) {
+		if (rt_priority != 0)
+			return -1;
+	} else if (policy == SCHED_FIFO || policy == SCHED_RR) {
+		if (rt_priority < SCHED_RT_PRIO_MIN || rt_priority > SCHED_RT_PRIO_MAX)
+			return -1;
+	} else {
 		return -1;
 	}
 
-	thread->joinable = true;
+	struct cpu *cpu = sched_lock_thread(thread);
 
-	while (!atomic_load(&thread->finished))
+	thread->policy = policy;
+	thread->rt_priority = rt_priority;
+	thread->time_slice = SCHED_DEFAULT_SLICE;
+	if (cpu) {
+		sched_place_locked(cpu, thread, 0);
+		irqlock_release(&cpu->sched_lock);
+	}
+	return 0;
+}
+
+uint64_t sched_runtime_ms(const tcb *thread)
+{
+	if (!thread)
+		return 0;
+#ifdef __x86_64__
+	uint32_t hz = pit_get_hz();
+	if (hz)
+		return thread->runtime * 1000 / hz;
+#endif
+	return thread->runtime;
+}
+
+uint64_t sched_min_vruntime(const struct cpu *cpu)
+{
+	if (!cpu || cpu->id >= CONFIG_CPU_MAX_COUNT)
+		return 0;
+	return cpu_min_vruntime[cpu->id];
+}
+
+uint64_t sched_online_mask(void)
+{
+	uint64_t mask = 0;
+	for (size_t i = 0; i < cpu_count; i++) {
+		if (sched_cpu_usable(&cpuinfo[i]) && cpuinfo[i].id < 64)
+			mask |= 1ULL << cpuinfo[i].id;
+	}
+	return mask;
+}
+
+int sched_set_affinity(tcb *thread, uint64_t mask)
+{
+	if (!thread || !(mask & sched_online_mask()))
+		return -1;
+
+	struct cpu *cpu = sched_lock_thread(thread);
+	thread->cpu_mask = mask;
+	bool misplaced = cpu && !sched_cpu_allowed(thread, cpu);
+	if (cpu)
+		irqlock_release(&cpu->sched_lock);
+
+	if (!misplaced)
+		return 0;
+
+	// a thread running elsewhere gets kicked off its CPU. the calling
+	// thread has to yield itself, see sched_leave_if_misplaced()
+	atomic_store(&sched_affinity_dirty, true);
+	if (thread != thread_current())
+		sched_kick_cpu(cpu);
+	return 0;
+}
+
+void sched_leave_if_misplaced(void)
+{
+	struct cpu *cpu = cpu_get_current();
+	tcb *self = thread_current();
+	if (cpu && self && !sched_cpu_allowed(self, cpu))
 		sched_yield();
+}
 
-	int code = thread->exit_code;
-	thread_release_final(thread);
-	return code;
+void sched_get_cpu_stats(const struct cpu *cpu, struct sched_cpu_stats *out)
+{
+	memset(out, 0, sizeof(*out));
+	if (!cpu || cpu->id >= CONFIG_CPU_MAX_COUNT)
+		return;
+
+	struct cpu *c = &cpuinfo[cpu->id];
+	irqlock_acquire(&c->sched_lock);
+
+	struct sched_cpu_acct acct = cpu_acct[c->id];
+	// count whatever has been running since the last switch too
+	if (acct.since && c->thread_list) {
+		uint64_t delta = sched_clock() - acct.since;
+		if (sched_is_idle(c, c->thread_list))
+			acct.idle += delta;
+		else
+			acct.busy += delta;
+	}
+
+	irqlock_release(&c->sched_lock);
+
+	out->busy_ns = sched_clock_to_ns(acct.busy);
+	out->idle_ns = sched_clock_to_ns(acct.idle);
+	out->migrations_in = acct.migrations_in;
+	out->migrations_out = acct.migrations_out;
+}
+
+// callers hold proc->thread_lock. the thread goes at its next reschedule,
+// a wait it's blocked in returns early
+static void thread_kill_locked(tcb *thread, int code)
+{
+	thread->kill_code = code;
+	atomic_store(&thread->kill_pending, true);
+	sched_wake(thread);
+
+	if (thread->cpu && thread->cpu != cpu_get_current())
+		sched_kick_cpu(thread->cpu);
+}
+
+// only if it's still one of proc's threads, thread may be long gone
+int thread_kill(pcb *proc, tcb *thread, int code)
+{
+	if (!proc || !thread)
+		return -1;
+
+	int ret = -1;
+	spinlock_acquire(&proc->thread_lock);
+	for (tcb *t = proc->threads; t; t = t->proc_next) {
+		if (t == thread) {
+			thread_kill_locked(t, code);
+			ret = 0;
+			break;
+		}
+	}
+	spinlock_release(&proc->thread_lock);
+
+	return ret;
 }
 
 int proc_kill(pcb *proc, int code)
@@ -1153,13 +2065,8 @@ int proc_kill(pcb *proc, int code)
 	proc->kill_code = code;
 
 	spinlock_acquire(&proc->thread_lock);
-	for (tcb *t = proc->threads; t; t = t->proc_next) {
-		t->kill_code = code;
-		atomic_store(&t->kill_pending, true);
-
-		if (t->cpu && t->cpu != cpu_get_current())
-			sched_ipi_cpu(t->cpu);
-	}
+	for (tcb *t = proc->threads; t; t = t->proc_next)
+		thread_kill_locked(t, code);
 	spinlock_release(&proc->thread_lock);
 
 	if (thread_current() && thread_current()->process == proc) {
@@ -1171,4 +2078,93 @@ int proc_kill(pcb *proc, int code)
 		sched_yield();
 
 	return 0;
-}
\ No newline at end of file
+}
+
+void proc_adopt(pcb *parent, pcb *child)
+{
+	if (!parent || !child)
+		return;
+
+	irqlock_acquire(&proc_tree_lock);
+	child->parent = parent;
+	child->parent_pid = parent->pid;
+	child->pgid = parent->pgid;
+	proc_sibling_link(&parent->children, child);
+	irqlock_release(&proc_tree_lock);
+}
+
+static bool proc_wait_matches(const pcb *parent, const pcb *child, int pid)
+{
+	if (pid > 0)
+		return child->pid == (uint32_t)pid;
+	if (pid == -1)
+		return true;
+	if (pid == 0)
+		return child->pgid == parent->pgid;
+	return child->pgid == (uint32_t)-pid;
+}
+
+// reap an exited child the way waitpid() picks one. returns its PID, 0 if
+// none has exited yet (WNOHANG) or the caller is being killed, -1 if no
+// child matches at all. nothing ever stops, so WUNTRACED changes nothing
+int proc_wait_child(pcb *parent, int pid, int options, int *exit_code)
+{
+	if (!parent)
+		return -1;
+
+	bool block = !(options & WNOHANG);
+
+	for (;;) {
+		if (block)
+			waitq_prepare(&parent->child_waitq);
+
+		pcb *found = NULL;
+		bool any = false;
+
+		irqlock_acquire(&proc_tree_lock);
+
+		if (pid > 0) {
+			pcb *child = idr_find(&pid_idr, (uint32_t)pid);
+			if (child && child->parent == parent) {
+				any = true;
+				if (child->zombie)
+					found = child;
+			}
+		} else {
+			for (pcb *z = parent->zombies; z && !found; z = z->sibling_next) {
+				if (proc_wait_matches(parent, z, pid))
+					found = z;
+			}
+			any = found != NULL;
+			for (pcb *c = parent->children; c && !any; c = c->sibling_next)
+				any = proc_wait_matches(parent, c, pid);
+		}
+
+		if (found) {
+			proc_sibling_unlink(found);
+			found->parent = NULL;
+		}
+
+		irqlock_release(&proc_tree_lock);
+
+		if (found || !any || !block) {
+			if (block)
+				waitq_finish(&parent->child_waitq);
+			if (!found)
+				return any ? 0 : -1;
+
+			int found_pid = (int)found->pid;
+			if (exit_code)
+				*exit_code = found->exit_code;
+			proc_free(found);
+			return found_pid;
+		}
+
+		sched_block();
+		waitq_finish(&parent->child_waitq);
+
+		tcb *self = thread_current();
+		if (self && atomic_load(&self->kill_pending))
+			return 0;
+	}
+}
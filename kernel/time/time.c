@@ -24,6 +24,7 @@
 #if defined(__x86_64__)
 #include <acpi/hpet.h>
 #include <platform/time/pit.h>
+#include <arch/time/tsc.h>
 #endif
 
 struct timekeeper_funcs tk;
@@ -125,33 +126,57 @@ uint8_t time_get_weekday()
 	return tk.get_weekday();
 }
 
-uint64_t get_ms(void)
-{
 #if defined(__x86_64__)
-	static uint64_t hpet_base_ns = 0;
-	static int hpet_base_set = 0;
+static uint64_t hpet_base_ns = 0;
+static int hpet_base_set = 0;
 
+static uint64_t tsc_base = 0;
+static uint64_t tsc_base_ns = 0;
+
+static uint64_t hpet_time_ns(void)
+{
 	uint64_t hpet_ns = hpet_get_ns();
-	if (hpet_ns) {
-		if (!hpet_base_set) {
-			uint64_t cur_ms = 0;
-			if (pit_is_initialized()) {
-				uint16_t hz = pit_get_hz();
-				if (hz)
-					cur_ms = (pit_get_ticks() * 1000ull) / (uint64_t)hz;
-			}
-			uint64_t cur_ns = cur_ms * 1000000ull;
-			hpet_base_ns = (hpet_ns > cur_ns) ? (hpet_ns - cur_ns) : hpet_ns;
-			hpet_base_set = 1;
+	if (!hpet_base_set) {
+		uint64_t cur_ms = 0;
+		if (pit_is_initialized()) {
+			uint16_t hz = pit_get_hz();
+			if (hz)
+				cur_ms = (pit_get_ticks() * 1000ull) / (uint64_t)hz;
 		}
-		return (hpet_ns - hpet_base_ns) / 1000000ull;
+		uint64_t cur_ns = cur_ms * 1000000ull;
+		hpet_base_ns = (hpet_ns > cur_ns) ? (hpet_ns - cur_ns) : hpet_ns;
+		hpet_base_set = 1;
 	}
+	return hpet_ns - hpet_base_ns;
+}
+#endif
+
+void time_clocksource_init(void)
+{
+#if defined(__x86_64__)
+	if (!tsc_init())
+		return;
+
+	// carry on from wherever the HPET clock is so time never goes back
+	tsc_base_ns = hpet_is_initialized() ? hpet_time_ns() : 0;
+	tsc_base = tsc_read();
+#endif
+}
+
+uint64_t time_ns(void)
+{
+#if defined(__x86_64__)
+	if (tsc_is_available())
+		return tsc_base_ns + tsc_to_ns(tsc_read() - tsc_base);
+
+	if (hpet_is_initialized())
+		return hpet_time_ns();
 
 	if (pit_is_initialized()) {
 		uint16_t hz = pit_get_hz();
 		if (!hz)
 			return 0;
-		return (pit_get_ticks() * 1000ull) / (uint64_t)hz;
+		return (pit_get_ticks() * 1000000000ull) / (uint64_t)hz;
 	}
 
 	return 0;
@@ -160,10 +185,20 @@ uint64_t get_ms(void)
 #endif
 }
 
-void sleep_ms(uint64_t ms)
+uint64_t get_ms(void)
+{
+	return time_ns() / 1000000ull;
+}
+
+void sleep_ns(uint64_t ns)
 {
-	uint64_t start = get_ms();
-	while (get_ms() - start < ms) {
+	uint64_t start = time_ns();
+	while (time_ns() - start < ns) {
 		__asm__ volatile("pause");
 	}
 }
+
+void sleep_ms(uint64_t ms)
+{
+	sleep_ns(ms * 1000000ull);
+}
@@ -33,10 +33,17 @@
 #include <loader/module.h>
 #include <time/time.h>
 #include <ipc/pipe.h>
+#include <ipc/unix.h>
+#include <ipc/splice.h>
+#include <ipc/uring.h>
+#include <user/spawn.h>
+#include <sys/poll.h>
 #include <aurix.h>
 #include <user/access.h>
 #include <arch/cpu/switch.h>
+#include <arch/cpu/fpu.h>
 #include <loader/elf.h>
+#include <loader/execcache.h>
 
 extern void switch_enter_user(void);
 
@@ -109,15 +116,11 @@ extern void switch_enter_user(void);
 #define FCNTL_F_GETFL 3
 #define FCNTL_F_SETFL 4
 #define FCNTL_F_DUPFD_CLOEXEC 1030
+#define FCNTL_F_SETPIPE_SZ 1031
+#define FCNTL_F_GETPIPE_SZ 1032
 
 #define FD_CLOEXEC 1
 
-#define POLLIN 0x0001
-#define POLLOUT 0x0004
-#define POLLERR 0x0008
-#define POLLHUP 0x0010
-#define POLLNVAL 0x0020
-
 #define DIR_HANDLE_MAX_ENTRIES 256
 
 #define EXEC_MAX_ARGS 128
@@ -169,12 +172,6 @@ extern void switch_enter_user(void);
 		}                                       \
 	} while (0)
 
-struct pollfd {
-	int fd;
-	short events;
-	short revents;
-};
-
 #define SYSCALL_FDSET_BYTES 128
 #define SYSCALL_FD_SETSIZE (SYSCALL_FDSET_BYTES * 8)
 
@@ -484,13 +481,13 @@ static int syscall_clone_memory(struct pcb *parent, struct pcb *child)
 
 static struct fileio *proc_fd_lookup_locked(struct pcb *proc, int fd)
 {
-	if (!proc || fd < 0 || fd >= PROC_MAX_FDS)
+	if (!proc)
 		return NULL;
-	return proc->fds[fd];
+	return fdtable_get(&proc->fdt, fd);
 }
 
 static int proc_fd_alloc_from_locked(struct pcb *proc, struct fileio *file,
-									 int start_fd)
+									 int start_fd, bool cloexec)
 {
 	if (!proc || !file)
 		return -EINVAL;
@@ -498,19 +495,14 @@ static int proc_fd_alloc_from_locked(struct pcb *proc, struct fileio *file,
 	if (start_fd < FD_FIRST_DYNAMIC)
 		start_fd = FD_FIRST_DYNAMIC;
 
-	for (int fd = start_fd; fd < PROC_MAX_FDS; fd++) {
-		if (!proc->fds[fd]) {
-			proc->fds[fd] = file;
-			return fd;
-		}
-	}
-
-	return -EMFILE;
+	return fdtable_alloc(&proc->fdt, file, start_fd, cloexec);
 }
 
+// a freshly created file asks for close-on-exec through its open flags
 static int proc_fd_alloc_locked(struct pcb *proc, struct fileio *file)
 {
-	return proc_fd_alloc_from_locked(proc, file, FD_FIRST_DYNAMIC);
+	return proc_fd_alloc_from_locked(proc, file, FD_FIRST_DYNAMIC,
+									 file && (file->flags & O_CLOEXEC));
 }
 
 static int syscall_fd_get(struct pcb *proc, int fd, struct fileio **out)
@@ -906,6 +898,13 @@ static void exec_enter_current_user(tcb *current, pcb *proc, uintptr_t entry)
 	current->kthread.cr3 = (uint64_t)proc->pm;
 	current->user = true;
 
+	// the new image starts from a clean FPU, a kernel thread turning into a
+	// user one needs an area first
+	if (current->kthread.fpu)
+		fpu_state_reset(current->kthread.fpu);
+	else
+		current->kthread.fpu = fpu_state_alloc();
+
 #if defined(__x86_64__)
 	gdt_set_kernel_stack(current->kthread.rsp0);
 	write_cr3((uint64_t)proc->pm);
@@ -1173,13 +1172,10 @@ int64_t sys_close(const syscall_args_t *args)
 	SYSCALL_REQUIRE_PROC(proc);
 
 	spinlock_acquire(&proc->fd_lock);
-	struct fileio *f = proc->fds[fd];
-	if (!f) {
-		spinlock_release(&proc->fd_lock);
-		return -EBADF;
-	}
-	proc->fds[fd] = NULL;
+	struct fileio *f = fdtable_remove(&proc->fdt, fd);
 	spinlock_release(&proc->fd_lock);
+	if (!f)
+		return -EBADF;
 
 	return close(f);
 }
@@ -1206,9 +1202,8 @@ int64_t sys_fcntl(const syscall_args_t *args)
 			return -EBADF;
 		}
 		fio_retain(f);
-		int newfd = proc_fd_alloc_from_locked(proc, f, minfd);
-		if (newfd >= 0 && cmd == FCNTL_F_DUPFD_CLOEXEC)
-			f->flags |= O_CLOEXEC;
+		int newfd = proc_fd_alloc_from_locked(proc, f, minfd,
+											  cmd == FCNTL_F_DUPFD_CLOEXEC);
 		spinlock_release(&proc->fd_lock);
 
 		if (newfd < 0) {
@@ -1218,6 +1213,23 @@ int64_t sys_fcntl(const syscall_args_t *args)
 		return newfd;
 	}
 
+	if (cmd == FCNTL_F_SETPIPE_SZ || cmd == FCNTL_F_GETPIPE_SZ) {
+		struct fileio *f = NULL;
+		int r = syscall_fd_get(proc, fd, &f);
+		if (r != 0)
+			return r;
+
+		if (!(f->flags & (PIPE_READ_END | PIPE_WRITE_END)))
+			r = -EBADF;
+		else if (cmd == FCNTL_F_SETPIPE_SZ)
+			r = pipe_resize(f, (size_t)arg);
+		else
+			r = (int)pipe_capacity(f);
+
+		close(f);
+		return r;
+	}
+
 	spinlock_acquire(&proc->fd_lock);
 	struct fileio *f = proc_fd_lookup_locked(proc, fd);
 	if (!f) {
@@ -1237,15 +1249,12 @@ int64_t sys_fcntl(const syscall_args_t *args)
 		return 0;
 	}
 	if (cmd == FCNTL_F_GETFD) {
-		int ret = (f->flags & O_CLOEXEC) ? FD_CLOEXEC : 0;
+		int ret = fdtable_cloexec(&proc->fdt, fd) ? FD_CLOEXEC : 0;
 		spinlock_release(&proc->fd_lock);
 		return ret;
 	}
 	if (cmd == FCNTL_F_SETFD) {
-		if ((int)arg & FD_CLOEXEC)
-			f->flags |= O_CLOEXEC;
-		else
-			f->flags &= ~O_CLOEXEC;
+		fdtable_set_cloexec(&proc->fdt, fd, ((int)arg & FD_CLOEXEC) != 0);
 		spinlock_release(&proc->fd_lock);
 		return 0;
 	}
@@ -1753,11 +1762,20 @@ int64_t sys_sleep(const syscall_args_t *args)
 	if (nanos >= 1000000000ULL)
 		return -EINVAL;
 
-	uint64_t ms = secs * 1000ULL + nanos / 1000000ULL;
-	sleep_ms(ms);
+	sleep_ns(secs * 1000000000ULL + nanos);
 	return 0;
 }
 
+static short syscall_poll_file(struct fileio *f, short events)
+{
+	if (f->flags & UNIX_FILE)
+		return unix_poll(f, events);
+	if (f->flags & (PIPE_READ_END | PIPE_WRITE_END))
+		return pipe_poll(f, events);
+
+	return events & (POLLIN | POLLOUT);
+}
+
 int64_t sys_poll(const syscall_args_t *args)
 {
 	struct pollfd *user_fds = (struct pollfd *)args->rdi;
@@ -1816,32 +1834,7 @@ int64_t sys_poll(const syscall_args_t *args)
 				continue;
 			}
 
-			if (f->flags & PIPE_READ_END) {
-				struct pipe *p = (struct pipe *)f->private;
-				if (p) {
-					spinlock_acquire(&p->lock);
-					if ((pfd->events & POLLIN) && p->used > 0)
-						pfd->revents |= POLLIN;
-					if (p->writers == 0)
-						pfd->revents |= POLLHUP;
-					spinlock_release(&p->lock);
-				}
-			} else if (f->flags & PIPE_WRITE_END) {
-				struct pipe *p = (struct pipe *)f->private;
-				if (p) {
-					spinlock_acquire(&p->lock);
-					if ((pfd->events & POLLOUT) && p->used < PIPE_BUFFER_SIZE)
-						pfd->revents |= POLLOUT;
-					if (p->readers == 0)
-						pfd->revents |= POLLERR;
-					spinlock_release(&p->lock);
-				}
-			} else {
-				if (pfd->events & POLLIN)
-					pfd->revents |= POLLIN;
-				if (pfd->events & POLLOUT)
-					pfd->revents |= POLLOUT;
-			}
+			pfd->revents = syscall_poll_file(f, pfd->events);
 
 			if (pfd->revents)
 				ready_total++;
@@ -1984,32 +1977,7 @@ int64_t sys_pselect(const syscall_args_t *args)
 				continue;
 			}
 
-			if (f->flags & PIPE_READ_END) {
-				struct pipe *p = (struct pipe *)f->private;
-				if (p) {
-					spinlock_acquire(&p->lock);
-					if ((pfd->events & POLLIN) && p->used > 0)
-						pfd->revents |= POLLIN;
-					if (p->writers == 0)
-						pfd->revents |= POLLHUP;
-					spinlock_release(&p->lock);
-				}
-			} else if (f->flags & PIPE_WRITE_END) {
-				struct pipe *p = (struct pipe *)f->private;
-				if (p) {
-					spinlock_acquire(&p->lock);
-					if ((pfd->events & POLLOUT) && p->used < PIPE_BUFFER_SIZE)
-						pfd->revents |= POLLOUT;
-					if (p->readers == 0)
-						pfd->revents |= POLLERR;
-					spinlock_release(&p->lock);
-				}
-			} else {
-				if (pfd->events & POLLIN)
-					pfd->revents |= POLLIN;
-				if (pfd->events & POLLOUT)
-					pfd->revents |= POLLOUT;
-			}
+			pfd->revents = syscall_poll_file(f, pfd->events);
 
 			if (pfd->revents)
 				ready_total++;
@@ -2084,9 +2052,8 @@ int64_t sys_dup(const syscall_args_t *args)
 		return -EBADF;
 	}
 	fio_retain(f);
-	int newfd = proc_fd_alloc_locked(proc, f);
-	if (newfd >= 0 && (flags & O_CLOEXEC))
-		f->flags |= O_CLOEXEC;
+	int newfd = proc_fd_alloc_from_locked(proc, f, FD_FIRST_DYNAMIC,
+										  (flags & O_CLOEXEC) != 0);
 	spinlock_release(&proc->fd_lock);
 
 	if (newfd < 0) {
@@ -2123,13 +2090,15 @@ int64_t sys_dup2(const syscall_args_t *args)
 	}
 
 	fio_retain(oldf);
-	struct fileio *to_close = proc->fds[newfd];
-	proc->fds[newfd] = oldf;
+	struct fileio *to_close = NULL;
+	int r = fdtable_install(&proc->fdt, newfd, oldf, false, &to_close);
 	spinlock_release(&proc->fd_lock);
 
+	if (r != 0)
+		close(oldf);
 	if (to_close)
 		close(to_close);
-	return 0;
+	return r;
 }
 
 int64_t sys_dup3(const syscall_args_t *args)
@@ -2156,18 +2125,16 @@ int64_t sys_dup3(const syscall_args_t *args)
 	}
 
 	fio_retain(oldf);
-	if (flags & O_CLOEXEC)
-		oldf->flags |= O_CLOEXEC;
-	else
-		oldf->flags &= ~O_CLOEXEC;
-
-	struct fileio *to_close = proc->fds[newfd];
-	proc->fds[newfd] = oldf;
+	struct fileio *to_close = NULL;
+	int r = fdtable_install(&proc->fdt, newfd, oldf, (flags & O_CLOEXEC) != 0,
+							&to_close);
 	spinlock_release(&proc->fd_lock);
 
+	if (r != 0)
+		close(oldf);
 	if (to_close)
 		close(to_close);
-	return 0;
+	return r;
 }
 
 int64_t sys_pipe(const syscall_args_t *args)
@@ -2201,7 +2168,7 @@ int64_t sys_pipe(const syscall_args_t *args)
 
 	int write_fd = proc_fd_alloc_locked(proc, ends[1]);
 	if (write_fd < 0) {
-		proc->fds[read_fd] = NULL;
+		fdtable_remove(&proc->fdt, read_fd);
 		spinlock_release(&proc->fd_lock);
 		close(ends[0]);
 		close(ends[1]);
@@ -2213,224 +2180,1056 @@ int64_t sys_pipe(const syscall_args_t *args)
 	return syscall_copy_to_user(fds, out, sizeof(out));
 }
 
-int64_t sys_stat(const syscall_args_t *args)
+static int syscall_sock_get(struct pcb *proc, int fd, struct fileio **out)
 {
-	int target = (int)args->rdi;
-	int fd = (int)args->rsi;
-	const char *path = (const char *)args->rdx;
-	int flags = (int)args->r10;
-	struct stat *st = (struct stat *)args->r8;
+	int r = syscall_fd_get(proc, fd, out);
+	if (r != 0)
+		return r;
 
-	(void)flags;
+	if (!((*out)->flags & UNIX_FILE)) {
+		close(*out);
+		*out = NULL;
+		return -ENOTSOCK;
+	}
+	return 0;
+}
 
-	SYSCALL_REQUIRE(st != NULL, -EFAULT);
-	SYSCALL_REQUIRE(syscall_user_writable(st, sizeof(*st)) == 0, -EFAULT);
+static int syscall_fd_install(struct pcb *proc, struct fileio *f)
+{
+	spinlock_acquire(&proc->fd_lock);
+	int fd = proc_fd_alloc_locked(proc, f);
+	spinlock_release(&proc->fd_lock);
 
-	struct pcb *proc = syscall_current_process();
-	SYSCALL_REQUIRE_PROC(proc);
+	if (fd < 0)
+		close(f);
+	return fd;
+}
 
-	struct stat kst;
+// copy a sockaddr_un in and turn its path into an absolute one
+static int syscall_sockaddr_path(struct pcb *proc, const void *addr,
+								 socklen_t len, char **resolved)
+{
+	struct sockaddr_un sun;
+	size_t min = offsetof(struct sockaddr_un, sun_path) + 1;
 
-	if (target == FSFD_TARGET_FD) {
-		struct fileio *f = NULL;
-		int r = syscall_fd_get(proc, fd, &f);
-		if (r != 0)
-			return r;
+	SYSCALL_REQUIRE(addr != NULL, -EFAULT);
+	SYSCALL_REQUIRE(len >= min && len <= sizeof(sun), -EINVAL);
 
-		struct vnode *vnode = (struct vnode *)f->private;
-		int ret = -EINVAL;
-		if (vnode && vnode->ops && vnode->ops->getattr)
-			ret = vnode->ops->getattr(vnode, &kst);
+	memset(&sun, 0, sizeof(sun));
+	int r = syscall_copy_from_user(&sun, addr, len);
+	if (r != 0)
+		return r;
 
-		close(f);
-		if (ret != 0)
-			return -EINVAL;
-		return syscall_copy_to_user(st, &kst, sizeof(kst));
+	if (sun.sun_family != AF_UNIX)
+		return -EAFNOSUPPORT;
+	// no abstract namespace
+	if (sun.sun_path[0] == '\0')
+		return -EINVAL;
+	if (bounded_strlen(sun.sun_path, sizeof(sun.sun_path)) ==
+		sizeof(sun.sun_path))
+		return -ENAMETOOLONG;
+
+	char *full = syscall_resolve_path(proc, sun.sun_path);
+	if (!full)
+		return -ENOMEM;
+	if (strlen(full) >= UNIX_PATH_MAX) {
+		kfree(full);
+		return -ENAMETOOLONG;
 	}
 
-	if (target != FSFD_TARGET_PATH && target != FSFD_TARGET_FD_PATH)
-		return -EINVAL;
-	if (!path)
-		return -EFAULT;
+	*resolved = full;
+	return 0;
+}
 
-	char *resolved = NULL;
-	int r = syscall_resolve_user_path_at(
-		proc, target == FSFD_TARGET_FD_PATH ? fd : AT_FDCWD, path, &resolved);
+static int syscall_sockaddr_out(const char *path, void *addr, socklen_t *lenp)
+{
+	if (!addr)
+		return 0;
+	SYSCALL_REQUIRE(lenp != NULL, -EFAULT);
+
+	socklen_t len;
+	int r = syscall_copy_from_user(&len, lenp, sizeof(len));
 	if (r != 0)
 		return r;
 
-	int ret = vfs_stat(resolved, &kst);
-	kfree(resolved);
-
-	if (ret != 0)
-		return -ENOENT;
+	struct sockaddr_un sun;
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
 
-	return syscall_copy_to_user(st, &kst, sizeof(kst));
+	socklen_t full = offsetof(struct sockaddr_un, sun_path) +
+					 strlen(sun.sun_path) + 1;
+	r = syscall_copy_to_user(addr, &sun, len < full ? len : full);
+	if (r != 0)
+		return r;
+	return syscall_copy_to_user(lenp, &full, sizeof(full));
 }
 
-int64_t sys_utimensat(const syscall_args_t *args)
+int64_t sys_socket(const syscall_args_t *args)
 {
-	int dirfd = (int)args->rdi;
-	const char *path = (const char *)args->rsi;
-	const struct aurix_timespec *times_user =
-		(const struct aurix_timespec *)args->rdx;
-	int flags = (int)args->r10;
+	int domain = (int)args->rdi;
+	int type = (int)args->rsi;
+	int protocol = (int)args->rdx;
 
-	if (flags & ~(AT_SYMLINK_NOFOLLOW | AT_EMPTY_PATH))
-		return -EINVAL;
+	SYSCALL_REQUIRE(domain == AF_UNIX, -EAFNOSUPPORT);
+	SYSCALL_REQUIRE(protocol == 0, -EPROTONOSUPPORT);
+	SYSCALL_REQUIRE(!(type & ~(SOCK_TYPE_MASK | SOCK_NONBLOCK | SOCK_CLOEXEC)),
+					-EINVAL);
 
 	struct pcb *proc = syscall_current_process();
 	SYSCALL_REQUIRE_PROC(proc);
 
-	struct aurix_timespec times_copy[2];
-	const struct aurix_timespec *times = NULL;
-	if (times_user) {
-		int r =
-			syscall_copy_from_user(times_copy, times_user, sizeof(times_copy));
-		if (r != 0)
-			return r;
-		times = times_copy;
-	}
-
-	struct stat st;
-	int stat_ret, set_ret;
-
-	if (!path || ((flags & AT_EMPTY_PATH) && path && path[0] == '\0')) {
-		struct fileio *f = NULL;
-		int r = syscall_fd_get(proc, dirfd, &f);
-		if (r != 0)
-			return r;
+	struct fileio *f = NULL;
+	int r = unix_socket(type, &f);
+	if (r != 0)
+		return r;
 
-		struct vnode *vnode = (struct vnode *)f->private;
-		if (!vnode || !vnode->ops || !vnode->ops->getattr ||
-			!vnode->ops->setattr) {
-			close(f);
-			return -EINVAL;
-		}
+	return syscall_fd_install(proc, f);
+}
 
-		stat_ret = vnode->ops->getattr(vnode, &st);
-		if (stat_ret != 0) {
-			close(f);
-			return -EINVAL;
-		}
+int64_t sys_socketpair(const syscall_args_t *args)
+{
+	int domain = (int)args->rdi;
+	int type = (int)args->rsi;
+	int protocol = (int)args->rdx;
+	int *fds = (int *)args->r10;
+
+	SYSCALL_REQUIRE(domain == AF_UNIX, -EAFNOSUPPORT);
+	SYSCALL_REQUIRE(protocol == 0, -EPROTONOSUPPORT);
+	SYSCALL_REQUIRE(!(type & ~(SOCK_TYPE_MASK | SOCK_NONBLOCK | SOCK_CLOEXEC)),
+					-EINVAL);
+	SYSCALL_REQUIRE(fds != NULL, -EFAULT);
+	SYSCALL_REQUIRE(syscall_user_writable(fds, sizeof(int) * 2) == 0, -EFAULT);
 
-		apply_utimens(&st, times);
-		set_ret = vnode->ops->setattr(vnode, &st);
-		close(f);
-		return set_ret == 0 ? 0 : -EINVAL;
-	}
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
 
-	char *resolved = NULL;
-	int r = syscall_resolve_user_path_at(proc, dirfd, path, &resolved);
+	struct fileio *ends[2] = { NULL, NULL };
+	int r = unix_socketpair(type, ends);
 	if (r != 0)
 		return r;
 
-	stat_ret = vfs_stat(resolved, &st);
-	if (stat_ret != 0) {
-		kfree(resolved);
-		return -ENOENT;
+	spinlock_acquire(&proc->fd_lock);
+	int fd0 = proc_fd_alloc_locked(proc, ends[0]);
+	if (fd0 < 0) {
+		spinlock_release(&proc->fd_lock);
+		close(ends[0]);
+		close(ends[1]);
+		return fd0;
 	}
 
-	apply_utimens(&st, times);
-	set_ret = vfs_setstat(resolved, &st);
-	kfree(resolved);
+	int fd1 = proc_fd_alloc_locked(proc, ends[1]);
+	if (fd1 < 0) {
+		fdtable_remove(&proc->fdt, fd0);
+		spinlock_release(&proc->fd_lock);
+		close(ends[0]);
+		close(ends[1]);
+		return fd1;
+	}
+	spinlock_release(&proc->fd_lock);
 
-	return set_ret == 0 ? 0 : -EINVAL;
+	int out[2] = { fd0, fd1 };
+	return syscall_copy_to_user(fds, out, sizeof(out));
 }
 
-int64_t sys_mount(const syscall_args_t *args)
+int64_t sys_bind(const syscall_args_t *args)
 {
-	const char *source_user = (const char *)args->rdi;
-	const char *target_user = (const char *)args->rsi;
-	const char *fstype_user = (const char *)args->rdx;
-	uint64_t flags = args->r10;
-	void *data = (void *)args->r8;
-
-	(void)source_user;
-
-	SYSCALL_REQUIRE(target_user != NULL, -EFAULT);
-	SYSCALL_REQUIRE(fstype_user != NULL, -EFAULT);
-	SYSCALL_REQUIRE(flags == 0, -EINVAL);
+	int fd = (int)args->rdi;
+	const void *addr = (const void *)args->rsi;
+	socklen_t len = (socklen_t)args->rdx;
 
 	struct pcb *proc = syscall_current_process();
 	SYSCALL_REQUIRE_PROC(proc);
-	if (!syscall_is_privileged(proc))
-		return -EPERM;
-
-	char *target = NULL;
-	char *fstype = NULL;
 
-	int r =
-		syscall_copy_string_from_user(target_user, &target, SYSCALL_MAX_PATH);
+	struct fileio *f = NULL;
+	int r = syscall_sock_get(proc, fd, &f);
 	if (r != 0)
 		return r;
 
-	r = syscall_copy_string_from_user(fstype_user, &fstype, 64);
-	if (r != 0) {
-		kfree(target);
-		return r;
+	char *path = NULL;
+	r = syscall_sockaddr_path(proc, addr, len, &path);
+	if (r == 0) {
+		r = unix_bind(f, path);
+		kfree(path);
 	}
 
-	struct vfs *mounted = vfs_mount(NULL, fstype, target, data);
-	kfree(target);
-	kfree(fstype);
-
-	return mounted ? 0 : -EINVAL;
+	close(f);
+	return r;
 }
 
-int64_t sys_ioctl(const syscall_args_t *args)
+int64_t sys_listen(const syscall_args_t *args)
 {
 	int fd = (int)args->rdi;
-	int request = (int)args->rsi;
-	void *arg = (void *)args->rdx;
+	int backlog = (int)args->rsi;
 
 	struct pcb *proc = syscall_current_process();
 	SYSCALL_REQUIRE_PROC(proc);
 
 	struct fileio *f = NULL;
-	int r = syscall_fd_get(proc, fd, &f);
+	int r = syscall_sock_get(proc, fd, &f);
 	if (r != 0)
 		return r;
-	if (!f->private) {
-		close(f);
-		return -EBADF;
-	}
 
-	int ret = vfs_ioctl((struct vnode *)f->private, request, arg);
+	r = unix_listen(f, backlog);
 	close(f);
-
-	if (ret == -1)
-		return -ENOTTY;
-	return ret;
+	return r;
 }
 
-int64_t sys_load_module(const syscall_args_t *args)
+int64_t sys_accept(const syscall_args_t *args)
 {
-	const char *path = (const char *)args->rdi;
-	SYSCALL_REQUIRE(path != NULL, -EFAULT);
+	int fd = (int)args->rdi;
+	void *addr = (void *)args->rsi;
+	socklen_t *lenp = (socklen_t *)args->rdx;
+	int flags = (int)args->r10;
+
+	SYSCALL_REQUIRE(!(flags & ~(SOCK_NONBLOCK | SOCK_CLOEXEC)), -EINVAL);
 
 	struct pcb *proc = syscall_current_process();
 	SYSCALL_REQUIRE_PROC(proc);
-	if (!syscall_is_privileged(proc))
-		return -EPERM;
 
-	char *resolved = NULL;
-	int r = syscall_resolve_user_path(proc, path, &resolved);
+	struct fileio *f = NULL;
+	int r = syscall_sock_get(proc, fd, &f);
 	if (r != 0)
 		return r;
 
-	struct fileio *f = open(resolved, O_RDONLY, 0);
-	kfree(resolved);
-	if (!f)
-		return -ENOENT;
+	struct fileio *conn = NULL;
+	r = unix_accept(f, &conn);
+	close(f);
+	if (r != 0)
+		return r;
 
-	if (f->size == 0) {
-		close(f);
-		return -EINVAL;
+	conn->flags |= flags & (SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+	// the client end is usually unnamed
+	char path[UNIX_PATH_MAX];
+	if (unix_getname(conn, true, path) != 0)
+		path[0] = '\0';
+	r = syscall_sockaddr_out(path, addr, lenp);
+	if (r != 0) {
+		close(conn);
+		return r;
 	}
 
-	size_t image_size = f->size;
-	void *image = kmalloc(image_size);
+	return syscall_fd_install(proc, conn);
+}
+
+int64_t sys_connect(const syscall_args_t *args)
+{
+	int fd = (int)args->rdi;
+	const void *addr = (const void *)args->rsi;
+	socklen_t len = (socklen_t)args->rdx;
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	struct fileio *f = NULL;
+	int r = syscall_sock_get(proc, fd, &f);
+	if (r != 0)
+		return r;
+
+	char *path = NULL;
+	r = syscall_sockaddr_path(proc, addr, len, &path);
+	if (r == 0) {
+		r = unix_connect(f, path);
+		kfree(path);
+	}
+
+	close(f);
+	return r;
+}
+
+// copy the iovec array in and check every buffer it points at
+static int syscall_iov_get(const struct iovec *user_iov, size_t cnt,
+						   bool to_user, struct iovec **out)
+{
+	SYSCALL_REQUIRE(cnt <= IOV_MAX, -EINVAL);
+	*out = NULL;
+	if (!cnt)
+		return 0;
+
+	struct iovec *iov = kmalloc(cnt * sizeof(struct iovec));
+	if (!iov)
+		return -ENOMEM;
+
+	int r = syscall_copy_from_user(iov, user_iov, cnt * sizeof(struct iovec));
+	for (size_t i = 0; r == 0 && i < cnt; i++) {
+		if (to_user)
+			r = syscall_user_writable(iov[i].iov_base, iov[i].iov_len);
+		else
+			r = syscall_user_readable(iov[i].iov_base, iov[i].iov_len);
+	}
+
+	if (r != 0) {
+		kfree(iov);
+		return r;
+	}
+
+	*out = iov;
+	return 0;
+}
+
+int64_t sys_sendmsg(const syscall_args_t *args)
+{
+	int fd = (int)args->rdi;
+	const struct msghdr *umsg = (const struct msghdr *)args->rsi;
+	int flags = (int)args->rdx;
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+	SYSCALL_REQUIRE(umsg != NULL, -EFAULT);
+
+	struct msghdr msg;
+	int r = syscall_copy_from_user(&msg, umsg, sizeof(msg));
+	if (r != 0)
+		return r;
+
+	struct fileio *f = NULL;
+	r = syscall_sock_get(proc, fd, &f);
+	if (r != 0)
+		return r;
+
+	struct iovec *iov = NULL;
+	char *dest = NULL;
+	uint8_t *control = NULL;
+	struct fileio *rights[UNIX_MAX_RIGHTS];
+	int nrights = 0;
+
+	r = syscall_iov_get(msg.msg_iov, msg.msg_iovlen, false, &iov);
+	if (r != 0)
+		goto out;
+
+	if (msg.msg_name) {
+		r = syscall_sockaddr_path(proc, msg.msg_name, msg.msg_namelen, &dest);
+		if (r != 0)
+			goto out;
+	}
+
+	if (msg.msg_control && msg.msg_controllen) {
+		if (msg.msg_controllen > PAGE_SIZE) {
+			r = -ENOBUFS;
+			goto out;
+		}
+
+		control = kmalloc(msg.msg_controllen);
+		if (!control) {
+			r = -ENOMEM;
+			goto out;
+		}
+		r = syscall_copy_from_user(control, msg.msg_control,
+								   msg.msg_controllen);
+		if (r != 0)
+			goto out;
+
+		size_t off = 0;
+		while (off + sizeof(struct cmsghdr) <= msg.msg_controllen) {
+			struct cmsghdr *cm = (struct cmsghdr *)(control + off);
+			if (cm->cmsg_len < sizeof(struct cmsghdr) ||
+				cm->cmsg_len > msg.msg_controllen - off) {
+				r = -EINVAL;
+				goto out;
+			}
+
+			if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+				r = -EINVAL;
+				goto out;
+			}
+
+			int *fds = (int *)CMSG_DATA(cm);
+			size_t n = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			for (size_t i = 0; i < n; i++) {
+				if (nrights == UNIX_MAX_RIGHTS) {
+					r = -ETOOMANYREFS;
+					goto out;
+				}
+				r = syscall_fd_get(proc, fds[i], &rights[nrights]);
+				if (r != 0)
+					goto out;
+				nrights++;
+			}
+
+			off += CMSG_ALIGN(cm->cmsg_len);
+		}
+	}
+
+	ssize_t sent = unix_sendmsg(f, iov, msg.msg_iovlen, rights, nrights, dest,
+								flags);
+	r = (int)sent;
+	// the socket took over the rights
+	if (sent >= 0)
+		nrights = 0;
+
+out:
+	for (int i = 0; i < nrights; i++)
+		close(rights[i]);
+	SYSCALL_KFREE_IF(control);
+	SYSCALL_KFREE_IF(dest);
+	SYSCALL_KFREE_IF(iov);
+	close(f);
+	return r;
+}
+
+// take back descriptors whose numbers never made it to userspace, unless
+// another thread has put something else in the slot since
+static void syscall_fds_revoke(struct pcb *proc, const int *fds,
+							   struct fileio *const *files, int n)
+{
+	struct fileio *drop[UNIX_MAX_RIGHTS];
+	int ndrop = 0;
+
+	spinlock_acquire(&proc->fd_lock);
+	for (int i = 0; i < n && ndrop < UNIX_MAX_RIGHTS; i++) {
+		if (fdtable_get(&proc->fdt, fds[i]) == files[i])
+			drop[ndrop++] = fdtable_remove(&proc->fdt, fds[i]);
+	}
+	spinlock_release(&proc->fd_lock);
+
+	for (int i = 0; i < ndrop; i++)
+		close(drop[i]);
+}
+
+int64_t sys_recvmsg(const syscall_args_t *args)
+{
+	int fd = (int)args->rdi;
+	struct msghdr *umsg = (struct msghdr *)args->rsi;
+	int flags = (int)args->rdx;
+
+	SYSCALL_REQUIRE(umsg != NULL, -EFAULT);
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	struct msghdr msg;
+	int r = syscall_copy_from_user(&msg, umsg, sizeof(msg));
+	if (r != 0)
+		return r;
+
+	struct fileio *f = NULL;
+	r = syscall_sock_get(proc, fd, &f);
+	if (r != 0)
+		return r;
+
+	struct iovec *iov = NULL;
+	r = syscall_iov_get(msg.msg_iov, msg.msg_iovlen, true, &iov);
+	if (r != 0) {
+		close(f);
+		return r;
+	}
+
+	// only ask for rights when there's room to hand at least one back
+	bool want_rights = msg.msg_control &&
+					   msg.msg_controllen >= CMSG_SPACE(sizeof(int));
+	struct fileio *rights[UNIX_MAX_RIGHTS];
+	int nrights = 0;
+	int mflags = 0;
+
+	ssize_t got = unix_recvmsg(f, iov, msg.msg_iovlen,
+							   want_rights ? rights : NULL, &nrights, flags,
+							   &mflags);
+	SYSCALL_KFREE_IF(iov);
+	close(f);
+	if (got < 0)
+		return got;
+
+	size_t controllen = 0;
+	int fds[UNIX_MAX_RIGHTS];
+	struct fileio *installed[UNIX_MAX_RIGHTS];
+	int nfds = 0;
+	if (nrights) {
+		size_t room = (msg.msg_controllen - CMSG_LEN(0)) / sizeof(int);
+		bool fd_cloexec = (flags & MSG_CMSG_CLOEXEC) != 0;
+
+		spinlock_acquire(&proc->fd_lock);
+		for (int i = 0; i < nrights; i++) {
+			int nfd = -1;
+			if ((size_t)nfds < room)
+				nfd = proc_fd_alloc_from_locked(proc, rights[i],
+												FD_FIRST_DYNAMIC, fd_cloexec);
+			if (nfd < 0) {
+				mflags |= MSG_CTRUNC;
+				continue;
+			}
+			installed[nfds] = rights[i];
+			fds[nfds++] = nfd;
+			rights[i] = NULL;
+		}
+		spinlock_release(&proc->fd_lock);
+
+		for (int i = 0; i < nrights; i++) {
+			if (rights[i])
+				close(rights[i]);
+		}
+
+		if (nfds) {
+			struct cmsghdr cm = {
+				.cmsg_len = CMSG_LEN(nfds * sizeof(int)),
+				.cmsg_level = SOL_SOCKET,
+				.cmsg_type = SCM_RIGHTS,
+			};
+			r = syscall_copy_to_user(msg.msg_control, &cm, sizeof(cm));
+			if (r == 0)
+				r = syscall_copy_to_user(
+					(uint8_t *)msg.msg_control + CMSG_LEN(0), fds,
+					nfds * sizeof(int));
+			if (r != 0) {
+				syscall_fds_revoke(proc, fds, installed, nfds);
+				return r;
+			}
+			controllen = cm.cmsg_len;
+		}
+	}
+
+	msg.msg_controllen = controllen;
+	msg.msg_namelen = 0;
+	msg.msg_flags = mflags;
+	r = syscall_copy_to_user(umsg, &msg, sizeof(msg));
+	if (r != 0) {
+		syscall_fds_revoke(proc, fds, installed, nfds);
+		return r;
+	}
+
+	return got;
+}
+
+int64_t sys_shutdown(const syscall_args_t *args)
+{
+	int fd = (int)args->rdi;
+	int how = (int)args->rsi;
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	struct fileio *f = NULL;
+	int r = syscall_sock_get(proc, fd, &f);
+	if (r != 0)
+		return r;
+
+	r = unix_shutdown(f, how);
+	close(f);
+	return r;
+}
+
+static int64_t syscall_getname(const syscall_args_t *args, bool peer)
+{
+	int fd = (int)args->rdi;
+	void *addr = (void *)args->rsi;
+	socklen_t *lenp = (socklen_t *)args->rdx;
+
+	SYSCALL_REQUIRE(addr != NULL, -EFAULT);
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	struct fileio *f = NULL;
+	int r = syscall_sock_get(proc, fd, &f);
+	if (r != 0)
+		return r;
+
+	char path[UNIX_PATH_MAX];
+	r = unix_getname(f, peer, path);
+	close(f);
+	if (r != 0)
+		return r;
+
+	return syscall_sockaddr_out(path, addr, lenp);
+}
+
+int64_t sys_getsockname(const syscall_args_t *args)
+{
+	return syscall_getname(args, false);
+}
+
+int64_t sys_getpeername(const syscall_args_t *args)
+{
+	return syscall_getname(args, true);
+}
+
+static int64_t syscall_rw_vector(const syscall_args_t *args, bool write,
+								 bool positional)
+{
+	int fd = (int)args->rdi;
+	const struct iovec *user_iov = (const struct iovec *)args->rsi;
+	int iovcnt = (int)args->rdx;
+	int64_t pos = (int64_t)args->r10;
+
+	SYSCALL_REQUIRE(iovcnt >= 0, -EINVAL);
+	SYSCALL_REQUIRE(!positional || pos >= 0, -EINVAL);
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	struct fileio *f = NULL;
+	int r = syscall_fd_get(proc, fd, &f);
+	if (r != 0)
+		return r;
+
+	struct iovec *iov = NULL;
+	r = syscall_iov_get(user_iov, (size_t)iovcnt, !write, &iov);
+	if (r != 0) {
+		close(f);
+		return r;
+	}
+
+	size_t off = (size_t)pos;
+	size_t *offp = positional ? &off : NULL;
+	ssize_t ret = write ? writev(f, iov, (size_t)iovcnt, offp) :
+						  readv(f, iov, (size_t)iovcnt, offp);
+
+	SYSCALL_KFREE_IF(iov);
+	close(f);
+	return ret;
+}
+
+int64_t sys_readv(const syscall_args_t *args)
+{
+	return syscall_rw_vector(args, false, false);
+}
+
+int64_t sys_writev(const syscall_args_t *args)
+{
+	return syscall_rw_vector(args, true, false);
+}
+
+int64_t sys_preadv(const syscall_args_t *args)
+{
+	return syscall_rw_vector(args, false, true);
+}
+
+int64_t sys_pwritev(const syscall_args_t *args)
+{
+	return syscall_rw_vector(args, true, true);
+}
+
+static int syscall_offset_get(const int64_t *user_off, size_t *off)
+{
+	if (!user_off)
+		return 0;
+
+	int64_t koff;
+	int r = syscall_copy_from_user(&koff, user_off, sizeof(koff));
+	if (r != 0)
+		return r;
+	if (koff < 0)
+		return -EINVAL;
+
+	*off = (size_t)koff;
+	return 0;
+}
+
+static int syscall_offset_put(int64_t *user_off, size_t off)
+{
+	if (!user_off)
+		return 0;
+
+	int64_t koff = (int64_t)off;
+	return syscall_copy_to_user(user_off, &koff, sizeof(koff));
+}
+
+int64_t sys_splice(const syscall_args_t *args)
+{
+	int fd_in = (int)args->rdi;
+	int64_t *user_off_in = (int64_t *)args->rsi;
+	int fd_out = (int)args->rdx;
+	int64_t *user_off_out = (int64_t *)args->r10;
+	size_t len = (size_t)args->r8;
+	unsigned int flags = (unsigned int)args->r9;
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	size_t off_in = 0, off_out = 0;
+	int r = syscall_offset_get(user_off_in, &off_in);
+	if (r != 0)
+		return r;
+	r = syscall_offset_get(user_off_out, &off_out);
+	if (r != 0)
+		return r;
+
+	struct fileio *in = NULL;
+	struct fileio *out = NULL;
+	r = syscall_fd_get(proc, fd_in, &in);
+	if (r != 0)
+		return r;
+	r = syscall_fd_get(proc, fd_out, &out);
+	if (r != 0) {
+		close(in);
+		return r;
+	}
+
+	ssize_t ret = splice(in, user_off_in ? &off_in : NULL, out,
+						 user_off_out ? &off_out : NULL, len, flags);
+	close(in);
+	close(out);
+
+	if (ret > 0) {
+		r = syscall_offset_put(user_off_in, off_in);
+		if (r == 0)
+			r = syscall_offset_put(user_off_out, off_out);
+		if (r != 0)
+			return r;
+	}
+	return ret;
+}
+
+int64_t sys_tee(const syscall_args_t *args)
+{
+	int fd_in = (int)args->rdi;
+	int fd_out = (int)args->rsi;
+	size_t len = (size_t)args->rdx;
+	unsigned int flags = (unsigned int)args->r10;
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	struct fileio *in = NULL;
+	struct fileio *out = NULL;
+	int r = syscall_fd_get(proc, fd_in, &in);
+	if (r != 0)
+		return r;
+	r = syscall_fd_get(proc, fd_out, &out);
+	if (r != 0) {
+		close(in);
+		return r;
+	}
+
+	ssize_t ret = tee(in, out, len, flags);
+	close(in);
+	close(out);
+	return ret;
+}
+
+int64_t sys_sendfile(const syscall_args_t *args)
+{
+	int fd_out = (int)args->rdi;
+	int fd_in = (int)args->rsi;
+	int64_t *user_off = (int64_t *)args->rdx;
+	size_t count = (size_t)args->r10;
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	size_t off = 0;
+	int r = syscall_offset_get(user_off, &off);
+	if (r != 0)
+		return r;
+
+	struct fileio *in = NULL;
+	struct fileio *out = NULL;
+	r = syscall_fd_get(proc, fd_in, &in);
+	if (r != 0)
+		return r;
+	r = syscall_fd_get(proc, fd_out, &out);
+	if (r != 0) {
+		close(in);
+		return r;
+	}
+
+	ssize_t ret = sendfile(out, in, user_off ? &off : NULL, count);
+	close(in);
+	close(out);
+
+	if (ret > 0) {
+		r = syscall_offset_put(user_off, off);
+		if (r != 0)
+			return r;
+	}
+	return ret;
+}
+
+int64_t sys_uring_setup(const syscall_args_t *args)
+{
+	uint32_t entries = (uint32_t)args->rdi;
+	struct uring_params *user_params = (struct uring_params *)args->rsi;
+
+	SYSCALL_REQUIRE(user_params != NULL, -EFAULT);
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	struct uring_params p;
+	int r = syscall_copy_from_user(&p, user_params, sizeof(p));
+	if (r != 0)
+		return r;
+
+	struct fileio *f = NULL;
+	r = uring_setup(proc, entries, &p, &f);
+	if (r != 0)
+		return r;
+
+	r = syscall_copy_to_user(user_params, &p, sizeof(p));
+	if (r != 0) {
+		close(f);
+		return r;
+	}
+
+	return syscall_fd_install(proc, f);
+}
+
+int64_t sys_uring_enter(const syscall_args_t *args)
+{
+	int fd = (int)args->rdi;
+	uint32_t to_submit = (uint32_t)args->rsi;
+	uint32_t min_complete = (uint32_t)args->rdx;
+	uint32_t flags = (uint32_t)args->r10;
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	struct fileio *f = NULL;
+	int r = syscall_fd_get(proc, fd, &f);
+	if (r != 0)
+		return r;
+
+	// the worker serves the process that set the ring up, not its children
+	struct uring *ring = f->private;
+	if (!(f->flags & URING_FILE) || ring->proc != proc) {
+		close(f);
+		return -EBADF;
+	}
+
+	r = uring_enter(f, to_submit, min_complete, flags);
+	close(f);
+	return r;
+}
+
+int64_t sys_stat(const syscall_args_t *args)
+{
+	int target = (int)args->rdi;
+	int fd = (int)args->rsi;
+	const char *path = (const char *)args->rdx;
+	int flags = (int)args->r10;
+	struct stat *st = (struct stat *)args->r8;
+
+	(void)flags;
+
+	SYSCALL_REQUIRE(st != NULL, -EFAULT);
+	SYSCALL_REQUIRE(syscall_user_writable(st, sizeof(*st)) == 0, -EFAULT);
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	struct stat kst;
+
+	if (target == FSFD_TARGET_FD) {
+		struct fileio *f = NULL;
+		int r = syscall_fd_get(proc, fd, &f);
+		if (r != 0)
+			return r;
+
+		// pipes, sockets and rings have no vnode behind them
+		if (f->flags &
+			(UNIX_FILE | URING_FILE | PIPE_READ_END | PIPE_WRITE_END)) {
+			memset(&kst, 0, sizeof(kst));
+			if (f->flags & UNIX_FILE)
+				kst.st_mode = S_IFSOCK | 0777;
+			else if (f->flags & URING_FILE)
+				kst.st_mode = 0600;
+			else
+				kst.st_mode = S_IFIFO | 0600;
+			kst.st_ino = (uint64_t)(uintptr_t)f->private;
+			kst.st_nlink = 1;
+			kst.st_blksize = PAGE_SIZE;
+			close(f);
+			return syscall_copy_to_user(st, &kst, sizeof(kst));
+		}
+
+		struct vnode *vnode = (struct vnode *)f->private;
+		int ret = -EINVAL;
+		if (vnode && vnode->ops && vnode->ops->getattr)
+			ret = vnode->ops->getattr(vnode, &kst);
+
+		close(f);
+		if (ret != 0)
+			return -EINVAL;
+		return syscall_copy_to_user(st, &kst, sizeof(kst));
+	}
+
+	if (target != FSFD_TARGET_PATH && target != FSFD_TARGET_FD_PATH)
+		return -EINVAL;
+	if (!path)
+		return -EFAULT;
+
+	char *resolved = NULL;
+	int r = syscall_resolve_user_path_at(
+		proc, target == FSFD_TARGET_FD_PATH ? fd : AT_FDCWD, path, &resolved);
+	if (r != 0)
+		return r;
+
+	int ret = vfs_stat(resolved, &kst);
+	kfree(resolved);
+
+	if (ret != 0)
+		return -ENOENT;
+
+	return syscall_copy_to_user(st, &kst, sizeof(kst));
+}
+
+int64_t sys_utimensat(const syscall_args_t *args)
+{
+	int dirfd = (int)args->rdi;
+	const char *path = (const char *)args->rsi;
+	const struct aurix_timespec *times_user =
+		(const struct aurix_timespec *)args->rdx;
+	int flags = (int)args->r10;
+
+	if (flags & ~(AT_SYMLINK_NOFOLLOW | AT_EMPTY_PATH))
+		return -EINVAL;
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	struct aurix_timespec times_copy[2];
+	const struct aurix_timespec *times = NULL;
+	if (times_user) {
+		int r =
+			syscall_copy_from_user(times_copy, times_user, sizeof(times_copy));
+		if (r != 0)
+			return r;
+		times = times_copy;
+	}
+
+	struct stat st;
+	int stat_ret, set_ret;
+
+	if (!path || ((flags & AT_EMPTY_PATH) && path && path[0] == '\0')) {
+		struct fileio *f = NULL;
+		int r = syscall_fd_get(proc, dirfd, &f);
+		if (r != 0)
+			return r;
+
+		struct vnode *vnode = (struct vnode *)f->private;
+		if (!vnode || !vnode->ops || !vnode->ops->getattr ||
+			!vnode->ops->setattr) {
+			close(f);
+			return -EINVAL;
+		}
+
+		stat_ret = vnode->ops->getattr(vnode, &st);
+		if (stat_ret != 0) {
+			close(f);
+			return -EINVAL;
+		}
+
+		apply_utimens(&st, times);
+		set_ret = vnode->ops->setattr(vnode, &st);
+		close(f);
+		return set_ret == 0 ? 0 : -EINVAL;
+	}
+
+	char *resolved = NULL;
+	int r = syscall_resolve_user_path_at(proc, dirfd, path, &resolved);
+	if (r != 0)
+		return r;
+
+	stat_ret = vfs_stat(resolved, &st);
+	if (stat_ret != 0) {
+		kfree(resolved);
+		return -ENOENT;
+	}
+
+	apply_utimens(&st, times);
+	set_ret = vfs_setstat(resolved, &st);
+	kfree(resolved);
+
+	return set_ret == 0 ? 0 : -EINVAL;
+}
+
+int64_t sys_mount(const syscall_args_t *args)
+{
+	const char *source_user = (const char *)args->rdi;
+	const char *target_user = (const char *)args->rsi;
+	const char *fstype_user = (const char *)args->rdx;
+	uint64_t flags = args->r10;
+	void *data = (void *)args->r8;
+
+	(void)source_user;
+
+	SYSCALL_REQUIRE(target_user != NULL, -EFAULT);
+	SYSCALL_REQUIRE(fstype_user != NULL, -EFAULT);
+	SYSCALL_REQUIRE(flags == 0, -EINVAL);
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+	if (!syscall_is_privileged(proc))
+		return -EPERM;
+
+	char *target = NULL;
+	char *fstype = NULL;
+
+	int r =
+		syscall_copy_string_from_user(target_user, &target, SYSCALL_MAX_PATH);
+	if (r != 0)
+		return r;
+
+	r = syscall_copy_string_from_user(fstype_user, &fstype, 64);
+	if (r != 0) {
+		kfree(target);
+		return r;
+	}
+
+	struct vfs *mounted = vfs_mount(NULL, fstype, target, data);
+	kfree(target);
+	kfree(fstype);
+
+	return mounted ? 0 : -EINVAL;
+}
+
+int64_t sys_ioctl(const syscall_args_t *args)
+{
+	int fd = (int)args->rdi;
+	int request = (int)args->rsi;
+	void *arg = (void *)args->rdx;
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+
+	struct fileio *f = NULL;
+	int r = syscall_fd_get(proc, fd, &f);
+	if (r != 0)
+		return r;
+	if (!f->private) {
+		close(f);
+		return -EBADF;
+	}
+	if (f->flags & (UNIX_FILE | URING_FILE | PIPE_READ_END | PIPE_WRITE_END)) {
+		close(f);
+		return -ENOTTY;
+	}
+
+	int ret = vfs_ioctl((struct vnode *)f->private, request, arg);
+	close(f);
+
+	if (ret == -1)
+		return -ENOTTY;
+	return ret;
+}
+
+int64_t sys_load_module(const syscall_args_t *args)
+{
+	const char *path = (const char *)args->rdi;
+	SYSCALL_REQUIRE(path != NULL, -EFAULT);
+
+	struct pcb *proc = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(proc);
+	if (!syscall_is_privileged(proc))
+		return -EPERM;
+
+	char *resolved = NULL;
+	int r = syscall_resolve_user_path(proc, path, &resolved);
+	if (r != 0)
+		return r;
+
+	struct fileio *f = open(resolved, O_RDONLY, 0);
+	kfree(resolved);
+	if (!f)
+		return -ENOENT;
+
+	if (f->size == 0) {
+		close(f);
+		return -EINVAL;
+	}
+
+	size_t image_size = f->size;
+	void *image = kmalloc(image_size);
 	if (!image) {
 		close(f);
 		return -ENOMEM;
@@ -2453,222 +3252,213 @@ int64_t sys_load_module(const syscall_args_t *args)
 	return 0;
 }
 
-int64_t sys_execve(const syscall_args_t *args)
+// cwd, name, credentials and open files a new child starts out with
+static int proc_inherit(pcb *parent, pcb *child)
 {
-	const char *path = (const char *)args->rdi;
-	const char *const *argv = (const char *const *)args->rsi;
-	const char *const *envp = (const char *const *)args->rdx;
+	if (child->cwd) {
+		kfree(child->cwd);
+		child->cwd = NULL;
+	}
+	if (parent->cwd)
+		child->cwd = strdup(parent->cwd);
 
-	SYSCALL_REQUIRE(path != NULL, -EFAULT);
+	if (child->name) {
+		kfree((void *)child->name);
+		child->name = NULL;
+	}
+	if (parent->name)
+		child->name = strdup(parent->name);
 
-	tcb *current = thread_current();
-	struct pcb *cur = current ? current->process : NULL;
-	SYSCALL_REQUIRE_PROC(cur);
+	child->umask = parent->umask;
+	child->uid = parent->uid;
+	child->gid = parent->gid;
+	child->euid = parent->euid;
+	child->egid = parent->egid;
 
-	if (cur->threads && cur->threads->proc_next)
-		return -EBUSY;
+	// proc_create() gave it its own stdio, the parent's table replaces it
+	spinlock_acquire(&child->fd_lock);
+	for (int fd = fdtable_next(&child->fdt, 0); fd >= 0;
+		 fd = fdtable_next(&child->fdt, fd + 1)) {
+		struct fileio *f = fdtable_remove(&child->fdt, fd);
+		spinlock_release(&child->fd_lock);
+		close(f);
+		spinlock_acquire(&child->fd_lock);
+	}
 
-	char *resolved = NULL;
-	char **argv_copy = NULL;
-	char **envp_copy = NULL;
-	char **shebang_argv = NULL;
-	char *buf = NULL;
-	char *script_path = NULL;
-	char *exec_path = NULL;
-	char *interp = NULL;
-	char *interp_arg = NULL;
-	char *interp_resolved = NULL;
-	size_t argv_count = 0, envp_count = 0, shebang_argc = 0;
-	size_t image_size = 0;
+	// the child isn't visible to anyone yet, nobody takes these the other
+	// way around
+	spinlock_acquire(&parent->fd_lock);
+	int r = fdtable_copy(&child->fdt, &parent->fdt);
+	spinlock_release(&parent->fd_lock);
+	spinlock_release(&child->fd_lock);
+	return r;
+}
+
+// everything execve() and spawn() need before touching an address space:
+// the copied argv/envp and the image to load, after shebang handling
+struct exec_args {
+	char **argv;
+	size_t argc;
+	char **envp;
+	size_t envc;
+	struct exec_image *exe;
+	char *script_path;
+	char *exec_path;
+	char *interp;
+	char *interp_arg;
+};
+
+static void exec_args_free(struct exec_args *ea)
+{
+	free_string_vector(ea->argv, ea->argc);
+	free_string_vector(ea->envp, ea->envc);
+	SYSCALL_KFREE_IF(ea->interp);
+	SYSCALL_KFREE_IF(ea->interp_arg);
+	if (ea->exec_path != ea->script_path)
+		SYSCALL_KFREE_IF(ea->exec_path);
+	SYSCALL_KFREE_IF(ea->script_path);
+	if (ea->exe)
+		execcache_put(ea->exe);
+	memset(ea, 0, sizeof(*ea));
+}
+
+static int exec_args_prepare(struct pcb *cur, const char *path,
+							 const char *const *argv, const char *const *envp,
+							 struct exec_args *ea)
+{
+	memset(ea, 0, sizeof(*ea));
 
-	int r = syscall_resolve_user_path(cur, path, &resolved);
+	int r = syscall_resolve_user_path(cur, path, &ea->script_path);
 	if (r != 0)
 		return r;
+	ea->exec_path = ea->script_path;
 
-	r = copy_user_string_vector(argv, EXEC_MAX_ARGS, &argv_copy, &argv_count);
-	if (r != 0) {
-		kfree(resolved);
-		return r;
-	}
+	r = copy_user_string_vector(argv, EXEC_MAX_ARGS, &ea->argv, &ea->argc);
+	if (r != 0)
+		goto fail;
 
-	if (resolved) {
-		const char *a0 = (argv_count > 0 && argv_copy && argv_copy[0]) ? argv_copy[0] : "(null)";
-		const char *a1 = (argv_count > 1 && argv_copy && argv_copy[1]) ? argv_copy[1] : "(null)";
+	if (ea->script_path) {
+		const char *resolved = ea->script_path;
+		const char *a0 = (ea->argc > 0 && ea->argv && ea->argv[0]) ? ea->argv[0] : "(null)";
+		const char *a1 = (ea->argc > 1 && ea->argv && ea->argv[1]) ? ea->argv[1] : "(null)";
 		if (strcmp(resolved, "/etc/rc") == 0 || strcmp(resolved, "/etc/console-sh") == 0 ||
 			strcmp(resolved, "/bin/sh") == 0) {
 			trace("execve: path=%s argv0=%s argv1=%s\n", resolved, a0, a1);
 		}
 	}
 
-	r = copy_user_string_vector(envp, EXEC_MAX_ENVP, &envp_copy, &envp_count);
-	if (r != 0) {
-		free_string_vector(argv_copy, argv_count);
-		kfree(resolved);
-		return r;
-	}
-
-	struct fileio *f = open(resolved, O_RDONLY, 0);
-	if (!f) {
-		free_string_vector(argv_copy, argv_count);
-		free_string_vector(envp_copy, envp_count);
-		kfree(resolved);
-		return -ENOENT;
-	}
-
-	if (f->size == 0) {
-		close(f);
-		free_string_vector(argv_copy, argv_count);
-		free_string_vector(envp_copy, envp_count);
-		kfree(resolved);
-		return -EINVAL;
-	}
-
-	image_size = f->size;
-	buf = (char *)kmalloc(image_size);
-	if (!buf) {
-		close(f);
-		free_string_vector(argv_copy, argv_count);
-		free_string_vector(envp_copy, envp_count);
-		kfree(resolved);
-		return -ENOMEM;
-	}
-
-	ssize_t got = read(f, image_size, buf);
-	if (got < 0 || (size_t)got != image_size) {
-		close(f);
-		kfree(buf);
-		free_string_vector(argv_copy, argv_count);
-		free_string_vector(envp_copy, envp_count);
-		kfree(resolved);
-		return -EIO;
-	}
-	close(f);
+	r = copy_user_string_vector(envp, EXEC_MAX_ENVP, &ea->envp, &ea->envc);
+	if (r != 0)
+		goto fail;
 
-	script_path = resolved;
-	exec_path = resolved;
+	r = execcache_get(ea->script_path, &ea->exe);
+	if (r != 0)
+		goto fail;
 
-	int sb = parse_shebang(buf, image_size, &interp, &interp_arg);
+	int sb = parse_shebang(ea->exe->data, ea->exe->size, &ea->interp,
+						   &ea->interp_arg);
 	if (sb < 0) {
-		free_string_vector(argv_copy, argv_count);
-		free_string_vector(envp_copy, envp_count);
-		kfree(buf);
-		kfree(resolved);
-		return sb;
+		r = sb;
+		goto fail;
 	}
 
 	if (sb > 0) {
-		interp_resolved = syscall_resolve_path(cur, interp);
+		char *interp_resolved = syscall_resolve_path(cur, ea->interp);
 		if (!interp_resolved) {
-			free_string_vector(argv_copy, argv_count);
-			free_string_vector(envp_copy, envp_count);
-			SYSCALL_KFREE_IF(interp);
-			SYSCALL_KFREE_IF(interp_arg);
-			kfree(buf);
-			kfree(resolved);
-			return -ENOMEM;
+			r = -ENOMEM;
+			goto fail;
 		}
+		ea->exec_path = interp_resolved;
 
-		struct fileio *interp_file = open(interp_resolved, O_RDONLY, 0);
-		if (!interp_file) {
-			free_string_vector(argv_copy, argv_count);
-			free_string_vector(envp_copy, envp_count);
-			kfree(interp_resolved);
-			SYSCALL_KFREE_IF(interp);
-			SYSCALL_KFREE_IF(interp_arg);
-			kfree(buf);
-			kfree(resolved);
-			return -ENOENT;
-		}
+		struct exec_image *interp_exe = NULL;
+		r = execcache_get(interp_resolved, &interp_exe);
+		if (r != 0)
+			goto fail;
 
-		if (interp_file->size == 0) {
-			close(interp_file);
-			free_string_vector(argv_copy, argv_count);
-			free_string_vector(envp_copy, envp_count);
-			kfree(interp_resolved);
-			SYSCALL_KFREE_IF(interp);
-			SYSCALL_KFREE_IF(interp_arg);
-			kfree(buf);
-			kfree(resolved);
-			return -EINVAL;
-		}
+		execcache_put(ea->exe);
+		ea->exe = interp_exe;
 
-		size_t interp_size = interp_file->size;
-		char *interp_buf = (char *)kmalloc(interp_size);
-		if (!interp_buf) {
-			close(interp_file);
-			free_string_vector(argv_copy, argv_count);
-			free_string_vector(envp_copy, envp_count);
-			kfree(interp_resolved);
-			SYSCALL_KFREE_IF(interp);
-			SYSCALL_KFREE_IF(interp_arg);
-			kfree(buf);
-			kfree(resolved);
-			return -ENOMEM;
-		}
+		char **shebang_argv = NULL;
+		size_t shebang_argc = 0;
+		r = build_shebang_argv(interp_resolved, ea->interp_arg,
+							   ea->script_path, ea->argv, ea->argc,
+							   &shebang_argv, &shebang_argc);
+		if (r != 0)
+			goto fail;
 
-		ssize_t got = read(interp_file, interp_size, interp_buf);
-		if (got < 0 || (size_t)got != interp_size) {
-			close(interp_file);
-			kfree(interp_buf);
-			free_string_vector(argv_copy, argv_count);
-			free_string_vector(envp_copy, envp_count);
-			kfree(interp_resolved);
-			SYSCALL_KFREE_IF(interp);
-			SYSCALL_KFREE_IF(interp_arg);
-			kfree(buf);
-			kfree(resolved);
-			return -EIO;
-		}
+		free_string_vector(ea->argv, ea->argc);
+		ea->argv = shebang_argv;
+		ea->argc = shebang_argc;
+	}
+
+	return 0;
 
-		close(interp_file);
-		kfree(buf);
-		buf = interp_buf;
-		image_size = interp_size;
+fail:
+	exec_args_free(ea);
+	return r;
+}
 
-		r = build_shebang_argv(interp_resolved, interp_arg, script_path,
-							   argv_copy, argv_count, &shebang_argv,
-							   &shebang_argc);
-		if (r != 0) {
-			free_string_vector(argv_copy, argv_count);
-			free_string_vector(envp_copy, envp_count);
-			kfree(interp_resolved);
-			SYSCALL_KFREE_IF(interp);
-			SYSCALL_KFREE_IF(interp_arg);
-			kfree(buf);
-			kfree(resolved);
-			return r;
-		}
+// load the prepared image into proc, whose pm and vctx are already fresh
+static bool exec_args_load(struct exec_args *ea, struct pcb *proc,
+						   uintptr_t *entry)
+{
+	if (ea->exe->has_image) {
+		return elf_load_user_shared(ea->exe->data, &ea->exe->img,
+									ea->exec_path, proc,
+									(const char *const *)ea->argv, ea->argc,
+									(const char *const *)ea->envp, ea->envc,
+									entry);
+	}
+
+	return elf_load_user_process(ea->exe->data, ea->exec_path, proc,
+								 (const char *const *)ea->argv, ea->argc,
+								 (const char *const *)ea->envp, ea->envc,
+								 entry);
+}
 
-		free_string_vector(argv_copy, argv_count);
-		argv_copy = shebang_argv;
-		argv_count = shebang_argc;
-		exec_path = interp_resolved;
+static void exec_close_cloexec(struct pcb *proc)
+{
+	spinlock_acquire(&proc->fd_lock);
+	for (int fd = fdtable_next_cloexec(&proc->fdt, 0); fd >= 0;
+		 fd = fdtable_next_cloexec(&proc->fdt, fd + 1)) {
+		struct fileio *f = fdtable_remove(&proc->fdt, fd);
+		spinlock_release(&proc->fd_lock);
+		close(f);
+		spinlock_acquire(&proc->fd_lock);
 	}
+	spinlock_release(&proc->fd_lock);
+}
+
+int64_t sys_execve(const syscall_args_t *args)
+{
+	const char *path = (const char *)args->rdi;
+	const char *const *argv = (const char *const *)args->rsi;
+	const char *const *envp = (const char *const *)args->rdx;
+
+	SYSCALL_REQUIRE(path != NULL, -EFAULT);
+
+	tcb *current = thread_current();
+	struct pcb *cur = current ? current->process : NULL;
+	SYSCALL_REQUIRE_PROC(cur);
+
+	if (cur->threads && cur->threads->proc_next)
+		return -EBUSY;
+
+	struct exec_args ea;
+	int r = exec_args_prepare(cur, path, argv, envp, &ea);
+	if (r != 0)
+		return r;
 
 	pagetable *new_pm = create_pagemap();
 	if (!new_pm) {
-		free_string_vector(argv_copy, argv_count);
-		free_string_vector(envp_copy, envp_count);
-		SYSCALL_KFREE_IF(interp);
-		SYSCALL_KFREE_IF(interp_arg);
-		if (exec_path != script_path)
-			kfree(exec_path);
-		kfree(script_path);
-		kfree(buf);
+		exec_args_free(&ea);
 		return -ENOMEM;
 	}
 
 	vctx_t *new_vctx = vinit(new_pm, 0x1000);
 	if (!new_vctx) {
 		destroy_pagemap(new_pm);
-		free_string_vector(argv_copy, argv_count);
-		free_string_vector(envp_copy, envp_count);
-		SYSCALL_KFREE_IF(interp);
-		SYSCALL_KFREE_IF(interp_arg);
-		if (exec_path != script_path)
-			kfree(exec_path);
-		kfree(script_path);
-		kfree(buf);
+		exec_args_free(&ea);
 		return -ENOMEM;
 	}
 
@@ -2696,62 +3486,208 @@ int64_t sys_execve(const syscall_args_t *args)
 	cur->user_stack_size = 0;
 	cur->user_rsp = 0;
 
-	uintptr_t entry = 0;
-	if (!elf_load_user_process(
-			buf, exec_path, cur, (const char *const *)argv_copy, argv_count,
-			(const char *const *)envp_copy, envp_count, &entry)) {
-		cur->pm = old_pm;
-		cur->vctx = old_vctx;
-		cur->image_elf = old_image_elf;
-		cur->image_size = old_image_size;
-		cur->image_phys_base = old_image_phys_base;
-		cur->image_load_base = old_image_load_base;
-		cur->image_link_base = old_image_link_base;
-		cur->image_exec_size = old_image_exec_size;
-		cur->user_stack_base = old_user_stack_base;
-		cur->user_stack_size = old_user_stack_size;
-		cur->user_rsp = old_user_rsp;
+	uintptr_t entry = 0;
+	bool loaded = exec_args_load(&ea, cur, &entry);
+	if (!loaded) {
+		cur->pm = old_pm;
+		cur->vctx = old_vctx;
+		cur->image_elf = old_image_elf;
+		cur->image_size = old_image_size;
+		cur->image_phys_base = old_image_phys_base;
+		cur->image_load_base = old_image_load_base;
+		cur->image_link_base = old_image_link_base;
+		cur->image_exec_size = old_image_exec_size;
+		cur->user_stack_base = old_user_stack_base;
+		cur->user_stack_size = old_user_stack_size;
+		cur->user_rsp = old_user_rsp;
+
+		vdestroy(new_vctx);
+		destroy_pagemap(new_pm);
+		exec_args_free(&ea);
+		return -EINVAL;
+	}
+
+	char *name_copy = kmalloc(strlen(ea.exec_path) + 1);
+	if (name_copy) {
+		strcpy(name_copy, ea.exec_path);
+		if (cur->name)
+			kfree((void *)cur->name);
+		cur->name = (const char *)name_copy;
+	}
+
+	if (old_vctx)
+		vdestroy(old_vctx);
+	if (old_pm)
+		destroy_pagemap(old_pm);
+	if (old_image_elf)
+		kfree(old_image_elf);
+
+	exec_args_free(&ea);
+
+	// past the point of no return, drop whatever is marked close-on-exec
+	exec_close_cloexec(cur);
+
+	exec_enter_current_user(current, cur, entry);
+	__builtin_unreachable();
+}
+
+static int spawn_install(pcb *child, int fd, struct fileio *f, bool cloexec)
+{
+	struct fileio *old = NULL;
+
+	spinlock_acquire(&child->fd_lock);
+	int r = fdtable_install(&child->fdt, fd, f, cloexec, &old);
+	spinlock_release(&child->fd_lock);
+
+	if (r != 0)
+		close(f);
+	if (old)
+		close(old);
+	return r;
+}
+
+static int spawn_apply_action(pcb *parent, pcb *child,
+							  const struct spawn_action *a)
+{
+	SYSCALL_REQUIRE_FD(a->fd);
+
+	switch (a->op) {
+	case SPAWN_CLOSE: {
+		spinlock_acquire(&child->fd_lock);
+		struct fileio *f = fdtable_remove(&child->fdt, a->fd);
+		spinlock_release(&child->fd_lock);
+		if (!f)
+			return -EBADF;
+		close(f);
+		return 0;
+	}
+	case SPAWN_DUP2: {
+		spinlock_acquire(&child->fd_lock);
+		struct fileio *f = fdtable_get(&child->fdt, a->srcfd);
+		if (!f) {
+			spinlock_release(&child->fd_lock);
+			return -EBADF;
+		}
+		// dup2 onto itself only clears close-on-exec
+		if (a->srcfd == a->fd) {
+			fdtable_set_cloexec(&child->fdt, a->fd, false);
+			spinlock_release(&child->fd_lock);
+			return 0;
+		}
+		fio_retain(f);
+		spinlock_release(&child->fd_lock);
+		return spawn_install(child, a->fd, f, false);
+	}
+	case SPAWN_OPEN: {
+		SYSCALL_REQUIRE(a->path != NULL, -EFAULT);
+
+		// relative to the parent's cwd, which the child shares
+		char *resolved = NULL;
+		int r = syscall_resolve_user_path(parent, a->path, &resolved);
+		if (r != 0)
+			return r;
+
+		struct fileio *f = open(resolved, a->flags, a->mode);
+		kfree(resolved);
+		if (!f)
+			return -ENOENT;
+		return spawn_install(child, a->fd, f, (a->flags & O_CLOEXEC) != 0);
+	}
+	default:
+		return -EINVAL;
+	}
+}
+
+// fork+exec without the fork: a fresh process gets the parent's fd table,
+// the file actions, and the new image, no address space is ever copied
+int64_t sys_spawn(const syscall_args_t *args)
+{
+	const char *path = (const char *)args->rdi;
+	const char *const *argv = (const char *const *)args->rsi;
+	const char *const *envp = (const char *const *)args->rdx;
+	const struct spawn_action *user_actions =
+		(const struct spawn_action *)args->r10;
+	int nactions = (int)args->r8;
+	int flags = (int)args->r9;
+
+	SYSCALL_REQUIRE(path != NULL, -EFAULT);
+	SYSCALL_REQUIRE(nactions >= 0 && nactions <= SPAWN_MAX_ACTIONS, -EINVAL);
+	SYSCALL_REQUIRE(!(flags & ~SPAWN_SETPGROUP), -EINVAL);
+
+	pcb *parent = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(parent);
+
+	struct spawn_action *actions = NULL;
+	size_t actions_len = (size_t)nactions * sizeof(*actions);
+	if (nactions) {
+		SYSCALL_REQUIRE(user_actions != NULL, -EFAULT);
+		SYSCALL_REQUIRE(syscall_user_readable(user_actions, actions_len) == 0,
+						-EFAULT);
+
+		actions = kmalloc(actions_len);
+		if (!actions)
+			return -ENOMEM;
+
+		int r = syscall_copy_from_user(actions, user_actions, actions_len);
+		if (r != 0) {
+			kfree(actions);
+			return r;
+		}
+	}
 
-		vdestroy(new_vctx);
-		destroy_pagemap(new_pm);
+	struct exec_args ea;
+	int r = exec_args_prepare(parent, path, argv, envp, &ea);
+	if (r != 0) {
+		SYSCALL_KFREE_IF(actions);
+		return r;
+	}
 
-		free_string_vector(argv_copy, argv_count);
-		free_string_vector(envp_copy, envp_count);
-		SYSCALL_KFREE_IF(interp);
-		SYSCALL_KFREE_IF(interp_arg);
-		if (exec_path != script_path)
-			kfree(exec_path);
-		kfree(script_path);
-		kfree(buf);
-		return -EINVAL;
+	pcb *child = proc_create();
+	if (!child) {
+		r = -ENOMEM;
+		goto out;
 	}
 
-	char *name_copy = kmalloc(strlen(exec_path) + 1);
-	if (name_copy) {
-		strcpy(name_copy, exec_path);
-		if (cur->name)
-			kfree((void *)cur->name);
-		cur->name = (const char *)name_copy;
+	r = proc_inherit(parent, child);
+	for (int i = 0; r == 0 && i < nactions; i++)
+		r = spawn_apply_action(parent, child, &actions[i]);
+	if (r != 0) {
+		proc_destroy(child);
+		goto out;
 	}
 
-	if (old_vctx)
-		vdestroy(old_vctx);
-	if (old_pm)
-		destroy_pagemap(old_pm);
-	if (old_image_elf)
-		kfree(old_image_elf);
+	exec_close_cloexec(child);
 
-	SYSCALL_KFREE_IF(interp);
-	SYSCALL_KFREE_IF(interp_arg);
-	if (exec_path != script_path)
-		kfree(exec_path);
-	kfree(script_path);
-	kfree(buf);
-	free_string_vector(argv_copy, argv_count);
-	free_string_vector(envp_copy, envp_count);
+	uintptr_t entry = 0;
+	if (!exec_args_load(&ea, child, &entry)) {
+		proc_destroy(child);
+		r = -EINVAL;
+		goto out;
+	}
 
-	exec_enter_current_user(current, cur, entry);
-	__builtin_unreachable();
+	if (child->name)
+		kfree((void *)child->name);
+	child->name = strdup(ea.exec_path);
+
+	uint32_t pid = child->pid;
+	proc_adopt(parent, child);
+	if (flags & SPAWN_SETPGROUP)
+		child->pgid = pid;
+
+	if (!thread_create_user(child, (void (*)(void))entry)) {
+		// already ours, so it turns into a zombie, take it right back
+		proc_destroy(child);
+		(void)proc_wait_child(parent, (int)pid, WNOHANG, NULL);
+		r = -ENOMEM;
+		goto out;
+	}
+
+	r = (int)pid;
+
+out:
+	exec_args_free(&ea);
+	SYSCALL_KFREE_IF(actions);
+	return r;
 }
 
 int64_t sys_exec(const syscall_args_t *args)
@@ -2767,6 +3703,32 @@ int64_t sys_exec(const syscall_args_t *args)
 	return sys_execve(&execve_args);
 }
 
+// only uring fds can be mapped for now, their pages are shared with the kernel
+static int64_t syscall_mmap_file(struct pcb *proc, int fd, size_t offset,
+								 size_t pages, int flags, uint64_t vflags)
+{
+	if (fd < 0)
+		return -EBADF;
+	if (flags & (MAP_FIXED | MAP_FIXED_NOREPLACE | MAP_PRIVATE))
+		return -EINVAL;
+
+	struct fileio *f = NULL;
+	int r = syscall_fd_get(proc, fd, &f);
+	if (r != 0)
+		return r;
+	if (!(f->flags & URING_FILE)) {
+		close(f);
+		return -ENOSYS;
+	}
+
+	void *mapped = NULL;
+	r = uring_mmap(f, proc, offset, pages, vflags, &mapped);
+	close(f);
+	if (r != 0)
+		return r;
+	return (int64_t)(uintptr_t)mapped;
+}
+
 int64_t sys_mmap(const syscall_args_t *args)
 {
 	void *addr = (void *)args->rdi;
@@ -2794,15 +3756,9 @@ int64_t sys_mmap(const syscall_args_t *args)
 	if (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC))
 		return -EINVAL;
 
-	if (offset != 0)
+	if (offset != 0 && (flags & MAP_ANONYMOUS))
 		return -EINVAL;
 
-	if (!(flags & MAP_ANONYMOUS)) {
-		if (fd < 0)
-			return -EBADF;
-		return -ENOSYS;
-	}
-
 	struct pcb *proc = syscall_current_process();
 	SYSCALL_REQUIRE_PROC(proc);
 	if (!proc->vctx)
@@ -2822,6 +3778,9 @@ int64_t sys_mmap(const syscall_args_t *args)
 	if (prot & PROT_EXEC)
 		vflags |= VALLOC_EXEC;
 
+	if (!(flags & MAP_ANONYMOUS))
+		return syscall_mmap_file(proc, fd, offset, pages, flags, vflags);
+
 	void *mapped = NULL;
 	uintptr_t min_addr = VPM_MIN_ADDR;
 	uintptr_t hint = (uintptr_t)addr;
@@ -2876,6 +3835,10 @@ int64_t sys_lseek(const syscall_args_t *args)
 	int r = syscall_fd_get(proc, fd, &f);
 	if (r != 0)
 		return r;
+	if (f->flags & (UNIX_FILE | URING_FILE | PIPE_READ_END | PIPE_WRITE_END)) {
+		close(f);
+		return -ESPIPE;
+	}
 
 	int64_t base = 0;
 	if (whence == SEEK_CUR)
@@ -2959,7 +3922,16 @@ int64_t sys_mprotect(const syscall_args_t *args)
 		uintptr_t phys = vget_phys(proc->pm, virt);
 		if (!phys)
 			return -ENOMEM;
-		map_page(proc->pm, virt, ALIGN_DOWN(phys, PAGE_SIZE), pflags);
+		uintptr_t phys_page = ALIGN_DOWN(phys, PAGE_SIZE);
+
+		// shared pages (fork, cached exec images) stay COW when made writable
+		uint64_t page_flags = pflags;
+		if ((pflags & VMM_WRITABLE) &&
+			((vget_flags(proc->pm, virt) & VMM_COW) ||
+			 pmm_refcount(phys_page) > 1)) {
+			page_flags = (pflags & ~VMM_WRITABLE) | VMM_COW;
+		}
+		map_page(proc->pm, virt, phys_page, page_flags);
 	}
 
 	for (vregion_t *region = proc->vctx->root; region; region = region->next) {
@@ -3016,42 +3988,11 @@ int64_t sys_fork(const syscall_args_t *args)
 	child->image_link_base = 0;
 	child->image_exec_size = 0;
 
-	if (child->cwd) {
-		kfree(child->cwd);
-		child->cwd = NULL;
-	}
-	if (parent->cwd)
-		child->cwd = strdup(parent->cwd);
-
-	if (child->name) {
-		kfree((void *)child->name);
-		child->name = NULL;
-	}
-	if (parent->name)
-		child->name = strdup(parent->name);
-
-	child->umask = parent->umask;
-	child->uid = parent->uid;
-	child->gid = parent->gid;
-	child->euid = parent->euid;
-	child->egid = parent->egid;
-
-	for (int fd = 0; fd < PROC_MAX_FDS; fd++) {
-		if (child->fds[fd]) {
-			close(child->fds[fd]);
-			child->fds[fd] = NULL;
-		}
-	}
-
-	spinlock_acquire(&parent->fd_lock);
-	for (int fd = 0; fd < PROC_MAX_FDS; fd++) {
-		struct fileio *f = parent->fds[fd];
-		if (!f)
-			continue;
-		fio_retain(f);
-		child->fds[fd] = f;
+	int inherit_err = proc_inherit(parent, child);
+	if (inherit_err != 0) {
+		proc_destroy(child);
+		return inherit_err;
 	}
-	spinlock_release(&parent->fd_lock);
 
 	int mem_err = syscall_clone_memory(parent, child);
 	if (mem_err != 0) {
@@ -3111,6 +4052,7 @@ int64_t sys_fork(const syscall_args_t *args)
 	*--rsp = 0x202;
 
 	child_thread->kthread.rsp = (uint64_t)(uintptr_t)rsp;
+	proc_adopt(parent, child);
 	thread_enqueue(child_thread);
 
 	return (int64_t)child->pid;
@@ -3157,9 +4099,9 @@ int64_t sys_waitpid(const syscall_args_t *args)
 	int *status = (int *)args->rsi;
 	int options = (int)args->rdx;
 
-	if (pid <= 0)
-		return -EINVAL;
-	if (options != 0)
+	if (pid == INT32_MIN)
+		return -ESRCH;
+	if (options & ~(WNOHANG | WUNTRACED))
 		return -EINVAL;
 
 	struct pcb *parent = syscall_current_process();
@@ -3169,24 +4111,21 @@ int64_t sys_waitpid(const syscall_args_t *args)
 		SYSCALL_REQUIRE(syscall_user_writable(status, sizeof(*status)) == 0,
 						-EFAULT);
 
-	struct pcb *child = proc_get_by_pid((uint32_t)pid);
-	if (!child)
+	int code = 0;
+	int reaped = proc_wait_child(parent, pid, options, &code);
+	if (reaped < 0)
 		return -ECHILD;
-	if (child->parent_pid != parent->pid)
-		return -ECHILD;
-
-	while (!child->exited)
-		sched_yield();
+	if (reaped == 0)
+		return (options & WNOHANG) ? 0 : -EINTR;
 
 	if (status) {
-		int st = (child->exit_code & 0xff) << 8;
+		int st = (code & 0xff) << 8;
 		int r = syscall_copy_to_user(status, &st, sizeof(st));
 		if (r != 0)
 			return r;
 	}
 
-	proc_destroy(child);
-	return pid;
+	return reaped;
 }
 
 int64_t sys_getpid(const syscall_args_t *args)
@@ -3232,10 +4171,305 @@ int64_t sys_getpgid(const syscall_args_t *args)
 	if (!target)
 		return -ESRCH;
 
-	pid_t pgid = (pid_t)target->pid;
+	pid_t pgid = (pid_t)target->pgid;
 	return syscall_copy_to_user(pgid_out, &pgid, sizeof(pgid));
 }
 
+int64_t sys_setpgid(const syscall_args_t *args)
+{
+	pid_t pid = (pid_t)args->rdi;
+	pid_t pgid = (pid_t)args->rsi;
+
+	struct pcb *caller = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(caller);
+
+	if (pid < 0 || pgid < 0)
+		return -EINVAL;
+	if (pid == 0)
+		pid = caller->pid;
+	if (pgid == 0)
+		pgid = pid;
+
+	struct pcb *target = proc_get_by_pid((uint32_t)pid);
+	if (!target)
+		return -ESRCH;
+	if (target != caller && target->parent != caller)
+		return -ESRCH;
+
+	// joining a group needs a member of it in the caller's session, which
+	// we don't track, so settle for the group existing at all
+	if (pgid != pid) {
+		struct pcb *leader = proc_get_by_pid((uint32_t)pgid);
+		if (!leader || leader->pgid != (uint32_t)pgid)
+			return -EPERM;
+	}
+
+	target->pgid = (uint32_t)pgid;
+	return 0;
+}
+
+// same rule as kill(): root, or a process running as the same user
+static bool sched_may_adjust(const struct pcb *caller, const struct pcb *target)
+{
+	return syscall_is_privileged(caller) || caller == target ||
+		   caller->uid == target->uid || caller->euid == target->uid;
+}
+
+static int sched_set_proc_nice(struct pcb *proc, int nice)
+{
+	spinlock_acquire(&proc->thread_lock);
+	for (tcb *t = proc->threads; t; t = t->proc_next)
+		sched_set_nice(t, nice);
+	spinlock_release(&proc->thread_lock);
+	return 0;
+}
+
+// the nicest value among a process's threads, which is what it runs at
+static int sched_get_proc_nice(struct pcb *proc)
+{
+	int nice = SCHED_NICE_MAX;
+	bool any = false;
+
+	spinlock_acquire(&proc->thread_lock);
+	for (tcb *t = proc->threads; t; t = t->proc_next) {
+		if (!any || t->nice < nice)
+			nice = t->nice;
+		any = true;
+	}
+	spinlock_release(&proc->thread_lock);
+	return any ? nice : 0;
+}
+
+int64_t sys_setpriority(const syscall_args_t *args)
+{
+	int which = (int)args->rdi;
+	pid_t who = (pid_t)args->rsi;
+	int nice = (int)args->rdx;
+
+	struct pcb *caller = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(caller);
+
+	if (which != PRIO_PROCESS || who < 0)
+		return -EINVAL;
+	if (who == 0)
+		who = caller->pid;
+
+	struct pcb *target = proc_get_by_pid((uint32_t)who);
+	if (!target)
+		return -ESRCH;
+	if (!sched_may_adjust(caller, target))
+		return -EPERM;
+
+	if (nice < SCHED_NICE_MIN)
+		nice = SCHED_NICE_MIN;
+	if (nice > SCHED_NICE_MAX)
+		nice = SCHED_NICE_MAX;
+
+	// anyone may back off, only root may ask for more
+	if (nice < sched_get_proc_nice(target) && !syscall_is_privileged(caller))
+		return -EACCES;
+
+	return sched_set_proc_nice(target, nice);
+}
+
+// returns 20 - nice so a valid answer is never negative
+int64_t sys_getpriority(const syscall_args_t *args)
+{
+	int which = (int)args->rdi;
+	pid_t who = (pid_t)args->rsi;
+
+	struct pcb *caller = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(caller);
+
+	if (which != PRIO_PROCESS || who < 0)
+		return -EINVAL;
+	if (who == 0)
+		who = caller->pid;
+
+	struct pcb *target = proc_get_by_pid((uint32_t)who);
+	if (!target)
+		return -ESRCH;
+
+	return 20 - sched_get_proc_nice(target);
+}
+
+// pid 0 is the calling thread, any other pid is every thread of that
+// process. TIDs are a separate namespace and never looked up here
+int64_t sys_sched_setscheduler(const syscall_args_t *args)
+{
+	pid_t pid = (pid_t)args->rdi;
+	int policy = (int)args->rsi;
+	const struct sched_param *uparam = (const struct sched_param *)args->rdx;
+
+	SYSCALL_REQUIRE(uparam != NULL, -EFAULT);
+
+	struct pcb *caller = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(caller);
+
+	struct sched_param param;
+	int ret = syscall_copy_from_user(&param, uparam, sizeof(param));
+	if (ret < 0)
+		return ret;
+
+	if (policy != SCHED_OTHER && policy != SCHED_FIFO && policy != SCHED_RR)
+		return -EINVAL;
+	if (policy == SCHED_OTHER && param.sched_priority != 0)
+		return -EINVAL;
+	if (policy != SCHED_OTHER &&
+		(param.sched_priority < SCHED_RT_PRIO_MIN ||
+		 param.sched_priority > SCHED_RT_PRIO_MAX))
+		return -EINVAL;
+	if (pid < 0)
+		return -EINVAL;
+
+	// a real-time thread can starve everything else, including the shell
+	if (policy != SCHED_OTHER && !syscall_is_privileged(caller))
+		return -EPERM;
+
+	if (pid == 0) {
+		if (sched_set_policy(thread_current(), policy,
+							 param.sched_priority) != 0)
+			return -EINVAL;
+		return 0;
+	}
+
+	struct pcb *target = proc_get_by_pid((uint32_t)pid);
+	if (!target)
+		return -ESRCH;
+	if (!sched_may_adjust(caller, target))
+		return -EPERM;
+
+	spinlock_acquire(&target->thread_lock);
+	for (tcb *t = target->threads; t; t = t->proc_next)
+		sched_set_policy(t, policy, param.sched_priority);
+	spinlock_release(&target->thread_lock);
+	return 0;
+}
+
+int64_t sys_sched_getscheduler(const syscall_args_t *args)
+{
+	pid_t pid = (pid_t)args->rdi;
+	struct sched_param *uparam = (struct sched_param *)args->rsi;
+
+	struct pcb *caller = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(caller);
+
+	if (pid < 0)
+		return -EINVAL;
+
+	int policy;
+	struct sched_param param;
+	if (pid == 0) {
+		policy = thread_current()->policy;
+		param.sched_priority = thread_current()->rt_priority;
+	} else {
+		struct pcb *target = proc_get_by_pid((uint32_t)pid);
+		if (!target)
+			return -ESRCH;
+		spinlock_acquire(&target->thread_lock);
+		tcb *thread = target->threads;
+		if (thread) {
+			policy = thread->policy;
+			param.sched_priority = thread->rt_priority;
+		}
+		spinlock_release(&target->thread_lock);
+		if (!thread)
+			return -ESRCH;
+	}
+
+	if (uparam) {
+		int ret = syscall_copy_to_user(uparam, &param, sizeof(param));
+		if (ret < 0)
+			return ret;
+	}
+
+	return policy;
+}
+
+// same pid rules as sched_setscheduler
+int64_t sys_sched_setaffinity(const syscall_args_t *args)
+{
+	pid_t pid = (pid_t)args->rdi;
+	size_t len = (size_t)args->rsi;
+	const void *umask = (const void *)args->rdx;
+
+	SYSCALL_REQUIRE(umask != NULL, -EFAULT);
+
+	struct pcb *caller = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(caller);
+
+	if (pid < 0 || len == 0)
+		return -EINVAL;
+
+	// CPUs past the first 64 don't exist here, ignore their bits
+	uint64_t mask = 0;
+	int ret = syscall_copy_from_user(&mask, umask,
+									 len < sizeof(mask) ? len : sizeof(mask));
+	if (ret < 0)
+		return ret;
+	if (!(mask & sched_online_mask()))
+		return -EINVAL;
+
+	if (pid == 0) {
+		if (sched_set_affinity(thread_current(), mask) != 0)
+			return -EINVAL;
+		sched_leave_if_misplaced();
+		return 0;
+	}
+
+	struct pcb *target = proc_get_by_pid((uint32_t)pid);
+	if (!target)
+		return -ESRCH;
+	if (!sched_may_adjust(caller, target))
+		return -EPERM;
+
+	spinlock_acquire(&target->thread_lock);
+	for (tcb *t = target->threads; t; t = t->proc_next)
+		sched_set_affinity(t, mask);
+	spinlock_release(&target->thread_lock);
+
+	sched_leave_if_misplaced();
+	return 0;
+}
+
+// returns the number of mask bytes written
+int64_t sys_sched_getaffinity(const syscall_args_t *args)
+{
+	pid_t pid = (pid_t)args->rdi;
+	size_t len = (size_t)args->rsi;
+	void *umask = (void *)args->rdx;
+
+	SYSCALL_REQUIRE(umask != NULL, -EFAULT);
+
+	struct pcb *caller = syscall_current_process();
+	SYSCALL_REQUIRE_PROC(caller);
+
+	uint64_t mask = 0;
+	if (pid < 0 || len < sizeof(mask))
+		return -EINVAL;
+
+	if (pid == 0) {
+		mask = thread_current()->cpu_mask;
+	} else {
+		struct pcb *target = proc_get_by_pid((uint32_t)pid);
+		if (!target)
+			return -ESRCH;
+		spinlock_acquire(&target->thread_lock);
+		tcb *thread = target->threads;
+		if (thread)
+			mask = thread->cpu_mask;
+		spinlock_release(&target->thread_lock);
+		if (!thread)
+			return -ESRCH;
+	}
+
+	mask &= sched_online_mask();
+	int ret = syscall_copy_to_user(umask, &mask, sizeof(mask));
+	if (ret < 0)
+		return ret;
+	return sizeof(mask);
+}
+
 int64_t sys_getuid(const syscall_args_t *args)
 {
 	(void)args;
@@ -3297,9 +4531,9 @@ int64_t sys_clock_get(const syscall_args_t *args)
 	if (clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC)
 		return -EINVAL;
 
-	uint64_t ms = get_ms();
-	int64_t s = (int64_t)(ms / 1000ull);
-	int64_t ns = (int64_t)((ms % 1000ull) * 1000000ull);
+	uint64_t now = time_ns();
+	int64_t s = (int64_t)(now / 1000000000ull);
+	int64_t ns = (int64_t)(now % 1000000000ull);
 
 	int r = syscall_copy_to_user(secs, &s, sizeof(s));
 	if (r != 0)
@@ -3369,6 +4603,26 @@ void syscall_builtin_init(void)
 	register_syscall(SYS_DUP3, sys_dup3, "dup3");
 	register_syscall(SYS_PIPE, sys_pipe, "pipe");
 	register_syscall(SYS_PIPE2, sys_pipe, "pipe2");
+	register_syscall(SYS_SOCKET, sys_socket, "socket");
+	register_syscall(SYS_SOCKETPAIR, sys_socketpair, "socketpair");
+	register_syscall(SYS_BIND, sys_bind, "bind");
+	register_syscall(SYS_LISTEN, sys_listen, "listen");
+	register_syscall(SYS_ACCEPT, sys_accept, "accept");
+	register_syscall(SYS_CONNECT, sys_connect, "connect");
+	register_syscall(SYS_SENDMSG, sys_sendmsg, "sendmsg");
+	register_syscall(SYS_RECVMSG, sys_recvmsg, "recvmsg");
+	register_syscall(SYS_SHUTDOWN, sys_shutdown, "shutdown");
+	register_syscall(SYS_GETSOCKNAME, sys_getsockname, "getsockname");
+	register_syscall(SYS_GETPEERNAME, sys_getpeername, "getpeername");
+	register_syscall(SYS_SPLICE, sys_splice, "splice");
+	register_syscall(SYS_TEE, sys_tee, "tee");
+	register_syscall(SYS_SENDFILE, sys_sendfile, "sendfile");
+	register_syscall(SYS_READV, sys_readv, "readv");
+	register_syscall(SYS_WRITEV, sys_writev, "writev");
+	register_syscall(SYS_PREADV, sys_preadv, "preadv");
+	register_syscall(SYS_PWRITEV, sys_pwritev, "pwritev");
+	register_syscall(SYS_URING_SETUP, sys_uring_setup, "uring_setup");
+	register_syscall(SYS_URING_ENTER, sys_uring_enter, "uring_enter");
 	register_syscall(SYS_MKDIR, sys_mkdir, "mkdir");
 	register_syscall(SYS_MKDIRAT, sys_mkdirat, "mkdirat");
 	register_syscall(SYS_UNLINKAT, sys_unlinkat, "unlinkat");
@@ -3385,4 +4639,16 @@ void syscall_builtin_init(void)
 	register_syscall(SYS_FACCESSAT, sys_faccessat, "faccessat");
 	register_syscall(SYS_UTIMENSAT, sys_utimensat, "utimensat");
 	register_syscall(SYS_GETPGID, sys_getpgid, "getpgid");
+	register_syscall(SYS_SETPGID, sys_setpgid, "setpgid");
+	register_syscall(SYS_SPAWN, sys_spawn, "spawn");
+	register_syscall(SYS_SETPRIORITY, sys_setpriority, "setpriority");
+	register_syscall(SYS_GETPRIORITY, sys_getpriority, "getpriority");
+	register_syscall(SYS_SCHED_SETSCHEDULER, sys_sched_setscheduler,
+					 "sched_setscheduler");
+	register_syscall(SYS_SCHED_GETSCHEDULER, sys_sched_getscheduler,
+					 "sched_getscheduler");
+	register_syscall(SYS_SCHED_SETAFFINITY, sys_sched_setaffinity,
+					 "sched_setaffinity");
+	register_syscall(SYS_SCHED_GETAFFINITY, sys_sched_getaffinity,
+					 "sched_getaffinity");
 }
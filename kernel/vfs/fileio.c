@@ -20,6 +20,8 @@
 #include <vfs/fileio.h>
 #include <vfs/vfs.h>
 #include <ipc/pipe.h>
+#include <ipc/unix.h>
+#include <ipc/uring.h>
 #include <mm/heap.h>
 #include <aurix.h>
 #include <debug/assert.h>
@@ -109,6 +111,15 @@ ssize_t read(struct fileio *file, size_t size, void *out)
 		return -EBADF;
 	}
 
+	if (file->flags & URING_FILE) {
+		return -EINVAL;
+	}
+
+	if (file->flags & UNIX_FILE) {
+		struct iovec iov = { .iov_base = out, .iov_len = size };
+		return unix_recvmsg(file, &iov, 1, NULL, NULL, 0, NULL);
+	}
+
 	if (file->flags & PIPE_READ_END) {
 		int ret = pipe_read(file, out, &size);
 		if (ret < 0)
@@ -144,6 +155,15 @@ int write(struct fileio *file, void *buf, size_t size)
 {
 	struct vnode *vn = file->private;
 
+	if (file->flags & URING_FILE) {
+		return -EINVAL;
+	}
+
+	if (file->flags & UNIX_FILE) {
+		struct iovec iov = { .iov_base = buf, .iov_len = size };
+		return (int)unix_sendmsg(file, &iov, 1, NULL, 0, NULL, 0);
+	}
+
 	if (file->flags & PIPE_WRITE_END) {
 		int ret = pipe_write(file, buf, &size);
 		if (ret < 0)
@@ -172,6 +192,85 @@ int write(struct fileio *file, void *buf, size_t size)
 	return ret;
 }
 
+// with a NULL offset the file position is used and advanced, otherwise it's
+// left alone
+ssize_t readv(struct fileio *file, const struct iovec *iov, size_t iovcnt,
+			  size_t *offset)
+{
+	if (!file) {
+		return -EBADF;
+	}
+
+	if (file->flags & URING_FILE) {
+		return -EINVAL;
+	}
+
+	if (file->flags & (UNIX_FILE | PIPE_READ_END | PIPE_WRITE_END)) {
+		if (offset)
+			return -ESPIPE;
+		if (file->flags & UNIX_FILE)
+			return unix_recvmsg(file, iov, iovcnt, NULL, NULL, 0, NULL);
+		if (file->flags & PIPE_WRITE_END)
+			return -EBADF;
+
+		size_t size = 0;
+		int ret = pipe_readv(file, iov, iovcnt, &size);
+		return ret < 0 ? ret : (ssize_t)size;
+	}
+
+	size_t pos = offset ? *offset : file->offset;
+	if (!(file->flags & SPECIAL_FILE_TYPE_DEVICE) && pos >= file->size) {
+		return 0;
+	}
+
+	ssize_t ret = vfs_readv((struct vnode *)file->private, iov, iovcnt, pos);
+	if (ret > 0 && !offset)
+		file->offset = pos + (size_t)ret;
+	return ret;
+}
+
+ssize_t writev(struct fileio *file, const struct iovec *iov, size_t iovcnt,
+			   size_t *offset)
+{
+	if (!file) {
+		return -EBADF;
+	}
+
+	if (file->flags & URING_FILE) {
+		return -EINVAL;
+	}
+
+	if (file->flags & (UNIX_FILE | PIPE_READ_END | PIPE_WRITE_END)) {
+		if (offset)
+			return -ESPIPE;
+		if (file->flags & UNIX_FILE)
+			return unix_sendmsg(file, iov, iovcnt, NULL, 0, NULL, 0);
+		if (file->flags & PIPE_READ_END)
+			return -EBADF;
+
+		size_t size = 0;
+		int ret = pipe_writev(file, iov, iovcnt, &size);
+		return ret < 0 ? ret : (ssize_t)size;
+	}
+
+	size_t pos = offset ? *offset : file->offset;
+	if (!offset && (file->flags & O_APPEND)) {
+		pos = file->size;
+	}
+
+	ssize_t ret = vfs_writev((struct vnode *)file->private, iov, iovcnt, pos);
+	if (ret <= 0)
+		return ret;
+
+	if (!(file->flags & SPECIAL_FILE_TYPE_DEVICE) &&
+		file->size < pos + (size_t)ret) {
+		file->size = pos + (size_t)ret;
+	}
+	if (!offset)
+		file->offset = pos + (size_t)ret;
+	return ret;
+}
+
 static void _fio_dir_handle_free(struct fileio *file)
 {
 	if (!file || !file->dir)
@@ -197,6 +296,16 @@ int close(struct fileio *file)
 
 	struct vnode *vn = file->private;
 
+	if (file->flags & UNIX_FILE) {
+		unix_close(file);
+		return 0;
+	}
+
+	if (file->flags & URING_FILE) {
+		uring_close(file);
+		return 0;
+	}
+
 	if (file->flags & PIPE_READ_END || file->flags & PIPE_WRITE_END) {
 		pipe_close(file);
 		return 0;
@@ -29,6 +29,7 @@
 #include <debug/assert.h>
 #include <sys/sched.h>
 #include <user/access.h>
+#include <loader/execcache.h>
 
 struct vfs *vfs_list = NULL;
 static struct vfs_fstype *registered_fstypes = NULL;
@@ -815,6 +816,7 @@ int vfs_write(struct vnode *vnode, void *buf, size_t size, size_t offset)
 	}
 
 	int ret = vnode->ops->write(vnode, buf, &size, &offset);
+	execcache_invalidate(vnode);
 
 	if (ret != 0) {
 		return ret;
@@ -823,6 +825,70 @@ int vfs_write(struct vnode *vnode, void *buf, size_t size, size_t offset)
 	}
 }
 
+ssize_t vfs_readv(struct vnode *vnode, const struct iovec *iov, size_t iovcnt,
+				  size_t offset)
+{
+	if (!vnode) {
+		return -1;
+	}
+
+	size_t bytes = 0;
+	if (vnode->ops->readv) {
+		int ret = vnode->ops->readv(vnode, iov, iovcnt, &bytes, &offset);
+		return ret != 0 ? ret : (ssize_t)bytes;
+	}
+
+	for (size_t i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len == 0)
+			continue;
+
+		size_t n = iov[i].iov_len;
+		if (vnode->ops->read(vnode, &n, &offset, iov[i].iov_base) != 0)
+			break;
+
+		bytes += n;
+		if (n < iov[i].iov_len)
+			break;
+	}
+
+	return (ssize_t)bytes;
+}
+
+ssize_t vfs_writev(struct vnode *vnode, const struct iovec *iov, size_t iovcnt,
+				   size_t offset)
+{
+	if (!vnode) {
+		return -1;
+	}
+
+	size_t bytes = 0;
+	if (vnode->ops->writev) {
+		int ret = vnode->ops->writev(vnode, iov, iovcnt, &bytes, &offset);
+		execcache_invalidate(vnode);
+		return ret != 0 ? ret : (ssize_t)bytes;
+	}
+
+	int ret = 0;
+	for (size_t i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len == 0)
+			continue;
+
+		size_t n = iov[i].iov_len;
+		ret = vnode->ops->write(vnode, iov[i].iov_base, &n, &offset);
+		if (ret != 0)
+			break;
+
+		bytes += n;
+		if (n < iov[i].iov_len)
+			break;
+	}
+
+	execcache_invalidate(vnode);
+	if (ret != 0 && !bytes)
+		return ret;
+	return (ssize_t)bytes;
+}
+
 int vfs_ioctl(struct vnode *vnode, int request, void *arg)
 {
 	if (!vnode) {
@@ -965,6 +1031,12 @@ int vfs_remove(const char *path)
 
 	// TODO: perms
 
+	struct vnode *victim = NULL;
+	if (vfs_lookup_nofollow(path, &victim) == 0 && victim) {
+		execcache_invalidate(victim);
+		vnode_unref(victim);
+	}
+
 	ret = parent->ops->remove(parent, filename);
 	kfree(filename);
 	vnode_unref(parent);
@@ -1066,6 +1138,7 @@ int vfs_setstat(const char *path, struct stat *st)
 	}
 
 	ret = vnode->ops->setattr(vnode, st);
+	execcache_invalidate(vnode);
 	vnode_unref(vnode);
 
 	return ret;
@@ -642,8 +642,15 @@ int mod_init(void)
 		kprintf(
 			"i8042_ps2: make_child AXAPI missing; running kbd/mouse inline\n");
 	} else {
-		ktid = make_child(ps2_kbd_thread);
-		mtid = make_child(ps2_mouse_thread);
+		// the workers only shuffle bytes between rings, keep them out of
+		// the way of whatever is consuming the input
+		if (make_child_ex) {
+			ktid = make_child_ex(ps2_kbd_thread, AX_CHILD_BACKGROUND);
+			mtid = make_child_ex(ps2_mouse_thread, AX_CHILD_BACKGROUND);
+		} else {
+			ktid = make_child(ps2_kbd_thread);
+			mtid = make_child(ps2_mouse_thread);
+		}
 		kbd_worker = (ktid >= 0);
 		mouse_worker = (mtid >= 0);
 		mod_log("spawned kbd tid=%d mouse tid=%d\n", ktid, mtid);
@@ -23,4 +23,259 @@
 #ifndef _PCI_H
 #define _PCI_H
 
+#include <aurix/axapi.h>
+#include <acpi/acpi.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PCI_DEVICE_CLASS "pci"
+
+#define PCI_CONFIG_VENDOR_ID 0x00
+#define PCI_CONFIG_DEVICE_ID 0x02
+#define PCI_CONFIG_COMMAND 0x04
+#define PCI_CONFIG_STATUS 0x06
+#define PCI_CONFIG_REVISION_ID 0x08
+#define PCI_CONFIG_PROG_INTF 0x09
+#define PCI_CONFIG_SUBCLASS 0x0a
+#define PCI_CONFIG_CLASS_CODE 0x0b
+#define PCI_CONFIG_CACHELINE_SIZE 0x0c
+#define PCI_CONFIG_LATENCY 0x0d
+#define PCI_CONFIG_HEADER_TYPE 0x0e
+#define PCI_CONFIG_BIST 0x0f
+#define PCI_CONFIG_BAR0 0x10
+#define PCI_CONFIG_SECONDARY_BUS 0x19
+#define PCI_CONFIG_SUBSYS_VENDOR_ID 0x2c
+#define PCI_CONFIG_SUBSYS_ID 0x2e
+#define PCI_CONFIG_CAPABILITIES 0x34
+#define PCI_CONFIG_INTERRUPT_LINE 0x3c
+#define PCI_CONFIG_INTERRUPT_PIN 0x3d
+
+#define PCI_COMMAND_IO (1 << 0)
+#define PCI_COMMAND_MEMORY (1 << 1)
+#define PCI_COMMAND_BUS_MASTER (1 << 2)
+#define PCI_COMMAND_INTX_DISABLE (1 << 10)
+
+#define PCI_STATUS_CAP_LIST (1 << 4)
+
+#define PCI_BAR_IO 0x01
+#define PCI_BAR_IO_MASK 0xfffffffc
+#define PCI_BAR_MEM_TYPE_64 0x04
+#define PCI_BAR_MEM_PREFETCH 0x08
+#define PCI_BAR_MEM_MASK 0xfffffff0
+
+#define PCI_TYPE_GENERIC 0x00
+#define PCI_TYPE_BRIDGE 0x01
+#define PCI_TYPE_CARDBUS_BRIDGE 0x02
+#define PCI_TYPE_MULTIFUNC 0x80
+
+#define PCI_CAP_ID_MSI 0x05
+#define PCI_CAP_ID_MSIX 0x11
+
+#define PCI_MSI_FLAGS 0x02
+#define PCI_MSI_FLAGS_ENABLE (1 << 0)
+#define PCI_MSI_FLAGS_QMASK (7 << 1)
+#define PCI_MSI_FLAGS_QSIZE (7 << 4)
+#define PCI_MSI_FLAGS_64BIT (1 << 7)
+#define PCI_MSI_ADDRESS_LO 0x04
+#define PCI_MSI_ADDRESS_HI 0x08
+#define PCI_MSI_DATA_32 0x08
+#define PCI_MSI_DATA_64 0x0c
+
+#define PCI_MSIX_FLAGS 0x02
+#define PCI_MSIX_FLAGS_QSIZE 0x7ff
+#define PCI_MSIX_FLAGS_MASKALL (1 << 14)
+#define PCI_MSIX_FLAGS_ENABLE (1 << 15)
+#define PCI_MSIX_TABLE 0x04
+#define PCI_MSIX_TABLE_BIR 0x07
+
+#define PCI_MSIX_ENTRY_SIZE 16
+#define PCI_MSIX_ENTRY_ADDR_LO 0x00
+#define PCI_MSIX_ENTRY_ADDR_HI 0x04
+#define PCI_MSIX_ENTRY_DATA 0x08
+#define PCI_MSIX_ENTRY_CTRL 0x0c
+#define PCI_MSIX_ENTRY_CTRL_MASKBIT 1
+
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+#define PCI_IRQ_NONE 0
+#define PCI_IRQ_MSI 1
+#define PCI_IRQ_MSIX 2
+
+#define PCI_MAX_VECTORS 32
+
+struct pci_dev;
+
+// implemented by the pci module, drivers only link against the AXAPI so they
+// reach these through pdev->ops
+struct pci_ops {
+	// maps a memory BAR uncached, NULL for I/O or unimplemented BARs
+	void *(*map_bar)(struct pci_dev *pdev, int bar);
+
+	// number of message-signalled vectors the function can raise, MSI-X is
+	// preferred over MSI, 0 if it only does INTx
+	int (*irq_vectors)(struct pci_dev *pdev);
+	// points vector index at a freshly allocated IRQ delivered to cpu
+	int (*irq_setup)(struct pci_dev *pdev, uint16_t index, uint32_t cpu,
+					 void (*callback)(void *), void *ctx);
+	// switches the function from INTx to the vectors set up so far
+	int (*irq_enable)(struct pci_dev *pdev);
+	// gives back a single vector, the last one going takes the whole
+	// release path with it
+	void (*irq_free)(struct pci_dev *pdev, uint16_t index);
+	void (*irq_release)(struct pci_dev *pdev);
+};
+
+// handed to drivers as device->driver_data for every "pci" class device
+struct pci_dev {
+	uint32_t id;
+	uint16_t segment;
+	uint8_t bus;
+	uint8_t dev;
+	uint8_t func;
+
+	// ECAM window of this function, NULL when going through 0xcf8/0xcfc
+	volatile uint8_t *cfg;
+
+	uint16_t vendor_id;
+	uint16_t device_id;
+	uint8_t class;
+	uint8_t subclass;
+	uint8_t prog_intf;
+	uint8_t revision;
+	uint8_t header_type;
+
+	uint8_t irq_line;
+	uint8_t irq_pin;
+
+	// raw BAR registers, plus the decoded base and size of each; the upper
+	// half of a 64-bit BAR has size 0
+	uint32_t bar[6];
+	uint64_t bar_base[6];
+	uint64_t bar_size[6];
+	void *bar_virt[6];
+
+	uint8_t msi_cap;
+	uint8_t msix_cap;
+	uint16_t msix_size;
+	volatile uint8_t *msix_table;
+
+	int irq_mode;
+	uint16_t nr_vectors;
+	uint8_t vectors[PCI_MAX_VECTORS];
+
+	const struct pci_ops *ops;
+};
+
+static inline uint32_t pci_make_id(uint8_t bus, uint8_t dev, uint8_t func)
+{
+	return ((uint32_t)bus << 16) | ((uint32_t)dev << 11) |
+		   ((uint32_t)func << 8);
+}
+
+static inline uint8_t pci_read8(const struct pci_dev *pdev, uint32_t reg)
+{
+	if (pdev->cfg)
+		return *(volatile uint8_t *)(pdev->cfg + (reg & 0xfff));
+
+	ax_outdw(PCI_CONFIG_ADDR, 0x80000000 | pdev->id | (reg & 0xfc));
+	return ax_inb(PCI_CONFIG_DATA + (reg & 0x03));
+}
+
+static inline uint16_t pci_read16(const struct pci_dev *pdev, uint32_t reg)
+{
+	if (pdev->cfg)
+		return *(volatile uint16_t *)(pdev->cfg + (reg & 0xffe));
+
+	ax_outdw(PCI_CONFIG_ADDR, 0x80000000 | pdev->id | (reg & 0xfc));
+	return ax_inw(PCI_CONFIG_DATA + (reg & 0x02));
+}
+
+static inline uint32_t pci_read32(const struct pci_dev *pdev, uint32_t reg)
+{
+	if (pdev->cfg)
+		return *(volatile uint32_t *)(pdev->cfg + (reg & 0xffc));
+
+	ax_outdw(PCI_CONFIG_ADDR, 0x80000000 | pdev->id | (reg & 0xfc));
+	return ax_indw(PCI_CONFIG_DATA);
+}
+
+static inline void pci_write16(const struct pci_dev *pdev, uint32_t reg,
+							   uint16_t val)
+{
+	if (pdev->cfg) {
+		*(volatile uint16_t *)(pdev->cfg + (reg & 0xffe)) = val;
+		return;
+	}
+
+	ax_outdw(PCI_CONFIG_ADDR, 0x80000000 | pdev->id | (reg & 0xfc));
+	ax_outw(PCI_CONFIG_DATA + (reg & 0x02), val);
+}
+
+static inline void pci_write32(const struct pci_dev *pdev, uint32_t reg,
+							   uint32_t val)
+{
+	if (pdev->cfg) {
+		*(volatile uint32_t *)(pdev->cfg + (reg & 0xffc)) = val;
+		return;
+	}
+
+	ax_outdw(PCI_CONFIG_ADDR, 0x80000000 | pdev->id | (reg & 0xfc));
+	ax_outdw(PCI_CONFIG_DATA, val);
+}
+
+static inline void pci_enable(const struct pci_dev *pdev, uint16_t bits)
+{
+	uint16_t cmd = pci_read16(pdev, PCI_CONFIG_COMMAND);
+	pci_write16(pdev, PCI_CONFIG_COMMAND, cmd | bits);
+}
+
+static inline void *pci_map_bar(struct pci_dev *pdev, int bar)
+{
+	return pdev->ops->map_bar(pdev, bar);
+}
+
+static inline int pci_irq_vectors(struct pci_dev *pdev)
+{
+	return pdev->ops->irq_vectors(pdev);
+}
+
+static inline int pci_irq_setup(struct pci_dev *pdev, uint16_t index,
+								uint32_t cpu, void (*callback)(void *),
+								void *ctx)
+{
+	return pdev->ops->irq_setup(pdev, index, cpu, callback, ctx);
+}
+
+static inline int pci_irq_enable(struct pci_dev *pdev)
+{
+	return pdev->ops->irq_enable(pdev);
+}
+
+static inline void pci_irq_free(struct pci_dev *pdev, uint16_t index)
+{
+	pdev->ops->irq_free(pdev, index);
+}
+
+static inline void pci_irq_release(struct pci_dev *pdev)
+{
+	pdev->ops->irq_release(pdev);
+}
+
+// ACPI MCFG, one entry per PCI segment group with an ECAM window
+struct mcfg_entry {
+	uint64_t base;
+	uint16_t segment;
+	uint8_t start_bus;
+	uint8_t end_bus;
+	uint32_t reserved;
+} __attribute__((packed));
+
+struct mcfg {
+	struct sdt_header hdr;
+	uint64_t reserved;
+	struct mcfg_entry entries[];
+} __attribute__((packed));
+
 #endif /* _PCI_H */
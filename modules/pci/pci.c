@@ -25,6 +25,7 @@
 #include <dev/driver.h>
 #include <config.h>
 #include <pci.h>
+#include <sys/errno.h>
 
 #include <stddef.h>
 #include <stdint.h>
@@ -32,27 +33,6 @@
 int mod_init(void);
 void mod_exit(void);
 
-#define PCI_CONFIG_VENDOR_ID 0x00
-#define PCI_CONFIG_DEVICE_ID 0x02
-#define PCI_CONFIG_COMMAND 0x04
-#define PCI_CONFIG_STATUS 0x06
-#define PCI_CONFIG_REVISION_ID 0x08
-#define PCI_CONFIG_PROG_INTF 0x09
-#define PCI_CONFIG_SUBCLASS 0x0a
-#define PCI_CONFIG_CLASS_CODE 0x0b
-#define PCI_CONFIG_CACHELINE_SIZE 0x0c
-#define PCI_CONFIG_LATENCY 0x0d
-#define PCI_CONFIG_HEADER_TYPE 0x0e
-#define PCI_CONFIG_BIST 0x0f
-
-#define PCI_TYPE_GENERIC 0x00
-#define PCI_TYPE_BRIDGE 0x01
-#define PCI_TYPE_CARDBUS_BRIDGE 0x02
-#define PCI_TYPE_MULTIFUNC 0x80
-
-#define PCI_CONFIG_ADDR 0xcf8
-#define PCI_CONFIG_DATA 0xcfc
-
 __attribute__((section(".aurix.mod"))) const struct axmod_info modinfo = {
 	.name = "pci",
 	.desc = "PCI driver",
@@ -62,82 +42,463 @@ __attribute__((section(".aurix.mod"))) const struct axmod_info modinfo = {
 	.mod_exit = mod_exit,
 };
 
-static int probe(struct device *dev)
+static struct device_ops pci_dev_ops = { 0 };
+
+static struct pci_dev devlist[CONFIG_PCI_MAX_DEVICES];
+static char devnames[CONFIG_PCI_MAX_DEVICES][16];
+static int devcount = 0;
+
+#define PCI_MAX_SEGMENTS 8
+
+struct pci_ecam {
+	uint64_t base;
+	uint16_t segment;
+	uint8_t start_bus;
+	uint8_t end_bus;
+	// buses whose 1 MiB window is already mapped
+	uint8_t mapped[32];
+	// buses already walked, bridges can't send us in circles
+	uint8_t scanned[32];
+};
+
+static struct pci_ecam ecams[PCI_MAX_SEGMENTS];
+static int ecam_count = 0;
+
+// segment 0 through 0xcf8/0xcfc when there's no MCFG
+static struct pci_ecam legacy_seg = { 0 };
+
+static const struct pci_ops pci_bus_ops;
+
+static void pci_ecam_init(void)
 {
-	(void)dev;
-	return 1;
+	struct mcfg *mcfg = find_sdt("MCFG");
+	if (!mcfg)
+		return;
+
+	size_t n = (mcfg->hdr.len - sizeof(struct mcfg)) / sizeof(struct mcfg_entry);
+	for (size_t i = 0; i < n && ecam_count < PCI_MAX_SEGMENTS; i++) {
+		struct mcfg_entry *e = &mcfg->entries[i];
+		struct pci_ecam *ecam = &ecams[ecam_count++];
+
+		memset(ecam, 0, sizeof(*ecam));
+		ecam->base = e->base;
+		ecam->segment = e->segment;
+		ecam->start_bus = e->start_bus;
+		ecam->end_bus = e->end_bus;
+
+		mod_log("ECAM segment %u, buses %02x-%02x at 0x%llx\n", e->segment,
+				e->start_bus, e->end_bus, e->base);
+	}
 }
 
-static struct driver pci_driver = {
-	.name = "pci",
-	.class_name = "pci",
-	.probe = probe,
-	.remove = 0,
-};
+static volatile uint8_t *pci_ecam_cfg(struct pci_ecam *ecam, uint8_t bus,
+									  uint8_t dev, uint8_t func)
+{
+	if (ecam == &legacy_seg || bus < ecam->start_bus || bus > ecam->end_bus)
+		return NULL;
 
-struct pci_device {
-	uint8_t bus;
-	uint8_t dev;
-	uint8_t func;
-};
+	uint64_t bus_base = ecam->base + ((uint64_t)(bus - ecam->start_bus) << 20);
+	if (!(ecam->mapped[bus / 8] & (1 << (bus % 8)))) {
+		ax_map_mmio(bus_base, 1 << 20);
+		ecam->mapped[bus / 8] |= 1 << (bus % 8);
+	}
 
-struct pci_devinfo {
-	uint16_t vendor_id;
-	uint16_t device_id;
-	uint8_t class;
-	uint8_t subclass;
-	uint8_t prog_intf;
-};
+	return (volatile uint8_t *)ax_phys_to_virt(bus_base) +
+		   ((uint32_t)dev << 15) + ((uint32_t)func << 12);
+}
+
+static void pci_size_bars(struct pci_dev *pdev, int count)
+{
+	// no decoding while the BARs hold the all-ones probe pattern
+	uint16_t cmd = pci_read16(pdev, PCI_CONFIG_COMMAND);
+	pci_write16(pdev, PCI_CONFIG_COMMAND,
+				cmd & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+	for (int i = 0; i < count; i++) {
+		uint32_t reg = PCI_CONFIG_BAR0 + i * 4;
+		uint32_t orig = pci_read32(pdev, reg);
+		pdev->bar[i] = orig;
+
+		pci_write32(pdev, reg, 0xffffffff);
+		uint32_t mask = pci_read32(pdev, reg);
+		pci_write32(pdev, reg, orig);
+
+		if (orig & PCI_BAR_IO) {
+			pdev->bar_base[i] = orig & PCI_BAR_IO_MASK;
+			mask &= PCI_BAR_IO_MASK & 0xffff;
+			pdev->bar_size[i] = mask ? (~mask & 0xffff) + 1 : 0;
+			continue;
+		}
+
+		uint64_t base = orig & PCI_BAR_MEM_MASK;
+		uint64_t size_mask = mask & PCI_BAR_MEM_MASK;
+
+		if ((orig & 0x06) == PCI_BAR_MEM_TYPE_64 && i + 1 < count) {
+			uint32_t hreg = reg + 4;
+			uint32_t horig = pci_read32(pdev, hreg);
+			pci_write32(pdev, hreg, 0xffffffff);
+			uint32_t hmask = pci_read32(pdev, hreg);
+			pci_write32(pdev, hreg, horig);
+
+			base |= (uint64_t)horig << 32;
+			size_mask |= (uint64_t)hmask << 32;
+
+			pdev->bar_base[i] = base;
+			pdev->bar_size[i] = size_mask ? ~size_mask + 1 : 0;
+
+			i++;
+			pdev->bar[i] = horig;
+			continue;
+		}
+
+		pdev->bar_base[i] = base;
+		pdev->bar_size[i] = size_mask ? (uint32_t)(~size_mask + 1) : 0;
+	}
+
+	pci_write16(pdev, PCI_CONFIG_COMMAND, cmd);
+}
+
+static void pci_find_caps(struct pci_dev *pdev)
+{
+	if (!(pci_read16(pdev, PCI_CONFIG_STATUS) & PCI_STATUS_CAP_LIST))
+		return;
+
+	uint8_t ptr = pci_read8(pdev, PCI_CONFIG_CAPABILITIES) & 0xfc;
+	// the list lives in the first 256 bytes, bound the walk in case it loops
+	for (int n = 0; ptr && n < 48; n++) {
+		uint8_t id = pci_read8(pdev, ptr);
+		if (id == PCI_CAP_ID_MSI && !pdev->msi_cap) {
+			pdev->msi_cap = ptr;
+		} else if (id == PCI_CAP_ID_MSIX && !pdev->msix_cap) {
+			pdev->msix_cap = ptr;
+			pdev->msix_size =
+				(pci_read16(pdev, ptr + PCI_MSIX_FLAGS) & PCI_MSIX_FLAGS_QSIZE) +
+				1;
+		}
+		ptr = pci_read8(pdev, ptr + 1) & 0xfc;
+	}
+}
+
+static void pci_scan_bus(struct pci_ecam *ecam, uint8_t bus);
+
+static void pci_visit(struct pci_ecam *ecam, uint8_t bus, uint8_t dev,
+					  uint8_t func)
+{
+	struct pci_dev probe = {
+		.id = pci_make_id(bus, dev, func),
+		.cfg = pci_ecam_cfg(ecam, bus, dev, func),
+	};
+	if (ecam != &legacy_seg && !probe.cfg)
+		return;
+
+	uint16_t vendor_id = pci_read16(&probe, PCI_CONFIG_VENDOR_ID);
+	if (vendor_id == 0xffff) {
+		return;
+	}
+
+	uint8_t header_type = pci_read8(&probe, PCI_CONFIG_HEADER_TYPE) &
+						  ~PCI_TYPE_MULTIFUNC;
+
+	if (devcount >= CONFIG_PCI_MAX_DEVICES) {
+		mod_log("Too many PCI devices, ignoring %02x:%02x.%d\n", bus, dev,
+				func);
+	} else {
+		struct pci_dev *pdev = &devlist[devcount];
+		*pdev = probe;
+		pdev->segment = ecam->segment;
+		pdev->bus = bus;
+		pdev->dev = dev;
+		pdev->func = func;
+		pdev->vendor_id = vendor_id;
+		pdev->device_id = pci_read16(pdev, PCI_CONFIG_DEVICE_ID);
+		pdev->revision = pci_read8(pdev, PCI_CONFIG_REVISION_ID);
+		pdev->prog_intf = pci_read8(pdev, PCI_CONFIG_PROG_INTF);
+		pdev->subclass = pci_read8(pdev, PCI_CONFIG_SUBCLASS);
+		pdev->class = pci_read8(pdev, PCI_CONFIG_CLASS_CODE);
+		pdev->header_type = header_type;
+		pdev->irq_line = pci_read8(pdev, PCI_CONFIG_INTERRUPT_LINE);
+		pdev->irq_pin = pci_read8(pdev, PCI_CONFIG_INTERRUPT_PIN);
+		pdev->ops = &pci_bus_ops;
+
+		if (header_type == PCI_TYPE_GENERIC)
+			pci_size_bars(pdev, 6);
+		else if (header_type == PCI_TYPE_BRIDGE)
+			pci_size_bars(pdev, 2);
+		pci_find_caps(pdev);
+
+		mod_log("Found device %04x:%02x:%02x.%d 0x%04x/0x%04x class "
+				"%02x:%02x%s%s\n",
+				ecam->segment, bus, dev, func, pdev->vendor_id,
+				pdev->device_id, pdev->class, pdev->subclass,
+				pdev->msi_cap ? " msi" : "", pdev->msix_cap ? " msi-x" : "");
+
+		char *name = devnames[devcount];
+		if (ecam->segment)
+			snprintf(name, sizeof(devnames[0]), "pci%04x:%02x:%02x.%d",
+					 ecam->segment, bus, dev, func);
+		else
+			snprintf(name, sizeof(devnames[0]), "pci%02x:%02x.%d", bus, dev,
+					 func);
+
+		struct device device = {
+			.name = name,
+			.class_name = PCI_DEVICE_CLASS,
+			.dev_node_path = name,
+			.driver_data = pdev,
+			.bound_driver = 0,
+			.ops = &pci_dev_ops,
+			.next = 0,
+		};
+
+		if (device_register(&device) == 0)
+			devcount++;
+	}
+
+	if (header_type == PCI_TYPE_BRIDGE) {
+		uint8_t secondary = pci_read8(&probe, PCI_CONFIG_SECONDARY_BUS);
+		if (secondary > bus)
+			pci_scan_bus(ecam, secondary);
+	}
+}
+
+static void pci_scan_bus(struct pci_ecam *ecam, uint8_t bus)
+{
+	if (ecam->scanned[bus / 8] & (1 << (bus % 8)))
+		return;
+	ecam->scanned[bus / 8] |= 1 << (bus % 8);
 
-struct pci_device devlist[CONFIG_PCI_MAX_DEVICES];
+	for (uint8_t dev = 0; dev < 32; dev++) {
+		struct pci_dev probe = {
+			.id = pci_make_id(bus, dev, 0),
+			.cfg = pci_ecam_cfg(ecam, bus, dev, 0),
+		};
+		if (ecam != &legacy_seg && !probe.cfg)
+			return;
+		if (pci_read16(&probe, PCI_CONFIG_VENDOR_ID) == 0xffff)
+			continue;
+
+		uint8_t header_type = pci_read8(&probe, PCI_CONFIG_HEADER_TYPE);
+		uint8_t func_count = header_type & PCI_TYPE_MULTIFUNC ? 8 : 1;
+
+		for (uint8_t func = 0; func < func_count; func++) {
+			pci_visit(ecam, bus, dev, func);
+		}
+	}
+}
 
-uint8_t pci_read8(uint32_t id, uint32_t reg)
+static void pci_scan_segment(struct pci_ecam *ecam)
 {
-	uint32_t addr = 0x80000000 | id | (reg & 0xfc);
-	ax_outdw(PCI_CONFIG_ADDR, addr);
-	return ax_inb(PCI_CONFIG_DATA + (reg & 0x03));
+	uint8_t root = ecam->start_bus;
+	struct pci_dev host = {
+		.id = pci_make_id(root, 0, 0),
+		.cfg = pci_ecam_cfg(ecam, root, 0, 0),
+	};
+
+	// a multi-function host bridge means one root bus per function
+	if (ecam != &legacy_seg && !host.cfg)
+		return;
+	if (!(pci_read8(&host, PCI_CONFIG_HEADER_TYPE) & PCI_TYPE_MULTIFUNC)) {
+		pci_scan_bus(ecam, root);
+		return;
+	}
+
+	for (uint8_t func = 0; func < 8; func++) {
+		host.id = pci_make_id(root, 0, func);
+		host.cfg = pci_ecam_cfg(ecam, root, 0, func);
+		if (pci_read16(&host, PCI_CONFIG_VENDOR_ID) == 0xffff)
+			continue;
+		pci_scan_bus(ecam, (uint8_t)(root + func));
+	}
 }
 
-uint16_t pci_read16(uint32_t id, uint32_t reg)
+static void *pci_dev_map_bar(struct pci_dev *pdev, int bar)
 {
-	uint32_t addr = 0x80000000 | id | (reg & 0xfc);
-	ax_outdw(PCI_CONFIG_ADDR, addr);
-	return ax_inw(PCI_CONFIG_DATA + (reg & 0x02));
+	if (bar < 0 || bar >= 6 || !pdev->bar_size[bar] ||
+		(pdev->bar[bar] & PCI_BAR_IO))
+		return NULL;
+
+	if (!pdev->bar_virt[bar]) {
+		pdev->bar_virt[bar] =
+			ax_map_mmio(pdev->bar_base[bar], pdev->bar_size[bar]);
+		pci_enable(pdev, PCI_COMMAND_MEMORY);
+	}
+
+	return pdev->bar_virt[bar];
+}
+
+static int pci_dev_irq_vectors(struct pci_dev *pdev)
+{
+	if (pdev->msix_cap)
+		return pdev->msix_size < PCI_MAX_VECTORS ? pdev->msix_size :
+												   PCI_MAX_VECTORS;
+	if (pdev->msi_cap)
+		return 1;
+	return 0;
 }
 
-void pci_visit(uint8_t bus, uint8_t dev, uint8_t func)
+static volatile uint8_t *pci_msix_table(struct pci_dev *pdev)
 {
-	uint32_t id = (bus << 16) | (dev << 11) | (func << 8);
-	struct pci_devinfo info;
-	info.vendor_id = pci_read16(id, PCI_CONFIG_VENDOR_ID);
-	if (info.vendor_id == 0xffff) {
+	if (pdev->msix_table)
+		return pdev->msix_table;
+
+	uint32_t table = pci_read32(pdev, pdev->msix_cap + PCI_MSIX_TABLE);
+	uint8_t *bar = pci_dev_map_bar(pdev, table & PCI_MSIX_TABLE_BIR);
+	if (!bar)
+		return NULL;
+
+	pdev->msix_table = bar + (table & ~PCI_MSIX_TABLE_BIR);
+	return pdev->msix_table;
+}
+
+static int pci_dev_irq_setup(struct pci_dev *pdev, uint16_t index,
+							 uint32_t cpu, void (*callback)(void *), void *ctx)
+{
+	if ((int)index >= pci_dev_irq_vectors(pdev))
+		return -EINVAL;
+
+	int irq = irq_alloc(callback, ctx);
+	if (irq < 0)
+		return irq;
+
+	uint64_t addr;
+	uint32_t data;
+	int err = irq_msi_message((uint8_t)irq, cpu, &addr, &data);
+	if (err != 0) {
+		irq_uninstall((uint8_t)irq);
+		return err;
+	}
+
+	if (pdev->msix_cap) {
+		volatile uint8_t *table = pci_msix_table(pdev);
+		if (!table) {
+			irq_uninstall((uint8_t)irq);
+			return -ENODEV;
+		}
+
+		volatile uint8_t *e = table + (size_t)index * PCI_MSIX_ENTRY_SIZE;
+		volatile uint32_t *ctrl = (volatile uint32_t *)(e + PCI_MSIX_ENTRY_CTRL);
+		*ctrl |= PCI_MSIX_ENTRY_CTRL_MASKBIT;
+		*(volatile uint32_t *)(e + PCI_MSIX_ENTRY_ADDR_LO) = (uint32_t)addr;
+		*(volatile uint32_t *)(e + PCI_MSIX_ENTRY_ADDR_HI) =
+			(uint32_t)(addr >> 32);
+		*(volatile uint32_t *)(e + PCI_MSIX_ENTRY_DATA) = data;
+		*ctrl &= ~PCI_MSIX_ENTRY_CTRL_MASKBIT;
+	} else {
+		uint8_t cap = pdev->msi_cap;
+		uint16_t flags = pci_read16(pdev, cap + PCI_MSI_FLAGS);
+		pci_write32(pdev, cap + PCI_MSI_ADDRESS_LO, (uint32_t)addr);
+		if (flags & PCI_MSI_FLAGS_64BIT) {
+			pci_write32(pdev, cap + PCI_MSI_ADDRESS_HI, (uint32_t)(addr >> 32));
+			pci_write16(pdev, cap + PCI_MSI_DATA_64, (uint16_t)data);
+		} else {
+			pci_write16(pdev, cap + PCI_MSI_DATA_32, (uint16_t)data);
+		}
+	}
+
+	// re-pointing a vector drops the IRQ it used to have
+	if (index < pdev->nr_vectors && pdev->vectors[index])
+		irq_uninstall(pdev->vectors[index]);
+
+	pdev->vectors[index] = (uint8_t)irq;
+	if (index >= pdev->nr_vectors)
+		pdev->nr_vectors = index + 1;
+
+	return irq;
+}
+
+static int pci_dev_irq_enable(struct pci_dev *pdev)
+{
+	if (!pdev->nr_vectors)
+		return -EINVAL;
+
+	if (pdev->msix_cap) {
+		uint16_t flags = pci_read16(pdev, pdev->msix_cap + PCI_MSIX_FLAGS);
+		flags |= PCI_MSIX_FLAGS_ENABLE;
+		flags &= ~PCI_MSIX_FLAGS_MASKALL;
+		pci_write16(pdev, pdev->msix_cap + PCI_MSIX_FLAGS, flags);
+		pdev->irq_mode = PCI_IRQ_MSIX;
+	} else {
+		uint16_t flags = pci_read16(pdev, pdev->msi_cap + PCI_MSI_FLAGS);
+		flags &= ~PCI_MSI_FLAGS_QSIZE;
+		flags |= PCI_MSI_FLAGS_ENABLE;
+		pci_write16(pdev, pdev->msi_cap + PCI_MSI_FLAGS, flags);
+		pdev->irq_mode = PCI_IRQ_MSI;
+	}
+
+	pci_enable(pdev, PCI_COMMAND_INTX_DISABLE | PCI_COMMAND_BUS_MASTER);
+	return 0;
+}
+
+static void pci_dev_irq_release(struct pci_dev *pdev)
+{
+	if (pdev->msix_cap) {
+		uint16_t flags = pci_read16(pdev, pdev->msix_cap + PCI_MSIX_FLAGS);
+		pci_write16(pdev, pdev->msix_cap + PCI_MSIX_FLAGS,
+					flags & ~PCI_MSIX_FLAGS_ENABLE);
+	} else if (pdev->msi_cap) {
+		uint16_t flags = pci_read16(pdev, pdev->msi_cap + PCI_MSI_FLAGS);
+		pci_write16(pdev, pdev->msi_cap + PCI_MSI_FLAGS,
+					flags & ~PCI_MSI_FLAGS_ENABLE);
+	}
+
+	for (uint16_t i = 0; i < pdev->nr_vectors; i++) {
+		if (pdev->vectors[i])
+			irq_uninstall(pdev->vectors[i]);
+		pdev->vectors[i] = 0;
+	}
+	pdev->nr_vectors = 0;
+	pdev->irq_mode = PCI_IRQ_NONE;
+
+	uint16_t cmd = pci_read16(pdev, PCI_CONFIG_COMMAND);
+	pci_write16(pdev, PCI_CONFIG_COMMAND, cmd & ~PCI_COMMAND_INTX_DISABLE);
+}
+
+static void pci_dev_irq_free(struct pci_dev *pdev, uint16_t index)
+{
+	if (index >= pdev->nr_vectors || !pdev->vectors[index])
 		return;
+
+	if (pdev->msix_cap && pdev->msix_table) {
+		volatile uint8_t *e =
+			pdev->msix_table + (size_t)index * PCI_MSIX_ENTRY_SIZE;
+		*(volatile uint32_t *)(e + PCI_MSIX_ENTRY_CTRL) |=
+			PCI_MSIX_ENTRY_CTRL_MASKBIT;
 	}
 
-	info.device_id = pci_read16(id, PCI_CONFIG_DEVICE_ID);
-	info.prog_intf = pci_read8(id, PCI_CONFIG_PROG_INTF);
-	info.subclass = pci_read8(id, PCI_CONFIG_SUBCLASS);
-	info.class = pci_read8(id, PCI_CONFIG_CLASS_CODE);
+	irq_uninstall(pdev->vectors[index]);
+	pdev->vectors[index] = 0;
+	while (pdev->nr_vectors && !pdev->vectors[pdev->nr_vectors - 1])
+		pdev->nr_vectors--;
 
-	mod_log("Found device %02x:%02x:%d 0x%04x/0x%04x\n", bus, dev, func, info.vendor_id, info.device_id);
+	if (pdev->nr_vectors == 0)
+		pci_dev_irq_release(pdev);
 }
 
+static const struct pci_ops pci_bus_ops = {
+	.map_bar = pci_dev_map_bar,
+	.irq_vectors = pci_dev_irq_vectors,
+	.irq_setup = pci_dev_irq_setup,
+	.irq_enable = pci_dev_irq_enable,
+	.irq_free = pci_dev_irq_free,
+	.irq_release = pci_dev_irq_release,
+};
+
 int mod_init()
 {
+	pci_ecam_init();
+
 	mod_log("Finding PCI devices...\n");
-	for (uint8_t bus = 0; bus < 256; bus++) {
-		for (uint8_t dev = 0; dev = 32; dev++) {
-			uint32_t pciid = (bus << 16) | (dev << 11);
-			uint8_t header_type = pci_read8(pciid, PCI_CONFIG_HEADER_TYPE);
-			uint8_t func_count = header_type & PCI_TYPE_MULTIFUNC ? 8 : 1;
-
-			for (uint8_t func = 0; func < func_count; func++) {
-				pci_visit(bus, dev, func);
-			}
-		}
+	if (ecam_count == 0) {
+		mod_log("No MCFG, using legacy configuration access\n");
+		pci_scan_segment(&legacy_seg);
 	}
+	for (int i = 0; i < ecam_count; i++)
+		pci_scan_segment(&ecams[i]);
+
+	mod_log("Registered %d PCI devices\n", devcount);
 
-	for (;;);
+	// drivers loaded before us are waiting for their devices
+	driver_bind_all();
 
 	return 0;
 }
@@ -0,0 +1,175 @@
+/*********************************************************************************/
+/* Module Name:  virtio_blk.h */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#ifndef _VIRTIO_BLK_H
+#define _VIRTIO_BLK_H
+
+#include <dev/blkdev.h>
+#include <arch/sys/irqlock.h>
+#include <pci.h>
+
+#include <stdint.h>
+
+#define VIRTIO_PCI_VENDOR 0x1af4
+// transitional virtio-blk, the one QEMU exposes with -drive if=virtio
+#define VIRTIO_PCI_DEVICE_BLK 0x1001
+
+// legacy virtio-pci register block in BAR0 (I/O space)
+#define VIRTIO_PCI_HOST_FEATURES 0x00
+#define VIRTIO_PCI_GUEST_FEATURES 0x04
+#define VIRTIO_PCI_QUEUE_PFN 0x08
+#define VIRTIO_PCI_QUEUE_NUM 0x0c
+#define VIRTIO_PCI_QUEUE_SEL 0x0e
+#define VIRTIO_PCI_QUEUE_NOTIFY 0x10
+#define VIRTIO_PCI_STATUS 0x12
+#define VIRTIO_PCI_ISR 0x13
+#define VIRTIO_PCI_CONFIG 0x14
+// with MSI-X enabled two vector registers sit in front of the device config
+#define VIRTIO_MSI_CONFIG_VECTOR 0x14
+#define VIRTIO_MSI_QUEUE_VECTOR 0x16
+#define VIRTIO_PCI_CONFIG_MSIX 0x18
+#define VIRTIO_MSI_NO_VECTOR 0xffff
+
+#define VIRTIO_PCI_QUEUE_ADDR_SHIFT 12
+#define VIRTIO_PCI_VRING_ALIGN 4096
+
+#define VIRTIO_ISR_QUEUE (1 << 0)
+#define VIRTIO_ISR_CONFIG (1 << 1)
+
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER 0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FAILED 0x80
+
+#define VIRTIO_BLK_F_SIZE_MAX (1u << 1)
+#define VIRTIO_BLK_F_SEG_MAX (1u << 2)
+#define VIRTIO_BLK_F_RO (1u << 5)
+#define VIRTIO_BLK_F_BLK_SIZE (1u << 6)
+#define VIRTIO_BLK_F_FLUSH (1u << 9)
+#define VIRTIO_BLK_F_MQ (1u << 12)
+#define VIRTIO_RING_F_INDIRECT_DESC (1u << 28)
+
+// offsets into the device config space
+#define VIRTIO_BLK_CFG_CAPACITY 0x00
+#define VIRTIO_BLK_CFG_SEG_MAX 0x0c
+#define VIRTIO_BLK_CFG_NUM_QUEUES 0x22
+
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_T_FLUSH 4
+
+#define VIRTIO_BLK_S_OK 0
+
+#define VRING_DESC_F_NEXT 1
+#define VRING_DESC_F_WRITE 2
+#define VRING_DESC_F_INDIRECT 4
+
+#define VRING_AVAIL_F_NO_INTERRUPT 1
+#define VRING_USED_F_NO_NOTIFY 1
+
+struct vring_desc {
+	uint64_t addr;
+	uint32_t len;
+	uint16_t flags;
+	uint16_t next;
+} __attribute__((packed));
+
+struct vring_avail {
+	uint16_t flags;
+	uint16_t idx;
+	uint16_t ring[];
+} __attribute__((packed));
+
+struct vring_used_elem {
+	uint32_t id;
+	uint32_t len;
+} __attribute__((packed));
+
+struct vring_used {
+	uint16_t flags;
+	uint16_t idx;
+	struct vring_used_elem ring[];
+} __attribute__((packed));
+
+struct virtio_blk_req_hdr {
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t sector;
+} __attribute__((packed));
+
+#define VBLK_MAX_DEVICES 4
+#define VBLK_MAX_QUEUES 8
+#define VBLK_QUEUE_DEPTH 64
+
+// every request takes one ring descriptor pointing at an indirect table in
+// its slot, the header and status byte live at the end of the same slot
+#define VBLK_SLOT_SIZE 2048
+#define VBLK_INDIRECT_MAX 120
+#define VBLK_SLOT_HDR 1920
+#define VBLK_SLOT_STATUS 1936
+
+#define VBLK_MAX_SEGMENTS 32
+#define VBLK_MAX_SECTORS 512
+
+struct vblk;
+
+struct vblk_queue {
+	struct vblk *vb;
+	uint16_t index;
+	uint16_t size;
+
+	struct vring_desc *desc;
+	struct vring_avail *avail;
+	struct vring_used *used;
+	uint16_t last_used;
+
+	uint8_t *slots;
+	uintptr_t slots_phys;
+
+	// descriptors handed out, the ring may be smaller than VBLK_QUEUE_DEPTH
+	uint16_t depth;
+	uint16_t free_ids[VBLK_QUEUE_DEPTH];
+	uint16_t nr_free;
+	struct blk_request *reqs[VBLK_QUEUE_DEPTH];
+
+	irqlock_t lock;
+
+	uint64_t submitted;
+	uint64_t completed;
+	uint64_t kicks;
+};
+
+struct vblk {
+	struct pci_dev *pdev;
+	uint16_t iobase;
+	uint16_t cfg;
+	bool msix;
+	uint32_t features;
+	uint64_t capacity;
+
+	uint16_t nr_queues;
+	struct vblk_queue queues[VBLK_MAX_QUEUES];
+
+	uint64_t irqs;
+
+	bool registered;
+	struct blkdev bdev;
+};
+
+#endif /* _VIRTIO_BLK_H */
@@ -0,0 +1,529 @@
+/*********************************************************************************/
+/* Module Name:  virtio_blk.c */
+/* Project:      AurixOS */
+/*                                                                               */
+/* Copyright (c) 2024-2026 Jozef Nagy */
+/*                                                                               */
+/* This source is subject to the MIT License. */
+/* See License.txt in the root of this repository. */
+/* All other rights reserved. */
+/*                                                                               */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE */
+/* SOFTWARE. */
+/*********************************************************************************/
+
+#include <aurix/axapi.h>
+#include <sys/aurix/mod.h>
+#include <sys/errno.h>
+#include <dev/driver.h>
+#include <dev/blkdev.h>
+#include <virtio_blk.h>
+#include <pci.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+int mod_init(void);
+void mod_exit(void);
+
+__attribute__((section(".aurix.mod"))) const struct axmod_info modinfo = {
+	.name = "virtio-blk",
+	.desc = "virtio block device driver",
+	.author = "Jozef Nagy",
+
+	.mod_init = mod_init,
+	.mod_exit = mod_exit,
+};
+
+static struct vblk vblks[VBLK_MAX_DEVICES];
+static int vblk_count = 0;
+
+#define mb() __asm__ volatile("mfence" ::: "memory")
+
+static inline uint8_t vblk_cfg8(struct vblk *vb, uint16_t off)
+{
+	return ax_inb(vb->iobase + vb->cfg + off);
+}
+
+static inline uint16_t vblk_cfg16(struct vblk *vb, uint16_t off)
+{
+	return ax_inw(vb->iobase + vb->cfg + off);
+}
+
+static inline uint32_t vblk_cfg32(struct vblk *vb, uint16_t off)
+{
+	return ax_indw(vb->iobase + vb->cfg + off);
+}
+
+static void vblk_set_status(struct vblk *vb, uint8_t bits)
+{
+	uint8_t status = bits ? ax_inb(vb->iobase + VIRTIO_PCI_STATUS) | bits : 0;
+	ax_outb(vb->iobase + VIRTIO_PCI_STATUS, status);
+}
+
+static size_t vring_bytes(uint16_t num)
+{
+	size_t ring = sizeof(struct vring_desc) * num + sizeof(uint16_t) * (3 + num);
+	ring = (ring + VIRTIO_PCI_VRING_ALIGN - 1) & ~(VIRTIO_PCI_VRING_ALIGN - 1);
+	return ring + sizeof(uint16_t) * 3 + sizeof(struct vring_used_elem) * num;
+}
+
+static int vblk_setup_queue(struct vblk *vb, uint16_t index)
+{
+	struct vblk_queue *q = &vb->queues[index];
+
+	ax_outw(vb->iobase + VIRTIO_PCI_QUEUE_SEL, index);
+	uint16_t num = ax_inw(vb->iobase + VIRTIO_PCI_QUEUE_NUM);
+	if (num == 0)
+		return -ENODEV;
+
+	if (vb->msix) {
+		// MSI-X vector n belongs to queue n
+		ax_outw(vb->iobase + VIRTIO_MSI_QUEUE_VECTOR, index);
+		if (ax_inw(vb->iobase + VIRTIO_MSI_QUEUE_VECTOR) != index)
+			return -ENOSPC;
+	}
+
+	// legacy devices fix the ring size, the ring has to be physically
+	// contiguous and page aligned
+	size_t ring_pages = (vring_bytes(num) + 4095) / 4096;
+	uintptr_t ring_phys = (uintptr_t)palloc(ring_pages);
+	if (!ring_phys)
+		return -ENOMEM;
+
+	uint16_t depth = num < VBLK_QUEUE_DEPTH ? num : VBLK_QUEUE_DEPTH;
+	size_t slot_pages = (depth * VBLK_SLOT_SIZE + 4095) / 4096;
+	uintptr_t slots_phys = (uintptr_t)palloc(slot_pages);
+	if (!slots_phys) {
+		pfree((void *)ring_phys, ring_pages);
+		return -ENOMEM;
+	}
+
+	uint8_t *ring = ax_phys_to_virt(ring_phys);
+	q->vb = vb;
+	q->index = index;
+	q->size = num;
+	q->desc = (struct vring_desc *)ring;
+	q->avail = (struct vring_avail *)(ring + sizeof(struct vring_desc) * num);
+	size_t used_off = sizeof(struct vring_desc) * num +
+					  sizeof(uint16_t) * (3 + num);
+	used_off = (used_off + VIRTIO_PCI_VRING_ALIGN - 1) &
+			   ~(VIRTIO_PCI_VRING_ALIGN - 1);
+	q->used = (struct vring_used *)(ring + used_off);
+	q->last_used = 0;
+
+	q->slots = ax_phys_to_virt(slots_phys);
+	q->slots_phys = slots_phys;
+
+	// only the first depth descriptors are ever handed out
+	q->depth = depth;
+	q->nr_free = depth;
+	for (uint16_t i = 0; i < depth; i++)
+		q->free_ids[i] = depth - 1 - i;
+
+	irqlock_init(&q->lock);
+
+	ax_outdw(vb->iobase + VIRTIO_PCI_QUEUE_PFN,
+			 (uint32_t)(ring_phys >> VIRTIO_PCI_QUEUE_ADDR_SHIFT));
+
+	return 0;
+}
+
+// fills the indirect table for req, returns the number of descriptors used
+static int vblk_build_table(struct vblk_queue *q, uint16_t id,
+							struct blk_request *req)
+{
+	uint8_t *slot = q->slots + (size_t)id * VBLK_SLOT_SIZE;
+	uintptr_t slot_phys = q->slots_phys + (size_t)id * VBLK_SLOT_SIZE;
+	struct vring_desc *table = (struct vring_desc *)slot;
+	struct virtio_blk_req_hdr *hdr =
+		(struct virtio_blk_req_hdr *)(slot + VBLK_SLOT_HDR);
+	volatile uint8_t *status = slot + VBLK_SLOT_STATUS;
+
+	switch (req->op) {
+	case BLK_OP_READ:
+		hdr->type = VIRTIO_BLK_T_IN;
+		break;
+	case BLK_OP_WRITE:
+		hdr->type = VIRTIO_BLK_T_OUT;
+		break;
+	case BLK_OP_FLUSH:
+		hdr->type = VIRTIO_BLK_T_FLUSH;
+		break;
+	default:
+		return -EINVAL;
+	}
+	hdr->reserved = 0;
+	hdr->sector = req->op == BLK_OP_FLUSH ? 0 : req->sector;
+	*status = 0xff;
+
+	int n = 0;
+	table[n].addr = slot_phys + VBLK_SLOT_HDR;
+	table[n].len = sizeof(struct virtio_blk_req_hdr);
+	table[n].flags = 0;
+	n++;
+
+	uint16_t data_flags = req->op == BLK_OP_READ ? VRING_DESC_F_WRITE : 0;
+	for (struct blk_bio *bio = req->bios; bio && req->op != BLK_OP_FLUSH;
+		 bio = bio->next) {
+		uintptr_t va = (uintptr_t)bio->buf;
+		size_t left = (size_t)bio->count * q->vb->bdev.sector_size;
+
+		// split at page boundaries, coalescing physically contiguous runs
+		while (left) {
+			size_t chunk = 4096 - (va & 4095);
+			if (chunk > left)
+				chunk = left;
+
+			uintptr_t phys = ax_virt_to_phys((const void *)va);
+			if (!phys)
+				return -EFAULT;
+
+			struct vring_desc *prev = &table[n - 1];
+			if (n > 1 && prev->addr + prev->len == phys) {
+				prev->len += (uint32_t)chunk;
+			} else {
+				if (n >= VBLK_INDIRECT_MAX - 1)
+					return -E2BIG;
+				table[n].addr = phys;
+				table[n].len = (uint32_t)chunk;
+				table[n].flags = data_flags;
+				n++;
+			}
+
+			va += chunk;
+			left -= chunk;
+		}
+	}
+
+	table[n].addr = slot_phys + VBLK_SLOT_STATUS;
+	table[n].len = 1;
+	table[n].flags = VRING_DESC_F_WRITE;
+	n++;
+
+	for (int i = 0; i < n - 1; i++) {
+		table[i].flags |= VRING_DESC_F_NEXT;
+		table[i].next = (uint16_t)(i + 1);
+	}
+	table[n - 1].next = 0;
+
+	return n;
+}
+
+static int vblk_submit(struct blkdev *bdev, struct blk_request *req)
+{
+	struct vblk *vb = bdev->driver_data;
+
+	// one queue per CPU, so submitters on different CPUs never share a lock
+	struct vblk_queue *q = &vb->queues[cpu_get_current_id() % vb->nr_queues];
+
+	irqlock_acquire(&q->lock);
+	if (q->nr_free == 0) {
+		irqlock_release(&q->lock);
+		return -EBUSY;
+	}
+	uint16_t id = q->free_ids[--q->nr_free];
+
+	int n = vblk_build_table(q, id, req);
+	if (n < 0) {
+		q->free_ids[q->nr_free++] = id;
+		irqlock_release(&q->lock);
+		return n;
+	}
+
+	q->desc[id].addr = q->slots_phys + (size_t)id * VBLK_SLOT_SIZE;
+	q->desc[id].len = (uint32_t)(n * sizeof(struct vring_desc));
+	q->desc[id].flags = VRING_DESC_F_INDIRECT;
+	q->desc[id].next = 0;
+	q->reqs[id] = req;
+
+	q->avail->ring[q->avail->idx % q->size] = id;
+	mb();
+	q->avail->idx++;
+	mb();
+
+	q->submitted++;
+	bool kick = !(q->used->flags & VRING_USED_F_NO_NOTIFY);
+	if (kick)
+		q->kicks++;
+	irqlock_release(&q->lock);
+
+	if (kick)
+		ax_outw(vb->iobase + VIRTIO_PCI_QUEUE_NOTIFY, q->index);
+
+	return 0;
+}
+
+static const struct blkdev_ops vblk_ops = {
+	.submit = vblk_submit,
+};
+
+#define VBLK_COMPLETE_BATCH 16
+
+static void vblk_drain(struct vblk_queue *q)
+{
+	struct blk_request *done[VBLK_COMPLETE_BATCH];
+	int status[VBLK_COMPLETE_BATCH];
+
+	for (;;) {
+		int nr = 0;
+
+		irqlock_acquire(&q->lock);
+		// no interrupts while we are reaping anyway
+		q->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+
+		while (nr < VBLK_COMPLETE_BATCH && q->last_used != q->used->idx) {
+			mb();
+			struct vring_used_elem *e =
+				&q->used->ring[q->last_used % q->size];
+			uint16_t id = (uint16_t)e->id;
+			q->last_used++;
+
+			if (id >= VBLK_QUEUE_DEPTH || !q->reqs[id])
+				continue;
+
+			volatile uint8_t *st =
+				q->slots + (size_t)id * VBLK_SLOT_SIZE + VBLK_SLOT_STATUS;
+			done[nr] = q->reqs[id];
+			status[nr] = *st == VIRTIO_BLK_S_OK ? 0 : -EIO;
+			nr++;
+
+			q->reqs[id] = 0;
+			q->free_ids[q->nr_free++] = id;
+		}
+
+		bool more = q->last_used != q->used->idx;
+		if (!more) {
+			q->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+			mb();
+			// catch anything that completed before interrupts came back on
+			more = q->last_used != q->used->idx;
+		}
+		q->completed += nr;
+		irqlock_release(&q->lock);
+
+		// completions may resubmit, which takes the queue lock again
+		for (int i = 0; i < nr; i++)
+			blk_request_complete(done[i], status[i]);
+
+		if (!more && nr < VBLK_COMPLETE_BATCH)
+			break;
+	}
+}
+
+static void vblk_queue_irq(void *ctx)
+{
+	struct vblk_queue *q = ctx;
+
+	// vector 0 is live before the queues are set up
+	if (!q->size)
+		return;
+
+	q->vb->irqs++;
+	vblk_drain(q);
+}
+
+static void vblk_irq(void *ctx)
+{
+	// every device sits on the same handler when they share a line
+	for (int i = 0; i < vblk_count; i++) {
+		struct vblk *vb = &vblks[i];
+		if (!vb->nr_queues || vb->msix)
+			continue;
+
+		// reading the ISR acknowledges the interrupt and drops INTx
+		uint8_t isr = ax_inb(vb->iobase + VIRTIO_PCI_ISR);
+		if (!(isr & VIRTIO_ISR_QUEUE))
+			continue;
+
+		vb->irqs++;
+		for (uint16_t q = 0; q < vb->nr_queues; q++)
+			vblk_drain(&vb->queues[q]);
+	}
+
+	(void)ctx;
+}
+
+static int vblk_init_device(struct vblk *vb, struct pci_dev *pdev)
+{
+	if (!(pdev->bar[0] & PCI_BAR_IO)) {
+		mod_log("%02x:%02x.%d: BAR0 is not I/O, modern-only device?\n",
+				pdev->bus, pdev->dev, pdev->func);
+		return -ENODEV;
+	}
+
+	vb->pdev = pdev;
+	vb->iobase = (uint16_t)(pdev->bar[0] & PCI_BAR_IO_MASK);
+	pci_enable(pdev, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+
+	vblk_set_status(vb, 0);
+	vblk_set_status(vb, VIRTIO_STATUS_ACKNOWLEDGE);
+	vblk_set_status(vb, VIRTIO_STATUS_DRIVER);
+
+	uint32_t host = ax_indw(vb->iobase + VIRTIO_PCI_HOST_FEATURES);
+	if (!(host & VIRTIO_RING_F_INDIRECT_DESC)) {
+		mod_log("device lacks indirect descriptors\n");
+		vblk_set_status(vb, VIRTIO_STATUS_FAILED);
+		return -ENODEV;
+	}
+
+	vb->features = host & (VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_BLK_F_FLUSH |
+						   VIRTIO_BLK_F_MQ | VIRTIO_BLK_F_SEG_MAX |
+						   VIRTIO_BLK_F_RO);
+	ax_outdw(vb->iobase + VIRTIO_PCI_GUEST_FEATURES, vb->features);
+
+	// per-queue vectors aimed at the CPU that submits to the queue; MSI-X
+	// has to be on before the config space is read since it moves it
+	int nvec = pdev->msix_cap ? pci_irq_vectors(pdev) : 0;
+	vb->cfg = VIRTIO_PCI_CONFIG;
+	if (nvec > 0 &&
+		pci_irq_setup(pdev, 0, 0, vblk_queue_irq, &vb->queues[0]) >= 0) {
+		if (pci_irq_enable(pdev) == 0) {
+			vb->msix = true;
+			vb->cfg = VIRTIO_PCI_CONFIG_MSIX;
+			ax_outw(vb->iobase + VIRTIO_MSI_CONFIG_VECTOR,
+					VIRTIO_MSI_NO_VECTOR);
+		} else {
+			pci_irq_release(pdev);
+		}
+	}
+
+	vb->capacity = (uint64_t)vblk_cfg32(vb, VIRTIO_BLK_CFG_CAPACITY) |
+				   ((uint64_t)vblk_cfg32(vb, VIRTIO_BLK_CFG_CAPACITY + 4) << 32);
+
+	uint16_t want = 1;
+	if (vb->features & VIRTIO_BLK_F_MQ)
+		want = vblk_cfg16(vb, VIRTIO_BLK_CFG_NUM_QUEUES);
+	if (want > ax_cpu_count())
+		want = (uint16_t)ax_cpu_count();
+	if (want > VBLK_MAX_QUEUES)
+		want = VBLK_MAX_QUEUES;
+	if (vb->msix && want > nvec)
+		want = (uint16_t)nvec;
+	if (want == 0)
+		want = 1;
+
+	vb->nr_queues = 0;
+	for (uint16_t i = 0; i < want; i++) {
+		bool own_vector = vb->msix && i > 0;
+		if (own_vector &&
+			pci_irq_setup(pdev, i, i % ax_cpu_count(), vblk_queue_irq,
+						  &vb->queues[i]) < 0)
+			break;
+		if (vblk_setup_queue(vb, i) != 0) {
+			// nothing is left behind that could fire into this queue
+			if (own_vector)
+				pci_irq_free(pdev, i);
+			break;
+		}
+		vb->nr_queues++;
+	}
+
+	if (vb->nr_queues == 0) {
+		mod_log("failed to set up any virtqueue\n");
+		if (vb->msix)
+			pci_irq_release(pdev);
+		vblk_set_status(vb, VIRTIO_STATUS_FAILED);
+		return -ENODEV;
+	}
+
+	struct blkdev *bdev = &vb->bdev;
+	memset(bdev, 0, sizeof(*bdev));
+	bdev->sector_size = 512;
+	bdev->sector_count = vb->capacity;
+	bdev->max_sectors = VBLK_MAX_SECTORS;
+	bdev->max_segments = VBLK_MAX_SEGMENTS;
+	// submitters pick their queue by CPU, so only the smallest one's depth
+	// is sure to fit
+	bdev->queue_depth = VBLK_QUEUE_DEPTH;
+	for (uint32_t i = 0; i < vb->nr_queues; i++) {
+		if (vb->queues[i].depth < bdev->queue_depth)
+			bdev->queue_depth = vb->queues[i].depth;
+	}
+	bdev->ops = &vblk_ops;
+	bdev->driver_data = vb;
+
+	if (vb->features & VIRTIO_BLK_F_SEG_MAX) {
+		// every bio may straddle a page, budget two segments each
+		uint32_t seg_max = vblk_cfg32(vb, VIRTIO_BLK_CFG_SEG_MAX);
+		if (seg_max && seg_max < VBLK_INDIRECT_MAX - 2) {
+			bdev->max_segments = seg_max / 2 ? seg_max / 2 : 1;
+			bdev->max_sectors = bdev->max_segments * 8;
+		}
+	}
+
+	if (!vb->msix)
+		irq_install(pdev->irq_line, vblk_irq, NULL);
+
+	vblk_set_status(vb, VIRTIO_STATUS_DRIVER_OK);
+
+	mod_log("%02x:%02x.%d: %llu sectors, %u queue(s), %s%s\n", pdev->bus,
+			pdev->dev, pdev->func, vb->capacity, vb->nr_queues,
+			vb->msix ? "msi-x" : "intx",
+			(vb->features & VIRTIO_BLK_F_FLUSH) ? ", flush" : "");
+
+	return 0;
+}
+
+// runs from driver_bind_all() with the device list locked, so the blkdev
+// is registered from vblk_bound() once it's unlocked
+static int vblk_probe(struct device *dev)
+{
+	struct pci_dev *pdev = dev ? dev->driver_data : 0;
+	if (!pdev || pdev->vendor_id != VIRTIO_PCI_VENDOR ||
+		pdev->device_id != VIRTIO_PCI_DEVICE_BLK)
+		return -1;
+
+	if (vblk_count >= VBLK_MAX_DEVICES)
+		return -1;
+
+	struct vblk *vb = &vblks[vblk_count];
+	memset(vb, 0, sizeof(*vb));
+	if (vblk_init_device(vb, pdev) != 0)
+		return -1;
+
+	vblk_count++;
+	return 0;
+}
+
+static void vblk_bound(void)
+{
+	for (int i = 0; i < vblk_count; i++) {
+		struct vblk *vb = &vblks[i];
+		if (vb->registered)
+			continue;
+
+		vb->registered = true;
+		if (blkdev_register(&vb->bdev) != 0)
+			mod_log("failed to register block device\n");
+	}
+}
+
+static struct driver vblk_driver = {
+	.name = "virtio-blk",
+	.class_name = PCI_DEVICE_CLASS,
+	.probe = vblk_probe,
+	.remove = 0,
+	.bound = vblk_bound,
+};
+
+int mod_init()
+{
+	if (driver_register(&vblk_driver) != 0)
+		return -1;
+
+	// if the pci module isn't up yet, its own bind pass picks us up
+	driver_bind_all();
+
+	return 0;
+}
+
+void mod_exit()
+{
+}
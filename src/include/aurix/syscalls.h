@@ -61,6 +61,34 @@ enum {
 	SYS_UTIMENSAT = 53,
 	SYS_GETPGID = 54,
 	SYS_PSELECT = 55,
+	SYS_SOCKET = 56,
+	SYS_SOCKETPAIR = 57,
+	SYS_BIND = 58,
+	SYS_LISTEN = 59,
+	SYS_ACCEPT = 60,
+	SYS_CONNECT = 61,
+	SYS_SENDMSG = 62,
+	SYS_RECVMSG = 63,
+	SYS_SHUTDOWN = 64,
+	SYS_GETSOCKNAME = 65,
+	SYS_GETPEERNAME = 66,
+	SYS_SPLICE = 67,
+	SYS_TEE = 68,
+	SYS_SENDFILE = 69,
+	SYS_READV = 70,
+	SYS_WRITEV = 71,
+	SYS_PREADV = 72,
+	SYS_PWRITEV = 73,
+	SYS_URING_SETUP = 74,
+	SYS_URING_ENTER = 75,
+	SYS_SETPGID = 76,
+	SYS_SPAWN = 77,
+	SYS_SETPRIORITY = 78,
+	SYS_GETPRIORITY = 79,
+	SYS_SCHED_SETSCHEDULER = 80,
+	SYS_SCHED_GETSCHEDULER = 81,
+	SYS_SCHED_SETAFFINITY = 82,
+	SYS_SCHED_GETAFFINITY = 83,
 };
 
 #define PROT_READ 0x01
@@ -73,8 +101,36 @@ enum {
 #define MAP_ANON 0x20
 #define MAP_ANONYMOUS MAP_ANON
 
+#define WNOHANG 1
+#define WUNTRACED 2
+
+#define SPAWN_OPEN 1
+#define SPAWN_CLOSE 2
+#define SPAWN_DUP2 3
+
+#define SPAWN_SETPGROUP 0x1
+
+#define SCHED_OTHER 0
+#define SCHED_FIFO 1
+#define SCHED_RR 2
+
+#define PRIO_PROCESS 0
+
+struct spawn_action {
+	int op;
+	int fd;
+	int srcfd;
+	int flags;
+	unsigned int mode;
+	unsigned int reserved;
+	const char *path;
+};
+
 typedef int file_t;
 
+struct iovec;
+struct uring_params;
+
 static inline long syscall_ret(long value)
 {
 	if (value < 0 && value >= -4095) {
@@ -238,4 +294,115 @@ static inline int sys_waitpid(int pid, int *status, int options)
 	return (int)syscall_ret(result);
 }
 
+static inline int sys_setpgid(int pid, int pgid)
+{
+	long result = raw_syscall6(SYS_SETPGID, pid, pgid, 0, 0, 0, 0);
+	return (int)syscall_ret(result);
+}
+
+static inline int sys_spawn(const char *path, char *const argv[],
+							char *const envp[],
+							const struct spawn_action *actions, int nactions,
+							int flags)
+{
+	long result = raw_syscall6(SYS_SPAWN, (long)path, (long)argv, (long)envp,
+							   (long)actions, nactions, flags);
+	return (int)syscall_ret(result);
+}
+
+static inline int sys_setpriority(int which, int who, int nice)
+{
+	long result = raw_syscall6(SYS_SETPRIORITY, which, who, nice, 0, 0, 0);
+	return (int)syscall_ret(result);
+}
+
+// the kernel answers 20 - nice so errors stay distinguishable
+static inline int sys_getpriority(int which, int who, int *nice)
+{
+	long result = raw_syscall6(SYS_GETPRIORITY, which, who, 0, 0, 0, 0);
+	if (syscall_ret(result) < 0)
+		return -1;
+	*nice = 20 - (int)result;
+	return 0;
+}
+
+// the kernel's struct sched_param is a single int priority
+static inline int sys_sched_setscheduler(int pid, int policy, int priority)
+{
+	long result = raw_syscall6(SYS_SCHED_SETSCHEDULER, pid, policy,
+							   (long)&priority, 0, 0, 0);
+	return (int)syscall_ret(result);
+}
+
+static inline int sys_sched_getscheduler(int pid, int *priority)
+{
+	long result =
+		raw_syscall6(SYS_SCHED_GETSCHEDULER, pid, (long)priority, 0, 0, 0, 0);
+	return (int)syscall_ret(result);
+}
+
+// mask is a CPU bitmap, bit n for CPU n
+static inline int sys_sched_setaffinity(int pid, unsigned long len,
+										const void *mask)
+{
+	long result = raw_syscall6(SYS_SCHED_SETAFFINITY, pid, (long)len,
+							   (long)mask, 0, 0, 0);
+	return (int)syscall_ret(result);
+}
+
+static inline int sys_sched_getaffinity(int pid, unsigned long len,
+										void *mask)
+{
+	long result = raw_syscall6(SYS_SCHED_GETAFFINITY, pid, (long)len,
+							   (long)mask, 0, 0, 0);
+	return (int)syscall_ret(result);
+}
+
+static inline long sys_readv(file_t file, const struct iovec *iov, int iovcnt)
+{
+	long result =
+		raw_syscall6(SYS_READV, (long)file, (long)iov, iovcnt, 0, 0, 0);
+	return syscall_ret(result);
+}
+
+static inline long sys_writev(file_t file, const struct iovec *iov, int iovcnt)
+{
+	long result =
+		raw_syscall6(SYS_WRITEV, (long)file, (long)iov, iovcnt, 0, 0, 0);
+	return syscall_ret(result);
+}
+
+static inline long sys_preadv(file_t file, const struct iovec *iov, int iovcnt,
+							  long offset)
+{
+	long result =
+		raw_syscall6(SYS_PREADV, (long)file, (long)iov, iovcnt, offset, 0, 0);
+	return syscall_ret(result);
+}
+
+static inline long sys_pwritev(file_t file, const struct iovec *iov,
+							   int iovcnt, long offset)
+{
+	long result =
+		raw_syscall6(SYS_PWRITEV, (long)file, (long)iov, iovcnt, offset, 0, 0);
+	return syscall_ret(result);
+}
+
+static inline long sys_uring_setup(unsigned int entries,
+								   struct uring_params *params)
+{
+	long result =
+		raw_syscall6(SYS_URING_SETUP, (long)entries, (long)params, 0, 0, 0, 0);
+	return syscall_ret(result);
+}
+
+static inline long sys_uring_enter(file_t ring, unsigned int to_submit,
+								   unsigned int min_complete,
+								   unsigned int flags)
+{
+	long result = raw_syscall6(SYS_URING_ENTER, (long)ring, (long)to_submit,
+							   (long)min_complete, (long)flags, 0, 0);
+	return syscall_ret(result);
+}
+
 #endif // _SYSCALL_H
@@ -0,0 +1,124 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <aurix/syscalls.h>
+
+// a log record: fixed header followed by its payload, written as two pieces
+// the way most of our loggers do it
+#define REC_HDR 16
+#define REC_BODY 112
+#define REC_SIZE (REC_HDR + REC_BODY)
+
+// records per writev call, two iovecs each
+#define BATCH 32
+
+enum mode { MODE_SCALAR, MODE_WRITEV, MODE_PWRITEV };
+
+static const char *mode_names[] = { "write", "writev", "pwritev" };
+
+static unsigned char hdr[REC_HDR];
+static unsigned char body[REC_BODY];
+
+static long now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
+
+static int run(const char *path, enum mode mode, long records)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf("iobench: can't open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct iovec iov[BATCH * 2];
+	for (int i = 0; i < BATCH; i++) {
+		iov[i * 2].iov_base = hdr;
+		iov[i * 2].iov_len = REC_HDR;
+		iov[i * 2 + 1].iov_base = body;
+		iov[i * 2 + 1].iov_len = REC_BODY;
+	}
+
+	long calls = 0;
+	long off = 0;
+	long start = now_us();
+
+	for (long done = 0; done < records;) {
+		long n = records - done < BATCH ? records - done : BATCH;
+		long ret = 0;
+
+		switch (mode) {
+		case MODE_SCALAR:
+			for (long i = 0; i < n; i++) {
+				ret = sys_write(fd, hdr, REC_HDR);
+				if (ret >= 0)
+					ret = sys_write(fd, body, REC_BODY);
+				calls += 2;
+				if (ret < 0)
+					break;
+			}
+			break;
+		case MODE_WRITEV:
+			ret = sys_writev(fd, iov, (int)n * 2);
+			calls++;
+			break;
+		case MODE_PWRITEV:
+			ret = sys_pwritev(fd, iov, (int)n * 2, off);
+			off += n * REC_SIZE;
+			calls++;
+			break;
+		}
+
+		if (ret < 0) {
+			printf("iobench: %s failed: %s\n", mode_names[mode],
+				   strerror(errno));
+			close(fd);
+			return -1;
+		}
+		done += n;
+	}
+
+	long elapsed = now_us() - start;
+	close(fd);
+
+	long bytes = records * REC_SIZE;
+	long mb = bytes / (1024 * 1024) ? bytes / (1024 * 1024) : 1;
+	printf("%-8s %8ld syscalls/MB %8ld us %8ld KiB/s\n", mode_names[mode],
+		   calls / mb, elapsed,
+		   elapsed ? (bytes / 1024) * 1000000L / elapsed : 0);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "/iobench.dat";
+	long mb = argc > 2 ? atol(argv[2]) : 4;
+	if (mb <= 0) {
+		printf("usage: iobench [path] [mb]\n");
+		return 1;
+	}
+
+	memset(hdr, 'h', sizeof(hdr));
+	memset(body, 'b', sizeof(body));
+
+	long records = mb * 1024 * 1024 / REC_SIZE;
+	printf("iobench: %ld MiB of %d byte records to %s\n", mb, REC_SIZE, path);
+
+	int status = 0;
+	for (int m = MODE_SCALAR; m <= MODE_PWRITEV; m++) {
+		if (run(path, (enum mode)m, records) != 0)
+			status = 1;
+	}
+
+	unlink(path);
+	return status;
+}
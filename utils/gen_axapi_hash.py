@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+
+import re
+import sys
+
+FNV1A_INIT = 0xCBF29CE484222325
+FNV1A_PRIME = 0x100000001B3
+MASK64 = (1 << 64) - 1
+
+MAX_SEED_TRIES = 1 << 20
+
+
+def die(msg: str) -> None:
+    print(msg, file=sys.stderr)
+    sys.exit(1)
+
+
+def fnv1a(seed: int, data: bytes) -> int:
+    h = seed
+    for ch in data:
+        h ^= ch
+        h = (h * FNV1A_PRIME) & MASK64
+    return h
+
+
+def parse_defs(path: str) -> list:
+    sym_re = re.compile(r"^\s*AXAPI_SYM\(\s*[^,]+,\s*([A-Za-z_][A-Za-z0-9_]*)\s*,")
+    names = []
+    with open(path, "r", encoding="ascii") as f:
+        for line in f:
+            m = sym_re.match(line)
+            if m:
+                names.append(m.group(1))
+    return names
+
+
+def find_seed(names: list, size: int) -> int:
+    # the seed replaces the FNV-1a offset basis, bump it until no two
+    # exports land in the same slot
+    for i in range(MAX_SEED_TRIES):
+        seed = (FNV1A_INIT + i) & MASK64
+        used = set()
+        for name in names:
+            slot = fnv1a(seed, name.encode("ascii")) & (size - 1)
+            if slot in used:
+                break
+            used.add(slot)
+        else:
+            return seed
+    return -1
+
+
+def main() -> int:
+    if len(sys.argv) != 3:
+        die(f"usage: {sys.argv[0]} <axapi_defs.inc> <out.h>")
+
+    names = parse_defs(sys.argv[1])
+    if len(names) != len(set(names)):
+        die("gen_axapi_hash: duplicate export in axapi_defs.inc")
+
+    size = 8
+    while size < len(names) * 2:
+        size <<= 1
+
+    seed = find_seed(names, size)
+    while seed < 0:
+        size <<= 1
+        seed = find_seed(names, size)
+
+    slots = [-1] * size
+    for idx, name in enumerate(names):
+        slots[fnv1a(seed, name.encode("ascii")) & (size - 1)] = idx
+
+    with open(sys.argv[2], "w", encoding="ascii", newline="\n") as f:
+        f.write("/* generated by gen_axapi_hash.py, do not edit */\n\n")
+        f.write("#define AXAPI_HASH_SEED 0x%016xULL\n" % seed)
+        f.write("#define AXAPI_HASH_SIZE %d\n" % size)
+        f.write("#define AXAPI_EXPORT_COUNT %d\n\n" % len(names))
+
+        f.write("static const int16_t axapi_hash_slots[AXAPI_HASH_SIZE] = {\n")
+        for idx in slots:
+            f.write("\t%d,\n" % idx)
+        f.write("};\n")
+
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())